@@ -0,0 +1,50 @@
+#!/usr/bin/env sh
+# Builds the Linux tools (trace replayer, ...) against the portable engine sources.
+#
+#   scripts/build-tools.sh [Release|Debug]
+#
+# Output goes to build-linux-<Config>/ next to the Windows build directories.
+set -eu
+
+CONFIG="${1:-Release}"
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+OUT="$ROOT/build-linux-$CONFIG"
+CC="${CC:-cc}"
+
+CFLAGS="-std=c11 -Wall -Wextra -pthread -I$ROOT/src -I$ROOT/tools"
+case "$CONFIG" in
+  Release) CFLAGS="$CFLAGS -O2" ;;
+  Debug) CFLAGS="$CFLAGS -O0 -g" ;;
+  *) echo "unknown config: $CONFIG" >&2; exit 2 ;;
+esac
+
+mkdir -p "$OUT"
+
+ENGINE="$ROOT/src/engine.c $ROOT/src/adapt.c $ROOT/src/keytrace.c $ROOT/src/layoutmem.c $ROOT/src/morph.c $ROOT/src/model.c $ROOT/src/snapshot.c $ROOT/src/config.c $ROOT/src/typeahead.c $ROOT/src/utf8.c"
+COMMON="$ROOT/tools/toolutil.c $ROOT/tools/keymap.c $ROOT/tools/querygen.c $ROOT/tools/batchproto.c $ROOT/tools/preedit.c $ROOT/tools/hooksim.c $ROOT/tools/script.c"
+
+build() {
+  name="$1"; shift
+  # shellcheck disable=SC2086
+  $CC $CFLAGS "$@" -o "$OUT/$name"
+  echo "Built: $OUT/$name"
+}
+
+# shellcheck disable=SC2086
+build diswitcher-replay "$ROOT/tools/diswitcher_replay.c" $ENGINE $COMMON
+build diswitcher-mktrace "$ROOT/tools/diswitcher_mktrace.c" $ENGINE $COMMON
+build diswitcher-morph "$ROOT/tools/diswitcher_morph.c" $ENGINE $COMMON
+build diswitcher-snapshot-stress "$ROOT/tools/diswitcher_snapshot_stress.c" $ENGINE $COMMON
+build diswitcher-typeahead-sim "$ROOT/tools/diswitcher_typeahead_sim.c" $ENGINE $COMMON
+build diswitcher-session-bench "$ROOT/tools/diswitcher_session_bench.c" $ENGINE $COMMON
+build diswitcherd "$ROOT/tools/diswitcherd.c" $ENGINE $COMMON
+build diswitcher-loadgen "$ROOT/tools/diswitcher_loadgen.c" $ENGINE $COMMON
+build diswitcher-shortwords "$ROOT/tools/diswitcher_shortwords.c" $ENGINE $COMMON
+build diswitcher-eval "$ROOT/tools/diswitcher_eval.c" $ENGINE $COMMON
+build diswitcher-synth "$ROOT/tools/diswitcher_synth.c" $ENGINE $COMMON
+build diswitcher-filter "$ROOT/tools/diswitcher_filter.c" $ENGINE $COMMON
+build diswitcher-train "$ROOT/tools/diswitcher_train.c" $ENGINE $COMMON
+build diswitcher-fieldsim "$ROOT/tools/diswitcher_fieldsim.c" $ENGINE $COMMON
+build diswitcher-mixed-bench "$ROOT/tools/diswitcher_mixed_bench.c" $ENGINE $COMMON
+build diswitcher-budget "$ROOT/tools/diswitcher_budget.c" $ENGINE $COMMON
+build diswitcher-preedit-bench "$ROOT/tools/diswitcher_preedit_bench.c" $ENGINE $COMMON
@@ -81,6 +81,9 @@ New-Item -ItemType Directory -Force -Path $outDir | Out-Null
 
 $defs = @("UNICODE","_UNICODE","WIN32_LEAN_AND_MEAN","NOMINMAX")
 
+# Portable engine sources are shared with the Linux tools (scripts/build-tools.sh).
+$srcNames = @("main.c","engine.c","adapt.c","keytrace.c","layoutmem.c","morph.c","model.c","snapshot.c","config.c","typeahead.c","utf8.c")
+
 if ($Toolchain -eq "msvc") {
   $cflags = @("/nologo","/W4","/utf-8")
   if ($Config -eq "Release") { $cflags += "/O2" } else { $cflags += @("/Od","/Zi") }
@@ -102,11 +105,12 @@ if ($Toolchain -eq "msvc") {
       }
     }
 
+    $srcs = $srcNames | ForEach-Object { "..\src\$_" }
     $res = Join-Path $outDir "diswitcher.res"
     if (Test-Path $res) {
-      & cl @cflags "..\src\main.c" $res /Fe:$exe user32.lib shell32.lib gdi32.lib /link /SUBSYSTEM:WINDOWS | Write-Host
+      & cl @cflags @srcs $res /Fe:$exe user32.lib shell32.lib gdi32.lib /link /SUBSYSTEM:WINDOWS | Write-Host
     } else {
-      & cl @cflags "..\src\main.c" /Fe:$exe user32.lib shell32.lib gdi32.lib /link /SUBSYSTEM:WINDOWS | Write-Host
+      & cl @cflags @srcs /Fe:$exe user32.lib shell32.lib gdi32.lib /link /SUBSYSTEM:WINDOWS | Write-Host
     }
   } finally {
     Pop-Location
@@ -131,11 +135,12 @@ elseif ($Toolchain -eq "mingw") {
     }
   }
 
+  $srcs = $srcNames | ForEach-Object { Join-Path $PSScriptRoot "..\src\$_" }
   $resObj = Join-Path $outDir "diswitcher_res.o"
   if (Test-Path $resObj) {
-    & gcc @cflags "-municode" "-mwindows" (Join-Path $PSScriptRoot "..\src\main.c") $resObj "-o" $exe "-luser32" "-lshell32" "-lgdi32"
+    & gcc @cflags "-municode" "-mwindows" @srcs $resObj "-o" $exe "-luser32" "-lshell32" "-lgdi32"
   } else {
-    & gcc @cflags "-municode" "-mwindows" (Join-Path $PSScriptRoot "..\src\main.c") "-o" $exe "-luser32" "-lshell32" "-lgdi32"
+    & gcc @cflags "-municode" "-mwindows" @srcs "-o" $exe "-luser32" "-lshell32" "-lgdi32"
   }
   Write-Host "Built: $exe"
 }
@@ -0,0 +1,134 @@
+#include "adapt.h"
+
+#include <string.h>
+
+#define ADAPT_SYMBOLS 33 // 0 = token boundary, then the letters of the larger alphabet
+#define ADAPT_COUNTERS (2u * DS_ADAPT_DEPTH * DS_ADAPT_WIDTH)
+#define ADAPT_COUNT_MAX 0xFFFFu
+#define ADAPT_WIDTH_BITS 12
+
+#if (1 << ADAPT_WIDTH_BITS) != DS_ADAPT_WIDTH
+#error "ADAPT_WIDTH_BITS does not match DS_ADAPT_WIDTH"
+#endif
+
+// Odd multipliers, one per row; the top bits of the product pick the counter.
+static const uint32_t kRowMul[DS_ADAPT_DEPTH] = { 0x9E3779B1u, 0x85EBCA77u, 0xC2B2AE3Du, 0x27D4EB2Fu };
+
+// Letter -> 1..26 (EN) or 1..32 (RU, ё folded to е) in the token's language; 0 if it is neither.
+static int Symbol(wchar_t ch, DsLang* lang)
+{
+    if (ch >= L'a' && ch <= L'z') { *lang = DS_LANG_EN; return ch - L'a' + 1; }
+    if (ch >= L'A' && ch <= L'Z') { *lang = DS_LANG_EN; return ch - L'A' + 1; }
+    if (ch >= 0x0430 && ch <= 0x044F) { *lang = DS_LANG_RU; return ch - 0x0430 + 1; }
+    if (ch >= 0x0410 && ch <= 0x042F) { *lang = DS_LANG_RU; return ch - 0x0410 + 1; }
+    if (ch == 0x0451 || ch == 0x0401) { *lang = DS_LANG_RU; return 0x0435 - 0x0430 + 1; }
+    return 0;
+}
+
+// Boundary-padded symbols of a single-script token; 0 if it has anything else in it.
+static size_t Symbols(const wchar_t* token, size_t n, DsLang* lang, uint8_t* sym)
+{
+    if (n < DS_ADAPT_MIN_CHARS || n > DS_ADAPT_MAX_CHARS) return 0;
+    *lang = DS_LANG_UNKNOWN;
+    sym[0] = 0;
+    for (size_t i = 0; i < n; i++) {
+        DsLang l = DS_LANG_UNKNOWN;
+        const int s = Symbol(token[i], &l);
+        if (!s || (*lang != DS_LANG_UNKNOWN && l != *lang)) return 0;
+        *lang = l;
+        sym[i + 1] = (uint8_t)s;
+    }
+    sym[n + 1] = 0;
+    return n + 2;
+}
+
+static uint32_t TrigramKey(const uint8_t* sym)
+{
+    return ((uint32_t)sym[0] * ADAPT_SYMBOLS + sym[1]) * ADAPT_SYMBOLS + sym[2];
+}
+
+static uint32_t Slot(uint32_t key, int row)
+{
+    return (key * kRowMul[row]) >> (32 - ADAPT_WIDTH_BITS);
+}
+
+static unsigned Estimate(const DsAdaptSketch* a, int lang, uint32_t key)
+{
+    unsigned est = ADAPT_COUNT_MAX;
+    for (int r = 0; r < DS_ADAPT_DEPTH; r++) {
+        const unsigned c = a->counters[lang][r][Slot(key, r)];
+        if (c < est) est = c;
+    }
+    return est;
+}
+
+DsAdaptSketch* DsAdaptAttach(void* mem, size_t size)
+{
+    if (!mem || size < sizeof(DsAdaptSketch)) return NULL;
+    DsAdaptSketch* a = (DsAdaptSketch*)mem;
+    if (memcmp(a->magic, DS_ADAPT_MAGIC, 4) == 0 && a->version == DS_ADAPT_VERSION && a->depth == DS_ADAPT_DEPTH &&
+        a->width == DS_ADAPT_WIDTH && a->decay_cursor < ADAPT_COUNTERS && a->epoch_tokens < DS_ADAPT_EPOCH) {
+        return a;
+    }
+    memset(a, 0, sizeof(*a));
+    memcpy(a->magic, DS_ADAPT_MAGIC, 4);
+    a->version = DS_ADAPT_VERSION;
+    a->depth = DS_ADAPT_DEPTH;
+    a->width = DS_ADAPT_WIDTH;
+    return a;
+}
+
+static void Decay(DsAdaptSketch* a)
+{
+    uint16_t* counters = &a->counters[0][0][0];
+    uint32_t cursor = a->decay_cursor;
+    for (int i = 0; i < DS_ADAPT_DECAY_STEP; i++) {
+        const unsigned c = counters[cursor];
+        if (c >= DS_ADAPT_MIN_COUNT && (c >> 1) < DS_ADAPT_MIN_COUNT) a->epoch_changed = 1;
+        counters[cursor] = (uint16_t)(c >> 1);
+        if (++cursor == ADAPT_COUNTERS) cursor = 0;
+    }
+    a->decay_cursor = cursor;
+}
+
+void DsAdaptLearn(DsAdaptSketch* a, const wchar_t* token, size_t n)
+{
+    uint8_t sym[DS_ADAPT_MAX_CHARS + 2];
+    DsLang lang;
+    const size_t len = Symbols(token, n, &lang, sym);
+    if (!len) return;
+
+    for (size_t i = 0; i + 3 <= len; i++) {
+        const uint32_t key = TrigramKey(sym + i);
+        const unsigned est = Estimate(a, lang, key);
+        if (est == ADAPT_COUNT_MAX) continue;
+        // Conservative update: only the counters holding the estimate grow.
+        for (int r = 0; r < DS_ADAPT_DEPTH; r++) {
+            uint16_t* c = &a->counters[lang][r][Slot(key, r)];
+            if (*c == est) *c = (uint16_t)(est + 1);
+        }
+        if (est + 1 == DS_ADAPT_MIN_COUNT) a->epoch_changed = 1;
+    }
+    a->learned[lang]++;
+    Decay(a);
+
+    if (++a->epoch_tokens == DS_ADAPT_EPOCH) {
+        if (a->epoch_changed) a->generation++;
+        a->epoch_tokens = 0;
+        a->epoch_changed = 0;
+    }
+}
+
+int DsAdaptBonus(const DsAdaptSketch* a, DsLang lang, const wchar_t* lower, size_t n, int maxBonus)
+{
+    uint8_t sym[DS_ADAPT_MAX_CHARS + 2];
+    DsLang tokenLang;
+    const size_t len = Symbols(lower, n, &tokenLang, sym);
+    if (!len || tokenLang != lang || maxBonus <= 0) return 0;
+
+    int familiar = 0;
+    for (size_t i = 0; i + 3 <= len; i++) {
+        if (Estimate(a, lang, TrigramKey(sym + i)) >= DS_ADAPT_MIN_COUNT) familiar++;
+    }
+    return maxBonus * familiar / (int)(len - 2);
+}
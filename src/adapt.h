@@ -0,0 +1,66 @@
+#ifndef DISWITCHER_ADAPT_H
+#define DISWITCHER_ADAPT_H
+
+// Adaptive letter statistics learned from the user's own typing.
+//
+// Tokens the user typed and kept (the engine left them alone, or the user reverted a correction
+// with Pause) are counted as boundary-marked letter trigrams ("^pr", "pri", ..., "et$") per
+// language in a count-min sketch: DEPTH rows of WIDTH saturating 16-bit counters, each row indexed
+// by its own multiplicative hash, conservative update. The estimate of a trigram is the smallest of
+// its counters. When scoring, a token earns up to `adapt_bonus` (src/model.h) in a language in
+// proportion to how many of its trigrams that language's sketch has seen often enough, so words
+// and word forms the user types regularly stop being "corrected" and their wrong-layout versions
+// are fixed sooner.
+//
+// Memory is fixed (64 KB of counters) and so is the work per token: learning touches DEPTH
+// counters per trigram and then halves the next DS_ADAPT_DECAY_STEP counters of a sweep that
+// cycles through the whole sketch, so every count halves once every WIDTH * DEPTH * 2 /
+// DS_ADAPT_DECAY_STEP learned tokens and old habits fade.
+//
+// The struct is plain data in host byte order so a host can keep it in a memory-mapped file and
+// carry it across restarts; DsAdaptAttach checks or initializes it in place. A sketch is updated by
+// the session it is attached to and must not be attached to sessions on different threads.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#include "layoutmem.h"
+
+#define DS_ADAPT_MAGIC "DSAS"
+#define DS_ADAPT_VERSION 1
+#define DS_ADAPT_DEPTH 4
+#define DS_ADAPT_WIDTH 4096      // per row; a power of two
+#define DS_ADAPT_MIN_CHARS 3     // shorter tokens carry too few trigrams to learn from
+#define DS_ADAPT_MAX_CHARS 32
+#define DS_ADAPT_MIN_COUNT 4     // a trigram counts as familiar from this estimate on
+#define DS_ADAPT_DECAY_STEP 8    // counters halved per learned token
+#define DS_ADAPT_EPOCH 64        // learned tokens per generation (see DsAdaptSketch.generation)
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t depth;
+    uint32_t width;
+    uint32_t decay_cursor;    // next counter the decay sweep halves
+    uint32_t generation;      // bumped at the end of an epoch in which a trigram became familiar
+                              // or stopped being; scores cached under an older one may be stale
+    uint32_t epoch_tokens;
+    uint32_t epoch_changed;   // a familiarity change happened in the current epoch
+    uint64_t learned[2];      // tokens learned per language (DsLang: RU, EN)
+    uint16_t counters[2][DS_ADAPT_DEPTH][DS_ADAPT_WIDTH];
+} DsAdaptSketch;
+
+// Validates the sketch at `mem` (`size` bytes, suitably aligned) or, if it is not a sketch of this
+// version and shape, resets it to an empty one. NULL if `size` is too small.
+DsAdaptSketch* DsAdaptAttach(void* mem, size_t size);
+
+// Learns a token that ended up on screen as typed. Ignored unless it is DS_ADAPT_MIN_CHARS to
+// DS_ADAPT_MAX_CHARS Latin or Cyrillic letters in one script (any case).
+void DsAdaptLearn(DsAdaptSketch* a, const wchar_t* token, size_t n);
+
+// Share of familiar trigrams of the lowercase token `lower` in `lang`, scaled to 0..`maxBonus`.
+int DsAdaptBonus(const DsAdaptSketch* a, DsLang lang, const wchar_t* lower, size_t n, int maxBonus);
+
+#endif
@@ -0,0 +1,194 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "utf8.h"
+
+#define DS_ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define CONFIG_MAX_WORD 64
+
+typedef struct {
+    const char* name;
+    size_t offset;
+} ThresholdField;
+
+static const ThresholdField kThresholds[] = {
+    { "min_mapped_short", offsetof(DsThresholds, min_mapped_short) },
+    { "min_mapped", offsetof(DsThresholds, min_mapped) },
+    { "min_diff_short", offsetof(DsThresholds, min_diff_short) },
+    { "min_diff", offsetof(DsThresholds, min_diff) },
+    { "weak_base", offsetof(DsThresholds, weak_base) },
+    { "min_diff_weak", offsetof(DsThresholds, min_diff_weak) },
+    { "min_diff_mixed", offsetof(DsThresholds, min_diff_mixed) },
+    { "morph_bonus", offsetof(DsThresholds, morph_bonus) },
+    { "short_word_evidence", offsetof(DsThresholds, short_word_evidence) },
+    { "phrase_min_evidence", offsetof(DsThresholds, phrase_min_evidence) },
+    { "adapt_bonus", offsetof(DsThresholds, adapt_bonus) },
+};
+
+static bool Fail(DsConfigError* err, size_t line, const char* what, const char* key)
+{
+    err->line = line;
+    snprintf(err->message, sizeof(err->message), "%s: %s", key, what);
+    return false;
+}
+
+static bool IsBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Next space-separated word of `value`, lowercased and converted; 0 at the end.
+static size_t NextWord(const char** p, const char* end, wchar_t* out, size_t outCap)
+{
+    while (*p < end && IsBlank(**p)) (*p)++;
+    const char* start = *p;
+    while (*p < end && !IsBlank(**p)) (*p)++;
+    if (*p == start) return 0;
+    const size_t n = DsUtf8ToWide(start, (size_t)(*p - start), out, outCap);
+    for (size_t i = 0; i < n; i++) out[i] = DsToLower(out[i]);
+    return n;
+}
+
+static bool ApplyPairs(DsCharPair* pairs, size_t* count, size_t cap, bool append, const char* value,
+                       const char* end, size_t line, const char* key, DsConfigError* err)
+{
+    if (!append) *count = 0;
+    wchar_t word[CONFIG_MAX_WORD];
+    size_t n;
+    while ((n = NextWord(&value, end, word, DS_ARRAYSIZE(word))) != 0) {
+        if (n != 2) return Fail(err, line, "expected two-character entries", key);
+        if (*count == cap) return Fail(err, line, "too many entries", key);
+        pairs[*count].first = word[0];
+        pairs[*count].second = word[1];
+        (*count)++;
+    }
+    return true;
+}
+
+static bool ApplyShortWords(wchar_t (*words)[3], size_t* count, bool append, const char* value,
+                            const char* end, size_t line, const char* key, DsConfigError* err)
+{
+    if (!append) *count = 0;
+    wchar_t word[CONFIG_MAX_WORD];
+    size_t n;
+    while ((n = NextWord(&value, end, word, DS_ARRAYSIZE(word))) != 0) {
+        if (n > 2) return Fail(err, line, "short words have one or two letters", key);
+        if (*count == DS_MODEL_MAX_SHORT_WORDS) return Fail(err, line, "too many entries", key);
+        memset(words[*count], 0, sizeof(words[*count]));
+        wmemcpy(words[*count], word, n);
+        (*count)++;
+    }
+    return true;
+}
+
+static bool ApplyExceptions(DsModel* model, bool append, const char* value, const char* end, size_t line,
+                            const char* key, DsConfigError* err)
+{
+    if (!append) {
+        memset(model->exceptions, 0, sizeof(model->exceptions));
+        model->exception_count = 0;
+    }
+    wchar_t word[CONFIG_MAX_WORD];
+    size_t n;
+    while ((n = NextWord(&value, end, word, DS_ARRAYSIZE(word))) != 0) {
+        if (!DsModelAddException(model, word, n)) return Fail(err, line, "too many entries", key);
+    }
+    return true;
+}
+
+static bool ApplyThreshold(DsModel* model, const char* name, const char* value, const char* end, size_t line,
+                           const char* key, DsConfigError* err)
+{
+    for (size_t i = 0; i < DS_ARRAYSIZE(kThresholds); i++) {
+        if (strcmp(kThresholds[i].name, name) != 0) continue;
+        char buf[16];
+        while (value < end && IsBlank(*value)) value++;
+        while (end > value && IsBlank(end[-1])) end--;
+        const size_t n = (size_t)(end - value);
+        if (n == 0 || n >= sizeof(buf)) return Fail(err, line, "expected an integer", key);
+        memcpy(buf, value, n);
+        buf[n] = 0;
+        char* stop = NULL;
+        const long v = strtol(buf, &stop, 10);
+        if (*stop || v < -1000 || v > 1000) return Fail(err, line, "expected an integer", key);
+        *(int*)((char*)&model->thresholds + kThresholds[i].offset) = (int)v;
+        return true;
+    }
+    return Fail(err, line, "unknown threshold", key);
+}
+
+static bool ApplyLine(DsModel* model, const char* line, const char* end, size_t lineNo, DsConfigError* err)
+{
+    const char* hash = memchr(line, '#', (size_t)(end - line));
+    if (hash) end = hash;
+    while (line < end && IsBlank(*line)) line++;
+    if (line == end) return true;
+
+    const char* eq = memchr(line, '=', (size_t)(end - line));
+    if (!eq) return Fail(err, lineNo, "expected key = value", "line");
+    const bool append = eq > line && eq[-1] == '+';
+    const char* keyEnd = append ? eq - 1 : eq;
+    while (keyEnd > line && IsBlank(keyEnd[-1])) keyEnd--;
+
+    char key[48];
+    const size_t keyLen = (size_t)(keyEnd - line);
+    if (keyLen == 0 || keyLen >= sizeof(key)) return Fail(err, lineNo, "bad key", "line");
+    memcpy(key, line, keyLen);
+    key[keyLen] = 0;
+    const char* value = eq + 1;
+
+    if (strncmp(key, "threshold.", 10) == 0) {
+        if (append) return Fail(err, lineNo, "cannot append to a threshold", key);
+        return ApplyThreshold(model, key + 10, value, end, lineNo, key, err);
+    }
+    if (strcmp(key, "bigrams.en") == 0) {
+        return ApplyPairs(model->bigrams_en, &model->bigrams_en_count, DS_MODEL_MAX_BIGRAMS, append, value, end, lineNo, key, err);
+    }
+    if (strcmp(key, "bigrams.ru") == 0) {
+        return ApplyPairs(model->bigrams_ru, &model->bigrams_ru_count, DS_MODEL_MAX_BIGRAMS, append, value, end, lineNo, key, err);
+    }
+    if (strcmp(key, "bigrams.ru_bad") == 0) {
+        return ApplyPairs(model->bad_bigrams_ru, &model->bad_bigrams_ru_count, DS_MODEL_MAX_BIGRAMS, append, value, end, lineNo, key, err);
+    }
+    if (strcmp(key, "map") == 0) {
+        return ApplyPairs(model->ru_to_en, &model->map_count, DS_MODEL_MAX_MAP, append, value, end, lineNo, key, err);
+    }
+    if (strcmp(key, "short.en") == 0) {
+        return ApplyShortWords(model->short_words_en, &model->short_words_en_count, append, value, end, lineNo, key, err);
+    }
+    if (strcmp(key, "short.ru") == 0) {
+        return ApplyShortWords(model->short_words_ru, &model->short_words_ru_count, append, value, end, lineNo, key, err);
+    }
+    if (strcmp(key, "exceptions") == 0) {
+        return ApplyExceptions(model, append, value, end, lineNo, key, err);
+    }
+    return Fail(err, lineNo, "unknown key", key);
+}
+
+bool DsConfigApply(DsModel* model, const char* text, size_t len, DsConfigError* err)
+{
+    err->line = 0;
+    err->message[0] = 0;
+
+    // Skip a UTF-8 byte order mark (Notepad writes one).
+    if (len >= 3 && memcmp(text, "\xEF\xBB\xBF", 3) == 0) {
+        text += 3;
+        len -= 3;
+    }
+
+    const char* p = text;
+    const char* end = text + len;
+    size_t lineNo = 0;
+    while (p < end) {
+        const char* nl = memchr(p, '\n', (size_t)(end - p));
+        const char* lineEnd = nl ? nl : end;
+        if (!ApplyLine(model, p, lineEnd, ++lineNo, err)) return false;
+        p = nl ? nl + 1 : end;
+    }
+    return true;
+}
@@ -0,0 +1,33 @@
+#ifndef DISWITCHER_CONFIG_H
+#define DISWITCHER_CONFIG_H
+
+// Text configuration applied on top of a model (diswitcher.conf, UTF-8):
+//
+//   # comment
+//   threshold.min_diff = 5        any DsThresholds field
+//   bigrams.en += qu              `=` replaces the list, `+=` extends it
+//   bigrams.ru = ст но то
+//   bigrams.ru_bad += ьь
+//   map = йq цw уe               physical key map, RU letter followed by its EN key
+//   short.en += ex
+//   short.ru = а в и
+//   exceptions += ctqxfc linux    tokens that are never corrected
+//
+// Values are separated by spaces or tabs. Unknown keys and malformed values are errors, so a typo
+// does not silently fall back to the defaults.
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "model.h"
+
+typedef struct {
+    size_t line; // 1-based; 0 if the error is not tied to a line
+    char message[96];
+} DsConfigError;
+
+// Applies `text` to `model`. On failure the model may be partially updated and `err` describes
+// the first problem.
+bool DsConfigApply(DsModel* model, const char* text, size_t len, DsConfigError* err);
+
+#endif
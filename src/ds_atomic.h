@@ -0,0 +1,141 @@
+#ifndef DISWITCHER_DS_ATOMIC_H
+#define DISWITCHER_DS_ATOMIC_H
+
+// Minimal sequentially consistent atomics for MSVC (Interlocked intrinsics) and GCC/Clang
+// (__atomic builtins). Only what the snapshot domain needs; every operation is a full barrier.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define DS_ALIGN(n) __declspec(align(n))
+#define DS_INLINE static __forceinline
+#else
+#define DS_ALIGN(n) __attribute__((aligned(n)))
+#define DS_INLINE static inline
+#endif
+
+#define DS_CACHE_LINE 64
+
+#if defined(_MSC_VER) && !defined(__clang__)
+
+// 64-bit operations go through cmpxchg so they are atomic on x86 as well as x64/ARM64.
+DS_INLINE uint64_t DsAtomicLoad64(volatile uint64_t* p)
+{
+    return (uint64_t)_InterlockedCompareExchange64((volatile __int64*)p, 0, 0);
+}
+
+DS_INLINE uint64_t DsAtomicCas64Value(volatile uint64_t* p, uint64_t expected, uint64_t desired)
+{
+    return (uint64_t)_InterlockedCompareExchange64((volatile __int64*)p, (__int64)desired, (__int64)expected);
+}
+
+DS_INLINE void DsAtomicStore64(volatile uint64_t* p, uint64_t v)
+{
+    uint64_t cur = DsAtomicLoad64(p);
+    for (;;) {
+        const uint64_t seen = DsAtomicCas64Value(p, cur, v);
+        if (seen == cur) return;
+        cur = seen;
+    }
+}
+
+DS_INLINE uint64_t DsAtomicFetchAdd64(volatile uint64_t* p, uint64_t v)
+{
+    uint64_t cur = DsAtomicLoad64(p);
+    for (;;) {
+        const uint64_t seen = DsAtomicCas64Value(p, cur, cur + v);
+        if (seen == cur) return cur;
+        cur = seen;
+    }
+}
+
+DS_INLINE void* DsAtomicLoadPtr(void* volatile* p)
+{
+    return _InterlockedCompareExchangePointer(p, NULL, NULL);
+}
+
+DS_INLINE void* DsAtomicExchangePtr(void* volatile* p, void* v)
+{
+    return _InterlockedExchangePointer(p, v);
+}
+
+DS_INLINE uint32_t DsAtomicLoad32(volatile uint32_t* p)
+{
+    return (uint32_t)_InterlockedCompareExchange((volatile long*)p, 0, 0);
+}
+
+DS_INLINE void DsAtomicStore32(volatile uint32_t* p, uint32_t v)
+{
+    _InterlockedExchange((volatile long*)p, (long)v);
+}
+
+DS_INLINE bool DsAtomicCas32(volatile uint32_t* p, uint32_t expected, uint32_t desired)
+{
+    return (uint32_t)_InterlockedCompareExchange((volatile long*)p, (long)desired, (long)expected) == expected;
+}
+
+DS_INLINE void DsCpuRelax(void)
+{
+#if defined(_M_IX86) || defined(_M_X64)
+    _mm_pause();
+#else
+    __yield();
+#endif
+}
+
+#else
+
+DS_INLINE uint64_t DsAtomicLoad64(volatile uint64_t* p)
+{
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+DS_INLINE void DsAtomicStore64(volatile uint64_t* p, uint64_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+DS_INLINE uint64_t DsAtomicFetchAdd64(volatile uint64_t* p, uint64_t v)
+{
+    return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST);
+}
+
+DS_INLINE void* DsAtomicLoadPtr(void* volatile* p)
+{
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+DS_INLINE void* DsAtomicExchangePtr(void* volatile* p, void* v)
+{
+    return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+DS_INLINE uint32_t DsAtomicLoad32(volatile uint32_t* p)
+{
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+DS_INLINE void DsAtomicStore32(volatile uint32_t* p, uint32_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+DS_INLINE bool DsAtomicCas32(volatile uint32_t* p, uint32_t expected, uint32_t desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+DS_INLINE void DsCpuRelax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+#endif
+
+#endif
@@ -0,0 +1,1537 @@
+#include "engine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wctype.h>
+
+#include "snapshot.h"
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#define DS_ALIGN64 __declspec(align(64))
+#else
+#define DS_ALIGN64 __attribute__((aligned(64)))
+#endif
+
+#define DS_ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+// ---------- Wrong-layout autocorrect (EN/RU) ----------
+
+typedef struct {
+    bool active;
+    uint64_t ts_ms;
+    wchar_t original[DS_PHRASE_MAX_CHARS + 1]; // one token or a whole phrase
+    wchar_t corrected[DS_PHRASE_MAX_CHARS + 1];
+    size_t original_len;
+    size_t corrected_len;
+    wchar_t boundary;
+    bool had_boundary;
+    bool corrected_to_english; // true if we mapped RU->EN
+    bool corrected_applied;    // true if current text is corrected+boundary
+    bool learned;              // the original was taught to the adaptive sketch on revert
+} LastFix;
+
+// Phrase correction: per-token evidence (mapped score minus typed score) is summed over the window.
+#define PHRASE_NO_FIT (-128) // token cannot be part of a wrong-layout phrase
+#define PHRASE_MAX_TOKEN_EVIDENCE 100
+
+typedef struct {
+    bool fix;        // correct this token on its own
+    bool to_english; // mapping direction (meaningful unless evidence is PHRASE_NO_FIT)
+    int evidence;
+    bool dropped;    // the deadline cut the scoring short of a certain answer; left as typed
+} TokenDecision;
+
+// Rolling FNV-1a hash of the token, maintained as characters are typed.
+#define TOKEN_HASH_SEED 0xcbf29ce484222325ULL
+#define TOKEN_HASH_PRIME 0x100000001b3ULL
+
+static uint64_t TokenHashAppend(uint64_t h, wchar_t ch)
+{
+    return (h ^ (uint64_t)(uint16_t)ch) * TOKEN_HASH_PRIME;
+}
+
+static uint64_t TokenHash(const wchar_t* token, size_t n)
+{
+    uint64_t h = TOKEN_HASH_SEED;
+    for (size_t i = 0; i < n; i++) h = TokenHashAppend(h, token[i]);
+    return h;
+}
+
+// ---------- Decision cache ----------
+// People type the same words all day. Remember the outcome of EvaluateToken per token
+// (4-way set associative, LRU within a set) so repeats skip lowercasing, mapping and scoring.
+// One entry is exactly one 64-byte cache line; tokens longer than the inline buffer are not cached.
+
+#define DECISION_CACHE_WAYS 4
+#define DECISION_CACHE_SETS 512 // 2048 entries, 128 KB
+#define DECISION_CACHE_MAX_CHARS 24
+
+typedef struct {
+    uint64_t hash;
+    uint32_t stamp;    // LRU clock; 0 = empty slot
+    uint8_t len;
+    uint8_t fix;       // 1 if the token should be corrected to `mapped`
+    uint8_t to_english;
+    int8_t evidence;   // TokenDecision.evidence
+    uint16_t mapped[DECISION_CACHE_MAX_CHARS]; // UTF-16 code units; the engine only maps BMP letters
+} DecisionCacheEntry;
+
+// ---------- Phrase window ----------
+// The last few tokens that ended uncorrected, together with the spaces typed after them, exactly
+// as they are on screen before the caret. Any boundary other than a space, any editing key, a
+// correction or a focus change ends the phrase.
+
+typedef struct {
+    uint8_t start; // offset into PhraseWindow.text
+    uint8_t len;
+    bool to_english;
+    int8_t evidence;
+} PhraseToken;
+
+typedef struct {
+    wchar_t text[DS_PHRASE_MAX_CHARS + 1];
+    size_t len;
+    PhraseToken tokens[DS_PHRASE_MAX_TOKENS - 1]; // the token being typed completes the phrase
+    size_t count;
+} PhraseWindow;
+
+// ---------- Session ----------
+// Everything that follows one stream of keys lives in the session: the token being typed, the
+// last fix, the phrase window, per-window layout memory, the decision cache and the statistics.
+// Only the model domain below is shared between sessions, and it is immutable once published.
+
+struct DsSession {
+    // First, so that every entry starts on its own cache line.
+    DS_ALIGN64 DecisionCacheEntry cache[DECISION_CACHE_SETS][DECISION_CACHE_WAYS];
+    uint32_t cache_clock;
+    DsCacheStats cache_stats;
+
+    DsHost host;
+
+    wchar_t token[DS_TOKEN_MAX_CHARS + 1];
+    size_t token_len;
+    uint64_t token_hash;
+    uint32_t swallow_vk_keyup;
+    bool swallow_keyup;
+
+    LastFix last_fix;
+
+    PhraseWindow phrase;
+    bool phrase_correction;
+    DsPhraseStats phrase_stats;
+
+    // Language of the word before the caret as it is on screen, for one- and two-letter tokens.
+    DsLang neighbor_lang;
+    bool short_words;
+
+    // Per-window layout memory for predictive switching on focus change.
+    DsLayoutMemory layout_memory;
+    uint64_t focus_window;
+    bool predictive_switching;
+    DsLayoutStats layout_stats;
+
+    // Letter statistics learned from this session's typing (src/adapt.h); NULL = off.
+    DsAdaptSketch* adapt;
+
+    // Per-key decision budget; the deadline is only set while a key event is being handled.
+    uint64_t budget_ns;  // 0 = unbounded
+    uint64_t deadline_ns;
+    DsTierStats tier_stats;
+
+    int model_slot;            // reader slot in the model domain
+    uint32_t cache_generation; // generation the decision cache was filled under
+    const DsModel* model;      // pinned model; only valid inside a key event
+};
+
+// ---------- Model ----------
+// Tables and thresholds live in one immutable DsModel behind an RCU snapshot domain: each key
+// event pins the current model for its duration, and DsEnginePublishModel may swap in a new one
+// from any thread at any time. Each session reads through its own reader slot.
+
+#define MODELS_UNINITIALIZED 0u
+#define MODELS_INITIALIZING 1u
+#define MODELS_READY 2u
+
+static DsSnapshotDomain g_models;
+static volatile uint32_t g_models_state = MODELS_UNINITIALIZED;
+static DsModel g_builtin_model;
+static volatile uint64_t g_model_generation = 0; // last generation handed out
+
+// The session behind the DsEngine* functions. Its reader slot survives DsEngineInit.
+static DsSession g_default_session = {
+    .token_hash = TOKEN_HASH_SEED,
+    .phrase_correction = true,
+    .neighbor_lang = DS_LANG_UNKNOWN,
+    .short_words = true,
+    .predictive_switching = true,
+    .model_slot = -1,
+    .model = &g_builtin_model,
+};
+
+static uint64_t NowNs(const DsSession* s)
+{
+    return s->host.clock_ns ? s->host.clock_ns(s->host.ctx) : 0;
+}
+
+// ---------- Decision tiers ----------
+// Scoring starts with what always runs and adds the expensive tiers (DsTier) one after another.
+// Before each one the clock is checked against the key's deadline; a tier that misses it is
+// skipped, and the most it could have added to each score is remembered. Tiers only ever add, so
+// the margin could have been lower by the base's share and higher by the mapped side's: a decision
+// that holds across that range is the one the full scorer would have made, anything else is dropped.
+
+typedef struct {
+    const DsHost* host;
+    uint64_t deadline_ns; // 0 = unbounded
+    DsTierStats* stats;
+    int base_swing;       // most the skipped tiers could have added to the base score
+    int mapped_swing;     // ... and to the mapped score
+} TierRun;
+
+// Whether `tier`, which adds at most `baseEffect` and `mappedEffect` to the scores, still runs.
+static bool TierMayRun(TierRun* run, DsTier tier, int baseEffect, int mappedEffect)
+{
+    if (!run) return true;
+    if (run->deadline_ns && run->host->clock_ns && run->host->clock_ns(run->host->ctx) >= run->deadline_ns) {
+        run->stats->timeouts[tier]++;
+        run->base_swing += baseEffect;
+        run->mapped_swing += mappedEffect;
+        return false;
+    }
+    run->stats->hits[tier]++;
+    return true;
+}
+
+static void InvalidateCache(DsSession* s)
+{
+    memset(s->cache, 0, sizeof(s->cache));
+    s->cache_clock = 0;
+}
+
+static uint32_t DecisionCacheTick(DsSession* s)
+{
+    if (++s->cache_clock == 0) {
+        // Clock wrapped: dropping everything is simpler than renormalizing stamps.
+        InvalidateCache(s);
+        s->cache_clock = 1;
+    }
+    return s->cache_clock;
+}
+
+static const DecisionCacheEntry* DecisionCacheLookup(DsSession* s, uint64_t hash, size_t n)
+{
+    if (n > DECISION_CACHE_MAX_CHARS) return NULL;
+    DecisionCacheEntry* set = s->cache[hash % DECISION_CACHE_SETS];
+    for (int w = 0; w < DECISION_CACHE_WAYS; w++) {
+        if (set[w].stamp && set[w].hash == hash && set[w].len == n) {
+            set[w].stamp = DecisionCacheTick(s);
+            return &set[w];
+        }
+    }
+    return NULL;
+}
+
+static void DecisionCacheStore(DsSession* s, uint64_t hash, size_t n, const TokenDecision* d, const wchar_t* mapped)
+{
+    if (n > DECISION_CACHE_MAX_CHARS) return;
+    DecisionCacheEntry* set = s->cache[hash % DECISION_CACHE_SETS];
+    DecisionCacheEntry* victim = &set[0];
+    for (int w = 0; w < DECISION_CACHE_WAYS; w++) {
+        if (!set[w].stamp) { victim = &set[w]; break; }
+        if (set[w].stamp < victim->stamp) victim = &set[w];
+    }
+    memset(victim, 0, sizeof(*victim));
+    victim->hash = hash;
+    victim->len = (uint8_t)n;
+    victim->fix = d->fix ? 1 : 0;
+    victim->to_english = d->to_english ? 1 : 0;
+    victim->evidence = (int8_t)d->evidence;
+    if (d->fix) {
+        for (size_t i = 0; i < n; i++) victim->mapped[i] = (uint16_t)mapped[i]; // mapping is 1:1 per char
+    }
+    victim->stamp = DecisionCacheTick(s);
+}
+
+bool DsIsLatinLetter(wchar_t ch)
+{
+    return (ch >= L'A' && ch <= L'Z') || (ch >= L'a' && ch <= L'z');
+}
+
+bool DsIsCyrillicLetter(wchar_t ch)
+{
+    return (ch >= 0x0400 && ch <= 0x04FF) || (ch >= 0x0500 && ch <= 0x052F);
+}
+
+static bool IsAlpha(wchar_t ch)
+{
+    // Explicit ranges first so the result does not depend on the C runtime locale.
+    return DsIsLatinLetter(ch) || DsIsCyrillicLetter(ch) || iswalpha((wint_t)ch) != 0;
+}
+
+static bool IsDigit(wchar_t ch)
+{
+    return (ch >= L'0' && ch <= L'9') || iswdigit((wint_t)ch) != 0;
+}
+
+bool DsIsWordChar(wchar_t ch)
+{
+    // Word basis: only letters/digits. Hyphens/apostrophes end the token for simplicity.
+    return IsAlpha(ch) || IsDigit(ch) || iswalnum((wint_t)ch) != 0;
+}
+
+wchar_t DsToLower(wchar_t ch)
+{
+    if (ch >= L'A' && ch <= L'Z') return (wchar_t)(ch - L'A' + L'a');
+    if (ch >= 0x0410 && ch <= 0x042F) return (wchar_t)(ch + 0x20); // А..Я
+    if (ch >= 0x0400 && ch <= 0x040F) return (wchar_t)(ch + 0x50); // Ѐ..Џ (incl. Ё)
+    return (wchar_t)towlower((wint_t)ch);
+}
+
+wchar_t DsToUpper(wchar_t ch)
+{
+    if (ch >= L'a' && ch <= L'z') return (wchar_t)(ch - L'a' + L'A');
+    if (ch >= 0x0430 && ch <= 0x044F) return (wchar_t)(ch - 0x20);
+    if (ch >= 0x0450 && ch <= 0x045F) return (wchar_t)(ch - 0x50);
+    return (wchar_t)towupper((wint_t)ch);
+}
+
+static int FindBigramScore(const wchar_t* token, const DsCharPair* commonPairs, size_t commonCount)
+{
+    // Returns number of bigrams found in the small "common bigrams" list.
+    const size_t n = wcslen(token);
+    if (n < 2) return 0;
+
+    int hits = 0;
+    for (size_t i = 0; i + 1 < n; i++) {
+        wchar_t bg[3] = { token[i], token[i + 1], 0 };
+        for (size_t j = 0; j < commonCount; j++) {
+            if (bg[0] == commonPairs[j].first && bg[1] == commonPairs[j].second) {
+                hits++;
+                break;
+            }
+        }
+    }
+    return hits;
+}
+
+static int CountBadBigrams(const wchar_t* token, const DsCharPair* badPairs, size_t badCount)
+{
+    const size_t n = wcslen(token);
+    if (n < 2) return 0;
+    int hits = 0;
+    for (size_t i = 0; i + 1 < n; i++) {
+        wchar_t bg0 = token[i];
+        wchar_t bg1 = token[i + 1];
+        for (size_t j = 0; j < badCount; j++) {
+            if (bg0 == badPairs[j].first && bg1 == badPairs[j].second) {
+                hits++;
+                break;
+            }
+        }
+    }
+    return hits;
+}
+
+static double VowelRatioEn(const wchar_t* token)
+{
+    const wchar_t* vowels = L"aeiouy";
+    int v = 0, l = 0;
+    for (const wchar_t* p = token; *p; p++) {
+        if (!DsIsLatinLetter(*p)) continue;
+        l++;
+        if (wcschr(vowels, *p)) v++;
+    }
+    if (l == 0) return 0.0;
+    return (double)v / (double)l;
+}
+
+static double VowelRatioRu(const wchar_t* token)
+{
+    const wchar_t* vowels = L"\u0430\u0435\u0451\u0438\u043e\u0443\u044b\u044d\u044e\u044f";
+    int v = 0, l = 0;
+    for (const wchar_t* p = token; *p; p++) {
+        if (!DsIsCyrillicLetter(*p)) continue;
+        l++;
+        if (wcschr(vowels, *p)) v++;
+    }
+    if (l == 0) return 0.0;
+    return (double)v / (double)l;
+}
+
+static int ScoreEnglish(const DsModel* model, const wchar_t* tokenLower)
+{
+    // Lightweight "not gibberish" score: common bigrams + vowel ratio sanity.
+    int latin = 0, nonLatinLetters = 0;
+    for (const wchar_t* p = tokenLower; *p; p++) {
+        if (DsIsLatinLetter(*p)) latin++;
+        else if (IsAlpha(*p)) nonLatinLetters++;
+    }
+    if (latin == 0) return -1000;
+    if (nonLatinLetters > 0) return -500;
+
+    const int hits = FindBigramScore(tokenLower, model->bigrams_en, model->bigrams_en_count);
+    const size_t n = wcslen(tokenLower);
+    const double vr = VowelRatioEn(tokenLower);
+
+    int score = 0;
+    score += hits * 3;
+    // Prefer some vowels but allow short words like "nth" to pass if bigrams look okay.
+    if (n >= 4 && vr < 0.20) score -= 6;
+    if (vr > 0.75) score -= 3;
+    // Penalize long runs without vowels.
+    if (n >= 6 && vr < 0.15) score -= 10;
+    // Slight length bonus.
+    score += (int)(n);
+    return score;
+}
+
+static int ScoreRussian(const DsModel* model, const wchar_t* tokenLower)
+{
+    int cyr = 0, nonCyrLetters = 0;
+    for (const wchar_t* p = tokenLower; *p; p++) {
+        if (DsIsCyrillicLetter(*p)) cyr++;
+        else if (IsAlpha(*p)) nonCyrLetters++;
+    }
+    if (cyr == 0) return -1000;
+    if (nonCyrLetters > 0) return -500;
+
+    const int hits = FindBigramScore(tokenLower, model->bigrams_ru, model->bigrams_ru_count);
+    const int badHits = CountBadBigrams(tokenLower, model->bad_bigrams_ru, model->bad_bigrams_ru_count);
+    const size_t n = wcslen(tokenLower);
+    const double vr = VowelRatioRu(tokenLower);
+
+    int score = 0;
+    score += hits * 3;
+    score -= badHits * 8;
+    if (n >= 4 && vr < 0.20) score -= 6;
+    if (vr > 0.80) score -= 3;
+    if (n >= 6 && vr < 0.15) score -= 10;
+    score += (int)(n);
+    return score;
+}
+
+void DsMapRuToEn(const wchar_t* in, wchar_t* out, size_t outCap)
+{
+    DsModelMap(NULL, true, in, out, outCap);
+}
+
+void DsMapEnToRu(const wchar_t* in, wchar_t* out, size_t outCap)
+{
+    DsModelMap(NULL, false, in, out, outCap);
+}
+
+static void RequestLayoutSwitch(DsSession* s, bool toEnglish)
+{
+    if (s->host.switch_layout) s->host.switch_layout(s->host.ctx, toEnglish);
+}
+
+static void SendBackspacesAndText(DsSession* s, size_t backspaces, const wchar_t* text)
+{
+    if (s->host.send_text) s->host.send_text(s->host.ctx, backspaces, text);
+}
+
+// Characters at the start of two equally long texts that a replacement can leave on screen.
+static size_t SharedPrefix(const wchar_t* a, const wchar_t* b, size_t n)
+{
+    size_t i = 0;
+    while (i < n && a[i] == b[i]) i++;
+    return i;
+}
+
+static void InvalidateLastFix(DsSession* s)
+{
+    s->last_fix.active = false;
+}
+
+static bool ToggleLastFixIfPossible(DsSession* s)
+{
+    LastFix* fix = &s->last_fix;
+    if (!fix->active) return false;
+
+    const uint64_t now = NowNs(s) / 1000000u;
+    if (now - fix->ts_ms > 30000) { // 30s window
+        fix->active = false;
+        return false;
+    }
+    if (!fix->had_boundary) {
+        fix->active = false;
+        return false;
+    }
+
+    const bool want_corrected = fix->corrected_applied ? false : true;
+    if (!want_corrected && !fix->learned && s->adapt) {
+        // Reverting says the text was right as typed: learn its words.
+        size_t start = 0;
+        for (size_t i = 0; i <= fix->original_len; i++) {
+            if (i < fix->original_len && fix->original[i] != L' ') continue;
+            DsAdaptLearn(s->adapt, fix->original + start, i - start);
+            start = i + 1;
+        }
+        fix->learned = true;
+    }
+
+    const wchar_t* targetText = want_corrected ? fix->corrected : fix->original;
+    const size_t targetLen = want_corrected ? fix->corrected_len : fix->original_len;
+    const size_t currentLen = want_corrected ? fix->original_len : fix->corrected_len;
+
+    // Switch layout to match the target.
+    const bool targetIsEnglish = want_corrected ? fix->corrected_to_english : !fix->corrected_to_english;
+    RequestLayoutSwitch(s, targetIsEnglish);
+
+    // Cursor is after: current + boundary. Replace with: target + boundary, from the first
+    // character that differs.
+    wchar_t out[DS_PHRASE_MAX_CHARS + 2];
+    if (targetLen + 1 >= DS_ARRAYSIZE(out) || targetLen != currentLen) {
+        fix->active = false;
+        return false;
+    }
+    const wchar_t* currentText = want_corrected ? fix->original : fix->corrected;
+    const size_t keep = SharedPrefix(currentText, targetText, targetLen);
+    wmemcpy(out, targetText + keep, targetLen - keep);
+    out[targetLen - keep] = fix->boundary;
+    out[targetLen - keep + 1] = 0;
+
+    SendBackspacesAndText(s, currentLen - keep + 1, out);
+
+    fix->corrected_applied = want_corrected ? true : false;
+    fix->ts_ms = now; // extend window while toggling
+    return true;
+}
+
+typedef struct {
+    int base;        // score in the script the token was typed in; for mixed tokens, of the other reading
+    int mapped;      // score of the token mapped to the other layout
+    bool mixed;      // both Latin and Cyrillic letters
+    bool to_english; // direction of the mapping: RU->EN for Cyrillic tokens
+    int evidence;    // how strongly the token supports a phrase correction (PHRASE_NO_FIT if not at all)
+} TokenScore;
+
+// A token mixing scripts was typed partly on the wrong layout: the start before the user noticed
+// and switched ("ghbвет"), or the rest after an accidental switch ("приdtn"). A letter's script
+// says which layout it was typed on, so the switch points need no search: each language's reading
+// maps exactly the letters typed on the other layout and keeps the others, in one pass, and
+// ApplyCorrection retypes from the first letter that changes. The better reading goes to `mapped`
+// with its score; the other one's score is the base, so min_diff_mixed is the margin between
+// them. On a tie the script the token ends in wins, since that is where the user switched to.
+static bool ScoreMixedToken(const DsModel* model, const wchar_t* token, size_t n, wchar_t* mapped, size_t mappedCap,
+                            TierRun* run, TokenScore* out)
+{
+    wchar_t toEn[DS_TOKEN_MAX_CHARS + 1];
+    wchar_t toRu[DS_TOKEN_MAX_CHARS + 1];
+    if (mappedCap < n + 1) return false;
+    DsModelMap(model, true, token, toEn, DS_ARRAYSIZE(toEn));
+    DsModelMap(model, false, token, toRu, DS_ARRAYSIZE(toRu));
+
+    wchar_t reading[2][DS_TOKEN_MAX_CHARS + 1]; // [DsLang]
+    wchar_t lower[2][DS_TOKEN_MAX_CHARS + 1];
+    bool valid[2] = { true, true };
+    for (size_t i = 0; i < n; i++) {
+        const bool latin = DsIsLatinLetter(DsToLower(token[i]));
+        reading[DS_LANG_EN][i] = latin ? token[i] : toEn[i];
+        reading[DS_LANG_RU][i] = latin ? toRu[i] : token[i];
+        for (int l = 0; l < 2; l++) {
+            lower[l][i] = DsToLower(reading[l][i]);
+            // A letter whose key is punctuation on the other layout would have split the word.
+            if (!(l == DS_LANG_EN ? DsIsLatinLetter(lower[l][i]) : DsIsCyrillicLetter(lower[l][i]))) valid[l] = false;
+        }
+    }
+    int score[2] = { -1000, -1000 };
+    for (int l = 0; l < 2; l++) {
+        reading[l][n] = 0;
+        lower[l][n] = 0;
+        if (valid[l]) score[l] = l == DS_LANG_EN ? ScoreEnglish(model, lower[l]) : ScoreRussian(model, lower[l]);
+    }
+    if (!valid[DS_LANG_EN] && !valid[DS_LANG_RU]) return false;
+    // Either reading may end up as the base, so a skipped lookup could have raised either score.
+    const int bonus = model->thresholds.morph_bonus;
+    if (valid[DS_LANG_RU] && model->morph && TierMayRun(run, DS_TIER_MORPH, bonus, bonus) &&
+        DsMorphContains(model->morph, lower[DS_LANG_RU], n)) {
+        score[DS_LANG_RU] += bonus;
+    }
+
+    const DsLang last = DsIsLatinLetter(DsToLower(token[n - 1])) ? DS_LANG_EN : DS_LANG_RU;
+    const DsLang best = score[DS_LANG_EN] == score[DS_LANG_RU] ? last
+                        : score[DS_LANG_EN] > score[DS_LANG_RU] ? DS_LANG_EN : DS_LANG_RU;
+    wmemcpy(mapped, reading[best], n + 1);
+    out->mapped = score[best];
+    out->base = score[best == DS_LANG_EN ? DS_LANG_RU : DS_LANG_EN];
+    out->mixed = true;
+    out->to_english = best == DS_LANG_EN;
+    out->evidence = PHRASE_NO_FIT;
+    return true;
+}
+
+// Lowercases, maps and scores the token; false if it is not a plain run of EN or RU letters.
+// `mapped` receives the token in the other layout (same length, original case). With `adapt`,
+// both sides earn the bonus for letter sequences the user types often in their language. With
+// `run`, the expensive tiers are subject to its deadline; NULL runs them all.
+static bool ScoreToken(const DsModel* model, const DsAdaptSketch* adapt, const wchar_t* token, size_t n, wchar_t* mapped,
+                       size_t mappedCap, TierRun* run, TokenScore* out)
+{
+    wchar_t lower[DS_TOKEN_MAX_CHARS + 1];
+    for (size_t i = 0; i < n; i++) lower[i] = DsToLower(token[i]);
+    lower[n] = 0;
+    if (DsModelIsException(model, lower, n)) return false;
+
+    int latin = 0, cyr = 0, otherLetters = 0;
+    for (size_t i = 0; i < n; i++) {
+        const wchar_t ch = lower[i];
+        if (DsIsLatinLetter(ch)) latin++;
+        else if (DsIsCyrillicLetter(ch)) cyr++;
+        else if (IsAlpha(ch)) otherLetters++;
+    }
+    if (otherLetters > 0) return false;
+
+    const bool mixedScripts = (latin > 0 && cyr > 0);
+    // Avoid "fixing" likely IDs like "C3PO", "R2D2", etc.
+    // If it contains digits, be conservative.
+    int digits = 0;
+    for (size_t i = 0; i < n; i++) if (IsDigit(lower[i])) digits++;
+    if (digits > 0) return false;
+    if (mixedScripts) return ScoreMixedToken(model, token, n, mapped, mappedCap, run, out);
+
+    const int scoreEn = ScoreEnglish(model, lower);
+    const int scoreRu = ScoreRussian(model, lower);
+
+    int mappedScore = -1000;
+    bool toEnglish = false;
+    wchar_t mappedLower[DS_TOKEN_MAX_CHARS + 1];
+    size_t ml = 0;
+
+    if (cyr > 0) {
+        DsModelMap(model, true, token, mapped, mappedCap);
+        ml = wcslen(mapped);
+        for (size_t i = 0; i < ml; i++) mappedLower[i] = DsToLower(mapped[i]);
+        mappedLower[ml] = 0;
+        mappedScore = ScoreEnglish(model, mappedLower);
+        toEnglish = true;
+    } else if (latin > 0) {
+        DsModelMap(model, false, token, mapped, mappedCap);
+        ml = wcslen(mapped);
+        for (size_t i = 0; i < ml; i++) mappedLower[i] = DsToLower(mapped[i]);
+        mappedLower[ml] = 0;
+        mappedScore = ScoreRussian(model, mappedLower);
+        toEnglish = false;
+    } else {
+        return false;
+    }
+
+    out->base = (cyr > 0) ? scoreRu : scoreEn;
+    out->mapped = mappedScore;
+    const int adaptBonus = model->thresholds.adapt_bonus;
+    if (adapt && TierMayRun(run, DS_TIER_ADAPT, adaptBonus, adaptBonus)) {
+        out->base += DsAdaptBonus(adapt, toEnglish ? DS_LANG_RU : DS_LANG_EN, lower, n, adaptBonus);
+        out->mapped += DsAdaptBonus(adapt, toEnglish ? DS_LANG_EN : DS_LANG_RU, mappedLower, ml, adaptBonus);
+    }
+    // A valid Russian form keeps its layout or earns its correction, whichever side it is on.
+    const int morphBonus = model->thresholds.morph_bonus;
+    if (model->morph && TierMayRun(run, DS_TIER_MORPH, toEnglish ? morphBonus : 0, toEnglish ? 0 : morphBonus)) {
+        if (toEnglish && DsMorphContains(model->morph, lower, n)) out->base += morphBonus;
+        if (!toEnglish && DsMorphContains(model->morph, mappedLower, ml)) {
+            out->mapped += morphBonus;
+            mappedScore += morphBonus;
+        }
+    }
+    out->mixed = false;
+    out->to_english = toEnglish;
+
+    // Bigram scores say little about one- and two-letter words, so those only count as phrase
+    // evidence when they map to a frequent short word and are not one where they were typed.
+    if (n < 3) {
+        const bool knownAsTyped = DsModelIsShortWord(model, lower, n, !toEnglish);
+        const bool knownMapped = DsModelIsShortWord(model, mappedLower, ml, toEnglish);
+        out->evidence = (!knownAsTyped && knownMapped) ? model->thresholds.short_word_evidence : PHRASE_NO_FIT;
+    } else {
+        const int diff = mappedScore - out->base;
+        out->evidence = diff < 0 ? PHRASE_NO_FIT : (diff > PHRASE_MAX_TOKEN_EVIDENCE ? PHRASE_MAX_TOKEN_EVIDENCE : diff);
+    }
+    return true;
+}
+
+// How far a scored token (n >= 3) clears the single-token thresholds; negative if it does not.
+static int TokenMargin(const DsThresholds* t, size_t n, const TokenScore* ts)
+{
+    // Decision thresholds: dynamic based on length (see DsThresholds).
+    const int diff = ts->mapped - ts->base;
+    int minMapped = (n <= 4) ? t->min_mapped_short : t->min_mapped;
+    int minDiff = (n <= 5) ? t->min_diff_short : t->min_diff;
+    if (ts->base <= t->weak_base) minDiff = t->min_diff_weak;
+    if (ts->mixed) minDiff = t->min_diff_mixed;
+
+    const int mappedMargin = ts->mapped - minMapped;
+    const int diffMargin = diff - minDiff;
+    return mappedMargin < diffMargin ? mappedMargin : diffMargin;
+}
+
+// Applies the single-token thresholds to a scored token (n >= 3).
+static bool DecideToken(DsSession* s, const wchar_t* token, size_t n, const wchar_t* mapped, const TokenScore* ts)
+{
+    const int base = ts->base;
+    const int mappedScore = ts->mapped;
+    const int diff = mappedScore - base;
+
+    if (TokenMargin(&s->model->thresholds, n, ts) >= 0) {
+        if (s->host.log) {
+            wchar_t dbg[256];
+            swprintf(dbg, DS_ARRAYSIZE(dbg),
+                     L"[DiSwitcher] autocorrect '%ls' -> '%ls' base=%d mapped=%d diff=%d\r\n",
+                     token, mapped, base, mappedScore, diff);
+            s->host.log(s->host.ctx, dbg);
+        }
+        return true;
+    }
+    return false;
+}
+
+// Script of a token of letters only; unknown if it mixes scripts or has anything else in it.
+static DsLang TokenLang(const wchar_t* token, size_t n)
+{
+    DsLang lang = DS_LANG_UNKNOWN;
+    for (size_t i = 0; i < n; i++) {
+        const DsLang l = DsIsLatinLetter(token[i]) ? DS_LANG_EN : DsIsCyrillicLetter(token[i]) ? DS_LANG_RU : DS_LANG_UNKNOWN;
+        if (l == DS_LANG_UNKNOWN || (i && l != lang)) return DS_LANG_UNKNOWN;
+        lang = l;
+    }
+    return lang;
+}
+
+// One- and two-letter tokens carry no bigram evidence of their own. One is corrected when it is not
+// a word as typed, is one on the other layout, and the word before it is in that other language
+// ("ghbdtn z" -> "привет я"). Not cached: the outcome depends on the neighbor, and the lookups
+// cost less than the cache would.
+static bool DecideShortToken(DsSession* s, const wchar_t* token, size_t n, wchar_t* mapped, size_t mappedCap, TokenDecision* d)
+{
+    if (!s->short_words || n == 0 || n > 2 || s->neighbor_lang == DS_LANG_UNKNOWN) return false;
+    const DsLang typed = TokenLang(token, n);
+    if (typed == DS_LANG_UNKNOWN || typed == s->neighbor_lang) return false;
+
+    wchar_t lower[3];
+    for (size_t i = 0; i < n; i++) lower[i] = DsToLower(token[i]);
+    lower[n] = 0;
+    if (DsShortWordClass(lower, n) != DS_SHORT_TWIN || DsModelIsException(s->model, lower, n)) return false;
+
+    // The twin flag follows the built-in map; confirm against the model's.
+    const bool toEnglish = typed == DS_LANG_RU;
+    wchar_t mappedLower[3];
+    DsModelMap(s->model, toEnglish, lower, mappedLower, DS_ARRAYSIZE(mappedLower));
+    if (wcslen(mappedLower) != n || TokenLang(mappedLower, n) != s->neighbor_lang ||
+        !(DsShortWordClass(mappedLower, n) & DS_SHORT_WORD)) {
+        return false;
+    }
+    DsModelMap(s->model, toEnglish, token, mapped, mappedCap);
+    d->fix = true;
+    d->to_english = toEnglish;
+    if (s->host.log) {
+        wchar_t dbg[96];
+        swprintf(dbg, DS_ARRAYSIZE(dbg), L"[DiSwitcher] autocorrect short '%ls' -> '%ls' after a %ls word\r\n", token,
+                 mapped, toEnglish ? L"EN" : L"RU");
+        s->host.log(s->host.ctx, dbg);
+    }
+    return true;
+}
+
+// Decides a token through the decision cache. When `out->fix` is set, `mapped` holds the correction.
+static void EvaluateToken(DsSession* s, const wchar_t* token, size_t n, uint64_t tokenHash, wchar_t* mapped, size_t mappedCap, TokenDecision* out)
+{
+    const uint64_t t0 = NowNs(s);
+
+    // Learning moves scores a little with every token. Rather than dropping the cache each time,
+    // decisions are keyed by the sketch generation too, which only changes when some trigram
+    // became familiar or stopped being: a cached decision lags the sketch by one epoch at most.
+    if (s->adapt) tokenHash ^= (uint64_t)(s->adapt->generation + 1) * 0x9E3779B97F4A7C15ULL;
+
+    out->dropped = false;
+    s->tier_stats.hits[DS_TIER_CHEAP]++;
+    const DecisionCacheEntry* cached = DecisionCacheLookup(s, tokenHash, n);
+    if (cached) {
+        out->fix = cached->fix != 0;
+        out->to_english = cached->to_english != 0;
+        out->evidence = cached->evidence;
+        if (out->fix) {
+            for (size_t i = 0; i < n; i++) mapped[i] = (wchar_t)cached->mapped[i];
+            mapped[n] = 0;
+        }
+        s->cache_stats.hits++;
+        s->cache_stats.hit_ns += NowNs(s) - t0;
+        return;
+    }
+
+    TokenScore ts;
+    TierRun run = { &s->host, s->deadline_ns, &s->tier_stats, 0, 0 };
+    out->fix = false;
+    out->to_english = false;
+    out->evidence = PHRASE_NO_FIT;
+    if (ScoreToken(s->model, s->adapt, token, n, mapped, mappedCap, &run, &ts)) {
+        const int margin = n >= 3 ? TokenMargin(&s->model->thresholds, n, &ts) : -1;
+        const bool partial = run.base_swing || run.mapped_swing;
+        if (partial && n >= 3 && margin - run.base_swing < 0 && margin + run.mapped_swing >= 0) {
+            out->dropped = true;
+            s->tier_stats.dropped++;
+            if (s->host.log) {
+                wchar_t dbg[160];
+                swprintf(dbg, DS_ARRAYSIZE(dbg), L"[DiSwitcher] deadline: '%ls' left as typed (margin %d, -%d..+%d)\r\n",
+                         token, margin, run.base_swing, run.mapped_swing);
+                s->host.log(s->host.ctx, dbg);
+            }
+        } else {
+            if (partial) s->tier_stats.settled++;
+            out->fix = n >= 3 && DecideToken(s, token, n, mapped, &ts);
+            out->to_english = ts.to_english;
+            out->evidence = ts.evidence;
+        }
+    }
+    // Partial scores are not what the token deserves: the next time it comes up, it gets the full
+    // scorer again if there is time.
+    if (!run.base_swing && !run.mapped_swing) DecisionCacheStore(s, tokenHash, n, out, mapped);
+    s->cache_stats.misses++;
+    s->cache_stats.miss_ns += NowNs(s) - t0;
+}
+
+// Replaces `original` (and the boundary, if any) before the caret with `corrected`, switches the
+// layout and remembers the replacement for Pause-to-revert.
+static void ApplyCorrection(DsSession* s, const wchar_t* original, size_t n, const wchar_t* corrected, bool toEnglish,
+                            wchar_t boundaryChar, bool includeBoundary)
+{
+    // Save last fix for Pause-to-revert.
+    LastFix* fix = &s->last_fix;
+    memset(fix, 0, sizeof(*fix));
+    fix->active = true;
+    fix->ts_ms = NowNs(s) / 1000000u;
+    wmemcpy(fix->original, original, n);
+    wmemcpy(fix->corrected, corrected, n);
+    fix->original_len = n;
+    fix->corrected_len = n;
+    fix->boundary = boundaryChar;
+    fix->had_boundary = includeBoundary;
+    fix->corrected_to_english = toEnglish;
+    fix->corrected_applied = true;
+
+    RequestLayoutSwitch(s, toEnglish);
+    DsLayoutMemoryConfirm(&s->layout_memory, s->focus_window, toEnglish ? DS_LANG_EN : DS_LANG_RU);
+
+    // Only what changed is retyped: a token fixed after a mid-word switch keeps its correct start.
+    const size_t keep = SharedPrefix(original, corrected, n);
+    wchar_t out[DS_PHRASE_MAX_CHARS + 2];
+    size_t len = n - keep;
+    wmemcpy(out, corrected + keep, len);
+    if (includeBoundary) out[len++] = boundaryChar;
+    out[len] = 0;
+    SendBackspacesAndText(s, n - keep, out);
+}
+
+// Token ended without a printable boundary (arrows, Enter handled as OTHER, ...): single-token only.
+// `dOut` receives the token's decision; no fit for tokens the scorer does not see (short or too long).
+static bool TryAutocorrectToken(DsSession* s, const wchar_t* token, size_t n, uint64_t tokenHash, TokenDecision* dOut)
+{
+    dOut->fix = false;
+    dOut->to_english = false;
+    dOut->evidence = PHRASE_NO_FIT;
+    dOut->dropped = false;
+    if (n == 0 || n > DS_TOKEN_MAX_CHARS) return false;
+
+    wchar_t mapped[DS_TOKEN_MAX_CHARS + 1];
+    if (n >= 3) EvaluateToken(s, token, n, tokenHash, mapped, DS_ARRAYSIZE(mapped), dOut);
+    if (!dOut->fix && !DecideShortToken(s, token, n, mapped, DS_ARRAYSIZE(mapped), dOut)) return false;
+    ApplyCorrection(s, token, n, mapped, dOut->to_english, 0, false);
+    return true;
+}
+
+static void PhraseReset(DsSession* s)
+{
+    s->phrase.len = 0;
+    s->phrase.count = 0;
+    s->phrase.text[0] = 0;
+}
+
+static void PhraseDropOldest(PhraseWindow* p)
+{
+    const size_t cut = p->count > 1 ? p->tokens[1].start : p->len;
+    wmemmove(p->text, p->text + cut, p->len - cut + 1);
+    p->len -= cut;
+    memmove(p->tokens, p->tokens + 1, (p->count - 1) * sizeof(PhraseToken));
+    p->count--;
+    for (size_t i = 0; i < p->count; i++) p->tokens[i].start = (uint8_t)(p->tokens[i].start - cut);
+}
+
+// Appends a token that ended uncorrected on a space.
+static void PhrasePush(DsSession* s, const wchar_t* token, size_t n, const TokenDecision* d, wchar_t boundary)
+{
+    PhraseWindow* p = &s->phrase;
+    if (n + 1 > DS_PHRASE_MAX_CHARS) {
+        PhraseReset(s);
+        return;
+    }
+    while (p->count == DS_ARRAYSIZE(p->tokens) || p->len + n + 1 > DS_PHRASE_MAX_CHARS) {
+        PhraseDropOldest(p);
+    }
+    PhraseToken* t = &p->tokens[p->count++];
+    t->start = (uint8_t)p->len;
+    t->len = (uint8_t)n;
+    t->to_english = d->to_english;
+    t->evidence = (int8_t)d->evidence;
+    wmemcpy(p->text + p->len, token, n);
+    p->len += n;
+    p->text[p->len++] = boundary;
+    p->text[p->len] = 0;
+}
+
+// A space typed right after another boundary stays part of the phrase.
+static void PhraseAppendBoundary(DsSession* s, wchar_t boundary)
+{
+    PhraseWindow* p = &s->phrase;
+    if (!p->count || p->len + 1 > DS_PHRASE_MAX_CHARS) {
+        PhraseReset(s);
+        return;
+    }
+    p->text[p->len++] = boundary;
+    p->text[p->len] = 0;
+}
+
+// The current token ended on a printable boundary. Corrects it alone or, when the preceding tokens
+// in the phrase window were typed in the same wrong layout, together with them in a single batch.
+// A phrase is corrected when the current token qualifies on its own, or when the evidence summed
+// over the phrase reaches the model's phrase_min_evidence. Returns true if text was replaced; `dOut` receives
+// the token's decision either way.
+static bool TryCorrectAtBoundary(DsSession* s, const wchar_t* token, size_t n, uint64_t tokenHash, wchar_t boundary, TokenDecision* dOut)
+{
+    const PhraseWindow* p = &s->phrase;
+    wchar_t mapped[DS_TOKEN_MAX_CHARS + 1];
+    EvaluateToken(s, token, n, tokenHash, mapped, DS_ARRAYSIZE(mapped), dOut);
+    if (!dOut->fix) DecideShortToken(s, token, n, mapped, DS_ARRAYSIZE(mapped), dOut);
+    const TokenDecision d = *dOut;
+
+    size_t k = 0; // preceding tokens that join the correction
+    if (s->phrase_correction && p->count && d.evidence != PHRASE_NO_FIT) {
+        int total = d.evidence;
+        while (k < p->count) {
+            const PhraseToken* t = &p->tokens[p->count - 1 - k];
+            if (t->evidence == PHRASE_NO_FIT || t->to_english != d.to_english) break;
+            total += t->evidence;
+            k++;
+        }
+        while (k && p->len - p->tokens[p->count - k].start + n + 1 > DS_PHRASE_MAX_CHARS) k--;
+        if (!d.fix && total < s->model->thresholds.phrase_min_evidence) k = 0;
+    }
+
+    if (!k) {
+        if (!d.fix) return false;
+        ApplyCorrection(s, token, n, mapped, d.to_english, boundary, true);
+        return true;
+    }
+
+    // Phrase: retype the window from its first joining token, mapping tokens and keeping spaces.
+    const size_t first = p->tokens[p->count - k].start;
+    const size_t prefix = p->len - first;
+    wchar_t original[DS_PHRASE_MAX_CHARS + 1];
+    wchar_t corrected[DS_PHRASE_MAX_CHARS + 1];
+    wmemcpy(original, p->text + first, prefix);
+    wmemcpy(original + prefix, token, n);
+    original[prefix + n] = 0;
+    wmemcpy(corrected, original, prefix + n + 1);
+
+    size_t shortTokens = n < 3 ? 1 : 0;
+    for (size_t i = p->count - k; i < p->count; i++) {
+        const PhraseToken* t = &p->tokens[i];
+        wchar_t in[DS_TOKEN_MAX_CHARS + 1];
+        wchar_t out[DS_TOKEN_MAX_CHARS + 1];
+        wmemcpy(in, p->text + t->start, t->len);
+        in[t->len] = 0;
+        DsModelMap(s->model, d.to_english, in, out, DS_ARRAYSIZE(out));
+        wmemcpy(corrected + (t->start - first), out, t->len);
+        if (t->len < 3) shortTokens++;
+    }
+    if (!d.fix) DsModelMap(s->model, d.to_english, token, mapped, DS_ARRAYSIZE(mapped));
+    wmemcpy(corrected + prefix, mapped, n);
+
+    if (s->host.log) {
+        wchar_t dbg[2 * DS_PHRASE_MAX_CHARS + 64];
+        swprintf(dbg, DS_ARRAYSIZE(dbg), L"[DiSwitcher] phrase '%ls' -> '%ls' (%u tokens)\r\n",
+                 original, corrected, (unsigned)(k + 1));
+        s->host.log(s->host.ctx, dbg);
+    }
+    ApplyCorrection(s, original, prefix + n, corrected, d.to_english, boundary, true);
+    s->phrase_stats.phrases++;
+    s->phrase_stats.phrase_tokens += k + 1;
+    s->phrase_stats.short_tokens += shortTokens;
+    return true;
+}
+
+// A token that ends without being corrected confirms the layout it was typed in.
+static void ConfirmTypedLayout(DsSession* s, const wchar_t* token, size_t n)
+{
+    if (!s->focus_window || n < 2) return;
+    int latin = 0, cyr = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (DsIsLatinLetter(token[i])) latin++;
+        else if (DsIsCyrillicLetter(token[i])) cyr++;
+    }
+    if (latin + cyr < 2 || (latin && cyr)) return;
+    DsLayoutMemoryConfirm(&s->layout_memory, s->focus_window, latin ? DS_LANG_EN : DS_LANG_RU);
+}
+
+// A token that stays as typed teaches the adaptive sketch, unless it leaned towards the other layout
+// at all: such a token can still be corrected retroactively as part of a phrase.
+static void LearnKeptToken(DsSession* s, const wchar_t* token, size_t n, const TokenDecision* d)
+{
+    if (s->adapt && d->evidence == PHRASE_NO_FIT && !d->dropped) DsAdaptLearn(s->adapt, token, n);
+}
+
+static void ResetToken(DsSession* s)
+{
+    s->token_len = 0;
+    s->token[0] = 0;
+    s->token_hash = TOKEN_HASH_SEED;
+}
+
+static void FreeModel(void* ctx, void* snapshot)
+{
+    (void)ctx;
+    if (snapshot != &g_builtin_model) DsModelFree((DsModel*)snapshot);
+}
+
+// Sets up the shared model domain on first use, from whichever thread gets there first.
+static void EnsureModels(void)
+{
+    if (DsAtomicLoad32(&g_models_state) == MODELS_READY) return;
+    if (DsAtomicCas32(&g_models_state, MODELS_UNINITIALIZED, MODELS_INITIALIZING)) {
+        DsModelInitDefaults(&g_builtin_model);
+        DsSnapshotInit(&g_models, &g_builtin_model, FreeModel, NULL);
+        DsAtomicStore32(&g_models_state, MODELS_READY);
+        return;
+    }
+    while (DsAtomicLoad32(&g_models_state) != MODELS_READY) DsCpuRelax();
+}
+
+// Typing state and statistics back to a fresh start; settings and the reader slot are kept.
+static void SessionReset(DsSession* s, const DsHost* host)
+{
+    s->host = *host;
+    ResetToken(s);
+    memset(&s->last_fix, 0, sizeof(s->last_fix));
+    s->swallow_keyup = false;
+    s->swallow_vk_keyup = 0;
+    memset(&s->cache_stats, 0, sizeof(s->cache_stats));
+    InvalidateCache(s);
+    s->cache_generation = 0;
+    DsLayoutMemoryInit(&s->layout_memory);
+    s->focus_window = 0;
+    memset(&s->layout_stats, 0, sizeof(s->layout_stats));
+    PhraseReset(s);
+    memset(&s->phrase_stats, 0, sizeof(s->phrase_stats));
+    s->neighbor_lang = DS_LANG_UNKNOWN;
+    s->deadline_ns = 0;
+    memset(&s->tier_stats, 0, sizeof(s->tier_stats));
+}
+
+static void* AllocSession(void)
+{
+    // Rounded up to the alignment, as aligned_alloc requires.
+    const size_t size = (sizeof(DsSession) + 63) & ~(size_t)63;
+#if defined(_MSC_VER)
+    return _aligned_malloc(size, 64);
+#else
+    return aligned_alloc(64, size);
+#endif
+}
+
+static void FreeSession(void* p)
+{
+#if defined(_MSC_VER)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+DsSession* DsSessionCreate(const DsHost* host)
+{
+    EnsureModels();
+    DsSession* s = (DsSession*)AllocSession();
+    if (!s) return NULL;
+    memset(s, 0, sizeof(*s));
+    s->model_slot = DsSnapshotRegisterReader(&g_models);
+    if (s->model_slot < 0) {
+        FreeSession(s);
+        return NULL;
+    }
+    s->phrase_correction = true;
+    s->short_words = true;
+    s->predictive_switching = true;
+    s->model = &g_builtin_model;
+    SessionReset(s, host);
+    return s;
+}
+
+void DsSessionDestroy(DsSession* s)
+{
+    if (!s) return;
+    DsSnapshotUnregisterReader(&g_models, s->model_slot);
+    FreeSession(s);
+}
+
+void DsSessionInvalidateCache(DsSession* s)
+{
+    InvalidateCache(s);
+}
+
+void DsSessionGetCacheStats(const DsSession* s, DsCacheStats* out)
+{
+    *out = s->cache_stats;
+}
+
+void DsSessionSetPhraseCorrection(DsSession* s, bool enabled)
+{
+    s->phrase_correction = enabled;
+    PhraseReset(s);
+}
+
+void DsSessionGetPhraseStats(const DsSession* s, DsPhraseStats* out)
+{
+    *out = s->phrase_stats;
+}
+
+void DsSessionSetDecisionBudget(DsSession* s, uint64_t budgetNs)
+{
+    s->budget_ns = budgetNs;
+}
+
+void DsSessionGetTierStats(const DsSession* s, DsTierStats* out)
+{
+    *out = s->tier_stats;
+}
+
+void DsSessionSetShortWords(DsSession* s, bool enabled)
+{
+    s->short_words = enabled;
+}
+
+void DsSessionSetPredictiveSwitching(DsSession* s, bool enabled)
+{
+    s->predictive_switching = enabled;
+}
+
+void DsSessionGetLayoutStats(const DsSession* s, DsLayoutStats* out)
+{
+    *out = s->layout_stats;
+}
+
+void DsSessionSetAdaptive(DsSession* s, DsAdaptSketch* sketch)
+{
+    s->adapt = sketch;
+    InvalidateCache(s);
+}
+
+void DsSessionFocusChanged(DsSession* s, uint64_t window, DsLang current)
+{
+    // The caret is somewhere else now: neither the token nor the last fix refer to it anymore.
+    ResetToken(s);
+    PhraseReset(s);
+    InvalidateLastFix(s);
+    s->neighbor_lang = DS_LANG_UNKNOWN;
+    s->focus_window = window;
+    s->layout_stats.focus_changes++;
+
+    const DsLang remembered = DsLayoutMemoryLookup(&s->layout_memory, window);
+    if (remembered == DS_LANG_UNKNOWN) return;
+    s->layout_stats.remembered++;
+    if (!s->predictive_switching || remembered == current) return;
+
+    s->layout_stats.predictive_switches++;
+    RequestLayoutSwitch(s, remembered == DS_LANG_EN);
+}
+
+DsKeyResult DsSessionKeyUp(DsSession* s, uint32_t vk)
+{
+    if (s->swallow_keyup && vk == s->swallow_vk_keyup) {
+        s->swallow_keyup = false;
+        s->swallow_vk_keyup = 0;
+        return DS_SWALLOW;
+    }
+    return DS_PASS;
+}
+
+static DsKeyResult HandleKeyDown(DsSession* s, DsKeyKind kind, wchar_t ch, uint32_t vk)
+{
+    switch (kind) {
+    case DS_KEY_PAUSE:
+        // Global hotkey: Pause to revert the last auto-correction (within a short window).
+        PhraseReset(s);
+        s->neighbor_lang = DS_LANG_UNKNOWN;
+        if (!ToggleLastFixIfPossible(s)) return DS_PASS;
+        // The application never saw the press, so it must not see the release either.
+        s->swallow_vk_keyup = vk;
+        s->swallow_keyup = true;
+        return DS_SWALLOW;
+
+    case DS_KEY_SHORTCUT:
+        // Ignore shortcuts/modifiers.
+        InvalidateLastFix(s);
+        PhraseReset(s);
+        s->neighbor_lang = DS_LANG_UNKNOWN;
+        return DS_PASS;
+
+    case DS_KEY_BACK:
+        InvalidateLastFix(s);
+        if (s->token_len > 0) {
+            s->token_len--;
+            s->token[s->token_len] = 0;
+            s->token_hash = TokenHash(s->token, s->token_len);
+        } else {
+            PhraseReset(s); // erased the boundary before the caret
+            s->neighbor_lang = DS_LANG_UNKNOWN;
+        }
+        return DS_PASS;
+
+    case DS_KEY_ESCAPE:
+        InvalidateLastFix(s);
+        ResetToken(s);
+        PhraseReset(s);
+        s->neighbor_lang = DS_LANG_UNKNOWN;
+        return DS_PASS;
+
+    case DS_KEY_TEXT:
+        if (DsIsWordChar(ch)) {
+            InvalidateLastFix(s);
+            if (s->token_len < DS_TOKEN_MAX_CHARS) {
+                s->token[s->token_len++] = ch;
+                s->token[s->token_len] = 0;
+                s->token_hash = TokenHashAppend(s->token_hash, ch);
+            }
+            return DS_PASS;
+        }
+        TokenDecision d = {false, false, PHRASE_NO_FIT, false};
+        if (s->token_len > 0) {
+            // If we correct on a printable boundary, swallow the boundary keystroke
+            // and re-inject it after correction to keep order stable.
+            if (TryCorrectAtBoundary(s, s->token, s->token_len, s->token_hash, ch, &d)) {
+                s->neighbor_lang = d.to_english ? DS_LANG_EN : DS_LANG_RU;
+                ResetToken(s);
+                PhraseReset(s);
+                s->swallow_vk_keyup = vk;
+                s->swallow_keyup = true;
+                return DS_SWALLOW;
+            }
+        }
+        ConfirmTypedLayout(s, s->token, s->token_len);
+        LearnKeptToken(s, s->token, s->token_len, &d);
+        InvalidateLastFix(s);
+        if (s->token_len > 0) s->neighbor_lang = TokenLang(s->token, s->token_len);
+        if (ch != L' ') {
+            PhraseReset(s);
+        } else if (s->token_len > 0) {
+            PhrasePush(s, s->token, s->token_len, &d, ch);
+        } else {
+            PhraseAppendBoundary(s, ch);
+        }
+        ResetToken(s);
+        return DS_PASS;
+
+    case DS_KEY_OTHER:
+    default: {
+        // Non-text key ends current token.
+        TokenDecision d;
+        if (!TryAutocorrectToken(s, s->token, s->token_len, s->token_hash, &d)) {
+            ConfirmTypedLayout(s, s->token, s->token_len);
+            LearnKeptToken(s, s->token, s->token_len, &d);
+        }
+        InvalidateLastFix(s);
+        ResetToken(s);
+        PhraseReset(s);
+        s->neighbor_lang = DS_LANG_UNKNOWN;
+        return DS_PASS;
+    }
+    }
+}
+
+// Pins the current model for one key event or text; sections on a session must not nest.
+static void SessionEnter(DsSession* s)
+{
+    s->model = (const DsModel*)DsSnapshotEnter(&g_models, s->model_slot);
+    if (s->model->generation != s->cache_generation) {
+        // Decisions cached under the previous model may not hold under this one.
+        InvalidateCache(s);
+        s->cache_generation = s->model->generation;
+    }
+}
+
+static void SessionLeave(DsSession* s)
+{
+    s->model = &g_builtin_model;
+    DsSnapshotLeave(&g_models, s->model_slot);
+}
+
+DsKeyResult DsSessionKeyDown(DsSession* s, DsKeyKind kind, wchar_t ch, uint32_t vk)
+{
+    SessionEnter(s);
+    s->deadline_ns = s->budget_ns ? NowNs(s) + s->budget_ns : 0;
+    const DsKeyResult result = HandleKeyDown(s, kind, ch, vk);
+    s->deadline_ns = 0;
+    // A swallowed key held down repeats into the application, which then needs its release.
+    if (result == DS_PASS && s->swallow_keyup && vk == s->swallow_vk_keyup) {
+        s->swallow_keyup = false;
+        s->swallow_vk_keyup = 0;
+    }
+    SessionLeave(s);
+    return result;
+}
+
+bool DsSessionCheckToken(DsSession* s, const wchar_t* token, size_t n, DsTokenVerdict* out)
+{
+    memset(out, 0, sizeof(*out));
+    if (n < 3 || n > DS_TOKEN_MAX_CHARS) return false;
+    wchar_t typed[DS_TOKEN_MAX_CHARS + 1];
+    wmemcpy(typed, token, n);
+    typed[n] = 0;
+
+    TokenScore ts;
+    SessionEnter(s);
+    out->scored = ScoreToken(s->model, s->adapt, typed, n, out->corrected, DS_ARRAYSIZE(out->corrected), NULL, &ts);
+    if (out->scored) {
+        out->margin = TokenMargin(&s->model->thresholds, n, &ts);
+        out->fix = out->margin >= 0;
+        out->to_english = ts.to_english;
+    }
+    SessionLeave(s);
+    return out->scored;
+}
+
+bool DsSessionFixToken(DsSession* s, const wchar_t* token, size_t n, wchar_t* out)
+{
+    if (n < 3 || n > DS_TOKEN_MAX_CHARS) return false;
+    wchar_t typed[DS_TOKEN_MAX_CHARS + 1];
+    wmemcpy(typed, token, n);
+    typed[n] = 0;
+
+    TokenDecision d;
+    SessionEnter(s);
+    EvaluateToken(s, typed, n, TokenHash(typed, n), out, n + 1, &d);
+    SessionLeave(s);
+    return d.fix;
+}
+
+// ---------- Text correction ----------
+// The text is typed into the session key by key, and whatever the engine would inject is applied
+// to an output buffer standing in for the text field.
+
+typedef struct {
+    const DsHost* host; // the session's own host, for the clock and the log
+    wchar_t* out;
+    size_t cap;
+    size_t len;
+    size_t corrections;
+} TextField;
+
+static uint64_t TextFieldClock(void* ctx)
+{
+    const DsHost* host = ((TextField*)ctx)->host;
+    return host->clock_ns ? host->clock_ns(host->ctx) : 0;
+}
+
+static void TextFieldLog(void* ctx, const wchar_t* msg)
+{
+    const DsHost* host = ((TextField*)ctx)->host;
+    if (host->log) host->log(host->ctx, msg);
+}
+
+static void TextFieldAppend(TextField* f, wchar_t ch)
+{
+    if (f->len + 1 < f->cap) f->out[f->len] = ch;
+    f->len++;
+}
+
+static void TextFieldSend(void* ctx, size_t backspaces, const wchar_t* text)
+{
+    TextField* f = (TextField*)ctx;
+    f->len = backspaces < f->len ? f->len - backspaces : 0;
+    for (const wchar_t* p = text; *p; p++) TextFieldAppend(f, *p);
+    f->corrections++;
+}
+
+size_t DsSessionCorrectText(DsSession* s, const wchar_t* text, size_t n, wchar_t* out, size_t outCap)
+{
+    // Whatever the session was in the middle of is put back afterwards.
+    const DsHost host = s->host;
+    wchar_t token[DS_TOKEN_MAX_CHARS + 1];
+    wmemcpy(token, s->token, DS_ARRAYSIZE(token));
+    const size_t tokenLen = s->token_len;
+    const uint64_t tokenHash = s->token_hash;
+    const PhraseWindow phrase = s->phrase;
+    const LastFix lastFix = s->last_fix;
+    const uint64_t focusWindow = s->focus_window;
+    const DsLang neighborLang = s->neighbor_lang;
+    const bool swallowKeyup = s->swallow_keyup;
+    const uint32_t swallowVk = s->swallow_vk_keyup;
+
+    TextField field = {&host, out, outCap, 0, 0};
+    s->host.ctx = &field;
+    s->host.clock_ns = TextFieldClock;
+    s->host.switch_layout = NULL;
+    s->host.send_text = TextFieldSend;
+    s->host.log = host.log ? TextFieldLog : NULL;
+    s->focus_window = 0; // not a window: remember no layout for it
+    ResetToken(s);
+    PhraseReset(s);
+    InvalidateLastFix(s);
+    s->neighbor_lang = DS_LANG_UNKNOWN;
+
+    SessionEnter(s);
+    // A trailing space ends the last token like any other boundary; it is dropped again below.
+    for (size_t i = 0; i <= n; i++) {
+        const wchar_t ch = i < n ? text[i] : L' ';
+        if ((uint32_t)ch < 0x20) {
+            // Line breaks and tabs end the token without joining a phrase, like Enter and Tab.
+            HandleKeyDown(s, DS_KEY_OTHER, 0, 0);
+            TextFieldAppend(&field, ch);
+        } else if (HandleKeyDown(s, DS_KEY_TEXT, ch, 0) == DS_PASS) {
+            TextFieldAppend(&field, ch);
+        }
+    }
+    SessionLeave(s);
+
+    const size_t len = field.len - 1;
+    if (outCap) out[len < outCap ? len : outCap - 1] = 0;
+
+    s->host = host;
+    wmemcpy(s->token, token, DS_ARRAYSIZE(token));
+    s->token_len = tokenLen;
+    s->token_hash = tokenHash;
+    s->phrase = phrase;
+    s->last_fix = lastFix;
+    s->focus_window = focusWindow;
+    s->neighbor_lang = neighborLang;
+    s->swallow_keyup = swallowKeyup;
+    s->swallow_vk_keyup = swallowVk;
+    return field.corrections;
+}
+
+// ---------- Default session ----------
+
+void DsEngineInit(const DsHost* host)
+{
+    EnsureModels(); // a published model survives re-initialization
+    if (g_default_session.model_slot < 0) g_default_session.model_slot = DsSnapshotRegisterReader(&g_models);
+    SessionReset(&g_default_session, host);
+}
+
+void DsEngineShutdown(void)
+{
+    if (DsAtomicLoad32(&g_models_state) != MODELS_READY) return;
+    if (g_default_session.model_slot >= 0) DsSnapshotUnregisterReader(&g_models, g_default_session.model_slot);
+    DsSnapshotDestroy(&g_models);
+    g_default_session.model_slot = -1;
+    g_default_session.model = &g_builtin_model;
+    DsAtomicStore32(&g_models_state, MODELS_UNINITIALIZED);
+}
+
+DsModel* DsEngineCloneModel(void)
+{
+    EnsureModels();
+    const int slot = DsSnapshotRegisterReader(&g_models);
+    if (slot < 0) return NULL;
+    DsModel* copy = DsModelClone((const DsModel*)DsSnapshotEnter(&g_models, slot));
+    DsSnapshotLeave(&g_models, slot);
+    DsSnapshotUnregisterReader(&g_models, slot);
+    return copy;
+}
+
+void DsEnginePublishModel(DsModel* model)
+{
+    EnsureModels();
+    uint32_t generation = (uint32_t)(DsAtomicFetchAdd64(&g_model_generation, 1) + 1);
+    if (!generation) generation = (uint32_t)(DsAtomicFetchAdd64(&g_model_generation, 1) + 1); // 0 is the built-in model
+    model->generation = generation;
+    DsSnapshotPublish(&g_models, model);
+}
+
+size_t DsEngineReclaimModels(void)
+{
+    return DsAtomicLoad32(&g_models_state) == MODELS_READY ? DsSnapshotReclaim(&g_models) : 0;
+}
+
+void DsEngineGetModelStats(DsModelStats* out)
+{
+    EnsureModels();
+    DsSnapshotStats s;
+    DsSnapshotGetStats(&g_models, &s);
+    out->generation = (uint32_t)DsAtomicLoad64(&g_model_generation);
+    out->published = s.published;
+    out->reclaimed = s.reclaimed;
+    out->pending = s.pending;
+}
+
+void DsEngineSetMorphology(const DsMorph* morph)
+{
+    DsModel* model = DsEngineCloneModel();
+    if (!model) return;
+    model->morph = morph;
+    DsEnginePublishModel(model);
+}
+
+void DsEngineInvalidateCache(void)
+{
+    InvalidateCache(&g_default_session);
+}
+
+void DsEngineGetCacheStats(DsCacheStats* out)
+{
+    DsSessionGetCacheStats(&g_default_session, out);
+}
+
+void DsEngineSetPhraseCorrection(bool enabled)
+{
+    DsSessionSetPhraseCorrection(&g_default_session, enabled);
+}
+
+void DsEngineSetDecisionBudget(uint64_t budgetNs)
+{
+    DsSessionSetDecisionBudget(&g_default_session, budgetNs);
+}
+
+void DsEngineGetTierStats(DsTierStats* out)
+{
+    DsSessionGetTierStats(&g_default_session, out);
+}
+
+void DsEngineSetShortWords(bool enabled)
+{
+    DsSessionSetShortWords(&g_default_session, enabled);
+}
+
+void DsEngineGetPhraseStats(DsPhraseStats* out)
+{
+    DsSessionGetPhraseStats(&g_default_session, out);
+}
+
+void DsEngineSetPredictiveSwitching(bool enabled)
+{
+    DsSessionSetPredictiveSwitching(&g_default_session, enabled);
+}
+
+void DsEngineSetAdaptive(DsAdaptSketch* sketch)
+{
+    DsSessionSetAdaptive(&g_default_session, sketch);
+}
+
+void DsEngineGetLayoutStats(DsLayoutStats* out)
+{
+    DsSessionGetLayoutStats(&g_default_session, out);
+}
+
+void DsEngineFocusChanged(uint64_t window, DsLang current)
+{
+    DsSessionFocusChanged(&g_default_session, window, current);
+}
+
+DsKeyResult DsEngineKeyUp(uint32_t vk)
+{
+    return DsSessionKeyUp(&g_default_session, vk);
+}
+
+DsKeyResult DsEngineKeyDown(DsKeyKind kind, wchar_t ch, uint32_t vk)
+{
+    EnsureModels();
+    if (g_default_session.model_slot < 0) g_default_session.model_slot = DsSnapshotRegisterReader(&g_models);
+    return DsSessionKeyDown(&g_default_session, kind, ch, vk);
+}
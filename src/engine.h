@@ -0,0 +1,220 @@
+#ifndef DISWITCHER_ENGINE_H
+#define DISWITCHER_ENGINE_H
+
+// Platform-neutral wrong-layout autocorrect engine (EN/RU).
+// The Windows hook (main.c) and the Linux tools (tools/) both drive it through DsHost,
+// so everything in here must stay free of Win32 calls.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#include "adapt.h"
+#include "layoutmem.h"
+#include "model.h"
+#include "morph.h"
+
+#define DS_TOKEN_MAX_CHARS 64
+
+// Phrase correction retypes at most this many tokens / characters (spaces included) in one batch.
+#define DS_PHRASE_MAX_TOKENS 4
+#define DS_PHRASE_MAX_CHARS 96
+
+typedef struct DsHost {
+    void* ctx;
+    // Monotonic clock in nanoseconds.
+    uint64_t (*clock_ns)(void* ctx);
+    // Ask the focused window to switch to the EN (toEnglish) or RU layout.
+    void (*switch_layout)(void* ctx, bool toEnglish);
+    // Erase `backspaces` characters before the caret and type `text`; both are at most
+    // DS_PHRASE_MAX_CHARS + 1 and must be delivered as one batch.
+    void (*send_text)(void* ctx, size_t backspaces, const wchar_t* text);
+    // Optional diagnostics sink; NULL disables message formatting entirely.
+    void (*log)(void* ctx, const wchar_t* msg);
+} DsHost;
+
+typedef enum {
+    DS_KEY_TEXT,     // key produced exactly one character in the current layout
+    DS_KEY_BACK,
+    DS_KEY_ESCAPE,
+    DS_KEY_PAUSE,
+    DS_KEY_SHORTCUT, // Ctrl/Alt chord
+    DS_KEY_OTHER,    // any other non-text key (arrows, modifiers, F-keys, ...)
+} DsKeyKind;
+
+typedef enum {
+    DS_PASS = 0,    // let the key through
+    DS_SWALLOW = 1, // the engine consumed the key
+} DsKeyResult;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t hit_ns;  // time spent deciding on cache hits
+    uint64_t miss_ns; // time spent deciding on misses (scoring + store)
+} DsCacheStats;
+
+typedef struct {
+    uint64_t focus_changes;
+    uint64_t remembered;           // focus changes into a window with a remembered layout
+    uint64_t predictive_switches;  // remembered layout differed from the current one
+} DsLayoutStats;
+
+typedef struct {
+    uint64_t phrases;       // corrections that retyped several tokens in one batch
+    uint64_t phrase_tokens; // tokens retyped by those, including the one that triggered it
+    uint64_t short_tokens;  // of those, one- and two-letter tokens
+} DsPhraseStats;
+
+typedef struct {
+    uint32_t generation; // of the last published model; 0 = built-in
+    uint64_t published;
+    uint64_t reclaimed;  // replaced models freed so far
+    uint64_t pending;    // replaced models the hook may still be using
+} DsModelStats;
+
+// Decision tiers, cheapest first. The cheap tier decides every token; the others only add to its
+// scores and are skipped once the key event's deadline has passed (DsSessionSetDecisionBudget).
+typedef enum {
+    DS_TIER_CHEAP, // decision cache, exceptions, bigram tables, short words
+    DS_TIER_ADAPT, // adaptive trigram bonus (src/adapt.h)
+    DS_TIER_MORPH, // word-form lookups (src/morph.h), possibly in pages not touched for a while
+    DS_TIER_COUNT,
+} DsTier;
+
+typedef struct {
+    uint64_t hits[DS_TIER_COUNT];     // tokens the tier ran for
+    uint64_t timeouts[DS_TIER_COUNT]; // tokens it was skipped for because the deadline had passed
+    uint64_t settled; // decided without a skipped tier, which could not have changed the outcome
+    uint64_t dropped; // could have: left as typed, not cached and not learned
+} DsTierStats;
+
+// ---------- Sessions ----------
+// A session follows one stream of keys: the token being typed, Pause-to-revert, the phrase window,
+// per-window layout memory, its own decision cache and statistics. Sessions share nothing but the
+// published model (read-only, see DsEnginePublishModel), so any number of them may run at once,
+// each on one thread at a time, without locks. The DsEngine* key functions below drive a built-in
+// default session for hosts that only need one.
+
+typedef struct DsSession DsSession;
+
+// NULL when out of memory or when DS_SNAPSHOT_MAX_READERS sessions already exist. The session
+// starts with phrase correction and predictive switching enabled. About 140 KB each.
+DsSession* DsSessionCreate(const DsHost* host);
+void DsSessionDestroy(DsSession* s);
+
+DsKeyResult DsSessionKeyDown(DsSession* s, DsKeyKind kind, wchar_t ch, uint32_t vk);
+DsKeyResult DsSessionKeyUp(DsSession* s, uint32_t vk);
+void DsSessionFocusChanged(DsSession* s, uint64_t window, DsLang current);
+
+void DsSessionSetPredictiveSwitching(DsSession* s, bool enabled);
+void DsSessionSetPhraseCorrection(DsSession* s, bool enabled);
+void DsSessionSetShortWords(DsSession* s, bool enabled);
+void DsSessionSetAdaptive(DsSession* s, DsAdaptSketch* sketch);
+void DsSessionInvalidateCache(DsSession* s);
+void DsSessionGetCacheStats(const DsSession* s, DsCacheStats* out);
+void DsSessionGetLayoutStats(const DsSession* s, DsLayoutStats* out);
+void DsSessionGetPhraseStats(const DsSession* s, DsPhraseStats* out);
+
+// Time a key event may spend deciding a token, measured with the host clock from the start of
+// DsSessionKeyDown; 0 (the default) is unbounded. A tier already running is never interrupted:
+// the deadline keeps later tiers from starting. When a skipped tier could have tipped the decision
+// either way, the token is left alone rather than decided on partial scores.
+void DsSessionSetDecisionBudget(DsSession* s, uint64_t budgetNs);
+void DsSessionGetTierStats(const DsSession* s, DsTierStats* out);
+
+typedef struct {
+    bool scored;     // a plain run of EN or RU letters the scorer judged
+    bool fix;        // typing it would correct it on its own (margin >= 0)
+    bool to_english; // mapping direction
+    int margin;      // how far the weaker of the two single-token thresholds is cleared (< 0: missed)
+    wchar_t corrected[DS_TOKEN_MAX_CHARS + 1]; // the token in the other layout, if scored
+} DsTokenVerdict;
+
+// Runs the single-token decision on `token` (3..DS_TOKEN_MAX_CHARS characters) without typing it:
+// nothing is injected and the session's state is untouched. False if the token was not scored.
+bool DsSessionCheckToken(DsSession* s, const wchar_t* token, size_t n, DsTokenVerdict* out);
+
+// The same decision through the session's decision cache, as typing makes it: true if `token`
+// (3..DS_TOKEN_MAX_CHARS characters) would be corrected on its own, with its other-layout form in
+// `out` (n + 1 characters). For bulk text with repeated words; there is no margin.
+bool DsSessionFixToken(DsSession* s, const wchar_t* token, size_t n, wchar_t* out);
+
+// Corrects finished text (a search query, a chat line) as if it had been typed into an empty field
+// through this session: each wrong-layout word or phrase is replaced by what the engine would have
+// injected. Writes the result to `out`, NUL-terminated and truncated to `outCap` - 1 characters,
+// and returns the number of corrections. Control characters end a token like Enter. The session's
+// typing state is left as it was; its decision cache and statistics are shared with typing.
+size_t DsSessionCorrectText(DsSession* s, const wchar_t* text, size_t n, wchar_t* out, size_t outCap);
+
+// ---------- Default session ----------
+
+void DsEngineInit(const DsHost* host);
+// Frees every published model. Only once no thread uses the engine anymore and every session
+// created with DsSessionCreate is destroyed.
+void DsEngineShutdown(void);
+
+DsKeyResult DsEngineKeyDown(DsKeyKind kind, wchar_t ch, uint32_t vk);
+DsKeyResult DsEngineKeyUp(uint32_t vk);
+
+// Focus moved to `window` (host-specific id, 0 if none) whose current layout is `current`.
+// Ends the token in progress and, if enabled, switches to the layout last confirmed there.
+void DsEngineFocusChanged(uint64_t window, DsLang current);
+void DsEngineSetPredictiveSwitching(bool enabled);
+void DsEngineGetLayoutStats(DsLayoutStats* out);
+
+// Retroactive phrase correction: when evidence builds up that the last few space-separated tokens
+// were all typed in the wrong layout, they are corrected together (short words included) with a
+// single delete-and-retype. Enabled by default.
+void DsEngineSetPhraseCorrection(bool enabled);
+void DsEngineGetPhraseStats(DsPhraseStats* out);
+
+// One- and two-letter tokens ("z" for "я", "yt" for "не") are corrected on their own when they are
+// not a word as typed, are one on the other layout (DsShortWordClass) and the word right before
+// them is in that other language. Enabled by default.
+void DsEngineSetShortWords(bool enabled);
+
+// Adaptive scoring (src/adapt.h): tokens the user keeps as typed, or restores with Pause, are
+// learned into `sketch`, and scores lean towards the letter sequences learned for each language
+// by up to the model's adapt_bonus. The sketch must outlive its use; NULL (the default) disables
+// both learning and the bonus.
+void DsEngineSetAdaptive(DsAdaptSketch* sketch);
+
+// Engine data (src/model.h). The model in use is immutable: take a copy, change it and publish it.
+// Publishing is safe from any thread while keys are being processed; the next key event of each
+// session picks the new model up and the replaced one is freed once no key event can still be
+// using it.
+// DsEngineCloneModel returns NULL on allocation failure; DsEnginePublishModel takes ownership.
+DsModel* DsEngineCloneModel(void);
+void DsEnginePublishModel(DsModel* model);
+// Frees replaced models that are no longer in use; returns how many are still pending. Publishing
+// does this too, a reloader only needs it to release the last replaced model promptly.
+size_t DsEngineReclaimModels(void);
+void DsEngineGetModelStats(DsModelStats* out);
+
+// Optional Russian word-form model (src/morph.h). Tokens that are valid forms keep their layout,
+// and wrong-layout tokens whose RU mapping is a valid form are corrected even when the bigram
+// scorer alone is unsure. Shorthand for publishing a copy of the current model with `morph` set;
+// the word-form model must outlive the engine. NULL disables the check.
+void DsEngineSetMorphology(const DsMorph* morph);
+
+// Per-key decision budget of the default session, see DsSessionSetDecisionBudget.
+void DsEngineSetDecisionBudget(uint64_t budgetNs);
+void DsEngineGetTierStats(DsTierStats* out);
+
+// Drops the default session's decision cache. Publishing a model does this on the next key event.
+void DsEngineInvalidateCache(void);
+void DsEngineGetCacheStats(DsCacheStats* out);
+
+// Case folding/classification used by the engine; exposed so tools agree with it exactly.
+bool DsIsLatinLetter(wchar_t ch);
+bool DsIsCyrillicLetter(wchar_t ch);
+bool DsIsWordChar(wchar_t ch);
+wchar_t DsToLower(wchar_t ch);
+wchar_t DsToUpper(wchar_t ch);
+
+void DsMapRuToEn(const wchar_t* in, wchar_t* out, size_t outCap);
+void DsMapEnToRu(const wchar_t* in, wchar_t* out, size_t outCap);
+
+#endif
@@ -0,0 +1,157 @@
+#include "keytrace.h"
+
+#include <string.h>
+
+#define DS_TRACE_MAX_STEP_BACK_MS 1000u
+
+static size_t PutVarint(uint8_t* p, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static bool GetVarint(DsTraceReader* r, uint64_t* out)
+{
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (r->pos >= r->size) return false;
+        const uint8_t b = r->data[r->pos++];
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *out = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+void DsTraceWriterInit(DsTraceWriter* w, uint8_t* buf, size_t cap,
+                       bool (*flush)(void* ctx, const uint8_t* data, size_t len), void* ctx)
+{
+    memset(w, 0, sizeof(*w));
+    w->buf = buf;
+    w->cap = cap;
+    w->flush = flush;
+    w->ctx = ctx;
+}
+
+bool DsTraceWriterFlush(DsTraceWriter* w)
+{
+    if (w->len && !w->failed) {
+        if (!w->flush || !w->flush(w->ctx, w->buf, w->len)) w->failed = true;
+    }
+    w->len = 0;
+    return !w->failed;
+}
+
+static uint8_t* Reserve(DsTraceWriter* w, size_t n)
+{
+    if (w->len + n > w->cap) DsTraceWriterFlush(w);
+    if (w->failed || n > w->cap) return NULL;
+    return w->buf + w->len;
+}
+
+void DsTraceWriteHeader(DsTraceWriter* w, uint64_t startUnixMs)
+{
+    uint8_t* p = Reserve(w, DS_TRACE_HEADER_SIZE);
+    if (!p) return;
+    memcpy(p, DS_TRACE_MAGIC, 4);
+    p[4] = DS_TRACE_VERSION;
+    p[5] = p[6] = p[7] = 0;
+    for (int i = 0; i < 8; i++) p[8 + i] = (uint8_t)(startUnixMs >> (8 * i));
+    w->len += DS_TRACE_HEADER_SIZE;
+}
+
+static size_t PutTagAndDelta(DsTraceWriter* w, uint8_t* p, uint8_t tag, uint64_t timeMs)
+{
+    // KBDLLHOOKSTRUCT.time is a 32-bit tick count that wraps every 49.7 days, so deltas are taken
+    // modulo 2^32: across the wrap they stay small and positive. Threads can also stamp events a few
+    // milliseconds out of order; such a step back is stored as 0 rather than as a 49-day jump, and
+    // the next delta is still taken from the later time so the reader's clock does not run ahead.
+    const uint32_t delta = w->have_last ? (uint32_t)(timeMs - w->last_ms) : 0;
+    const bool stepBack = delta > UINT32_MAX - DS_TRACE_MAX_STEP_BACK_MS;
+    if (!stepBack) w->last_ms = timeMs;
+    w->have_last = true;
+    p[0] = tag;
+    return 1 + PutVarint(p + 1, stepBack ? 0 : delta);
+}
+
+void DsTraceWriteKey(DsTraceWriter* w, uint64_t timeMs, bool down, uint32_t vk, uint32_t scan, uint8_t flags)
+{
+    uint8_t* p = Reserve(w, DS_TRACE_MAX_RECORD);
+    if (!p) return;
+    const uint8_t tag = (uint8_t)((down ? DS_TRACE_KEYDOWN : DS_TRACE_KEYUP) | (flags & 0xF8));
+    size_t n = PutTagAndDelta(w, p, tag, timeMs);
+    p[n++] = (uint8_t)vk;
+    n += PutVarint(p + n, scan);
+    w->len += n;
+}
+
+void DsTraceWriteLayout(DsTraceWriter* w, uint64_t timeMs, uint32_t layoutId, bool byEngine)
+{
+    uint8_t* p = Reserve(w, DS_TRACE_MAX_RECORD);
+    if (!p) return;
+    const uint8_t tag = (uint8_t)(DS_TRACE_LAYOUT | (byEngine ? DS_TRACE_F_ENGINE : 0));
+    size_t n = PutTagAndDelta(w, p, tag, timeMs);
+    n += PutVarint(p + n, layoutId);
+    w->len += n;
+}
+
+void DsTraceWriteFocus(DsTraceWriter* w, uint64_t timeMs, uint32_t windowId)
+{
+    uint8_t* p = Reserve(w, DS_TRACE_MAX_RECORD);
+    if (!p) return;
+    size_t n = PutTagAndDelta(w, p, DS_TRACE_FOCUS, timeMs);
+    n += PutVarint(p + n, windowId);
+    w->len += n;
+}
+
+bool DsTraceReaderInit(DsTraceReader* r, const uint8_t* data, size_t size)
+{
+    memset(r, 0, sizeof(*r));
+    if (size < DS_TRACE_HEADER_SIZE) return false;
+    if (memcmp(data, DS_TRACE_MAGIC, 4) != 0) return false;
+    if (data[4] != DS_TRACE_VERSION) return false;
+    for (int i = 0; i < 8; i++) r->start_unix_ms |= (uint64_t)data[8 + i] << (8 * i);
+    r->data = data;
+    r->size = size;
+    r->pos = DS_TRACE_HEADER_SIZE;
+    return true;
+}
+
+int DsTraceReadNext(DsTraceReader* r, DsTraceEvent* ev)
+{
+    if (r->pos >= r->size) return 0;
+
+    memset(ev, 0, sizeof(*ev));
+    const uint8_t tag = r->data[r->pos++];
+    uint64_t delta = 0, v = 0;
+    if (!GetVarint(r, &delta)) return -1;
+    r->time_ms += delta;
+
+    ev->type = (DsTraceType)(tag & 0x07);
+    ev->flags = (uint8_t)(tag & 0xF8);
+    ev->time_ms = r->time_ms;
+
+    switch (ev->type) {
+    case DS_TRACE_KEYDOWN:
+    case DS_TRACE_KEYUP:
+        if (r->pos >= r->size) return -1;
+        ev->vk = r->data[r->pos++];
+        if (!GetVarint(r, &v)) return -1;
+        ev->scan = (uint32_t)v;
+        return 1;
+    case DS_TRACE_LAYOUT:
+    case DS_TRACE_FOCUS:
+        if (!GetVarint(r, &v)) return -1;
+        ev->value = (uint32_t)v;
+        return 1;
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef DISWITCHER_KEYTRACE_H
+#define DISWITCHER_KEYTRACE_H
+
+// Compact binary keystroke capture (".dskt").
+//
+// File layout (little-endian):
+//   header: "DSKT" | u8 version | u8 reserved[3] | u64 start time (Unix ms)
+//   records: u8 tag | varint delta_ms | payload
+//
+// tag bits 0-2 hold the record type, bits 3-7 are type-specific flags:
+//   KEYDOWN/KEYUP  payload: u8 vk | varint scan; flags: EXTENDED, ALTDOWN, INJECTED
+//   LAYOUT         payload: varint layout id (low 32 bits of the HKL); flags: ENGINE
+//   FOCUS          payload: varint window id (small per-capture id, 0 = no window)
+// A typical keystroke costs 4 bytes.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DS_TRACE_MAGIC "DSKT"
+#define DS_TRACE_VERSION 1
+#define DS_TRACE_HEADER_SIZE 16
+#define DS_TRACE_MAX_RECORD 16
+
+typedef enum {
+    DS_TRACE_KEYDOWN = 0,
+    DS_TRACE_KEYUP = 1,
+    DS_TRACE_LAYOUT = 2,
+    DS_TRACE_FOCUS = 3,
+} DsTraceType;
+
+enum {
+    DS_TRACE_F_EXTENDED = 0x08,
+    DS_TRACE_F_ALTDOWN = 0x10,
+    DS_TRACE_F_INJECTED = 0x20,
+    DS_TRACE_F_ENGINE = 0x08, // LAYOUT: switch was requested by the engine, not the user
+};
+
+typedef struct {
+    DsTraceType type;
+    uint8_t flags;    // DS_TRACE_F_* bits as stored in the tag
+    uint64_t time_ms; // milliseconds since the start of the capture
+    uint32_t vk;
+    uint32_t scan;
+    uint32_t value;   // layout id or window id
+} DsTraceEvent;
+
+// Writer: encodes into a caller-owned buffer; `flush` is called whenever it fills up.
+typedef struct {
+    uint8_t* buf;
+    size_t cap;
+    size_t len;
+    uint64_t last_ms;
+    bool have_last;
+    void* ctx;
+    bool (*flush)(void* ctx, const uint8_t* data, size_t len);
+    bool failed;
+} DsTraceWriter;
+
+void DsTraceWriterInit(DsTraceWriter* w, uint8_t* buf, size_t cap,
+                       bool (*flush)(void* ctx, const uint8_t* data, size_t len), void* ctx);
+void DsTraceWriteHeader(DsTraceWriter* w, uint64_t startUnixMs);
+// `time_ms` is any monotonic millisecond clock (e.g. KBDLLHOOKSTRUCT.time); only deltas are stored,
+// modulo 2^32, so a 32-bit tick count may wrap within a capture.
+void DsTraceWriteKey(DsTraceWriter* w, uint64_t timeMs, bool down, uint32_t vk, uint32_t scan, uint8_t flags);
+void DsTraceWriteLayout(DsTraceWriter* w, uint64_t timeMs, uint32_t layoutId, bool byEngine);
+void DsTraceWriteFocus(DsTraceWriter* w, uint64_t timeMs, uint32_t windowId);
+bool DsTraceWriterFlush(DsTraceWriter* w);
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+    uint64_t time_ms;
+    uint64_t start_unix_ms;
+} DsTraceReader;
+
+// Returns false if the header is missing or has an unsupported version.
+bool DsTraceReaderInit(DsTraceReader* r, const uint8_t* data, size_t size);
+// Returns 1 for an event, 0 at end of data, -1 on a truncated/corrupt record.
+int DsTraceReadNext(DsTraceReader* r, DsTraceEvent* ev);
+
+#endif
@@ -0,0 +1,65 @@
+#include "layoutmem.h"
+
+#include <string.h>
+
+static uint32_t SetIndex(uint64_t window)
+{
+    // Window handles are pointer-like and share low bits; mix before picking a set.
+    uint64_t h = window * 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(h >> 58) % DS_LAYOUT_MEMORY_SETS;
+}
+
+void DsLayoutMemoryInit(DsLayoutMemory* m)
+{
+    memset(m, 0, sizeof(*m));
+}
+
+static uint32_t Tick(DsLayoutMemory* m)
+{
+    if (++m->clock == 0) {
+        // Wrapped after 4G confirmations: forget everything rather than renormalize.
+        memset(m->sets, 0, sizeof(m->sets));
+        m->clock = 1;
+    }
+    return m->clock;
+}
+
+void DsLayoutMemoryConfirm(DsLayoutMemory* m, uint64_t window, DsLang lang)
+{
+    if (!window || lang == DS_LANG_UNKNOWN) return;
+    DsLayoutMemoryEntry* set = m->sets[SetIndex(window)];
+    DsLayoutMemoryEntry* victim = &set[0];
+    for (int w = 0; w < DS_LAYOUT_MEMORY_WAYS; w++) {
+        if (set[w].stamp && set[w].window == window) {
+            victim = &set[w];
+            break;
+        }
+        if (!set[w].stamp) {
+            victim = &set[w];
+            continue;
+        }
+        if (victim->stamp && set[w].stamp < victim->stamp) victim = &set[w];
+    }
+    const uint32_t stamp = Tick(m);
+    victim->window = window;
+    victim->lang = lang;
+    victim->stamp = stamp;
+}
+
+DsLang DsLayoutMemoryLookup(const DsLayoutMemory* m, uint64_t window)
+{
+    if (!window) return DS_LANG_UNKNOWN;
+    const DsLayoutMemoryEntry* set = m->sets[SetIndex(window)];
+    for (int w = 0; w < DS_LAYOUT_MEMORY_WAYS; w++) {
+        if (set[w].stamp && set[w].window == window) return (DsLang)set[w].lang;
+    }
+    return DS_LANG_UNKNOWN;
+}
+
+void DsLayoutMemoryForget(DsLayoutMemory* m, uint64_t window)
+{
+    DsLayoutMemoryEntry* set = m->sets[SetIndex(window)];
+    for (int w = 0; w < DS_LAYOUT_MEMORY_WAYS; w++) {
+        if (set[w].stamp && set[w].window == window) memset(&set[w], 0, sizeof(set[w]));
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef DISWITCHER_LAYOUTMEM_H
+#define DISWITCHER_LAYOUTMEM_H
+
+// Bounded window -> layout memory: the layout last confirmed by typing in each window.
+// 4-way set associative with LRU eviction inside a set, same shape as the decision cache.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DS_LAYOUT_MEMORY_WAYS 4
+#define DS_LAYOUT_MEMORY_SETS 64 // 256 windows, 4 KB
+
+typedef enum {
+    DS_LANG_UNKNOWN = -1,
+    DS_LANG_RU = 0,
+    DS_LANG_EN = 1,
+} DsLang;
+
+typedef struct {
+    uint64_t window; // host window id; 0 is never stored
+    uint32_t stamp;  // LRU clock; 0 = empty slot
+    int32_t lang;    // DsLang
+} DsLayoutMemoryEntry;
+
+typedef struct {
+    DsLayoutMemoryEntry sets[DS_LAYOUT_MEMORY_SETS][DS_LAYOUT_MEMORY_WAYS];
+    uint32_t clock;
+} DsLayoutMemory;
+
+void DsLayoutMemoryInit(DsLayoutMemory* m);
+void DsLayoutMemoryConfirm(DsLayoutMemory* m, uint64_t window, DsLang lang);
+DsLang DsLayoutMemoryLookup(const DsLayoutMemory* m, uint64_t window);
+void DsLayoutMemoryForget(DsLayoutMemory* m, uint64_t window);
+
+#endif
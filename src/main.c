@@ -1,9 +1,13 @@
 #include <windows.h>
 #include <shellapi.h>
 #include <strsafe.h>
-#include <wctype.h>
 #include <string.h>
 
+#include "config.h"
+#include "engine.h"
+#include "keytrace.h"
+#include "typeahead.h"
+
 enum {
     WM_TRAYICON = WM_USER + 1,
     IDM_TRAY_EXIT = 1001,
@@ -17,248 +21,7 @@ static HICON g_app_icon_big = NULL;
 static HANDLE g_single_instance_mutex = NULL;
 
 // ---------- Wrong-layout autocorrect (EN/RU) ----------
-
-#define TOKEN_MAX_CHARS 64
-
-static wchar_t g_token[TOKEN_MAX_CHARS + 1];
-static size_t g_token_len = 0;
-static DWORD g_swallow_vk_keyup = 0;
-static BOOL g_swallow_keyup = FALSE;
-
-typedef struct {
-    BOOL active;
-    ULONGLONG ts_ms;
-    wchar_t original[TOKEN_MAX_CHARS + 1];
-    wchar_t corrected[TOKEN_MAX_CHARS + 1];
-    size_t original_len;
-    size_t corrected_len;
-    wchar_t boundary;
-    BOOL had_boundary;
-    BOOL corrected_to_english; // TRUE if we mapped RU->EN
-    BOOL corrected_applied;    // TRUE if current text is corrected+boundary
-} LastFix;
-
-static LastFix g_last_fix = {0};
-
-static BOOL IsLatinLetter(wchar_t ch)
-{
-    return (ch >= L'A' && ch <= L'Z') || (ch >= L'a' && ch <= L'z');
-}
-
-static BOOL IsCyrillicLetter(wchar_t ch)
-{
-    return (ch >= 0x0400 && ch <= 0x04FF) || (ch >= 0x0500 && ch <= 0x052F);
-}
-
-static BOOL IsWordChar(wchar_t ch)
-{
-    // Word basis: only letters/digits. Hyphens/apostrophes end the token for simplicity.
-    return iswalnum((wint_t)ch) != 0;
-}
-
-static wchar_t ToLowerInvariant(wchar_t ch)
-{
-    if (ch >= L'A' && ch <= L'Z') return (wchar_t)(ch - L'A' + L'a');
-    // Cyrillic case fold: towlower handles Unicode on Windows.
-    return (wchar_t)towlower((wint_t)ch);
-}
-
-static int FindBigramScore(const wchar_t* token, const wchar_t* const* commonPairs, size_t commonCount)
-{
-    // Returns number of bigrams found in the small "common bigrams" list.
-    const size_t n = wcslen(token);
-    if (n < 2) return 0;
-
-    int hits = 0;
-    for (size_t i = 0; i + 1 < n; i++) {
-        wchar_t bg[3] = { token[i], token[i + 1], 0 };
-        for (size_t j = 0; j < commonCount; j++) {
-            if (bg[0] == commonPairs[j][0] && bg[1] == commonPairs[j][1]) {
-                hits++;
-                break;
-            }
-        }
-    }
-    return hits;
-}
-
-static int CountBadBigrams(const wchar_t* token, const wchar_t* const* badPairs, size_t badCount)
-{
-    const size_t n = wcslen(token);
-    if (n < 2) return 0;
-    int hits = 0;
-    for (size_t i = 0; i + 1 < n; i++) {
-        wchar_t bg0 = token[i];
-        wchar_t bg1 = token[i + 1];
-        for (size_t j = 0; j < badCount; j++) {
-            if (bg0 == badPairs[j][0] && bg1 == badPairs[j][1]) {
-                hits++;
-                break;
-            }
-        }
-    }
-    return hits;
-}
-
-static double VowelRatioEn(const wchar_t* token)
-{
-    const wchar_t* vowels = L"aeiouy";
-    int v = 0, l = 0;
-    for (const wchar_t* p = token; *p; p++) {
-        if (!IsLatinLetter(*p)) continue;
-        l++;
-        if (wcschr(vowels, *p)) v++;
-    }
-    if (l == 0) return 0.0;
-    return (double)v / (double)l;
-}
-
-static double VowelRatioRu(const wchar_t* token)
-{
-    const wchar_t* vowels = L"\u0430\u0435\u0451\u0438\u043e\u0443\u044b\u044d\u044e\u044f";
-    int v = 0, l = 0;
-    for (const wchar_t* p = token; *p; p++) {
-        if (!IsCyrillicLetter(*p)) continue;
-        l++;
-        if (wcschr(vowels, *p)) v++;
-    }
-    if (l == 0) return 0.0;
-    return (double)v / (double)l;
-}
-
-static int ScoreEnglish(const wchar_t* tokenLower)
-{
-    // Lightweight "not gibberish" score: common bigrams + vowel ratio sanity.
-    static const wchar_t* const bigrams[] = {
-        L"th", L"he", L"in", L"er", L"an", L"re", L"on", L"at", L"en", L"nd",
-        L"ti", L"es", L"or", L"te", L"of", L"ed", L"is", L"it", L"al", L"ar",
-        L"st", L"to", L"nt", L"ng", L"se", L"ha", L"as", L"ou", L"io", L"le",
-        // Short-word helpers
-        L"oo", L"ck", L"ok", L"bo", L"ee",
-    };
-
-    int latin = 0, nonLatinLetters = 0;
-    for (const wchar_t* p = tokenLower; *p; p++) {
-        if (IsLatinLetter(*p)) latin++;
-        else if (iswalpha((wint_t)*p)) nonLatinLetters++;
-    }
-    if (latin == 0) return -1000;
-    if (nonLatinLetters > 0) return -500;
-
-    const int hits = FindBigramScore(tokenLower, bigrams, ARRAYSIZE(bigrams));
-    const size_t n = wcslen(tokenLower);
-    const double vr = VowelRatioEn(tokenLower);
-
-    int score = 0;
-    score += hits * 3;
-    // Prefer some vowels but allow short words like "nth" to pass if bigrams look okay.
-    if (n >= 4 && vr < 0.20) score -= 6;
-    if (vr > 0.75) score -= 3;
-    // Penalize long runs without vowels.
-    if (n >= 6 && vr < 0.15) score -= 10;
-    // Slight length bonus.
-    score += (int)(n);
-    return score;
-}
-
-static int ScoreRussian(const wchar_t* tokenLower)
-{
-    static const wchar_t* const bigrams[] = {
-        L"\u0441\u0442", L"\u043d\u043e", L"\u0442\u043e", L"\u043d\u0430", L"\u0435\u043d", L"\u043e\u0432", L"\u043d\u0438", L"\u0440\u0430", L"\u0432\u043e", L"\u043a\u043e",
-        L"\u043f\u0440", L"\u043f\u043e", L"\u0435\u0440", L"\u0440\u043e", L"\u043e\u0441", L"\u0430\u043b", L"\u0442\u0430", L"\u0432\u0430", L"\u043d\u0435", L"\u043b\u0438",
-        L"\u0440\u0435",
-    };
-    static const wchar_t* const badBigrams[] = {
-        L"\u0449\u0449", // щщ
-        L"\u044a\u044a", // ъъ
-        L"\u044b\u044b", // ыы
-        L"\u0439\u0439", // йй
-        L"\u044c\u044a", // ьъ
-        L"\u044a\u044c", // ъь
-        L"\u0436\u044b", // жы (should be жи)
-        L"\u0448\u044b", // шы (should be ши)
-    };
-
-    int cyr = 0, nonCyrLetters = 0;
-    for (const wchar_t* p = tokenLower; *p; p++) {
-        if (IsCyrillicLetter(*p)) cyr++;
-        else if (iswalpha((wint_t)*p)) nonCyrLetters++;
-    }
-    if (cyr == 0) return -1000;
-    if (nonCyrLetters > 0) return -500;
-
-    const int hits = FindBigramScore(tokenLower, bigrams, ARRAYSIZE(bigrams));
-    const int badHits = CountBadBigrams(tokenLower, badBigrams, ARRAYSIZE(badBigrams));
-    const size_t n = wcslen(tokenLower);
-    const double vr = VowelRatioRu(tokenLower);
-
-    int score = 0;
-    score += hits * 3;
-    score -= badHits * 8;
-    if (n >= 4 && vr < 0.20) score -= 6;
-    if (vr > 0.80) score -= 3;
-    if (n >= 6 && vr < 0.15) score -= 10;
-    score += (int)(n);
-    return score;
-}
-
-typedef struct {
-    wchar_t from;
-    wchar_t to;
-} CharMap;
-
-// Physical-keyboard mapping for QWERTY <-> ЙЦУКЕН (lowercase).
-static const CharMap kRuToEn[] = {
-    {L'\u0439', L'q'},{L'\u0446', L'w'},{L'\u0443', L'e'},{L'\u043a', L'r'},{L'\u0435', L't'},{L'\u043d', L'y'},{L'\u0433', L'u'},{L'\u0448', L'i'},{L'\u0449', L'o'},{L'\u0437', L'p'},{L'\u0445', L'['},{L'\u044a', L']'},
-    {L'\u0444', L'a'},{L'\u044b', L's'},{L'\u0432', L'd'},{L'\u0430', L'f'},{L'\u043f', L'g'},{L'\u0440', L'h'},{L'\u043e', L'j'},{L'\u043b', L'k'},{L'\u0434', L'l'},{L'\u0436', L';'},{L'\u044d', L'\''},
-    {L'\u044f', L'z'},{L'\u0447', L'x'},{L'\u0441', L'c'},{L'\u043c', L'v'},{L'\u0438', L'b'},{L'\u0442', L'n'},{L'\u044c', L'm'},{L'\u0431', L','},{L'\u044e', L'.'},
-    {L'\u0451', L'`'},
-};
-
-static const CharMap kEnToRu[] = {
-    {L'q', L'\u0439'},{L'w', L'\u0446'},{L'e', L'\u0443'},{L'r', L'\u043a'},{L't', L'\u0435'},{L'y', L'\u043d'},{L'u', L'\u0433'},{L'i', L'\u0448'},{L'o', L'\u0449'},{L'p', L'\u0437'},{L'[', L'\u0445'},{L']', L'\u044a'},
-    {L'a', L'\u0444'},{L's', L'\u044b'},{L'd', L'\u0432'},{L'f', L'\u0430'},{L'g', L'\u043f'},{L'h', L'\u0440'},{L'j', L'\u043e'},{L'k', L'\u043b'},{L'l', L'\u0434'},{L';', L'\u0436'},{L'\'', L'\u044d'},
-    {L'z', L'\u044f'},{L'x', L'\u0447'},{L'c', L'\u0441'},{L'v', L'\u043c'},{L'b', L'\u0438'},{L'n', L'\u0442'},{L'm', L'\u044c'},{L',', L'\u0431'},{L'.', L'\u044e'},
-    {L'`', L'\u0451'},
-};
-
-static wchar_t MapChar(const CharMap* map, size_t mapCount, wchar_t ch)
-{
-    for (size_t i = 0; i < mapCount; i++) {
-        if (map[i].from == ch) return map[i].to;
-    }
-    return 0;
-}
-
-static void MapRuToEn(const wchar_t* in, wchar_t* out, size_t outCap)
-{
-    size_t n = 0;
-    for (const wchar_t* p = in; *p && n + 1 < outCap; p++) {
-        wchar_t ch = *p;
-        const BOOL upper = (ch != ToLowerInvariant(ch));
-        wchar_t lower = ToLowerInvariant(ch);
-        wchar_t mapped = MapChar(kRuToEn, ARRAYSIZE(kRuToEn), lower);
-        if (!mapped) mapped = lower;
-        if (upper && mapped >= L'a' && mapped <= L'z') mapped = (wchar_t)(mapped - L'a' + L'A');
-        out[n++] = mapped;
-    }
-    out[n] = 0;
-}
-
-static void MapEnToRu(const wchar_t* in, wchar_t* out, size_t outCap)
-{
-    size_t n = 0;
-    for (const wchar_t* p = in; *p && n + 1 < outCap; p++) {
-        wchar_t ch = *p;
-        const BOOL upper = (ch >= L'A' && ch <= L'Z');
-        wchar_t lower = (ch >= L'A' && ch <= L'Z') ? (wchar_t)(ch - L'A' + L'a') : ch;
-        wchar_t mapped = MapChar(kEnToRu, ARRAYSIZE(kEnToRu), lower);
-        if (!mapped) mapped = lower;
-        if (upper) mapped = (wchar_t)towupper((wint_t)mapped);
-        out[n++] = mapped;
-    }
-    out[n] = 0;
-}
+// Token tracking and scoring live in engine.c; this file only adapts it to Win32.
 
 static HKL FindLayoutByPrimaryLang(WORD primaryLang)
 {
@@ -289,10 +52,62 @@ static void RequestLayoutSwitch(HKL target)
     }
 }
 
+// Injection cost, reported at exit: a phrase correction is one SendInput round instead of one per word.
+static ULONGLONG g_inject_rounds = 0;
+static ULONGLONG g_inject_events = 0;
+static ULONGLONG g_inject_qpc = 0;
+
+// Keys typed while a correction is in flight are held and re-injected after it (src/typeahead.h).
+#define TYPEAHEAD_TIMER_ID 2
+
+static DsTypeahead g_typeahead;
+static BOOL g_typeahead_enabled = TRUE; // --no-typeahead
+
+// Time the hook may spend deciding one key before the expensive scoring tiers are skipped
+// (--budget-us N, 0 = unbounded). Far above a normal decision; it only matters when one stalls.
+static DWORD g_budget_us = 2000;
+static HWND g_main_hwnd = NULL;
+
+static uint64_t HostClockNs(void* ctx);
+
+// Keeps the latency-cap timer in line with the earliest pending deadline.
+static void ArmTypeaheadTimer(void)
+{
+    const uint64_t deadline = DsTypeaheadDeadline(&g_typeahead);
+    if (!g_main_hwnd) return;
+    if (!deadline) {
+        KillTimer(g_main_hwnd, TYPEAHEAD_TIMER_ID);
+        return;
+    }
+    const uint64_t now = HostClockNs(NULL);
+    const UINT ms = deadline > now ? (UINT)((deadline - now + 999999) / 1000000) : 1;
+    SetTimer(g_main_hwnd, TYPEAHEAD_TIMER_ID, ms ? ms : 1, NULL);
+}
+
+static void ReplayHeldKeys(void)
+{
+    DsTypeaheadKey keys[DS_TYPEAHEAD_MAX_KEYS];
+    INPUT inputs[DS_TYPEAHEAD_MAX_KEYS];
+    const size_t n = DsTypeaheadFlush(&g_typeahead, keys, HostClockNs(NULL));
+    for (size_t i = 0; i < n; i++) {
+        inputs[i].type = INPUT_KEYBOARD;
+        inputs[i].ki.wVk = (WORD)keys[i].vk;
+        inputs[i].ki.wScan = (WORD)keys[i].scan;
+        inputs[i].ki.dwFlags = (keys[i].down ? 0 : KEYEVENTF_KEYUP) | ((keys[i].flags & LLKHF_EXTENDED) ? KEYEVENTF_EXTENDEDKEY : 0);
+        inputs[i].ki.time = 0;
+        inputs[i].ki.dwExtraInfo = DsTypeaheadReplayTag(&keys[i]);
+    }
+    const UINT sent = n ? SendInput((UINT)n, inputs, sizeof(INPUT)) : 0;
+    if (sent < n) DsTypeaheadReplayFailed(&g_typeahead, n, sent);
+    ArmTypeaheadTimer();
+}
+
 static void SendBackspacesAndText(size_t backspaces, const wchar_t* text)
 {
-    INPUT inputs[256];
+    // Key down + key up per backspace and per character of the largest batch the engine sends.
+    INPUT inputs[4 * (DS_PHRASE_MAX_CHARS + 1) + 2];
     UINT count = 0;
+    const ULONG_PTR tag = DsTypeaheadCorrectionTag();
 
     for (size_t i = 0; i < backspaces && count + 2 < ARRAYSIZE(inputs); i++) {
         inputs[count].type = INPUT_KEYBOARD;
@@ -300,7 +115,7 @@ static void SendBackspacesAndText(size_t backspaces, const wchar_t* text)
         inputs[count].ki.wScan = 0;
         inputs[count].ki.dwFlags = 0;
         inputs[count].ki.time = 0;
-        inputs[count].ki.dwExtraInfo = 0;
+        inputs[count].ki.dwExtraInfo = tag;
         count++;
 
         inputs[count].type = INPUT_KEYBOARD;
@@ -308,7 +123,7 @@ static void SendBackspacesAndText(size_t backspaces, const wchar_t* text)
         inputs[count].ki.wScan = 0;
         inputs[count].ki.dwFlags = KEYEVENTF_KEYUP;
         inputs[count].ki.time = 0;
-        inputs[count].ki.dwExtraInfo = 0;
+        inputs[count].ki.dwExtraInfo = tag;
         count++;
     }
 
@@ -318,7 +133,7 @@ static void SendBackspacesAndText(size_t backspaces, const wchar_t* text)
         inputs[count].ki.wScan = *p;
         inputs[count].ki.dwFlags = KEYEVENTF_UNICODE;
         inputs[count].ki.time = 0;
-        inputs[count].ki.dwExtraInfo = 0;
+        inputs[count].ki.dwExtraInfo = tag;
         count++;
 
         inputs[count].type = INPUT_KEYBOARD;
@@ -326,163 +141,576 @@ static void SendBackspacesAndText(size_t backspaces, const wchar_t* text)
         inputs[count].ki.wScan = *p;
         inputs[count].ki.dwFlags = KEYEVENTF_UNICODE | KEYEVENTF_KEYUP;
         inputs[count].ki.time = 0;
-        inputs[count].ki.dwExtraInfo = 0;
+        inputs[count].ki.dwExtraInfo = tag;
         count++;
     }
 
     if (count) {
-        SendInput(count, inputs, sizeof(INPUT));
+        LARGE_INTEGER t0, t1;
+        QueryPerformanceCounter(&t0);
+        const UINT sent = SendInput(count, inputs, sizeof(INPUT));
+        QueryPerformanceCounter(&t1);
+        DsTypeaheadCorrectionSent(&g_typeahead, sent, HostClockNs(NULL));
+        ArmTypeaheadTimer();
+        g_inject_rounds++;
+        g_inject_events += count;
+        g_inject_qpc += (ULONGLONG)(t1.QuadPart - t0.QuadPart);
     }
 }
 
-static void InvalidateLastFix(void)
+// ---------- Keystroke capture (opt-in: --capture <file>) ----------
+// Records raw hook traffic in the compact format from keytrace.h so production problems can be
+// replayed off-desktop with tools/diswitcher_replay.c. Records are buffered and written from the
+// hook thread only when the buffer fills, on a periodic timer and at exit.
+
+#define CAPTURE_BUFFER_BYTES (64 * 1024)
+#define CAPTURE_MAX_WINDOWS 256
+#define CAPTURE_FLUSH_TIMER_ID 1
+#define CAPTURE_FLUSH_INTERVAL_MS 5000
+
+typedef struct {
+    HANDLE file;
+    DsTraceWriter writer;
+    BYTE buf[CAPTURE_BUFFER_BYTES];
+    HWND windows[CAPTURE_MAX_WINDOWS]; // index + 1 is the window id stored in the trace
+    UINT window_count;
+    DWORD last_layout;
+    DWORD engine_layout; // last layout requested by the engine, to tag the resulting LAYOUT record
+} Capture;
+
+static Capture* g_capture = NULL;
+
+static bool CaptureFlushToFile(void* ctx, const uint8_t* data, size_t len)
 {
-    g_last_fix.active = FALSE;
+    Capture* c = (Capture*)ctx;
+    DWORD written = 0;
+    return WriteFile(c->file, data, (DWORD)len, &written, NULL) && written == (DWORD)len;
 }
 
-static BOOL ToggleLastFixIfPossible(void)
+static BOOL CaptureOpen(const wchar_t* path)
 {
-    if (!g_last_fix.active) return FALSE;
-
-    const ULONGLONG now = GetTickCount64();
-    if (now - g_last_fix.ts_ms > 30000) { // 30s window
-        g_last_fix.active = FALSE;
+    Capture* c = (Capture*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(Capture));
+    if (!c) return FALSE;
+    c->file = CreateFileW(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (c->file == INVALID_HANDLE_VALUE) {
+        HeapFree(GetProcessHeap(), 0, c);
         return FALSE;
     }
-    if (!g_last_fix.had_boundary) {
-        g_last_fix.active = FALSE;
-        return FALSE;
+
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    const ULONGLONG ticks100ns = ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    const ULONGLONG unixMs = (ticks100ns - 116444736000000000ULL) / 10000ULL;
+
+    DsTraceWriterInit(&c->writer, c->buf, sizeof(c->buf), CaptureFlushToFile, c);
+    DsTraceWriteHeader(&c->writer, unixMs);
+    g_capture = c;
+    return TRUE;
+}
+
+static void CaptureClose(void)
+{
+    if (!g_capture) return;
+    DsTraceWriterFlush(&g_capture->writer);
+    CloseHandle(g_capture->file);
+    HeapFree(GetProcessHeap(), 0, g_capture);
+    g_capture = NULL;
+}
+
+static UINT32 CaptureWindowId(Capture* c, HWND hwnd)
+{
+    if (!hwnd) return 0;
+    for (UINT i = 0; i < c->window_count; i++) {
+        if (c->windows[i] == hwnd) return i + 1;
+    }
+    if (c->window_count == CAPTURE_MAX_WINDOWS) c->window_count = 0; // recycle ids in a very long session
+    c->windows[c->window_count++] = hwnd;
+    return c->window_count;
+}
+
+static void CaptureFocusEvent(HWND hwnd, DWORD timeMs)
+{
+    DsTraceWriteFocus(&g_capture->writer, timeMs, CaptureWindowId(g_capture, hwnd));
+}
+
+static void CaptureKeyEvent(const KBDLLHOOKSTRUCT* k, BOOL down)
+{
+    Capture* c = g_capture;
+    if (down) {
+        const DWORD layout = (DWORD)(UINT_PTR)GetForegroundKeyboardLayout();
+        if (layout != c->last_layout) {
+            c->last_layout = layout;
+            DsTraceWriteLayout(&c->writer, k->time, layout, layout == c->engine_layout);
+            c->engine_layout = 0;
+        }
+    }
+
+    BYTE flags = 0;
+    if (k->flags & LLKHF_EXTENDED) flags |= DS_TRACE_F_EXTENDED;
+    if (k->flags & LLKHF_ALTDOWN) flags |= DS_TRACE_F_ALTDOWN;
+    DsTraceWriteKey(&c->writer, k->time, down ? true : false, k->vkCode, k->scanCode, flags);
+}
+
+// ---------- Engine host ----------
+
+static uint64_t HostClockNs(void* ctx)
+{
+    (void)ctx;
+    static LARGE_INTEGER freq = {0};
+    if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    const ULONGLONG sec = (ULONGLONG)now.QuadPart / (ULONGLONG)freq.QuadPart;
+    const ULONGLONG rem = (ULONGLONG)now.QuadPart % (ULONGLONG)freq.QuadPart;
+    return sec * 1000000000ULL + rem * 1000000000ULL / (ULONGLONG)freq.QuadPart;
+}
+
+static void HostSwitchLayout(void* ctx, bool toEnglish)
+{
+    (void)ctx;
+    const HKL target = FindLayoutByPrimaryLang(toEnglish ? LANG_ENGLISH : LANG_RUSSIAN);
+    if (g_capture && target) g_capture->engine_layout = (DWORD)(UINT_PTR)target;
+    RequestLayoutSwitch(target);
+}
+
+static void HostSendText(void* ctx, size_t backspaces, const wchar_t* text)
+{
+    (void)ctx;
+    SendBackspacesAndText(backspaces, text);
+}
+
+static void HostLog(void* ctx, const wchar_t* msg)
+{
+    (void)ctx;
+    OutputDebugStringW(msg);
+}
+
+// ---------- Engine model and hot reload ----------
+// The engine model (src/model.h) is the built-in tables plus diswitcher.conf (src/config.h) plus
+// the word-form model ru.dsmf (src/morph.h), both next to the executable unless --config/--morph
+// name other files. ru.dsmf is mapped read-only and used in place. A reloader thread watches both
+// files and publishes a freshly built model when one changes; the keyboard hook never waits for
+// it, and the replaced model (with its mapping) is freed once no hook call can still be using it.
+// A file that fails to load keeps the previous model in place until the next change.
+
+#define MORPH_DEFAULT_FILE L"ru.dsmf"
+#define CONFIG_DEFAULT_FILE L"diswitcher.conf"
+#define CONFIG_MAX_BYTES (1u << 20)
+#define RELOAD_DEBOUNCE_MS 300 // editors save in several writes
+#define RELOAD_POLL_MS 1000    // also the interval at which replaced models are reclaimed
+
+typedef struct {
+    HANDLE file;
+    HANDLE mapping;
+    const void* view;
+    DsMorph morph;
+} MorphMapping;
+
+static wchar_t g_morph_path[MAX_PATH] = {0};
+static wchar_t g_config_path[MAX_PATH] = {0};
+static FILETIME g_morph_stamp = {0};
+static FILETIME g_config_stamp = {0};
+static HANDLE g_reload_thread = NULL;
+static HANDLE g_reload_stop = NULL;
+
+static void FreeMorphMapping(void* ctx)
+{
+    MorphMapping* m = (MorphMapping*)ctx;
+    if (m->view) UnmapViewOfFile(m->view);
+    if (m->mapping) CloseHandle(m->mapping);
+    if (m->file && m->file != INVALID_HANDLE_VALUE) CloseHandle(m->file);
+    HeapFree(GetProcessHeap(), 0, m);
+}
+
+static MorphMapping* MapMorphology(const wchar_t* path)
+{
+    MorphMapping* m = (MorphMapping*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(MorphMapping));
+    if (!m) return NULL;
+    // FILE_SHARE_DELETE lets a new model be renamed over the mapped one.
+    m->file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                          FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m->file == INVALID_HANDLE_VALUE) goto fail;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m->file, &size) || size.QuadPart == 0 || size.QuadPart > 0x7FFFFFFF) goto fail;
+    m->mapping = CreateFileMappingW(m->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m->mapping) goto fail;
+    m->view = MapViewOfFile(m->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m->view) goto fail;
+    if (!DsMorphOpen(&m->morph, m->view, (size_t)size.QuadPart)) goto fail;
+    return m;
+
+fail:
+    FreeMorphMapping(m);
+    return NULL;
+}
+
+static BOOL ApplyConfigFile(const wchar_t* path, DsModel* model)
+{
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return FALSE;
+    BOOL ok = FALSE;
+    char* text = NULL;
+    LARGE_INTEGER size;
+    DWORD read = 0;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart > CONFIG_MAX_BYTES) goto done;
+    text = (char*)HeapAlloc(GetProcessHeap(), 0, (SIZE_T)size.QuadPart + 1);
+    if (!text) goto done;
+    if (!ReadFile(file, text, (DWORD)size.QuadPart, &read, NULL)) goto done;
+
+    DsConfigError err;
+    ok = DsConfigApply(model, text, read, &err) ? TRUE : FALSE;
+    if (!ok) {
+        wchar_t buf[MAX_PATH + 160];
+        StringCchPrintfW(buf, ARRAYSIZE(buf), L"[DiSwitcher] %ls:%u: %hs\r\n", path, (unsigned)err.line, err.message);
+        OutputDebugStringW(buf);
     }
 
-    const BOOL want_corrected = g_last_fix.corrected_applied ? FALSE : TRUE;
+done:
+    if (text) HeapFree(GetProcessHeap(), 0, text);
+    CloseHandle(file);
+    return ok;
+}
+
+// Last write time, or zero if the file does not exist.
+static FILETIME FileStamp(const wchar_t* path)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    FILETIME none = {0};
+    if (!GetFileAttributesExW(path, GetFileExInfoStandard, &data)) return none;
+    return data.ftLastWriteTime;
+}
+
+static BOOL StampIsSet(FILETIME t)
+{
+    return t.dwLowDateTime || t.dwHighDateTime;
+}
 
-    const wchar_t* targetText = want_corrected ? g_last_fix.corrected : g_last_fix.original;
-    const size_t targetLen = want_corrected ? g_last_fix.corrected_len : g_last_fix.original_len;
-    const size_t currentLen = want_corrected ? g_last_fix.original_len : g_last_fix.corrected_len;
+static BOOL ModelFilesChanged(void)
+{
+    const FILETIME config = FileStamp(g_config_path);
+    const FILETIME morph = FileStamp(g_morph_path);
+    return CompareFileTime(&config, &g_config_stamp) != 0 || CompareFileTime(&morph, &g_morph_stamp) != 0;
+}
 
-    // Switch layout to match the target.
-    const BOOL targetIsEnglish = want_corrected ? g_last_fix.corrected_to_english : !g_last_fix.corrected_to_english;
-    const HKL targetLayout = FindLayoutByPrimaryLang(targetIsEnglish ? LANG_ENGLISH : LANG_RUSSIAN);
-    RequestLayoutSwitch(targetLayout);
+// Builds a model from the current files and publishes it. Missing files are fine (built-in
+// tables, no word-form model); a file that exists but does not load keeps the current model.
+static BOOL LoadModel(void)
+{
+    const FILETIME configStamp = FileStamp(g_config_path);
+    const FILETIME morphStamp = FileStamp(g_morph_path);
 
-    // Cursor is after: current + boundary. Replace with: target + boundary.
-    wchar_t out[TOKEN_MAX_CHARS + 2];
-    if (targetLen + 1 >= ARRAYSIZE(out)) {
-        g_last_fix.active = FALSE;
+    DsModel* model = DsModelCreate();
+    if (!model) return FALSE;
+    if (StampIsSet(configStamp) && !ApplyConfigFile(g_config_path, model)) {
+        DsModelFree(model);
         return FALSE;
     }
-    memcpy(out, targetText, (targetLen + 1) * sizeof(wchar_t));
-    out[targetLen] = g_last_fix.boundary;
-    out[targetLen + 1] = 0;
+    if (StampIsSet(morphStamp)) {
+        MorphMapping* m = MapMorphology(g_morph_path);
+        if (!m) {
+            OutputDebugStringW(L"[DiSwitcher] Failed to load morphology model; keeping the current model.\r\n");
+            DsModelFree(model);
+            return FALSE;
+        }
+        model->morph = &m->morph;
+        model->release = FreeMorphMapping;
+        model->release_ctx = m;
+    }
 
-    SendBackspacesAndText(currentLen + 1, out);
+    DsEnginePublishModel(model);
+    g_config_stamp = configStamp;
+    g_morph_stamp = morphStamp;
 
-    g_last_fix.corrected_applied = want_corrected ? TRUE : FALSE;
-    g_last_fix.ts_ms = now; // extend window while toggling
+    wchar_t buf[128];
+    StringCchPrintfW(buf, ARRAYSIZE(buf), L"[DiSwitcher] model %u: config %ls, morphology %u forms\r\n",
+                     (unsigned)model->generation, StampIsSet(configStamp) ? L"loaded" : L"built-in",
+                     model->morph ? model->morph->form_count : 0u);
+    OutputDebugStringW(buf);
     return TRUE;
 }
 
-static BOOL TryAutocorrectToken(const wchar_t* token, wchar_t boundaryChar, BOOL includeBoundary)
+// Absolute path of `name` next to the executable, unless `path` was already given.
+static void ResolveModelPath(wchar_t* path, size_t cap, const wchar_t* name)
 {
-    const size_t n = wcslen(token);
-    if (n < 3) return FALSE;
-    if (n > TOKEN_MAX_CHARS) return FALSE;
+    wchar_t full[MAX_PATH];
+    if (path[0]) {
+        const DWORD len = GetFullPathNameW(path, ARRAYSIZE(full), full, NULL);
+        if (len && len < ARRAYSIZE(full)) StringCchCopyW(path, cap, full);
+        return;
+    }
+    const DWORD len = GetModuleFileNameW(NULL, full, ARRAYSIZE(full));
+    if (!len || len >= ARRAYSIZE(full)) return;
+    wchar_t* slash = wcsrchr(full, L'\\');
+    if (!slash) return;
+    slash[1] = 0;
+    if (FAILED(StringCchCatW(full, ARRAYSIZE(full), name))) return;
+    StringCchCopyW(path, cap, full);
+}
 
-    wchar_t lower[TOKEN_MAX_CHARS + 1];
-    for (size_t i = 0; i < n; i++) lower[i] = ToLowerInvariant(token[i]);
-    lower[n] = 0;
+// Length of the directory part including the trailing backslash; 0 if there is none.
+static size_t DirectoryLength(const wchar_t* path)
+{
+    const wchar_t* slash = wcsrchr(path, L'\\');
+    return slash ? (size_t)(slash - path + 1) : 0;
+}
 
-    int latin = 0, cyr = 0, otherLetters = 0;
-    for (size_t i = 0; i < n; i++) {
-        const wchar_t ch = lower[i];
-        if (IsLatinLetter(ch)) latin++;
-        else if (IsCyrillicLetter(ch)) cyr++;
-        else if (iswalpha((wint_t)ch)) otherLetters++;
-    }
-    if (otherLetters > 0) return FALSE;
-
-    const BOOL mixedScripts = (latin > 0 && cyr > 0);
-    // Avoid "fixing" likely IDs like "C3PO", "R2D2", etc.
-    // If it contains digits, be conservative.
-    int digits = 0;
-    for (size_t i = 0; i < n; i++) if (iswdigit((wint_t)lower[i])) digits++;
-    if (digits > 0) return FALSE;
-
-    const int scoreEn = ScoreEnglish(lower);
-    const int scoreRu = ScoreRussian(lower);
-
-    wchar_t mapped[TOKEN_MAX_CHARS + 1];
-    int mappedScore = -1000;
-    BOOL toEnglish = FALSE;
-
-    if (cyr > 0) {
-        MapRuToEn(token, mapped, ARRAYSIZE(mapped));
-        wchar_t mappedLower[TOKEN_MAX_CHARS + 1];
-        size_t ml = wcslen(mapped);
-        for (size_t i = 0; i < ml; i++) mappedLower[i] = ToLowerInvariant(mapped[i]);
-        mappedLower[ml] = 0;
-        mappedScore = ScoreEnglish(mappedLower);
-        toEnglish = TRUE;
-    } else if (latin > 0) {
-        MapEnToRu(token, mapped, ARRAYSIZE(mapped));
-        wchar_t mappedLower[TOKEN_MAX_CHARS + 1];
-        size_t ml = wcslen(mapped);
-        for (size_t i = 0; i < ml; i++) mappedLower[i] = ToLowerInvariant(mapped[i]);
-        mappedLower[ml] = 0;
-        mappedScore = ScoreRussian(mappedLower);
-        toEnglish = FALSE;
-    } else {
+static HANDLE WatchDirectoryOf(const wchar_t* path)
+{
+    wchar_t dir[MAX_PATH];
+    const size_t len = DirectoryLength(path);
+    if (!len || len >= ARRAYSIZE(dir)) return INVALID_HANDLE_VALUE;
+    wmemcpy(dir, path, len);
+    dir[len] = 0;
+    return FindFirstChangeNotificationW(dir, FALSE, FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE |
+                                                        FILE_NOTIFY_CHANGE_SIZE);
+}
+
+// ---------- Adaptive statistics ----------
+// What the engine learns from the user's typing (src/adapt.h) lives in diswitcher.adapt next to the
+// executable (or --adapt <file>), mapped read-write so it survives restarts without explicit saving.
+// Only the hook thread touches it. --no-adapt leaves the file alone and turns learning off.
+
+#define ADAPT_DEFAULT_FILE L"diswitcher.adapt"
+
+static wchar_t g_adapt_path[MAX_PATH] = {0};
+static BOOL g_adapt_enabled = TRUE; // --no-adapt
+static HANDLE g_adapt_file = INVALID_HANDLE_VALUE;
+static HANDLE g_adapt_mapping = NULL;
+static void* g_adapt_view = NULL;
+
+static void CloseAdaptive(void)
+{
+    DsEngineSetAdaptive(NULL);
+    if (g_adapt_view) {
+        FlushViewOfFile(g_adapt_view, 0);
+        UnmapViewOfFile(g_adapt_view);
+        g_adapt_view = NULL;
+    }
+    if (g_adapt_mapping) {
+        CloseHandle(g_adapt_mapping);
+        g_adapt_mapping = NULL;
+    }
+    if (g_adapt_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(g_adapt_file);
+        g_adapt_file = INVALID_HANDLE_VALUE;
+    }
+}
+
+static BOOL OpenAdaptive(const wchar_t* path)
+{
+    g_adapt_file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+                               FILE_ATTRIBUTE_NORMAL, NULL);
+    if (g_adapt_file == INVALID_HANDLE_VALUE) return FALSE;
+    // A mapping larger than the file grows it, zero-filled; DsAdaptAttach then starts it afresh.
+    g_adapt_mapping = CreateFileMappingW(g_adapt_file, NULL, PAGE_READWRITE, 0, (DWORD)sizeof(DsAdaptSketch), NULL);
+    if (g_adapt_mapping) g_adapt_view = MapViewOfFile(g_adapt_mapping, FILE_MAP_WRITE, 0, 0, sizeof(DsAdaptSketch));
+    DsAdaptSketch* sketch = g_adapt_view ? DsAdaptAttach(g_adapt_view, sizeof(DsAdaptSketch)) : NULL;
+    if (!sketch) {
+        CloseAdaptive();
         return FALSE;
     }
+    DsEngineSetAdaptive(sketch);
+    return TRUE;
+}
 
-    // Decision thresholds: dynamic based on length; tuned to fix cases like "руддщ" -> "hello".
-    const int base = (cyr > 0) ? scoreRu : scoreEn;
-    const int diff = mappedScore - base;
-
-    int minMapped = (n <= 4) ? 6 : 8;
-    int minDiff = (n <= 5) ? 4 : 6;
-    if (base <= 6) minDiff = 3;
-    if (mixedScripts) minDiff = 2;
-
-    if (mappedScore >= minMapped && diff >= minDiff) {
-        wchar_t dbg[256];
-        StringCchPrintfW(dbg, ARRAYSIZE(dbg),
-                         L"[DiSwitcher] autocorrect '%s' -> '%s' base=%d mapped=%d diff=%d\r\n",
-                         token, mapped, base, mappedScore, diff);
-        OutputDebugStringW(dbg);
-
-        // Save last fix for Pause-to-revert.
-        ZeroMemory(&g_last_fix, sizeof(g_last_fix));
-        g_last_fix.active = TRUE;
-        g_last_fix.ts_ms = GetTickCount64();
-        StringCchCopyW(g_last_fix.original, ARRAYSIZE(g_last_fix.original), token);
-        StringCchCopyW(g_last_fix.corrected, ARRAYSIZE(g_last_fix.corrected), mapped);
-        g_last_fix.original_len = n;
-        g_last_fix.corrected_len = wcslen(mapped);
-        g_last_fix.boundary = boundaryChar;
-        g_last_fix.had_boundary = includeBoundary ? TRUE : FALSE;
-        g_last_fix.corrected_to_english = toEnglish ? TRUE : FALSE;
-        g_last_fix.corrected_applied = TRUE;
-
-        const HKL target = FindLayoutByPrimaryLang(toEnglish ? LANG_ENGLISH : LANG_RUSSIAN);
-        RequestLayoutSwitch(target);
-        if (includeBoundary) {
-            wchar_t withBoundary[TOKEN_MAX_CHARS + 2];
-            size_t ml = wcslen(mapped);
-            if (ml + 1 < ARRAYSIZE(withBoundary)) {
-                memcpy(withBoundary, mapped, (ml + 1) * sizeof(wchar_t));
-                withBoundary[ml] = boundaryChar;
-                withBoundary[ml + 1] = 0;
-                SendBackspacesAndText(n, withBoundary);
-            } else {
-                SendBackspacesAndText(n, mapped);
+static DWORD WINAPI ReloadThreadProc(LPVOID param)
+{
+    (void)param;
+    HANDLE handles[3];
+    DWORD count = 0;
+    handles[count++] = g_reload_stop;
+    const HANDLE configWatch = WatchDirectoryOf(g_config_path);
+    if (configWatch != INVALID_HANDLE_VALUE) handles[count++] = configWatch;
+    // Both files usually live in the same directory; one watch covers them.
+    const size_t dirLen = DirectoryLength(g_config_path);
+    const BOOL sameDir = dirLen == DirectoryLength(g_morph_path) &&
+                         CompareStringOrdinal(g_config_path, (int)dirLen, g_morph_path, (int)dirLen, TRUE) == CSTR_EQUAL;
+    const HANDLE morphWatch = sameDir ? INVALID_HANDLE_VALUE : WatchDirectoryOf(g_morph_path);
+    if (morphWatch != INVALID_HANDLE_VALUE) handles[count++] = morphWatch;
+
+    for (;;) {
+        const DWORD r = WaitForMultipleObjects(count, handles, FALSE, RELOAD_POLL_MS);
+        if (r == WAIT_OBJECT_0 || r == WAIT_FAILED) break;
+        if (r != WAIT_TIMEOUT) {
+            FindNextChangeNotification(handles[r - WAIT_OBJECT_0]);
+            if (WaitForSingleObject(g_reload_stop, RELOAD_DEBOUNCE_MS) == WAIT_OBJECT_0) break;
+            for (DWORD i = 1; i < count; i++) {
+                while (WaitForSingleObject(handles[i], 0) == WAIT_OBJECT_0) FindNextChangeNotification(handles[i]);
             }
-        } else {
-            SendBackspacesAndText(n, mapped);
         }
-        return TRUE;
+        // The timeout path also retries files that failed to load and covers lost notifications.
+        if (ModelFilesChanged()) LoadModel();
+        DsEngineReclaimModels();
+    }
+
+    if (configWatch != INVALID_HANDLE_VALUE) FindCloseChangeNotification(configWatch);
+    if (morphWatch != INVALID_HANDLE_VALUE) FindCloseChangeNotification(morphWatch);
+    return 0;
+}
+
+static void StartReloader(void)
+{
+    g_reload_stop = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!g_reload_stop) return;
+    g_reload_thread = CreateThread(NULL, 0, ReloadThreadProc, NULL, 0, NULL);
+    if (!g_reload_thread) {
+        OutputDebugStringW(L"[DiSwitcher] Failed to start the model reloader; changes need a restart.\r\n");
+        CloseHandle(g_reload_stop);
+        g_reload_stop = NULL;
+    }
+}
+
+static void StopReloader(void)
+{
+    if (g_reload_thread) {
+        SetEvent(g_reload_stop);
+        WaitForSingleObject(g_reload_thread, INFINITE);
+        CloseHandle(g_reload_thread);
+        g_reload_thread = NULL;
+    }
+    if (g_reload_stop) {
+        CloseHandle(g_reload_stop);
+        g_reload_stop = NULL;
+    }
+}
+
+static void InitEngine(void)
+{
+    DsHost host;
+    ZeroMemory(&host, sizeof(host));
+    host.clock_ns = HostClockNs;
+    host.switch_layout = HostSwitchLayout;
+    host.send_text = HostSendText;
+    host.log = HostLog;
+    DsEngineInit(&host);
+    DsEngineSetDecisionBudget((uint64_t)g_budget_us * 1000u);
+    DsTypeaheadInit(&g_typeahead, DS_TYPEAHEAD_DEFAULT_CAP_MS * 1000000ull);
+    if (!g_typeahead_enabled) DsTypeaheadSetEnabled(&g_typeahead, false);
+
+    ResolveModelPath(g_config_path, ARRAYSIZE(g_config_path), CONFIG_DEFAULT_FILE);
+    ResolveModelPath(g_morph_path, ARRAYSIZE(g_morph_path), MORPH_DEFAULT_FILE);
+    if (!LoadModel()) {
+        OutputDebugStringW(L"[DiSwitcher] Using the built-in model.\r\n");
+    }
+    StartReloader();
+
+    if (g_adapt_enabled) {
+        ResolveModelPath(g_adapt_path, ARRAYSIZE(g_adapt_path), ADAPT_DEFAULT_FILE);
+        if (!OpenAdaptive(g_adapt_path)) {
+            OutputDebugStringW(L"[DiSwitcher] Adaptive statistics unavailable; not learning.\r\n");
+        }
+    }
+}
+
+static DsLang LangOfLayout(HKL hkl)
+{
+    const WORD primary = PRIMARYLANGID(LOWORD((UINT_PTR)hkl));
+    if (primary == LANG_ENGLISH) return DS_LANG_EN;
+    if (primary == LANG_RUSSIAN) return DS_LANG_RU;
+    return DS_LANG_UNKNOWN;
+}
+
+// ---------- Focus tracking ----------
+// Foreground changes feed the engine's per-window layout memory (predictive switching).
+
+static HWINEVENTHOOK g_focus_hook = NULL;
+
+static void CALLBACK ForegroundChangedProc(HWINEVENTHOOK hook, DWORD event, HWND hwnd,
+                                           LONG idObject, LONG idChild, DWORD eventThread, DWORD eventTimeMs)
+{
+    (void)hook;
+    (void)event;
+    (void)idObject;
+    (void)idChild;
+    (void)eventThread;
+    if (g_capture) CaptureFocusEvent(hwnd, eventTimeMs);
+
+    DWORD tid = hwnd ? GetWindowThreadProcessId(hwnd, NULL) : 0;
+    const HKL layout = tid ? GetKeyboardLayout(tid) : GetKeyboardLayout(0);
+    DsEngineFocusChanged((uint64_t)(UINT_PTR)hwnd, LangOfLayout(layout));
+}
+
+static void InstallFocusHook(void)
+{
+    if (g_focus_hook) return;
+    // Out-of-context hooks are delivered on this (the hook-owning) thread, like the keyboard hook.
+    g_focus_hook = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, NULL,
+                                   ForegroundChangedProc, 0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+    if (!g_focus_hook) {
+        OutputDebugStringW(L"[DiSwitcher] Failed to install focus hook; predictive switching disabled.\r\n");
+    }
+}
+
+static void UninstallFocusHook(void)
+{
+    if (!g_focus_hook) return;
+    UnhookWinEvent(g_focus_hook);
+    g_focus_hook = NULL;
+}
+
+static void ReportEngineStats(void)
+{
+    wchar_t buf[256];
+
+    DsCacheStats s;
+    DsEngineGetCacheStats(&s);
+    const ULONGLONG total = s.hits + s.misses;
+    if (total) {
+        const double hitUs = s.hits ? (double)s.hit_ns / 1000.0 / (double)s.hits : 0.0;
+        const double missUs = s.misses ? (double)s.miss_ns / 1000.0 / (double)s.misses : 0.0;
+        StringCchPrintfW(buf, ARRAYSIZE(buf),
+                         L"[DiSwitcher] decision cache: %llu/%llu hits (%.1f%%), %.2f us/hit, %.2f us/miss\r\n",
+                         s.hits, total, 100.0 * (double)s.hits / (double)total, hitUs, missUs);
+        OutputDebugStringW(buf);
+    }
+
+    DsTierStats tier;
+    DsEngineGetTierStats(&tier);
+    if (tier.timeouts[DS_TIER_ADAPT] || tier.timeouts[DS_TIER_MORPH]) {
+        StringCchPrintfW(buf, ARRAYSIZE(buf),
+                         L"[DiSwitcher] deadline: adapt %llu/%llu, morph %llu/%llu skipped; %llu settled, %llu dropped\r\n",
+                         tier.timeouts[DS_TIER_ADAPT], tier.hits[DS_TIER_ADAPT] + tier.timeouts[DS_TIER_ADAPT],
+                         tier.timeouts[DS_TIER_MORPH], tier.hits[DS_TIER_MORPH] + tier.timeouts[DS_TIER_MORPH],
+                         tier.settled, tier.dropped);
+        OutputDebugStringW(buf);
+    }
+
+    DsLayoutStats ls;
+    DsEngineGetLayoutStats(&ls);
+    StringCchPrintfW(buf, ARRAYSIZE(buf),
+                     L"[DiSwitcher] focus changes: %llu, remembered: %llu, predictive switches: %llu\r\n",
+                     ls.focus_changes, ls.remembered, ls.predictive_switches);
+    OutputDebugStringW(buf);
+
+    DsModelStats ms;
+    DsEngineGetModelStats(&ms);
+    StringCchPrintfW(buf, ARRAYSIZE(buf),
+                     L"[DiSwitcher] models: generation %u, %llu published, %llu reclaimed, %llu pending\r\n",
+                     (unsigned)ms.generation, ms.published, ms.reclaimed, ms.pending);
+    OutputDebugStringW(buf);
+
+    const DsTypeaheadStats* ts = &g_typeahead.stats;
+    if (ts->corrections) {
+        StringCchPrintfW(buf, ARRAYSIZE(buf),
+                         L"[DiSwitcher] type-ahead: %llu windows, %llu held, %llu replayed, depth %llu, max hold %.1f ms, %llu capped, %llu lost, %llu overflows\r\n",
+                         ts->corrections, ts->held, ts->replayed, ts->max_depth, (double)ts->max_hold_ns / 1e6,
+                         ts->capped, ts->lost, ts->overflows);
+        OutputDebugStringW(buf);
+    }
+
+    DsPhraseStats ps;
+    DsEngineGetPhraseStats(&ps);
+    if (g_inject_rounds) {
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        const double injectUs = (double)g_inject_qpc * 1e6 / (double)freq.QuadPart;
+        StringCchPrintfW(buf, ARRAYSIZE(buf),
+                         L"[DiSwitcher] injection: %llu rounds, %llu events, %.1f us/round; phrases: %llu (%llu tokens, %llu short)\r\n",
+                         g_inject_rounds, g_inject_events, injectUs / (double)g_inject_rounds,
+                         ps.phrases, ps.phrase_tokens, ps.short_tokens);
+        OutputDebugStringW(buf);
     }
-    return FALSE;
 }
 
 static void DebugPrintVkEvent(const wchar_t* prefix, DWORD vkCode, DWORD scanCode, DWORD flags)
@@ -656,13 +884,33 @@ static LRESULT CALLBACK LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lP
 {
     if (nCode == HC_ACTION) {
         const KBDLLHOOKSTRUCT* k = (const KBDLLHOOKSTRUCT*)lParam;
+        uint32_t replayTag = 0;
         if (k->flags & LLKHF_INJECTED) {
-            return CallNextHookEx(NULL, nCode, wParam, lParam);
+            const uint32_t tag = k->dwExtraInfo <= 0xFFFFFFFFu ? (uint32_t)k->dwExtraInfo : 0;
+            if (DS_INJECT_IS_CORRECTION(tag)) {
+                if (DsTypeaheadCorrectionSeen(&g_typeahead)) ReplayHeldKeys();
+                else if (!g_typeahead.correction_in_flight) ArmTypeaheadTimer();
+                return CallNextHookEx(NULL, nCode, wParam, lParam);
+            }
+            // Other software's input passes untouched; our re-injected keys are the user's typing.
+            if (!DS_INJECT_IS_REPLAY(tag)) return CallNextHookEx(NULL, nCode, wParam, lParam);
+            replayTag = tag;
+        }
+
+        const BOOL keyDown = (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN);
+        if (g_capture && !replayTag) CaptureKeyEvent(k, keyDown);
+
+        const uint64_t now = HostClockNs(NULL);
+        if (DsTypeaheadExpire(&g_typeahead, now)) ReplayHeldKeys();
+        DsTypeaheadKey key = { k->vkCode, k->scanCode, k->flags, keyDown ? true : false, 0, 0, 0 };
+        const DsTypeaheadAction action = DsTypeaheadOffer(&g_typeahead, &key, replayTag, now);
+        if (action != DS_TYPEAHEAD_PASS) {
+            if (action == DS_TYPEAHEAD_HOLD_FLUSH) ReplayHeldKeys();
+            else ArmTypeaheadTimer();
+            return 1;
         }
 
-        if (g_swallow_keyup && (wParam == WM_KEYUP || wParam == WM_SYSKEYUP) && k->vkCode == g_swallow_vk_keyup) {
-            g_swallow_keyup = FALSE;
-            g_swallow_vk_keyup = 0;
+        if ((wParam == WM_KEYUP || wParam == WM_SYSKEYUP) && DsEngineKeyUp(k->vkCode) == DS_SWALLOW) {
             return 1;
         }
 
@@ -689,80 +937,36 @@ static LRESULT CALLBACK LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lP
             break;
         }
 
-        if (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN) {
-            // Global hotkey: Pause to revert the last auto-correction (within a short window).
-            if (k->vkCode == VK_PAUSE) {
-                if (ToggleLastFixIfPossible()) return 1;
-                return CallNextHookEx(NULL, nCode, wParam, lParam);
-            }
-
-            // Ignore shortcuts/modifiers.
-            const BOOL ctrl = (GetAsyncKeyState(VK_CONTROL) & 0x8000) != 0;
-            const BOOL alt = (GetAsyncKeyState(VK_MENU) & 0x8000) != 0;
-            if (ctrl || alt) {
-                InvalidateLastFix();
-                return CallNextHookEx(NULL, nCode, wParam, lParam);
-            }
+        if (keyDown) {
+            DsKeyKind kind = DS_KEY_OTHER;
+            wchar_t ch = 0;
 
-            if (k->vkCode == VK_BACK) {
-                InvalidateLastFix();
-                if (g_token_len > 0) {
-                    g_token_len--;
-                    g_token[g_token_len] = 0;
-                }
-                return CallNextHookEx(NULL, nCode, wParam, lParam);
-            }
-
-            if (k->vkCode == VK_ESCAPE) {
-                InvalidateLastFix();
-                g_token_len = 0;
-                g_token[0] = 0;
-                return CallNextHookEx(NULL, nCode, wParam, lParam);
-            }
-
-            // Convert this keystroke to the actual character produced in the foreground layout.
-            HKL hkl = GetForegroundKeyboardLayout();
-            BYTE ks[256];
-            ZeroMemory(ks, sizeof(ks));
-            GetKeyboardState(ks);
-
-            wchar_t out[8];
-            const UINT vk = (UINT)k->vkCode;
-            const UINT sc = (UINT)k->scanCode;
-            int rc = ToUnicodeEx(vk, sc, ks, out, (int)ARRAYSIZE(out), 0, hkl);
-            if (rc == 1) {
-                const wchar_t ch = out[0];
-                if (IsWordChar(ch)) {
-                    InvalidateLastFix();
-                    if (g_token_len < TOKEN_MAX_CHARS) {
-                        g_token[g_token_len++] = ch;
-                        g_token[g_token_len] = 0;
-                    }
-                } else {
-                    if (g_token_len >= 3) {
-                        // If we correct on a printable boundary, swallow the boundary keystroke
-                        // and re-inject it after correction to keep order stable.
-                        if (TryAutocorrectToken(g_token, ch, TRUE)) {
-                            g_token_len = 0;
-                            g_token[0] = 0;
-                            g_swallow_vk_keyup = k->vkCode;
-                            g_swallow_keyup = TRUE;
-                            return 1;
-                        }
-                    }
-                    InvalidateLastFix();
-                    g_token_len = 0;
-                    g_token[0] = 0;
-                }
+            if (k->vkCode == VK_PAUSE) {
+                kind = DS_KEY_PAUSE;
+            } else if ((GetAsyncKeyState(VK_CONTROL) & 0x8000) || (GetAsyncKeyState(VK_MENU) & 0x8000)) {
+                kind = DS_KEY_SHORTCUT;
+            } else if (k->vkCode == VK_BACK) {
+                kind = DS_KEY_BACK;
+            } else if (k->vkCode == VK_ESCAPE) {
+                kind = DS_KEY_ESCAPE;
             } else {
-                // Non-text key ends current token.
-                if (g_token_len >= 3) {
-                    (void)TryAutocorrectToken(g_token, 0, FALSE);
+                // Convert this keystroke to the actual character produced in the foreground layout.
+                HKL hkl = GetForegroundKeyboardLayout();
+                BYTE ks[256];
+                ZeroMemory(ks, sizeof(ks));
+                GetKeyboardState(ks);
+
+                wchar_t out[8];
+                const UINT vk = (UINT)k->vkCode;
+                const UINT sc = (UINT)k->scanCode;
+                int rc = ToUnicodeEx(vk, sc, ks, out, (int)ARRAYSIZE(out), 0, hkl);
+                if (rc == 1) {
+                    kind = DS_KEY_TEXT;
+                    ch = out[0];
                 }
-                InvalidateLastFix();
-                g_token_len = 0;
-                g_token[0] = 0;
             }
+
+            if (DsEngineKeyDown(kind, ch, k->vkCode) == DS_SWALLOW) return 1;
         }
     }
     return CallNextHookEx(NULL, nCode, wParam, lParam);
@@ -864,8 +1068,18 @@ static void TrayShowMenu(HWND hwnd)
 
 static void Cleanup(HWND hwnd)
 {
-    (void)hwnd;
     UninstallKeyboardHook();
+    UninstallFocusHook();
+    KillTimer(hwnd, TYPEAHEAD_TIMER_ID);
+    g_main_hwnd = NULL;
+    StopReloader();
+    ReportEngineStats();
+    CloseAdaptive();
+    DsEngineShutdown();
+    if (g_capture) {
+        KillTimer(hwnd, CAPTURE_FLUSH_TIMER_ID);
+        CaptureClose();
+    }
     TrayRemove();
     if (g_tray_menu) {
         DestroyMenu(g_tray_menu);
@@ -889,6 +1103,7 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
 {
     switch (msg) {
     case WM_CREATE: {
+        g_main_hwnd = hwnd;
         g_tray_menu = CreatePopupMenu();
         if (g_tray_menu) {
             AppendMenuW(g_tray_menu, MF_STRING, IDM_TRAY_EXIT, L"Exit");
@@ -902,8 +1117,22 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
         if (!InstallKeyboardHook()) {
             ShowWin32ErrorBox(hwnd, L"Failed to install keyboard hook.");
         }
+        InstallFocusHook();
+        if (g_capture) SetTimer(hwnd, CAPTURE_FLUSH_TIMER_ID, CAPTURE_FLUSH_INTERVAL_MS, NULL);
         return 0;
     }
+    case WM_TIMER:
+        if (wParam == TYPEAHEAD_TIMER_ID) {
+            KillTimer(hwnd, TYPEAHEAD_TIMER_ID);
+            if (DsTypeaheadExpire(&g_typeahead, HostClockNs(NULL))) ReplayHeldKeys();
+            else ArmTypeaheadTimer();
+            return 0;
+        }
+        if (wParam == CAPTURE_FLUSH_TIMER_ID && g_capture) {
+            DsTraceWriterFlush(&g_capture->writer);
+            return 0;
+        }
+        break;
     case WM_COMMAND: {
         const UINT id = LOWORD(wParam);
         if (id == IDM_TRAY_EXIT) {
@@ -945,6 +1174,33 @@ static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
     return DefWindowProcW(hwnd, msg, wParam, lParam);
 }
 
+static void ParseCommandLine(void)
+{
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (!argv) return;
+    for (int i = 1; i < argc; i++) {
+        if (lstrcmpiW(argv[i], L"--capture") == 0 && i + 1 < argc) {
+            if (!CaptureOpen(argv[++i])) {
+                ShowWin32ErrorBox(NULL, L"Failed to open capture file.");
+            }
+        } else if (lstrcmpiW(argv[i], L"--morph") == 0 && i + 1 < argc) {
+            StringCchCopyW(g_morph_path, ARRAYSIZE(g_morph_path), argv[++i]);
+        } else if (lstrcmpiW(argv[i], L"--config") == 0 && i + 1 < argc) {
+            StringCchCopyW(g_config_path, ARRAYSIZE(g_config_path), argv[++i]);
+        } else if (lstrcmpiW(argv[i], L"--no-typeahead") == 0) {
+            g_typeahead_enabled = FALSE;
+        } else if (lstrcmpiW(argv[i], L"--budget-us") == 0 && i + 1 < argc) {
+            g_budget_us = (DWORD)wcstoul(argv[++i], NULL, 10);
+        } else if (lstrcmpiW(argv[i], L"--adapt") == 0 && i + 1 < argc) {
+            StringCchCopyW(g_adapt_path, ARRAYSIZE(g_adapt_path), argv[++i]);
+        } else if (lstrcmpiW(argv[i], L"--no-adapt") == 0) {
+            g_adapt_enabled = FALSE;
+        }
+    }
+    LocalFree(argv);
+}
+
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR lpCmdLine, int nCmdShow)
 {
     (void)hPrevInstance;
@@ -962,6 +1218,9 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR lpCmdLin
         return 0;
     }
 
+    ParseCommandLine();
+    InitEngine();
+
     const wchar_t* kClassName = L"DiSwitcherHiddenWindow";
 
     if (!g_app_icon_small) g_app_icon_small = CreateTrayIconS(16);
@@ -0,0 +1,236 @@
+#include "model.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "shortwords.h"
+
+#define DS_ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+// ---------- Built-in data ----------
+
+// Lightweight "not gibberish" scoring: common bigrams (+ a few short-word helpers).
+static const wchar_t* const kBigramsEn[] = {
+    L"th", L"he", L"in", L"er", L"an", L"re", L"on", L"at", L"en", L"nd",
+    L"ti", L"es", L"or", L"te", L"of", L"ed", L"is", L"it", L"al", L"ar",
+    L"st", L"to", L"nt", L"ng", L"se", L"ha", L"as", L"ou", L"io", L"le",
+    // Short-word helpers
+    L"oo", L"ck", L"ok", L"bo", L"ee",
+};
+
+static const wchar_t* const kBigramsRu[] = {
+    L"\u0441\u0442", L"\u043d\u043e", L"\u0442\u043e", L"\u043d\u0430", L"\u0435\u043d", L"\u043e\u0432", L"\u043d\u0438", L"\u0440\u0430", L"\u0432\u043e", L"\u043a\u043e",
+    L"\u043f\u0440", L"\u043f\u043e", L"\u0435\u0440", L"\u0440\u043e", L"\u043e\u0441", L"\u0430\u043b", L"\u0442\u0430", L"\u0432\u0430", L"\u043d\u0435", L"\u043b\u0438",
+    L"\u0440\u0435",
+};
+
+static const wchar_t* const kBadBigramsRu[] = {
+    L"\u0449\u0449", // щщ
+    L"\u044a\u044a", // ъъ
+    L"\u044b\u044b", // ыы
+    L"\u0439\u0439", // йй
+    L"\u044c\u044a", // ьъ
+    L"\u044a\u044c", // ъь
+    L"\u0436\u044b", // жы (should be жи)
+    L"\u0448\u044b", // шы (should be ши)
+};
+
+// Most frequent one- and two-letter words. Bigram scores say nothing about them, so short tokens
+// only take part in phrase corrections when they map onto one of these.
+static const wchar_t* const kShortWordsEn[] = {
+    L"a", L"i", L"am", L"an", L"as", L"at", L"be", L"by", L"do", L"go", L"he", L"if", L"in", L"is",
+    L"it", L"me", L"my", L"no", L"of", L"ok", L"on", L"or", L"so", L"to", L"up", L"us", L"we",
+};
+
+static const wchar_t* const kShortWordsRu[] = {
+    L"\u0430", L"\u0432", L"\u0438", L"\u043a", L"\u043e", L"\u0441", L"\u0443", L"\u044f",
+    L"\u0431\u044b", L"\u0432\u043e", L"\u0432\u044b", L"\u0434\u0430", L"\u0434\u043e",
+    L"\u0436\u0435", L"\u0437\u0430", L"\u0438\u0437", L"\u0438\u043c", L"\u0438\u0445",
+    L"\u043a\u043e", L"\u043b\u0438", L"\u043c\u044b", L"\u043d\u0430", L"\u043d\u0435",
+    L"\u043d\u0438", L"\u043d\u043e", L"\u043d\u0443", L"\u043e\u0431", L"\u043e\u043d",
+    L"\u043e\u0442", L"\u043f\u043e", L"\u0441\u043e", L"\u0442\u0430", L"\u0442\u0435",
+    L"\u0442\u043e", L"\u0442\u044b", L"\u0443\u0436",
+};
+
+// Physical-keyboard mapping for QWERTY <-> ЙЦУКЕН (lowercase); EN -> RU is the inverse.
+static const DsCharPair kRuToEn[] = {
+    {L'\u0439', L'q'},{L'\u0446', L'w'},{L'\u0443', L'e'},{L'\u043a', L'r'},{L'\u0435', L't'},{L'\u043d', L'y'},{L'\u0433', L'u'},{L'\u0448', L'i'},{L'\u0449', L'o'},{L'\u0437', L'p'},{L'\u0445', L'['},{L'\u044a', L']'},
+    {L'\u0444', L'a'},{L'\u044b', L's'},{L'\u0432', L'd'},{L'\u0430', L'f'},{L'\u043f', L'g'},{L'\u0440', L'h'},{L'\u043e', L'j'},{L'\u043b', L'k'},{L'\u0434', L'l'},{L'\u0436', L';'},{L'\u044d', L'\''},
+    {L'\u044f', L'z'},{L'\u0447', L'x'},{L'\u0441', L'c'},{L'\u043c', L'v'},{L'\u0438', L'b'},{L'\u0442', L'n'},{L'\u044c', L'm'},{L'\u0431', L','},{L'\u044e', L'.'},
+    {L'\u0451', L'`'},
+};
+
+static size_t CopyPairs(DsCharPair* out, size_t cap, const wchar_t* const* pairs, size_t count)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < count && n < cap; i++) {
+        out[n].first = pairs[i][0];
+        out[n].second = pairs[i][1];
+        n++;
+    }
+    return n;
+}
+
+static size_t CopyWords(wchar_t (*out)[3], size_t cap, const wchar_t* const* words, size_t count)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < count && n < cap; i++) {
+        memset(out[n], 0, sizeof(out[n]));
+        wcsncpy(out[n], words[i], 2);
+        n++;
+    }
+    return n;
+}
+
+void DsModelInitDefaults(DsModel* m)
+{
+    memset(m, 0, sizeof(*m));
+
+    // Tuned to fix cases like "руддщ" -> "hello".
+    m->thresholds.min_mapped_short = 6;
+    m->thresholds.min_mapped = 8;
+    m->thresholds.min_diff_short = 4;
+    m->thresholds.min_diff = 6;
+    m->thresholds.weak_base = 6;
+    m->thresholds.min_diff_weak = 3;
+    m->thresholds.min_diff_mixed = 2;
+    m->thresholds.morph_bonus = 8;
+    m->thresholds.short_word_evidence = 3;
+    m->thresholds.phrase_min_evidence = 8;
+    m->thresholds.adapt_bonus = 6;
+
+    m->bigrams_en_count = CopyPairs(m->bigrams_en, DS_MODEL_MAX_BIGRAMS, kBigramsEn, DS_ARRAYSIZE(kBigramsEn));
+    m->bigrams_ru_count = CopyPairs(m->bigrams_ru, DS_MODEL_MAX_BIGRAMS, kBigramsRu, DS_ARRAYSIZE(kBigramsRu));
+    m->bad_bigrams_ru_count = CopyPairs(m->bad_bigrams_ru, DS_MODEL_MAX_BIGRAMS, kBadBigramsRu, DS_ARRAYSIZE(kBadBigramsRu));
+
+    memcpy(m->ru_to_en, kRuToEn, sizeof(kRuToEn));
+    m->map_count = DS_ARRAYSIZE(kRuToEn);
+
+    m->short_words_en_count = CopyWords(m->short_words_en, DS_MODEL_MAX_SHORT_WORDS, kShortWordsEn, DS_ARRAYSIZE(kShortWordsEn));
+    m->short_words_ru_count = CopyWords(m->short_words_ru, DS_MODEL_MAX_SHORT_WORDS, kShortWordsRu, DS_ARRAYSIZE(kShortWordsRu));
+}
+
+DsModel* DsModelCreate(void)
+{
+    DsModel* m = (DsModel*)malloc(sizeof(DsModel));
+    if (m) DsModelInitDefaults(m);
+    return m;
+}
+
+DsModel* DsModelClone(const DsModel* m)
+{
+    DsModel* copy = (DsModel*)malloc(sizeof(DsModel));
+    if (!copy) return NULL;
+    memcpy(copy, m, sizeof(*copy));
+    copy->release = NULL;
+    copy->release_ctx = NULL;
+    return copy;
+}
+
+void DsModelFree(DsModel* m)
+{
+    if (!m) return;
+    if (m->release) m->release(m->release_ctx);
+    free(m);
+}
+
+// ---------- Exceptions ----------
+
+static uint64_t ExceptionHash(const wchar_t* lower, size_t n)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < n; i++) h = (h ^ (uint64_t)(uint16_t)lower[i]) * 0x100000001b3ULL;
+    return h ? h : 1;
+}
+
+bool DsModelAddException(DsModel* m, const wchar_t* word, size_t n)
+{
+    if (!n || m->exception_count * 2 >= DS_MODEL_EXCEPTION_SLOTS) return false;
+    wchar_t lower[64];
+    if (n > DS_ARRAYSIZE(lower)) return false;
+    for (size_t i = 0; i < n; i++) lower[i] = DsToLower(word[i]);
+
+    const uint64_t h = ExceptionHash(lower, n);
+    size_t slot = (size_t)(h % DS_MODEL_EXCEPTION_SLOTS);
+    while (m->exceptions[slot]) {
+        if (m->exceptions[slot] == h) return true;
+        slot = (slot + 1) % DS_MODEL_EXCEPTION_SLOTS;
+    }
+    m->exceptions[slot] = h;
+    m->exception_count++;
+    return true;
+}
+
+bool DsModelIsException(const DsModel* m, const wchar_t* lower, size_t n)
+{
+    if (!m->exception_count) return false;
+    const uint64_t h = ExceptionHash(lower, n);
+    size_t slot = (size_t)(h % DS_MODEL_EXCEPTION_SLOTS);
+    while (m->exceptions[slot]) {
+        if (m->exceptions[slot] == h) return true;
+        slot = (slot + 1) % DS_MODEL_EXCEPTION_SLOTS;
+    }
+    return false;
+}
+
+bool DsModelIsShortWord(const DsModel* m, const wchar_t* lower, size_t n, bool english)
+{
+    if (n == 0 || n > 2) return false;
+    const wchar_t (*words)[3] = english ? m->short_words_en : m->short_words_ru;
+    const size_t count = english ? m->short_words_en_count : m->short_words_ru_count;
+    for (size_t i = 0; i < count; i++) {
+        if (words[i][0] == lower[0] && words[i][1] == (n > 1 ? lower[1] : 0)) return true;
+    }
+    return false;
+}
+
+uint32_t DsShortWordClass(const wchar_t* lower, size_t n)
+{
+    // Key as generated: first letter << 11 | second letter (or 0); both BMP letters below U+0800.
+    if (n == 0 || n > 2 || (uint32_t)lower[0] >= 0x800 || (n == 2 && (uint32_t)lower[1] >= 0x800)) return 0;
+    const uint32_t key = ((uint32_t)lower[0] << 11) | (n == 2 ? (uint32_t)lower[1] : 0);
+    const uint32_t bucket = (key * DS_SHORT_MUL1) >> (32 - DS_SHORT_BUCKET_BITS);
+    const uint32_t slot = ((key * DS_SHORT_MUL2) >> (32 - DS_SHORT_TABLE_BITS)) ^ kShortDisplace[bucket];
+    const uint32_t entry = kShortTable[slot];
+    return (entry & 0xFFFFFFu) == key ? entry >> 24 : 0;
+}
+
+// ---------- Layout mapping ----------
+
+static wchar_t MapChar(const DsModel* m, bool toEnglish, wchar_t lower)
+{
+    const DsCharPair* map = m ? m->ru_to_en : kRuToEn;
+    const size_t count = m ? m->map_count : DS_ARRAYSIZE(kRuToEn);
+    for (size_t i = 0; i < count; i++) {
+        const DsCharPair* pair = &map[i];
+        if (toEnglish ? pair->first == lower : pair->second == lower) return toEnglish ? pair->second : pair->first;
+    }
+    return 0;
+}
+
+void DsModelMap(const DsModel* m, bool toEnglish, const wchar_t* in, wchar_t* out, size_t outCap)
+{
+    size_t n = 0;
+    for (const wchar_t* p = in; *p && n + 1 < outCap; p++) {
+        const wchar_t ch = *p;
+        bool upper;
+        wchar_t lower;
+        if (toEnglish) {
+            lower = DsToLower(ch);
+            upper = (ch != lower);
+        } else {
+            upper = (ch >= L'A' && ch <= L'Z');
+            lower = upper ? (wchar_t)(ch - L'A' + L'a') : ch;
+        }
+        wchar_t mapped = MapChar(m, toEnglish, lower);
+        if (!mapped) mapped = lower;
+        if (upper) {
+            // RU -> EN only capitalizes letters: 'Б' stays ',' rather than whatever towupper makes of it.
+            if (!toEnglish) mapped = DsToUpper(mapped);
+            else if (mapped >= L'a' && mapped <= L'z') mapped = (wchar_t)(mapped - L'a' + L'A');
+        }
+        out[n++] = mapped;
+    }
+    out[n] = 0;
+}
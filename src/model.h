@@ -0,0 +1,100 @@
+#ifndef DISWITCHER_MODEL_H
+#define DISWITCHER_MODEL_H
+
+// Everything the engine decides with: bigram tables, the physical layout map, thresholds, short
+// words, exceptions and the optional word-form model. A published model is immutable; changes are
+// made on a private copy (DsModelClone) and published as a whole (DsEnginePublishModel), so the
+// hook always sees one consistent model.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#include "morph.h"
+
+#define DS_MODEL_MAX_BIGRAMS 128
+#define DS_MODEL_MAX_MAP 64
+#define DS_MODEL_MAX_SHORT_WORDS 96
+#define DS_MODEL_EXCEPTION_SLOTS 1024 // open addressing; at most half of them are used
+
+typedef struct {
+    wchar_t first;
+    wchar_t second;
+} DsCharPair;
+
+typedef struct {
+    int min_mapped_short;    // mapped score required for tokens of up to 4 characters
+    int min_mapped;          // ... and for longer tokens
+    int min_diff_short;      // mapped - typed score required for tokens of up to 5 characters
+    int min_diff;            // ... and for longer tokens
+    int weak_base;           // typed score at or below which min_diff_weak applies instead
+    int min_diff_weak;
+    int min_diff_mixed;      // tokens mixing Latin and Cyrillic letters
+    int morph_bonus;         // added to the Russian side for known word forms
+    int short_word_evidence; // phrase evidence of a short token mapping onto a frequent short word
+    int phrase_min_evidence; // phrase total needed when no token qualifies alone
+    int adapt_bonus;         // most a token can gain from the user's own letter statistics
+} DsThresholds;
+
+typedef struct DsModel {
+    uint32_t generation; // assigned when published
+
+    DsThresholds thresholds;
+
+    DsCharPair bigrams_en[DS_MODEL_MAX_BIGRAMS];
+    size_t bigrams_en_count;
+    DsCharPair bigrams_ru[DS_MODEL_MAX_BIGRAMS];
+    size_t bigrams_ru_count;
+    DsCharPair bad_bigrams_ru[DS_MODEL_MAX_BIGRAMS];
+    size_t bad_bigrams_ru_count;
+
+    // Physical key mapping: lowercase Russian letter -> character on the same key in EN.
+    DsCharPair ru_to_en[DS_MODEL_MAX_MAP];
+    size_t map_count;
+
+    // One- and two-letter words, lowercase, NUL padded.
+    wchar_t short_words_en[DS_MODEL_MAX_SHORT_WORDS][3];
+    size_t short_words_en_count;
+    wchar_t short_words_ru[DS_MODEL_MAX_SHORT_WORDS][3];
+    size_t short_words_ru_count;
+
+    // Hashes of lowercase tokens that are never corrected (0 = empty slot).
+    uint64_t exceptions[DS_MODEL_EXCEPTION_SLOTS];
+    size_t exception_count;
+
+    // Optional word-form model and the cleanup for the memory it points into (e.g. a file
+    // mapping); called when the model is freed.
+    const DsMorph* morph;
+    void (*release)(void* ctx);
+    void* release_ctx;
+} DsModel;
+
+// Built-in tables and thresholds, as compiled in.
+void DsModelInitDefaults(DsModel* m);
+
+// Heap helpers. DsModelCreate returns a model with the defaults; DsModelClone copies everything
+// except the release hook (the copy shares `morph` without owning it). NULL on allocation failure.
+DsModel* DsModelCreate(void);
+DsModel* DsModelClone(const DsModel* m);
+void DsModelFree(DsModel* m);
+
+bool DsModelAddException(DsModel* m, const wchar_t* word, size_t n);
+bool DsModelIsException(const DsModel* m, const wchar_t* lower, size_t n);
+
+bool DsModelIsShortWord(const DsModel* m, const wchar_t* lower, size_t n, bool english);
+
+// Every valid one- and two-letter EN and RU word, and every letter pair or letter that turns into
+// one on the other layout, in a perfect hash generated ahead of time (src/shortwords.h, from
+// tools/diswitcher_shortwords.c): one hash and one compare per lookup. Unlike the short words
+// above, the set is complete and fixed, not just the most frequent words. Returns DS_SHORT_* flags
+// for the lowercase token, 0 if it is neither.
+#define DS_SHORT_WORD 0x1u // a word in the script it is written in
+#define DS_SHORT_TWIN 0x2u // a word once mapped to the other layout with the built-in map
+uint32_t DsShortWordClass(const wchar_t* lower, size_t n);
+
+// Maps text typed on one layout to what the same keys produce on the other; case is preserved,
+// characters without a mapping are copied (lowercased). A NULL model uses the built-in map.
+void DsModelMap(const DsModel* m, bool toEnglish, const wchar_t* in, wchar_t* out, size_t outCap);
+
+#endif
@@ -0,0 +1,69 @@
+#include "morph.h"
+
+#include <string.h>
+
+static uint32_t ReadU32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int DsMorphSymbol(wchar_t ch)
+{
+    if (ch >= 0x0410 && ch <= 0x042F) ch = (wchar_t)(ch + 0x20); // А..Я
+    if (ch == 0x0451 || ch == 0x0401) ch = 0x0435;                // ё/Ё -> е
+    if (ch >= 0x0430 && ch <= 0x044F) return (int)(ch - 0x0430) + 1;
+    if (ch == L'-') return DS_MORPH_SYM_HYPHEN;
+    return 0;
+}
+
+bool DsMorphOpen(DsMorph* m, const void* data, size_t size)
+{
+    memset(m, 0, sizeof(*m));
+    const uint8_t* p = (const uint8_t*)data;
+    if (size < DS_MORPH_HEADER_SIZE || memcmp(p, DS_MORPH_MAGIC, 4) != 0) return false;
+    if (ReadU32(p + 4) != DS_MORPH_VERSION) return false;
+
+    const uint32_t edgeCount = ReadU32(p + 8);
+    const uint32_t root = ReadU32(p + 12);
+    if (edgeCount == 0 || edgeCount > DS_MORPH_MAX_EDGES) return false;
+    if ((size - DS_MORPH_HEADER_SIZE) / 4 < edgeCount) return false;
+    if (root >= edgeCount) return false;
+    // The edge array is read in place; the format is little-endian and 4-byte aligned after the header.
+    if (((uintptr_t)(p + DS_MORPH_HEADER_SIZE) & 3) != 0) return false;
+
+    m->edges = (const uint32_t*)(p + DS_MORPH_HEADER_SIZE);
+    m->edge_count = edgeCount;
+    m->root = root;
+    m->form_count = ReadU32(p + 16);
+    m->state_count = ReadU32(p + 20);
+    return true;
+}
+
+bool DsMorphContains(const DsMorph* m, const wchar_t* word, size_t n)
+{
+    if (!m->edges || n == 0) return false;
+
+    uint32_t state = m->root;
+    for (size_t i = 0; i < n; i++) {
+        const int sym = DsMorphSymbol(word[i]);
+        if (!sym || !state) return false;
+
+        uint32_t e = 0;
+        bool found = false;
+        for (uint32_t idx = state; idx < m->edge_count; idx++) {
+            e = m->edges[idx];
+            const uint32_t label = DS_MORPH_EDGE_LABEL(e);
+            if (label == (uint32_t)sym) {
+                found = true;
+                break;
+            }
+            // Edges are sorted by label: stop early once past the symbol.
+            if (label > (uint32_t)sym || (e & DS_MORPH_EDGE_LAST)) break;
+        }
+        if (!found) return false;
+        if (i + 1 == n) return (e & DS_MORPH_EDGE_FINAL) != 0;
+        state = DS_MORPH_EDGE_TARGET(e);
+        if (state >= m->edge_count) return false;
+    }
+    return false;
+}
@@ -0,0 +1,53 @@
+#ifndef DISWITCHER_MORPH_H
+#define DISWITCHER_MORPH_H
+
+// Read-only Russian word-form model: a minimal acyclic automaton (DAWG) over every inflected form.
+// Minimization shares common suffixes, so each lexeme collapses into a stem path that ends in a
+// shared "paradigm" subgraph of endings; millions of forms fit in a few MB.
+//
+// The model is a flat little-endian blob that can be memory-mapped as is:
+//   header: "DSMF" | u32 version | u32 edge count | u32 root | u32 form count | u32 state count | u64 reserved
+//   edges:  u32[edge count]; a state is a run of edges sorted by label, the last one flagged LAST.
+//     bits 0-5   label (DS_MORPH_SYM_*)
+//     bit  6     FINAL: a word form ends after this edge
+//     bit  7     LAST: last edge of its state
+//     bits 8-31  index of the target state's first edge (0 = no outgoing edges)
+// Built by tools/diswitcher_morph.c from OpenCorpora/pymorphy-style dictionaries or plain form lists.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#define DS_MORPH_MAGIC "DSMF"
+#define DS_MORPH_VERSION 1
+#define DS_MORPH_HEADER_SIZE 32
+
+// Alphabet: а..я -> 1..32 (ё folds to е), '-' -> 33.
+#define DS_MORPH_SYM_HYPHEN 33
+#define DS_MORPH_SYMBOLS 34
+
+#define DS_MORPH_EDGE_LABEL(e) ((e) & 0x3Fu)
+#define DS_MORPH_EDGE_FINAL 0x40u
+#define DS_MORPH_EDGE_LAST 0x80u
+#define DS_MORPH_EDGE_TARGET(e) ((e) >> 8)
+#define DS_MORPH_MAX_EDGES (1u << 24)
+
+typedef struct {
+    const uint32_t* edges;
+    uint32_t edge_count;
+    uint32_t root;
+    uint32_t form_count;
+    uint32_t state_count;
+} DsMorph;
+
+// Lowercase Cyrillic letter or hyphen -> symbol; 0 if the character is outside the alphabet.
+int DsMorphSymbol(wchar_t ch);
+
+// Validates the header and bounds; `data` must stay mapped while the model is in use.
+bool DsMorphOpen(DsMorph* m, const void* data, size_t size);
+
+// True if `word` (any case) is a known word form.
+bool DsMorphContains(const DsMorph* m, const wchar_t* word, size_t n);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef DISWITCHER_SHORTWORDS_H
+#define DISWITCHER_SHORTWORDS_H
+
+// Generated by tools/diswitcher_shortwords.c (diswitcher-shortwords gen > src/shortwords.h);
+// do not edit. 181 keys; multipliers found on attempt 1. Only src/model.c includes this.
+
+#include <stdint.h>
+
+#define DS_SHORT_TABLE_BITS 9
+#define DS_SHORT_BUCKET_BITS 7
+#define DS_SHORT_MUL1 0x77AE0BF3u
+#define DS_SHORT_MUL2 0xEEB9026Fu
+
+static const uint16_t kShortDisplace[1u << DS_SHORT_BUCKET_BITS] = {
+    1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0,
+    0, 0, 4, 0, 0, 0, 0, 0, 2, 2, 0, 0, 0, 0, 0, 3,
+    0, 0, 4, 0, 3, 2, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0,
+    1, 0, 1, 1, 0, 0, 4, 0, 0, 0, 4, 2, 1, 1, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 3, 0, 0, 0, 0, 0, 1,
+    0, 0, 2, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+// (first letter << 11 | second letter or 0) | DS_SHORT_* flags << 24; 0 = empty.
+static const uint32_t kShortTable[1u << DS_SHORT_TABLE_BITS] = {
+    0x0203206A, 0x02226444, 0x00000000, 0x00000000, 0x02035862, 0x0103386F, 0x02224442, 0x02224C30,
+    0x00000000, 0x00000000, 0x02222440, 0x01036879, 0x00000000, 0x0121E44B, 0x00000000, 0x00000000,
+    0x02031070, 0x0203A071, 0x00000000, 0x00000000, 0x0121AC35, 0x00000000, 0x00000000, 0x01227800,
+    0x01030873, 0x00000000, 0x01218445, 0x00000000, 0x00000000, 0x01037872, 0x0203D06C, 0x01034800,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x0121C000, 0x02226443, 0x00000000, 0x00000000,
+    0x00000000, 0x0121943E, 0x0103A86D, 0x0222044C, 0x02037066, 0x02224432, 0x0121EC38, 0x02033071,
+    0x00000000, 0x02039000, 0x00000000, 0x00000000, 0x00000000, 0x01220800, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x02037074, 0x00000000, 0x00000000, 0x00000000, 0x0121AC51, 0x00000000, 0x02032000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x0103A06F, 0x01221C41,
+    0x00000000, 0x00000000, 0x01034866, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x0103B865, 0x00000000, 0x00000000, 0x01034069, 0x01218434, 0x00000000, 0x01221435, 0x0121F442,
+    0x00000000, 0x00000000, 0x02037073, 0x0121944B, 0x00000000, 0x00000000, 0x0222244C, 0x02035071,
+    0x0203186A, 0x00000000, 0x00000000, 0x00000000, 0x02224430, 0x00000000, 0x00000000, 0x01034874,
+    0x00000000, 0x00000000, 0x02221C40, 0x00000000, 0x00000000, 0x00000000, 0x0121C437, 0x0121FC3E,
+    0x00000000, 0x0203606A, 0x02032863, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x02224C3B, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x0222244B, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x0121EC35,
+    0x00000000, 0x00000000, 0x01034873, 0x00000000, 0x0121C445, 0x00000000, 0x00000000, 0x00000000,
+    0x01034864, 0x00000000, 0x00000000, 0x00000000, 0x0221BC48, 0x00000000, 0x00000000, 0x0103786E,
+    0x00000000, 0x00000000, 0x02224C3A, 0x00000000, 0x00000000, 0x00000000, 0x0121D43E, 0x02219C37,
+    0x0121F431, 0x0121EC43, 0x0203386A, 0x02219449, 0x00000000, 0x02220448, 0x0203D000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x0203106B, 0x01036865, 0x02031800,
+    0x00000000, 0x00000000, 0x01219000, 0x02223443, 0x0103086E, 0x0103986F, 0x00000000, 0x00000000,
+    0x00000000, 0x02032073, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x0222444B,
+    0x00000000, 0x00000000, 0x00000000, 0x0203C86A, 0x00000000, 0x00000000, 0x00000000, 0x0203506E,
+    0x0103A868, 0x01227C34, 0x01218C4B, 0x0203306C, 0x00000000, 0x01031079, 0x00000000, 0x00000000,
+    0x0203A06B, 0x0221C443, 0x00000000, 0x00000000, 0x01038069, 0x00000000, 0x02222000, 0x00000000,
+    0x0103086D, 0x02224C47, 0x00000000, 0x00000000, 0x0203B073, 0x01034065, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x0222643D, 0x00000000, 0x0103706F, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x0203306B, 0x00000000,
+    0x00000000, 0x00000000, 0x0221FC49, 0x00000000, 0x01221C3C, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x02036066, 0x02224C46, 0x01226C39, 0x0103786B, 0x0121DC38,
+    0x00000000, 0x0121F43D, 0x00000000, 0x01221430, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x02222447, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x0121AC3C, 0x00000000, 0x00000000, 0x02224000, 0x00000000,
+    0x00000000, 0x00000000, 0x0221BC44, 0x00000000, 0x00000000, 0x00000000, 0x02031000, 0x0122143E,
+    0x00000000, 0x0121A430, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x02220444,
+    0x00000000, 0x02031076, 0x0121EC30, 0x00000000, 0x0121D000, 0x0121AC3B, 0x0103486E, 0x00000000,
+    0x00000000, 0x00000000, 0x01036861, 0x00000000, 0x02038066, 0x0121A43E, 0x01037878, 0x00000000,
+    0x00000000, 0x00000000, 0x0103206F, 0x00000000, 0x00000000, 0x01221800, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x02035079, 0x0103A873, 0x0203C866, 0x0121EC3E, 0x00000000,
+    0x0221AC49, 0x00000000, 0x02220443, 0x00000000, 0x0203A076, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x01226C45, 0x01030878, 0x0122144B, 0x02033000, 0x01227433,
+    0x01037877, 0x00000000, 0x00000000, 0x00000000, 0x0121843B, 0x00000000, 0x00000000, 0x01037868,
+    0x01034061, 0x02219C40, 0x0203C874, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x0203C865, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x0121F000, 0x02222435, 0x00000000,
+    0x00000000, 0x00000000, 0x0121AC39, 0x00000000, 0x01031065, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x02224C42, 0x01030868,
+    0x00000000, 0x00000000, 0x01030800, 0x0121F439, 0x00000000, 0x00000000, 0x00000000, 0x01220C3E,
+    0x00000000, 0x0203706A, 0x00000000, 0x01218000, 0x0121B435, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x0203A074, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x0221C43D, 0x02035000, 0x00000000, 0x02221449, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x01218439, 0x00000000, 0x00000000, 0x01037866, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x0103A870, 0x02225C49, 0x02222442, 0x02224435, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x0121C43C, 0x01221C36, 0x01032868, 0x00000000, 0x00000000,
+    0x0103406D, 0x02219C4C, 0x00000000, 0x02224C40, 0x00000000, 0x00000000, 0x00000000, 0x02032800,
+    0x00000000, 0x0121BC30, 0x00000000, 0x0203906A, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x0203C862, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x02032876, 0x00000000, 0x00000000, 0x00000000, 0x0121C43B, 0x01030874, 0x00000000,
+    0x00000000, 0x01038061, 0x00000000, 0x02219C4B, 0x0121F445, 0x00000000, 0x00000000, 0x00000000,
+};
+
+#endif
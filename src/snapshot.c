@@ -0,0 +1,115 @@
+#include "snapshot.h"
+
+#include <string.h>
+
+static void WriterLock(DsSnapshotDomain* d)
+{
+    while (!DsAtomicCas32(&d->writer_lock, 0, 1)) DsCpuRelax();
+}
+
+static void WriterUnlock(DsSnapshotDomain* d)
+{
+    DsAtomicStore32(&d->writer_lock, 0);
+}
+
+void DsSnapshotInit(DsSnapshotDomain* d, void* initial, DsSnapshotFreeFn freeFn, void* freeCtx)
+{
+    memset(d, 0, sizeof(*d));
+    d->free_fn = freeFn;
+    d->free_ctx = freeCtx;
+    d->epoch = 1; // slot value 0 means "quiescent", so epochs start at 1
+    DsAtomicExchangePtr(&d->current, initial);
+}
+
+void DsSnapshotDestroy(DsSnapshotDomain* d)
+{
+    WriterLock(d);
+    for (size_t i = 0; i < d->retired_count; i++) d->free_fn(d->free_ctx, d->retired[i].snapshot);
+    d->retired_count = 0;
+    void* current = DsAtomicExchangePtr(&d->current, NULL);
+    if (current) d->free_fn(d->free_ctx, current);
+    WriterUnlock(d);
+}
+
+int DsSnapshotRegisterReader(DsSnapshotDomain* d)
+{
+    for (int i = 0; i < DS_SNAPSHOT_MAX_READERS; i++) {
+        if (DsAtomicCas32(&d->readers[i].used, 0, 1)) {
+            DsAtomicStore64(&d->readers[i].epoch, 0);
+            return i;
+        }
+    }
+    return -1;
+}
+
+void DsSnapshotUnregisterReader(DsSnapshotDomain* d, int slot)
+{
+    DsAtomicStore64(&d->readers[slot].epoch, 0);
+    DsAtomicStore32(&d->readers[slot].used, 0);
+}
+
+// Oldest epoch any reader may still be running in, or UINT64_MAX if all are quiescent.
+static uint64_t OldestActiveEpoch(DsSnapshotDomain* d)
+{
+    uint64_t oldest = UINT64_MAX;
+    for (int i = 0; i < DS_SNAPSHOT_MAX_READERS; i++) {
+        const uint64_t e = DsAtomicLoad64(&d->readers[i].epoch);
+        if (e && e < oldest) oldest = e;
+    }
+    return oldest;
+}
+
+// Caller holds the writer lock.
+static size_t ReclaimLocked(DsSnapshotDomain* d)
+{
+    if (!d->retired_count) return 0;
+    const uint64_t oldest = OldestActiveEpoch(d);
+    size_t kept = 0;
+    for (size_t i = 0; i < d->retired_count; i++) {
+        // Readers that entered after the retire epoch loaded the replacement, not this snapshot.
+        if (d->retired[i].epoch < oldest) {
+            d->free_fn(d->free_ctx, d->retired[i].snapshot);
+            d->reclaimed++;
+        } else {
+            d->retired[kept++] = d->retired[i];
+        }
+    }
+    d->retired_count = kept;
+    return kept;
+}
+
+void DsSnapshotPublish(DsSnapshotDomain* d, void* next)
+{
+    WriterLock(d);
+    // Keep room for the snapshot being replaced; only a reader stuck inside a section can make
+    // this spin, and read sections are short.
+    while (d->retired_count == DS_SNAPSHOT_MAX_RETIRED && ReclaimLocked(d) == DS_SNAPSHOT_MAX_RETIRED) DsCpuRelax();
+
+    void* old = DsAtomicExchangePtr(&d->current, next);
+    const uint64_t retireEpoch = DsAtomicFetchAdd64(&d->epoch, 1);
+    d->published++;
+    if (old) {
+        d->retired[d->retired_count].snapshot = old;
+        d->retired[d->retired_count].epoch = retireEpoch;
+        d->retired_count++;
+    }
+    ReclaimLocked(d);
+    WriterUnlock(d);
+}
+
+size_t DsSnapshotReclaim(DsSnapshotDomain* d)
+{
+    WriterLock(d);
+    const size_t pending = ReclaimLocked(d);
+    WriterUnlock(d);
+    return pending;
+}
+
+void DsSnapshotGetStats(DsSnapshotDomain* d, DsSnapshotStats* out)
+{
+    WriterLock(d);
+    out->published = d->published;
+    out->reclaimed = d->reclaimed;
+    out->pending = d->retired_count;
+    WriterUnlock(d);
+}
@@ -0,0 +1,86 @@
+#ifndef DISWITCHER_SNAPSHOT_H
+#define DISWITCHER_SNAPSHOT_H
+
+// Read-copy-update for one immutable object (the engine model): readers pin the current snapshot
+// wait-free, writers publish a replacement atomically and the old one is freed once no reader can
+// still see it. Reclamation is epoch based:
+//   - readers own a slot; entering stores the global epoch in it, leaving stores 0;
+//   - publishing swaps the pointer, then bumps the epoch and retires the old snapshot with the
+//     epoch it was replaced in;
+//   - a retired snapshot is freed when every slot is 0 or newer than its retire epoch.
+// Readers never block or retry. Writers are serialized by a spin lock and only ever wait when
+// DS_SNAPSHOT_MAX_RETIRED snapshots are still pinned by slow readers.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ds_atomic.h"
+
+#define DS_SNAPSHOT_MAX_READERS 256
+#define DS_SNAPSHOT_MAX_RETIRED 32
+
+typedef void (*DsSnapshotFreeFn)(void* ctx, void* snapshot);
+
+typedef struct {
+    DS_ALIGN(DS_CACHE_LINE) volatile uint64_t epoch; // 0 = not inside a read section
+    volatile uint32_t used;
+    uint8_t pad[DS_CACHE_LINE - sizeof(uint64_t) - sizeof(uint32_t)];
+} DsSnapshotSlot;
+
+typedef struct {
+    void* snapshot;
+    uint64_t epoch;
+} DsRetiredSnapshot;
+
+typedef struct {
+    DS_ALIGN(DS_CACHE_LINE) void* volatile current;
+    volatile uint64_t epoch;
+    volatile uint32_t writer_lock;
+
+    // Writer side, guarded by writer_lock.
+    DsSnapshotFreeFn free_fn;
+    void* free_ctx;
+    DsRetiredSnapshot retired[DS_SNAPSHOT_MAX_RETIRED];
+    size_t retired_count;
+    uint64_t published;
+    uint64_t reclaimed;
+
+    DsSnapshotSlot readers[DS_SNAPSHOT_MAX_READERS];
+} DsSnapshotDomain;
+
+void DsSnapshotInit(DsSnapshotDomain* d, void* initial, DsSnapshotFreeFn freeFn, void* freeCtx);
+// Frees the current and all retired snapshots. No reader may be registered anymore.
+void DsSnapshotDestroy(DsSnapshotDomain* d);
+
+// Returns a reader slot index, or -1 if all DS_SNAPSHOT_MAX_READERS slots are taken.
+int DsSnapshotRegisterReader(DsSnapshotDomain* d);
+void DsSnapshotUnregisterReader(DsSnapshotDomain* d, int slot);
+
+// Wait-free. The returned snapshot stays valid until DsSnapshotLeave on the same slot.
+// Sections on one slot must not nest.
+DS_INLINE void* DsSnapshotEnter(DsSnapshotDomain* d, int slot)
+{
+    DsAtomicStore64(&d->readers[slot].epoch, DsAtomicLoad64(&d->epoch));
+    return DsAtomicLoadPtr(&d->current);
+}
+
+DS_INLINE void DsSnapshotLeave(DsSnapshotDomain* d, int slot)
+{
+    DsAtomicStore64(&d->readers[slot].epoch, 0);
+}
+
+// Publishes `next` and retires the previous snapshot, freeing whatever is already unreachable.
+void DsSnapshotPublish(DsSnapshotDomain* d, void* next);
+// Frees retired snapshots no reader can see anymore; returns how many are still pending.
+size_t DsSnapshotReclaim(DsSnapshotDomain* d);
+
+typedef struct {
+    uint64_t published;
+    uint64_t reclaimed;
+    uint64_t pending;
+} DsSnapshotStats;
+
+void DsSnapshotGetStats(DsSnapshotDomain* d, DsSnapshotStats* out);
+
+#endif
@@ -0,0 +1,187 @@
+#include "typeahead.h"
+
+#include <string.h>
+
+#define REPLAY_CAP (2 * DS_TYPEAHEAD_MAX_KEYS)
+
+void DsTypeaheadInit(DsTypeahead* q, uint64_t capNs)
+{
+    memset(q, 0, sizeof(*q));
+    q->enabled = true;
+    q->cap_ns = capNs;
+    q->lost_ns = DS_TYPEAHEAD_LOST_FACTOR * capNs;
+}
+
+void DsTypeaheadSetEnabled(DsTypeahead* q, bool enabled)
+{
+    const uint64_t capNs = q->cap_ns;
+    const DsTypeaheadStats stats = q->stats;
+    DsTypeaheadInit(q, capNs);
+    q->stats = stats;
+    q->enabled = enabled;
+}
+
+uint32_t DsTypeaheadCorrectionTag(void)
+{
+    return DS_INJECT_MAGIC | DS_INJECT_CORRECTION;
+}
+
+uint32_t DsTypeaheadReplayTag(const DsTypeaheadKey* key)
+{
+    return DS_INJECT_MAGIC | DS_INJECT_REPLAY | (key->seq & DS_INJECT_SEQ_MASK);
+}
+
+void DsTypeaheadCorrectionSent(DsTypeahead* q, uint32_t events, uint64_t nowNs)
+{
+    if (!q->enabled || !events) return;
+    q->correction_sent_ns = nowNs;
+    q->correction_in_flight += events;
+    q->stats.corrections++;
+}
+
+bool DsTypeaheadCorrectionSeen(DsTypeahead* q)
+{
+    if (!q->correction_in_flight) return false; // arrived after the latency cap gave up on it
+    if (--q->correction_in_flight) return false;
+    return q->held_count > 0;
+}
+
+static DsTypeaheadKey* ReplayAt(DsTypeahead* q, size_t i)
+{
+    return &q->replay[(q->replay_head + i) % REPLAY_CAP];
+}
+
+static void ReplayPop(DsTypeahead* q)
+{
+    q->replay_head = (q->replay_head + 1) % REPLAY_CAP;
+    q->replay_count--;
+}
+
+// True if a key that arrived before `seq` has not been processed yet.
+static bool EarlierPending(DsTypeahead* q, uint32_t seq)
+{
+    if (q->held_count && q->held[0].seq < seq) return true;
+    for (size_t i = 0; i < q->replay_count; i++) {
+        if (ReplayAt(q, i)->seq < seq) return true;
+    }
+    return false;
+}
+
+DsTypeaheadAction DsTypeaheadOffer(DsTypeahead* q, DsTypeaheadKey* key, uint32_t tag, uint64_t nowNs)
+{
+    if (q->enabled && DS_INJECT_IS_REPLAY(tag)) {
+        // Replays come back in the order they were sent, so the key is normally the head of the
+        // list; entries ahead of it were lost on the way.
+        size_t i = 0;
+        while (i < q->replay_count && (ReplayAt(q, i)->seq & DS_INJECT_SEQ_MASK) != (tag & DS_INJECT_SEQ_MASK)) i++;
+        if (i == q->replay_count) {
+            // Given up on as lost; its place in the order is gone, so it goes through.
+            q->stats.passed_late++;
+            key->seq = q->next_seq++;
+            key->arrived_ns = nowNs;
+            return DS_TYPEAHEAD_PASS;
+        }
+        key->seq = ReplayAt(q, i)->seq;
+        key->arrived_ns = ReplayAt(q, i)->arrived_ns;
+        while (i--) ReplayPop(q);
+        ReplayPop(q);
+    } else {
+        key->seq = q->next_seq++;
+        key->arrived_ns = nowNs;
+    }
+    if (!q->enabled) return DS_TYPEAHEAD_PASS;
+
+    if (!q->correction_in_flight && !EarlierPending(q, key->seq)) return DS_TYPEAHEAD_PASS;
+    key->held_ns = nowNs;
+    if (q->held_count == DS_TYPEAHEAD_MAX_KEYS) {
+        q->stats.overflows++;
+        return DS_TYPEAHEAD_PASS;
+    }
+
+    size_t pos = q->held_count;
+    while (pos && q->held[pos - 1].seq > key->seq) {
+        q->held[pos] = q->held[pos - 1];
+        pos--;
+    }
+    q->held[pos] = *key;
+    q->held_count++;
+    q->stats.held++;
+    if (q->held_count > q->stats.max_depth) q->stats.max_depth = q->held_count;
+
+    // With replays of ours still in the input stream the key has to go out right away, behind them:
+    // anything held back now would be sent after keys that arrive later. The same holds when it runs
+    // into a correction triggered by a key replayed before it; re-injected, it lands after that
+    // correction's events too. Only with nothing but a correction in flight do keys wait here.
+    return q->correction_in_flight && !q->replay_count ? DS_TYPEAHEAD_HOLD : DS_TYPEAHEAD_HOLD_FLUSH;
+}
+
+size_t DsTypeaheadFlush(DsTypeahead* q, DsTypeaheadKey* out, uint64_t nowNs)
+{
+    const size_t n = q->held_count;
+    for (size_t i = 0; i < n; i++) {
+        const DsTypeaheadKey* k = &q->held[i];
+        const uint64_t hold = nowNs - k->held_ns;
+        if (hold > q->stats.max_hold_ns) q->stats.max_hold_ns = hold;
+        if (q->replay_count == REPLAY_CAP) {
+            // Replays are not coming back (or very late); stop tracking the oldest.
+            ReplayPop(q);
+            q->stats.passed_late++;
+        }
+        const size_t slot = (q->replay_head + q->replay_count) % REPLAY_CAP;
+        q->replay[slot] = *k;
+        q->replay_sent_ns[slot] = nowNs;
+        q->replay_count++;
+        out[i] = *k;
+    }
+    q->held_count = 0;
+    q->stats.replayed += n;
+    return n;
+}
+
+void DsTypeaheadReplayFailed(DsTypeahead* q, size_t flushed, size_t sent)
+{
+    size_t drop = flushed > sent ? flushed - sent : 0;
+    if (drop > q->replay_count) drop = q->replay_count;
+    q->replay_count -= drop;
+}
+
+static uint64_t Earliest(uint64_t a, uint64_t b)
+{
+    return !a || (b && b < a) ? b : a;
+}
+
+uint64_t DsTypeaheadDeadline(const DsTypeahead* q)
+{
+    uint64_t deadline = 0;
+    if (q->correction_in_flight) deadline = q->correction_sent_ns + q->lost_ns;
+    if (q->replay_count) deadline = Earliest(deadline, q->replay_sent_ns[q->replay_head] + q->lost_ns);
+    for (size_t i = 0; i < q->held_count; i++) deadline = Earliest(deadline, q->held[i].held_ns + q->cap_ns);
+    return deadline;
+}
+
+bool DsTypeaheadExpire(DsTypeahead* q, uint64_t nowNs)
+{
+    const uint64_t deadline = DsTypeaheadDeadline(q);
+    if (!deadline || nowNs < deadline) return false;
+
+    if (q->correction_in_flight && nowNs >= q->correction_sent_ns + q->lost_ns) {
+        q->correction_in_flight = 0;
+        q->stats.lost++;
+    }
+    while (q->replay_count && nowNs >= q->replay_sent_ns[q->replay_head] + q->lost_ns) {
+        ReplayPop(q);
+        q->stats.lost++;
+    }
+    if (!q->held_count) return false;
+    // Held keys only wait for a correction; with that given up on they go out now.
+    if (!q->correction_in_flight) return true;
+    // The correction is still on its way, but the keys have waited as long as they may. Re-injected
+    // now they still arrive after its events, so nothing is given up for the cap.
+    for (size_t i = 0; i < q->held_count; i++) {
+        if (nowNs >= q->held[i].held_ns + q->cap_ns) {
+            q->stats.capped++;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,121 @@
+#ifndef DISWITCHER_TYPEAHEAD_H
+#define DISWITCHER_TYPEAHEAD_H
+
+// Type-ahead stage between the keyboard hook and the engine. A correction is injected (backspaces
+// plus text), and those events take a while to travel through the input stream. Real keys typed
+// meanwhile may already be queued ahead of them; the backspaces then erase the new keys instead of
+// the wrong-layout word. While a correction is in flight, user keys are therefore held here and
+// re-injected in their original order once its last event has come back through the hook. Since
+// injected input is delivered in the order it was sent, re-injected keys land behind every event
+// injected before them.
+//
+// Keys are numbered on arrival and always processed in that order: a re-injected (replayed) key is
+// only let through when no correction is in flight and no earlier key is still pending; otherwise
+// it is held again, so a replayed boundary that triggers another correction keeps the rest behind
+// it (the replayed key that runs into such a correction is re-injected at once, which puts it behind
+// the correction's events). No key sits in the queue longer than the latency cap: at the deadline
+// held keys are flushed, which still puts them behind the correction. Injected events that have not
+// come back after DS_TYPEAHEAD_LOST_FACTOR times the cap (blocked by UIPI, eaten by another hook)
+// are given up on so that they cannot hold up typing for good.
+//
+// Injected events are recognized by a tag the host attaches to them (dwExtraInfo on Windows).
+// Platform neutral and single-threaded: the host calls it from the hook thread only.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DS_TYPEAHEAD_MAX_KEYS 64
+#define DS_TYPEAHEAD_DEFAULT_CAP_MS 60
+#define DS_TYPEAHEAD_LOST_FACTOR 4
+
+// Injection tags: "DS" in the high half, then the kind and, for replays, the key's sequence number.
+#define DS_INJECT_MAGIC 0x44530000u
+#define DS_INJECT_MAGIC_MASK 0xFFFF0000u
+#define DS_INJECT_CORRECTION 0x1000u
+#define DS_INJECT_REPLAY 0x2000u
+#define DS_INJECT_KIND_MASK 0xF000u
+#define DS_INJECT_SEQ_MASK 0x0FFFu
+
+#define DS_INJECT_IS_CORRECTION(tag) (((tag) & (DS_INJECT_MAGIC_MASK | DS_INJECT_KIND_MASK)) == (DS_INJECT_MAGIC | DS_INJECT_CORRECTION))
+#define DS_INJECT_IS_REPLAY(tag) (((tag) & (DS_INJECT_MAGIC_MASK | DS_INJECT_KIND_MASK)) == (DS_INJECT_MAGIC | DS_INJECT_REPLAY))
+
+typedef struct {
+    uint32_t vk;
+    uint32_t scan;
+    uint32_t flags;      // host key flags (extended key, ...), re-injected as they were
+    bool down;
+    uint32_t seq;        // arrival order; assigned by DsTypeaheadOffer
+    uint64_t arrived_ns; // first arrival
+    uint64_t held_ns;    // when it last entered the queue, for the latency cap
+} DsTypeaheadKey;
+
+typedef enum {
+    DS_TYPEAHEAD_PASS,       // process the key now
+    DS_TYPEAHEAD_HOLD,       // swallow it; it will be re-injected
+    DS_TYPEAHEAD_HOLD_FLUSH, // swallow it and re-inject everything held (DsTypeaheadFlush) now
+} DsTypeaheadAction;
+
+typedef struct {
+    uint64_t corrections;   // injected corrections that opened a window
+    uint64_t held;          // key events swallowed for later (a key held twice counts twice)
+    uint64_t replayed;      // key events re-injected
+    uint64_t passed_late;   // replayed events that came back after being given up on
+    uint64_t capped;        // flushes forced by the latency cap while a correction was in flight
+    uint64_t lost;          // corrections and replays given up on
+    uint64_t overflows;     // keys passed through unordered because the queue was full
+    uint64_t max_depth;
+    uint64_t max_hold_ns;   // held to re-injected, worst case (bounded by the cap)
+} DsTypeaheadStats;
+
+typedef struct {
+    bool enabled;
+    uint64_t cap_ns;
+    uint64_t lost_ns;
+    uint32_t next_seq;
+
+    // Correction events sent but not seen back yet, and when the last of them was sent.
+    uint32_t correction_in_flight;
+    uint64_t correction_sent_ns;
+
+    DsTypeaheadKey held[DS_TYPEAHEAD_MAX_KEYS]; // sorted by seq
+    size_t held_count;
+
+    // Replayed keys sent but not seen back yet, in send order (which is seq order).
+    DsTypeaheadKey replay[2 * DS_TYPEAHEAD_MAX_KEYS];
+    uint64_t replay_sent_ns[2 * DS_TYPEAHEAD_MAX_KEYS];
+    size_t replay_head;
+    size_t replay_count;
+
+    DsTypeaheadStats stats;
+} DsTypeahead;
+
+void DsTypeaheadInit(DsTypeahead* q, uint64_t capNs);
+// Disabled, every key passes (the previous behaviour); in-flight bookkeeping is dropped.
+void DsTypeaheadSetEnabled(DsTypeahead* q, bool enabled);
+
+uint32_t DsTypeaheadCorrectionTag(void);
+uint32_t DsTypeaheadReplayTag(const DsTypeaheadKey* key);
+
+// A correction of `events` input events, tagged DsTypeaheadCorrectionTag, was just injected.
+void DsTypeaheadCorrectionSent(DsTypeahead* q, uint32_t events, uint64_t nowNs);
+// One of them came back through the hook (let it through). True if held keys should be flushed.
+bool DsTypeaheadCorrectionSeen(DsTypeahead* q);
+
+// A user key arrived: `tag` is 0 for a physical key or the replay tag it was re-injected with.
+// `key` gets its sequence number and arrival time filled in.
+DsTypeaheadAction DsTypeaheadOffer(DsTypeahead* q, DsTypeaheadKey* key, uint32_t tag, uint64_t nowNs);
+
+// Moves every held key to the replay list and copies them to `out` (DS_TYPEAHEAD_MAX_KEYS
+// entries) for re-injection, each with DsTypeaheadReplayTag. Returns the count.
+size_t DsTypeaheadFlush(DsTypeahead* q, DsTypeaheadKey* out, uint64_t nowNs);
+// Only the first `sent` of the last flushed keys could be injected; forget the rest.
+void DsTypeaheadReplayFailed(DsTypeahead* q, size_t flushed, size_t sent);
+
+// When the host must call DsTypeaheadExpire at the latest; 0 if nothing is pending.
+uint64_t DsTypeaheadDeadline(const DsTypeahead* q);
+// Past the deadline: flush keys held for too long and give up on injected events that are lost.
+// True if held keys should be flushed.
+bool DsTypeaheadExpire(DsTypeahead* q, uint64_t nowNs);
+
+#endif
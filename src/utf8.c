@@ -0,0 +1,94 @@
+#include "utf8.h"
+
+size_t DsUtf8Decode(const uint8_t* s, size_t n, uint32_t* cp)
+{
+    if (!n) {
+        *cp = 0;
+        return 0;
+    }
+    const uint8_t b0 = s[0];
+    if (b0 < 0x80) {
+        *cp = b0;
+        return 1;
+    }
+
+    size_t len;
+    uint32_t v, min;
+    if ((b0 & 0xE0) == 0xC0) { len = 2; v = b0 & 0x1F; min = 0x80; }
+    else if ((b0 & 0xF0) == 0xE0) { len = 3; v = b0 & 0x0F; min = 0x800; }
+    else if ((b0 & 0xF8) == 0xF0) { len = 4; v = b0 & 0x07; min = 0x10000; }
+    else { *cp = DS_UTF8_REPLACEMENT; return 1; }
+
+    if (len > n) {
+        *cp = DS_UTF8_REPLACEMENT;
+        return 1;
+    }
+    for (size_t i = 1; i < len; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *cp = DS_UTF8_REPLACEMENT;
+            return 1;
+        }
+        v = (v << 6) | (s[i] & 0x3F);
+    }
+    // Reject overlongs, surrogates and out-of-range values.
+    if (v < min || v > 0x10FFFF || (v >= 0xD800 && v <= 0xDFFF)) {
+        *cp = DS_UTF8_REPLACEMENT;
+        return 1;
+    }
+    *cp = v;
+    return len;
+}
+
+size_t DsUtf8Encode(uint32_t cp, uint8_t* out)
+{
+    if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) cp = DS_UTF8_REPLACEMENT;
+    if (cp < 0x80) {
+        out[0] = (uint8_t)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (uint8_t)(0xC0 | (cp >> 6));
+        out[1] = (uint8_t)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (uint8_t)(0xE0 | (cp >> 12));
+        out[1] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (uint8_t)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (uint8_t)(0xF0 | (cp >> 18));
+    out[1] = (uint8_t)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (uint8_t)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+size_t DsUtf8ToWide(const char* in, size_t inLen, wchar_t* out, size_t outCap)
+{
+    size_t n = 0;
+    size_t pos = 0;
+    if (!outCap) return 0;
+    while (pos < inLen && n + 1 < outCap) {
+        uint32_t cp;
+        pos += DsUtf8Decode((const uint8_t*)in + pos, inLen - pos, &cp);
+        if (sizeof(wchar_t) == 2 && cp > 0xFFFF) cp = DS_UTF8_REPLACEMENT; // engine works on BMP only
+        out[n++] = (wchar_t)cp;
+    }
+    out[n] = 0;
+    return n;
+}
+
+size_t DsWideToUtf8(const wchar_t* in, size_t inLen, char* out, size_t outCap)
+{
+    size_t n = 0;
+    if (!outCap) return 0;
+    for (size_t i = 0; i < inLen; i++) {
+        uint8_t buf[4];
+        const size_t len = DsUtf8Encode((uint32_t)in[i], buf);
+        if (n + len + 1 > outCap) break;
+        for (size_t j = 0; j < len; j++) out[n++] = (char)buf[j];
+    }
+    out[n] = 0;
+    return n;
+}
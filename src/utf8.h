@@ -0,0 +1,24 @@
+#ifndef DISWITCHER_UTF8_H
+#define DISWITCHER_UTF8_H
+
+// Minimal UTF-8 <-> code point helpers for the file/socket based front ends.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#define DS_UTF8_REPLACEMENT 0xFFFDu
+
+// Decodes one code point from s[0..n). Returns the number of bytes consumed (>= 1 when n > 0);
+// malformed input yields U+FFFD and consumes one byte.
+size_t DsUtf8Decode(const uint8_t* s, size_t n, uint32_t* cp);
+
+// Encodes `cp` into out[0..4). Returns the number of bytes written.
+size_t DsUtf8Encode(uint32_t cp, uint8_t* out);
+
+// Converts a whole string. Return the number of units written (excluding the terminator);
+// output is always NUL-terminated and truncated to fit.
+size_t DsUtf8ToWide(const char* in, size_t inLen, wchar_t* out, size_t outCap);
+size_t DsWideToUtf8(const wchar_t* in, size_t inLen, char* out, size_t outCap);
+
+#endif
@@ -0,0 +1,138 @@
+#include "batchproto.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void DsBatchBufferFree(DsBatchBuffer* b)
+{
+    free(b->data);
+    b->data = NULL;
+    b->len = 0;
+    b->cap = 0;
+    b->failed = false;
+}
+
+static bool Reserve(DsBatchBuffer* b, size_t n)
+{
+    if (b->failed) return false;
+    if (b->len + n <= b->cap) return true;
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + n) cap *= 2;
+    uint8_t* data = (uint8_t*)realloc(b->data, cap);
+    if (!data) {
+        b->failed = true;
+        return false;
+    }
+    b->data = data;
+    b->cap = cap;
+    return true;
+}
+
+void DsBatchPutBytes(DsBatchBuffer* b, const void* data, size_t n)
+{
+    if (!n || !Reserve(b, n)) return;
+    memcpy(b->data + b->len, data, n);
+    b->len += n;
+}
+
+void DsBatchPut8(DsBatchBuffer* b, uint8_t v)
+{
+    DsBatchPutBytes(b, &v, 1);
+}
+
+void DsBatchPut16(DsBatchBuffer* b, uint16_t v)
+{
+    const uint8_t le[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+    DsBatchPutBytes(b, le, 2);
+}
+
+void DsBatchPut32(DsBatchBuffer* b, uint32_t v)
+{
+    const uint8_t le[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    DsBatchPutBytes(b, le, 4);
+}
+
+size_t DsBatchFitString(const char* s, size_t n)
+{
+    if (n <= DS_BATCH_MAX_STRING_BYTES) return n;
+    n = DS_BATCH_MAX_STRING_BYTES;
+    while (n && ((uint8_t)s[n] & 0xC0) == 0x80) n--; // s[n], the first byte left out, must start a character
+    return n;
+}
+
+void DsBatchPutString(DsBatchBuffer* b, const char* s, size_t n)
+{
+    n = DsBatchFitString(s, n);
+    DsBatchPut16(b, (uint16_t)n);
+    DsBatchPutBytes(b, s, n);
+}
+
+size_t DsBatchBeginFrame(DsBatchBuffer* b, uint32_t kind, uint32_t id)
+{
+    const size_t start = b->len;
+    DsBatchPut32(b, 0);
+    DsBatchPut32(b, kind);
+    DsBatchPut32(b, id);
+    return start;
+}
+
+void DsBatchEndFrame(DsBatchBuffer* b, size_t frameStart)
+{
+    if (b->failed) return;
+    const uint32_t n = (uint32_t)(b->len - frameStart - 4);
+    uint8_t* p = b->data + frameStart;
+    p[0] = (uint8_t)n;
+    p[1] = (uint8_t)(n >> 8);
+    p[2] = (uint8_t)(n >> 16);
+    p[3] = (uint8_t)(n >> 24);
+}
+
+void DsBatchReaderInit(DsBatchReader* r, const void* data, size_t n)
+{
+    r->p = (const uint8_t*)data;
+    r->left = n;
+    r->ok = true;
+}
+
+static const uint8_t* Take(DsBatchReader* r, size_t n)
+{
+    if (!r->ok || r->left < n) {
+        r->ok = false;
+        return NULL;
+    }
+    const uint8_t* p = r->p;
+    r->p += n;
+    r->left -= n;
+    return p;
+}
+
+uint8_t DsBatchGet8(DsBatchReader* r)
+{
+    const uint8_t* p = Take(r, 1);
+    return p ? p[0] : 0;
+}
+
+uint16_t DsBatchGet16(DsBatchReader* r)
+{
+    const uint8_t* p = Take(r, 2);
+    return p ? (uint16_t)(p[0] | (p[1] << 8)) : 0;
+}
+
+uint32_t DsBatchLoad32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint32_t DsBatchGet32(DsBatchReader* r)
+{
+    const uint8_t* p = Take(r, 4);
+    return p ? DsBatchLoad32(p) : 0;
+}
+
+const char* DsBatchGetString(DsBatchReader* r, size_t* n)
+{
+    *n = DsBatchGet16(r);
+    const uint8_t* p = Take(r, *n);
+    if (!p) *n = 0;
+    return (const char*)p;
+}
@@ -0,0 +1,79 @@
+#ifndef DISWITCHER_BATCHPROTO_H
+#define DISWITCHER_BATCHPROTO_H
+
+// Wire format of diswitcherd, the local batch correction daemon (tools/diswitcherd.c).
+//
+// A stream socket carries frames in both directions: u32 payload length, then the payload. All
+// integers are little-endian. Every payload starts with u32 kind and u32 request id; the reply
+// carries the id of its request. A connection may pipeline requests, and replies can come back in
+// a different order than the requests were sent.
+//
+//   CORRECT request: u32 count, then count x (u16 length, UTF-8 bytes)
+//   CORRECT reply:   u32 count, then count x (u8 flags, u8 0, i16 margin, u16 length, UTF-8 bytes)
+//                    the corrected string; `margin` belongs to the word whose single-token decision
+//                    came closest to the threshold (>= 0: corrected on its own, < 0: kept by that
+//                    much); only meaningful with DS_BATCH_SCORED. A corrected string longer than
+//                    DS_BATCH_MAX_STRING_BYTES is cut at a character boundary and flagged
+//                    DS_BATCH_TRUNCATED
+//   STATS request:   nothing
+//   STATS reply:     u16 length, UTF-8 text (one "key=value" line, see diswitcherd.c)
+//   ERROR reply:     u16 length, UTF-8 message; sent for a malformed request, or in place of a
+//                    CORRECT reply that would be longer than DS_BATCH_MAX_FRAME ("reply too large":
+//                    send fewer strings per request). The connection stays.
+//
+// A frame longer than DS_BATCH_MAX_FRAME closes the connection; neither side sends one.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DS_BATCH_MAX_FRAME (1u << 20)
+#define DS_BATCH_MAX_STRINGS 4096
+#define DS_BATCH_MAX_STRING_BYTES 4096
+
+#define DS_BATCH_KIND_CORRECT 1u
+#define DS_BATCH_KIND_STATS 2u
+#define DS_BATCH_KIND_ERROR 0xFFu
+
+#define DS_BATCH_CORRECTED 0x01u // the string was changed
+#define DS_BATCH_SCORED 0x02u    // at least one word was long enough and plain enough to score
+#define DS_BATCH_TRUNCATED 0x04u // the corrected string was cut to DS_BATCH_MAX_STRING_BYTES
+
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t cap;
+    bool failed; // an allocation failed; the contents are incomplete
+} DsBatchBuffer;
+
+void DsBatchBufferFree(DsBatchBuffer* b);
+void DsBatchPut8(DsBatchBuffer* b, uint8_t v);
+void DsBatchPut16(DsBatchBuffer* b, uint16_t v);
+void DsBatchPut32(DsBatchBuffer* b, uint32_t v);
+void DsBatchPutBytes(DsBatchBuffer* b, const void* data, size_t n);
+// u16 length, then the bytes, cut to DsBatchFitString.
+void DsBatchPutString(DsBatchBuffer* b, const char* s, size_t n);
+// Length of the longest prefix of the UTF-8 string `s` that fits DS_BATCH_MAX_STRING_BYTES without
+// splitting a character.
+size_t DsBatchFitString(const char* s, size_t n);
+
+// Starts a frame (length placeholder, kind, id); DsBatchEndFrame fills in the length.
+size_t DsBatchBeginFrame(DsBatchBuffer* b, uint32_t kind, uint32_t id);
+void DsBatchEndFrame(DsBatchBuffer* b, size_t frameStart);
+
+typedef struct {
+    const uint8_t* p;
+    size_t left;
+    bool ok; // false once a read ran past the end
+} DsBatchReader;
+
+void DsBatchReaderInit(DsBatchReader* r, const void* data, size_t n);
+uint8_t DsBatchGet8(DsBatchReader* r);
+uint16_t DsBatchGet16(DsBatchReader* r);
+uint32_t DsBatchGet32(DsBatchReader* r);
+// Returns a pointer into the payload (not NUL-terminated), or NULL past the end.
+const char* DsBatchGetString(DsBatchReader* r, size_t* n);
+
+uint32_t DsBatchLoad32(const uint8_t* p);
+
+#endif
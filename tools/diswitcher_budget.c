@@ -0,0 +1,227 @@
+// Exercises the per-key decision budget (DsSessionSetDecisionBudget) against a clock it controls.
+//
+//   diswitcher-budget [--tick-ns T] [--budgets-us a,b,...] [--words N] [--adapt] [--morph ru.dsmf]
+//                     [--config diswitcher.conf] [--check] corpus.txt
+//
+// The session's host clock is fake: every read advances it by --tick-ns (default 1000), so how far
+// scoring gets before the deadline depends only on how many times the engine looked at the clock,
+// never on the machine. Each word of 3+ letters in one script from the corpus (up to --words,
+// default 20000) is typed key by key with a space after it, once as written and once on the other
+// layout, into a fresh session per budget; budget 0 is the unbounded reference. --adapt attaches an
+// adaptive sketch trained on the corpus words first, so that tier has something to do.
+//
+// Each budget reports the tier counters (DsTierStats) and how its words ended up against the
+// reference: corrections lost to the deadline, corrections the reference did not make and words
+// changed into something else. With --check the exit status is 1 if a budget under which no tier
+// timed out differs from the reference at all, if any word was changed into something else, or,
+// without --adapt (whose learning legitimately diverges), if a deadline added a correction.
+
+#define _POSIX_C_SOURCE 200809L
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "keymap.h"
+#include "toolutil.h"
+
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define MAX_BUDGETS 16
+
+typedef struct {
+    DsTextField field; // first: the session's send_text gets the Host
+    uint64_t now_ns;
+    uint64_t tick_ns;
+} Host;
+
+typedef struct {
+    DsTierStats tiers;
+    uint64_t corrections;
+    uint64_t lost;  // the reference corrected it, this budget did not
+    uint64_t extra; // this budget corrected it, the reference did not
+    uint64_t other; // both changed it, differently
+} Outcome;
+
+static uint64_t TickClock(void* ctx)
+{
+    Host* h = (Host*)ctx;
+    h->now_ns += h->tick_ns;
+    return h->now_ns;
+}
+
+static bool Same(const wchar_t* a, size_t alen, const wchar_t* b, size_t blen)
+{
+    return alen == blen && wmemcmp(a, b, alen) == 0;
+}
+
+// Types every word both ways under `budgetNs`. `results` holds each output (2 per word, n + 1
+// characters each): filled in for the reference run, compared against otherwise.
+static bool Run(const DsBenchWord* words, size_t count, uint64_t budgetNs, uint64_t tickNs, const DsAdaptSketch* trained,
+                bool reference, wchar_t* results, Outcome* out)
+{
+    memset(out, 0, sizeof(*out));
+    Host h;
+    memset(&h, 0, sizeof(h));
+    h.tick_ns = tickNs;
+    DsHost host = {0};
+    host.ctx = &h;
+    host.clock_ns = TickClock;
+    host.send_text = DsTextFieldSend;
+    DsSession* s = DsSessionCreate(&host);
+    if (!s) return false;
+    DsSessionSetPhraseCorrection(s, false);
+    DsSessionSetShortWords(s, false);
+    DsSessionSetDecisionBudget(s, budgetNs);
+    DsAdaptSketch* sketch = NULL;
+    if (trained) {
+        sketch = (DsAdaptSketch*)malloc(sizeof(DsAdaptSketch));
+        if (!sketch) return false;
+        memcpy(sketch, trained, sizeof(*sketch));
+        DsSessionSetAdaptive(s, sketch);
+    }
+
+    wchar_t* r = results;
+    for (size_t i = 0; i < count; i++) {
+        const DsBenchWord* w = &words[i];
+        for (int side = 0; side < 2; side++, r += w->len + 1) {
+            const wchar_t* typed = side ? w->other : w->text;
+            const DsTextField* f = &h.field;
+            DsTextFieldTypeToken(s, &h.field, typed, w->len);
+            const bool changed = !Same(f->text, f->len - 1, typed, w->len);
+            out->corrections += changed;
+            if (reference) {
+                wmemcpy(r, f->text, w->len + 1);
+                continue;
+            }
+            const bool refChanged = !Same(r, w->len, typed, w->len);
+            if (Same(f->text, f->len, r, w->len + 1)) continue;
+            if (refChanged && !changed) out->lost++;
+            else if (!refChanged && changed) out->extra++;
+            else out->other++;
+        }
+    }
+    DsSessionGetTierStats(s, &out->tiers);
+    DsSessionDestroy(s);
+    free(sketch);
+    return true;
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: diswitcher-budget [--tick-ns T] [--budgets-us a,b,...] [--words N] [--adapt] [--morph ru.dsmf] [--config diswitcher.conf] [--check] corpus.txt\n");
+}
+
+int main(int argc, char** argv)
+{
+    setlocale(LC_ALL, "C.UTF-8");
+
+    uint64_t tickNs = 1000;
+    double budgetsUs[MAX_BUDGETS] = { 0, 1, 2, 3, 4, 5 };
+    size_t budgetCount = 6;
+    size_t maxWords = 20000;
+    bool adapt = false, check = false;
+    const char* morphPath = NULL;
+    const char* configPath = NULL;
+    const char* path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--tick-ns") == 0 && i + 1 < argc) tickNs = (uint64_t)atoll(argv[++i]);
+        else if (strcmp(argv[i], "--budgets-us") == 0 && i + 1 < argc) {
+            budgetCount = 0;
+            for (char* p = argv[++i]; *p && budgetCount < MAX_BUDGETS; p += *p == ',') {
+                char* end;
+                budgetsUs[budgetCount++] = strtod(p, &end);
+                if (end == p) { Usage(); return 2; }
+                p = end;
+            }
+        } else if (strcmp(argv[i], "--words") == 0 && i + 1 < argc) maxWords = (size_t)atol(argv[++i]);
+        else if (strcmp(argv[i], "--adapt") == 0) adapt = true;
+        else if (strcmp(argv[i], "--morph") == 0 && i + 1 < argc) morphPath = argv[++i];
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) configPath = argv[++i];
+        else if (strcmp(argv[i], "--check") == 0) check = true;
+        else if (argv[i][0] == '-' || path) { Usage(); return 2; }
+        else path = argv[i];
+    }
+    if (!path || maxWords == 0 || tickNs == 0 || budgetCount == 0) {
+        Usage();
+        return 2;
+    }
+
+    DsMappedFile morphFile = {0};
+    DsMorph morph;
+    if (!DsToolLoadModel(morphPath, configPath, &morphFile, &morph)) return 1;
+
+    DsMappedFile corpus;
+    if (DsMapFile(path, &corpus) != 0) {
+        perror(path);
+        return 1;
+    }
+    DsBenchWord* words = (DsBenchWord*)malloc(maxWords * sizeof(DsBenchWord));
+    if (!words) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    const size_t count = DsLoadBenchWords(&corpus, maxWords, 3, true, words);
+    DsUnmapFile(&corpus);
+    size_t chars = 0;
+    for (size_t i = 0; i < count; i++) chars += 2 * (words[i].len + 1);
+    wchar_t* results = (wchar_t*)malloc((chars + 1) * sizeof(wchar_t));
+    DsAdaptSketch* trained = adapt ? (DsAdaptSketch*)malloc(sizeof(DsAdaptSketch)) : NULL;
+    if (!results || (adapt && !trained)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    if (trained) {
+        DsAdaptAttach(trained, sizeof(*trained));
+        for (size_t i = 0; i < count; i++) DsAdaptLearn(trained, words[i].text, words[i].len);
+    }
+
+    Outcome ref;
+    if (!Run(words, count, 0, tickNs, trained, true, results, &ref)) {
+        fprintf(stderr, "cannot create a session\n");
+        return 1;
+    }
+    printf("corpus: %zu words, each typed as written and on the other layout; clock tick %llu ns\n\n", count,
+           (unsigned long long)tickNs);
+    printf("budget us     cheap   adapt ran/skipped    morph ran/skipped   settled   dropped  corrections     lost   extra  other\n");
+
+    int failed = 0;
+    for (size_t b = 0; b < budgetCount; b++) {
+        const uint64_t budgetNs = (uint64_t)(budgetsUs[b] * 1000.0);
+        Outcome o;
+        if (!Run(words, count, budgetNs, tickNs, trained, false, results, &o)) {
+            fprintf(stderr, "cannot create a session\n");
+            return 1;
+        }
+        const DsTierStats* t = &o.tiers;
+        printf("%9.1f %9llu %10llu/%-10llu %9llu/%-10llu %9llu %9llu %12llu %8llu %7llu %6llu\n", budgetsUs[b],
+               (unsigned long long)t->hits[DS_TIER_CHEAP], (unsigned long long)t->hits[DS_TIER_ADAPT],
+               (unsigned long long)t->timeouts[DS_TIER_ADAPT], (unsigned long long)t->hits[DS_TIER_MORPH],
+               (unsigned long long)t->timeouts[DS_TIER_MORPH], (unsigned long long)t->settled,
+               (unsigned long long)t->dropped, (unsigned long long)o.corrections, (unsigned long long)o.lost,
+               (unsigned long long)o.extra, (unsigned long long)o.other);
+
+        const bool timedOut = t->timeouts[DS_TIER_ADAPT] || t->timeouts[DS_TIER_MORPH];
+        if (!timedOut && (o.lost || o.extra || o.other)) {
+            printf("  FAIL: no tier timed out, yet %llu words differ from the unbounded run\n",
+                   (unsigned long long)(o.lost + o.extra + o.other));
+            failed = 1;
+        }
+        if (o.other) {
+            printf("  FAIL: %llu words changed into something else\n", (unsigned long long)o.other);
+            failed = 1;
+        }
+        if (!adapt && o.extra) {
+            printf("  FAIL: %llu corrections the unbounded run did not make\n", (unsigned long long)o.extra);
+            failed = 1;
+        }
+    }
+
+    free(trained);
+    free(results);
+    free(words);
+    DsEngineShutdown();
+    if (morphPath) DsUnmapFile(&morphFile);
+    return check ? failed : 0;
+}
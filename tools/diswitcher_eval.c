@@ -0,0 +1,466 @@
+// Measures how often the engine gets it wrong on real text, across all cores.
+//
+//   diswitcher-eval [--threads N] [--chunk KB] [--morph ru.dsmf] [--config diswitcher.conf]
+//                   [--no-phrase] [--no-short] corpus.txt...
+//
+// Each corpus is UTF-8 text, memory-mapped and cut into chunks of about --chunk KB (default 1024)
+// at line breaks, or at a space when a line runs on. Every line is corrected twice through
+// DsSessionCorrectText, which runs the full decision logic (single tokens, phrases, short words):
+// as written, where any change is a false positive, and with every letter mapped to the other
+// layout, where each word should come back exactly as written. Mapping is one character for one,
+// so words are compared in place. Only words of Latin or Cyrillic letters in one script are
+// counted; the wrong-layout set leaves out words whose mapping needs a key that is not a letter
+// ("бы" is ",s" on the EN layout), since that key splits the word before the engine sees it.
+//
+// The report is a confusion matrix by word length (false positives, fixes, misses, and words
+// changed into something else) and the throughput in words and bytes per second.
+//
+// Scheduling: each worker owns a deque of chunk indices, one contiguous range packed into a single
+// 64-bit word. The owner takes chunks from the front and an idle worker steals the back half of
+// another's range with one compare-and-swap, so lines of uneven length even out without a shared
+// queue. Workers keep their own session and counters, merged at the end.
+
+#define _GNU_SOURCE
+#include <locale.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "snapshot.h"
+#include "toolutil.h"
+#include "utf8.h"
+
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define LINE_MAX_CHARS 2048 // longer lines are split at a space (or anywhere, if there is none)
+#define LENGTH_ROWS 16      // words of 1..15 letters, then 16 and more
+#define MAX_FILES 64
+
+typedef struct {
+    uint64_t kept;    // as written, left alone
+    uint64_t changed; // as written, changed: false positive
+    uint64_t fixed;   // wrong layout, restored exactly
+    uint64_t missed;  // wrong layout, left as typed
+    uint64_t garbled; // wrong layout, changed into something else
+} Cell;
+
+typedef struct {
+    Cell rows[LENGTH_ROWS];
+    Cell langs[2]; // DsLang: RU, EN
+    uint64_t words;
+    uint64_t skipped;     // digits, mixed scripts, other alphabets
+    uint64_t unmappable;  // left out of the wrong-layout set
+    uint64_t lines;
+    uint64_t misaligned;  // output length differed from input; not compared
+} Stats;
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+} Chunk;
+
+// Owner takes from `begin`, thieves shorten `end`; both halves of one word so one CAS moves both.
+typedef struct {
+    DS_ALIGN(DS_CACHE_LINE) volatile uint64_t range; // begin | end << 32
+} Deque;
+
+typedef struct {
+    pthread_t thread;
+    unsigned id;
+    unsigned count;
+    Deque* deques;
+    const Chunk* chunks;
+    DsSession* session;
+    Stats stats;
+    uint64_t chunks_done;
+    uint64_t steals;
+    uint64_t stolen;
+} Worker;
+
+static bool g_phrase = true;
+static bool g_short = true;
+
+// Letter -> same key on the other layout (BMP), 0 for everything else.
+static wchar_t g_flip[0x10000];
+
+static void InitFlip(void)
+{
+    for (wchar_t ch = 1; ch < 0x10000; ch++) {
+        const wchar_t one[2] = { ch, 0 };
+        wchar_t mapped[2] = { 0, 0 };
+        if (DsIsCyrillicLetter(ch)) DsMapRuToEn(one, mapped, ARRAYSIZE(mapped));
+        else if (DsIsLatinLetter(ch)) DsMapEnToRu(one, mapped, ARRAYSIZE(mapped));
+        g_flip[ch] = mapped[0] != ch ? mapped[0] : 0;
+    }
+}
+
+static uint64_t Pack(uint32_t begin, uint32_t end)
+{
+    return (uint64_t)begin | ((uint64_t)end << 32);
+}
+
+static bool PopOwn(Deque* d, uint32_t* chunk)
+{
+    uint64_t r = __atomic_load_n(&d->range, __ATOMIC_ACQUIRE);
+    for (;;) {
+        const uint32_t begin = (uint32_t)r, end = (uint32_t)(r >> 32);
+        if (begin >= end) return false;
+        if (__atomic_compare_exchange_n(&d->range, &r, Pack(begin + 1, end), false, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+            *chunk = begin;
+            return true;
+        }
+    }
+}
+
+// Takes the back half of `victim`'s range: the first stolen chunk is returned, the rest becomes
+// the thief's own range. The thief's deque is empty, so nobody else writes it meanwhile.
+static bool Steal(Deque* victim, Deque* own, uint32_t* chunk, uint64_t* stolen)
+{
+    uint64_t r = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+    for (;;) {
+        const uint32_t begin = (uint32_t)r, end = (uint32_t)(r >> 32);
+        if (begin >= end) return false;
+        const uint32_t mid = end - (end - begin + 1) / 2;
+        if (__atomic_compare_exchange_n(&victim->range, &r, Pack(begin, mid), false, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(&own->range, Pack(mid + 1, end), __ATOMIC_RELEASE);
+            *chunk = mid;
+            *stolen += end - mid;
+            return true;
+        }
+    }
+}
+
+static bool NextChunk(Worker* w, uint32_t* chunk)
+{
+    if (PopOwn(&w->deques[w->id], chunk)) return true;
+    for (unsigned i = 1; i < w->count; i++) {
+        if (Steal(&w->deques[(w->id + i) % w->count], &w->deques[w->id], chunk, &w->stolen)) {
+            w->steals++;
+            return true;
+        }
+    }
+    return false; // every range looked empty: whatever is left is already being worked on
+}
+
+static unsigned LengthRow(size_t n)
+{
+    return n >= LENGTH_ROWS ? LENGTH_ROWS - 1 : (unsigned)n - 1;
+}
+
+static DsLang WordLang(const wchar_t* w, size_t n)
+{
+    DsLang lang = DS_LANG_UNKNOWN;
+    for (size_t i = 0; i < n; i++) {
+        const DsLang l = DsIsLatinLetter(w[i]) ? DS_LANG_EN : DsIsCyrillicLetter(w[i]) ? DS_LANG_RU : DS_LANG_UNKNOWN;
+        if (l == DS_LANG_UNKNOWN || (i && l != lang)) return DS_LANG_UNKNOWN;
+        lang = l;
+    }
+    return lang;
+}
+
+static void AddCell(Cell* c, const Cell* d)
+{
+    c->kept += d->kept;
+    c->changed += d->changed;
+    c->fixed += d->fixed;
+    c->missed += d->missed;
+    c->garbled += d->garbled;
+}
+
+static void EvaluateLine(Worker* w, const wchar_t* line, size_t n)
+{
+    Stats* st = &w->stats;
+    wchar_t typed[LINE_MAX_CHARS + 1];
+    wchar_t asIs[LINE_MAX_CHARS + 2];
+    wchar_t fixed[LINE_MAX_CHARS + 2];
+    for (size_t i = 0; i < n; i++) {
+        const wchar_t f = (uint32_t)line[i] < 0x10000 ? g_flip[line[i]] : 0;
+        typed[i] = f ? f : line[i];
+    }
+    typed[n] = 0;
+    DsSessionCorrectText(w->session, line, n, asIs, ARRAYSIZE(asIs));
+    DsSessionCorrectText(w->session, typed, n, fixed, ARRAYSIZE(fixed));
+    st->lines++;
+    if (wcslen(asIs) != n || wcslen(fixed) != n) {
+        st->misaligned++;
+        return;
+    }
+
+    size_t start = 0;
+    for (size_t i = 0; i <= n; i++) {
+        if (i < n && DsIsWordChar(line[i])) continue;
+        const size_t len = i - start;
+        const size_t at = start;
+        start = i + 1;
+        if (!len) continue;
+        st->words++;
+        const DsLang lang = WordLang(line + at, len);
+        if (lang == DS_LANG_UNKNOWN) {
+            st->skipped++;
+            continue;
+        }
+        Cell c = {0};
+        if (wmemcmp(asIs + at, line + at, len) == 0) c.kept = 1;
+        else c.changed = 1;
+
+        bool mappable = true;
+        for (size_t k = at; k < i && mappable; k++) mappable = DsIsWordChar(typed[k]);
+        if (!mappable) {
+            st->unmappable++;
+        } else if (wmemcmp(fixed + at, line + at, len) == 0) {
+            c.fixed = 1;
+        } else if (wmemcmp(fixed + at, typed + at, len) == 0) {
+            c.missed = 1;
+        } else {
+            c.garbled = 1;
+        }
+        AddCell(&st->rows[LengthRow(len)], &c);
+        AddCell(&st->langs[lang], &c);
+    }
+}
+
+static void EvaluateChunk(Worker* w, const Chunk* chunk)
+{
+    wchar_t line[LINE_MAX_CHARS + 1];
+    const uint8_t* p = chunk->data;
+    const uint8_t* end = p + chunk->size;
+    while (p < end) {
+        const uint8_t* eol = (const uint8_t*)memchr(p, '\n', (size_t)(end - p));
+        if (!eol) eol = end;
+        // Runaway lines: cut at the last space that keeps the piece within LINE_MAX_CHARS bytes
+        // (so within as many characters), or at a character boundary.
+        const uint8_t* stop = eol;
+        if ((size_t)(eol - p) > LINE_MAX_CHARS) {
+            stop = p + LINE_MAX_CHARS;
+            const uint8_t* space = stop;
+            while (space > p && *space != ' ') space--;
+            if (space > p) stop = space;
+            else while (stop > p && (*stop & 0xC0) == 0x80) stop--;
+        }
+        size_t bytes = (size_t)(stop - p);
+        if (bytes && p[bytes - 1] == '\r') bytes--;
+        const size_t n = DsUtf8ToWide((const char*)p, bytes, line, ARRAYSIZE(line));
+        if (n) EvaluateLine(w, line, n);
+        p = stop == eol ? eol + 1 : stop;
+    }
+}
+
+static uint64_t Clock(void* ctx)
+{
+    (void)ctx;
+    return DsMonotonicNs();
+}
+
+static void* WorkerMain(void* arg)
+{
+    Worker* w = (Worker*)arg;
+    uint32_t chunk;
+    while (NextChunk(w, &chunk)) {
+        EvaluateChunk(w, &w->chunks[chunk]);
+        w->chunks_done++;
+    }
+    return NULL;
+}
+
+// ---------- Chunking ----------
+
+typedef struct {
+    Chunk* items;
+    size_t count;
+    size_t cap;
+} ChunkList;
+
+static void AddChunk(ChunkList* l, const uint8_t* data, size_t size)
+{
+    if (l->count == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 1024;
+        l->items = (Chunk*)realloc(l->items, l->cap * sizeof(Chunk));
+        if (!l->items) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    l->items[l->count].data = data;
+    l->items[l->count].size = size;
+    l->count++;
+}
+
+// Cuts after a line break near each target size, or after a space if the line goes on for another
+// chunk's worth; both are ASCII, so no cut lands inside a UTF-8 sequence or a word.
+static void SplitFile(ChunkList* l, const uint8_t* data, size_t size, size_t target)
+{
+    size_t start = 0;
+    while (start < size) {
+        size_t cut = start + target;
+        if (cut >= size) {
+            AddChunk(l, data + start, size - start);
+            return;
+        }
+        const size_t limit = cut + target < size ? cut + target : size;
+        const uint8_t* nl = (const uint8_t*)memchr(data + cut, '\n', limit - cut);
+        if (nl) {
+            cut = (size_t)(nl - data) + 1;
+        } else {
+            while (cut < limit && data[cut] != ' ') cut++;
+            if (cut < limit) cut++;
+            else while (cut < size && (data[cut] & 0xC0) == 0x80) cut++;
+        }
+        AddChunk(l, data + start, cut - start);
+        start = cut;
+    }
+}
+
+// ---------- Report ----------
+
+static double Percent(uint64_t part, uint64_t whole)
+{
+    return whole ? 100.0 * (double)part / (double)whole : 0.0;
+}
+
+static void PrintCell(const char* label, const Cell* c)
+{
+    const uint64_t asIs = c->kept + c->changed;
+    const uint64_t wrong = c->fixed + c->missed + c->garbled;
+    printf("%-6s %12llu %10llu %7.3f%% %12llu %12llu %10llu %8llu %7.2f%%\n", label, (unsigned long long)asIs,
+           (unsigned long long)c->changed, Percent(c->changed, asIs), (unsigned long long)wrong,
+           (unsigned long long)c->fixed, (unsigned long long)c->missed, (unsigned long long)c->garbled,
+           Percent(c->fixed, wrong));
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: diswitcher-eval [--threads N] [--chunk KB] [--morph ru.dsmf] [--config diswitcher.conf] [--no-phrase] [--no-short] corpus.txt...\n");
+}
+
+int main(int argc, char** argv)
+{
+    setlocale(LC_ALL, "C.UTF-8");
+
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned threads = cores > 0 ? (unsigned)cores : 1;
+    size_t chunkKb = 1024;
+    const char* morphPath = NULL;
+    const char* configPath = NULL;
+    const char* paths[MAX_FILES];
+    size_t fileCount = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) chunkKb = (size_t)atol(argv[++i]);
+        else if (strcmp(argv[i], "--morph") == 0 && i + 1 < argc) morphPath = argv[++i];
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) configPath = argv[++i];
+        else if (strcmp(argv[i], "--no-phrase") == 0) g_phrase = false;
+        else if (strcmp(argv[i], "--no-short") == 0) g_short = false;
+        else if (argv[i][0] == '-' || fileCount == MAX_FILES) { Usage(); return 2; }
+        else paths[fileCount++] = argv[i];
+    }
+    if (!fileCount || threads == 0 || threads >= DS_SNAPSHOT_MAX_READERS || chunkKb == 0) {
+        Usage();
+        return 2;
+    }
+
+    DsMappedFile morphFile = {0};
+    DsMorph morph;
+    if (!DsToolLoadModel(morphPath, configPath, &morphFile, &morph)) return 1;
+    InitFlip();
+
+    DsMappedFile files[MAX_FILES];
+    ChunkList chunks = {0};
+    uint64_t bytes = 0;
+    for (size_t f = 0; f < fileCount; f++) {
+        if (DsMapFile(paths[f], &files[f]) != 0) {
+            perror(paths[f]);
+            return 1;
+        }
+        SplitFile(&chunks, files[f].data, files[f].size, chunkKb * 1024);
+        bytes += files[f].size;
+    }
+    if (chunks.count > UINT32_MAX) {
+        fprintf(stderr, "too many chunks; raise --chunk\n");
+        return 1;
+    }
+
+    Deque* deques = (Deque*)aligned_alloc(DS_CACHE_LINE, threads * sizeof(Deque));
+    Worker* workers = (Worker*)calloc(threads, sizeof(Worker));
+    if (!deques || !workers) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    DsHost host = {0};
+    host.clock_ns = Clock;
+    for (unsigned i = 0; i < threads; i++) {
+        const uint32_t begin = (uint32_t)(chunks.count * i / threads);
+        const uint32_t end = (uint32_t)(chunks.count * (i + 1) / threads);
+        deques[i].range = Pack(begin, end);
+        workers[i].id = i;
+        workers[i].count = threads;
+        workers[i].deques = deques;
+        workers[i].chunks = chunks.items;
+        workers[i].session = DsSessionCreate(&host);
+        if (!workers[i].session) {
+            fprintf(stderr, "cannot create a session\n");
+            return 1;
+        }
+        DsSessionSetPhraseCorrection(workers[i].session, g_phrase);
+        DsSessionSetShortWords(workers[i].session, g_short);
+    }
+
+    const uint64_t t0 = DsMonotonicNs();
+    for (unsigned i = 0; i < threads; i++) pthread_create(&workers[i].thread, NULL, WorkerMain, &workers[i]);
+    Stats total = {0};
+    uint64_t steals = 0, stolen = 0, minChunks = UINT64_MAX, maxChunks = 0;
+    for (unsigned i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        const Stats* s = &workers[i].stats;
+        for (int r = 0; r < LENGTH_ROWS; r++) AddCell(&total.rows[r], &s->rows[r]);
+        for (int l = 0; l < 2; l++) AddCell(&total.langs[l], &s->langs[l]);
+        total.words += s->words;
+        total.skipped += s->skipped;
+        total.unmappable += s->unmappable;
+        total.lines += s->lines;
+        total.misaligned += s->misaligned;
+        steals += workers[i].steals;
+        stolen += workers[i].stolen;
+        if (workers[i].chunks_done < minChunks) minChunks = workers[i].chunks_done;
+        if (workers[i].chunks_done > maxChunks) maxChunks = workers[i].chunks_done;
+        DsSessionDestroy(workers[i].session);
+    }
+    const double seconds = (double)(DsMonotonicNs() - t0) / 1e9;
+
+    printf("corpus: %zu file(s), %.1f MB, %llu lines, %llu words (%llu skipped, %llu not typeable in the other layout)\n",
+           fileCount, (double)bytes / 1e6, (unsigned long long)total.lines, (unsigned long long)total.words,
+           (unsigned long long)total.skipped, (unsigned long long)total.unmappable);
+    if (total.misaligned) printf("lines not compared (output length changed): %llu\n", (unsigned long long)total.misaligned);
+    printf("\nlength   as written    changed   FP rate  wrong layout        fixed     missed  garbled  recall\n");
+    Cell all = {0};
+    for (int r = 0; r < LENGTH_ROWS; r++) {
+        const Cell* c = &total.rows[r];
+        AddCell(&all, c);
+        if (!c->kept && !c->changed) continue;
+        char label[8];
+        snprintf(label, sizeof(label), r == LENGTH_ROWS - 1 ? "%d+" : "%d", r + 1);
+        PrintCell(label, c);
+    }
+    PrintCell("EN", &total.langs[DS_LANG_EN]);
+    PrintCell("RU", &total.langs[DS_LANG_RU]);
+    PrintCell("all", &all);
+
+    // Both passes decide every word once.
+    printf("\nthroughput: %.0f words/s, %.1f MB/s with %u threads in %.2f s\n", 2.0 * (double)total.words / seconds,
+           (double)bytes / 1e6 / seconds, threads, seconds);
+    printf("scheduling: %zu chunks, %llu steals took %llu chunks; chunks per thread %llu..%llu\n", chunks.count,
+           (unsigned long long)steals, (unsigned long long)stolen, (unsigned long long)minChunks,
+           (unsigned long long)maxChunks);
+
+    for (size_t f = 0; f < fileCount; f++) DsUnmapFile(&files[f]);
+    free(chunks.items);
+    free(workers);
+    free(deques);
+    DsEngineShutdown();
+    if (morphPath) DsUnmapFile(&morphFile);
+    return 0;
+}
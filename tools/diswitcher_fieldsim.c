@@ -0,0 +1,237 @@
+// Headless text field: runs scenario scripts through the keystroke pipeline of the Windows build and
+// checks the text the focused application ends up with.
+//
+//   diswitcher-fieldsim [--inject-ms X] [--event-us X] [--repeat DELAY_MS,RATE] [--no-typeahead]
+//                       [--morph ru.dsmf] [--verbose] scenario.txt...
+//
+// Scripts are read by tools/script.h, as in diswitcher-mktrace; `expect` checks the field once all
+// injected input has arrived, and the script continues from there.
+//
+// The hook is the model shared with diswitcher-typeahead-sim (tools/hooksim.h): injected events
+// reach LowLevelKeyboardProc after the injection delay, real keys arrive on their own schedule, and
+// whatever the hook lets through is applied to the field (text, backspace). Corrections are sent as
+// SendBackspacesAndText sends them, and typed-ahead keys are held and replayed as on the desktop.
+//
+// Besides `expect`, every scenario checks that the application saw each key press and release in
+// pairs: a release without its press means a swallowed boundary key leaked its key-up, and a press
+// without its release means the key-up was swallowed after the press got through.
+//
+// Reported per scenario: key presses, corrections, events injected (corrections and replayed
+// keys), backspaces sent, and end-to-end correction latency, from the key press that triggered a
+// correction to the last of its events reaching the field. Exits with status 1 if any scenario
+// fails.
+
+#define _POSIX_C_SOURCE 200809L
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "engine.h"
+#include "hooksim.h"
+#include "keymap.h"
+#include "script.h"
+#include "toolutil.h"
+#include "typeahead.h"
+
+// A correction on its way: started by a key press, done when its last event reaches the field.
+typedef struct {
+    uint64_t started_ns;
+    size_t remaining;
+} Batch;
+
+typedef struct {
+    uint64_t keys;       // scripted key presses
+    uint64_t stuck;      // presses the field got without the key-up
+    size_t expects;
+    size_t failed;
+    uint64_t* latency_ns;
+    size_t latency_count;
+    size_t latency_cap;
+} Result;
+
+typedef struct {
+    DsHookSim hook;
+    bool verbose;
+    const char* name;
+
+    Batch* batches;
+    size_t batch_head;
+    size_t batch_len;
+    size_t batch_cap;
+
+    Result result;
+} Sim;
+
+static void CorrectionSent(void* ctx, const DsHookSim* hook, size_t backspaces, const wchar_t* text, size_t events)
+{
+    Sim* s = (Sim*)ctx;
+    s->batches = (Batch*)DsGrow(s->batches, &s->batch_cap, s->batch_len + 1, sizeof(Batch));
+    s->batches[s->batch_len++] = (Batch){ hook->now, events };
+    if (s->verbose) {
+        printf("  %8.1f ms  correction: %zu backspaces, \"%ls\"\n", (double)hook->now / 1e6, backspaces, text);
+    }
+}
+
+static void CorrectionArrived(void* ctx, const DsHookSim* hook)
+{
+    Sim* s = (Sim*)ctx;
+    if (s->batch_head == s->batch_len) return;
+    Batch* b = &s->batches[s->batch_head];
+    if (--b->remaining) return;
+    Result* r = &s->result;
+    r->latency_ns = (uint64_t*)DsGrow(r->latency_ns, &r->latency_cap, r->latency_count + 1, sizeof(uint64_t));
+    r->latency_ns[r->latency_count++] = hook->now - b->started_ns;
+    if (++s->batch_head == s->batch_len) s->batch_head = s->batch_len = 0;
+}
+
+static void Check(Sim* s, const DsScriptStep* st)
+{
+    if (!st->expect) {
+        s->result.stuck += DsHookSimStuckKeys(&s->hook);
+        return;
+    }
+    s->result.expects++;
+    const size_t n = wcslen(st->expect);
+    const DsHookSim* h = &s->hook;
+    if (n == h->len && wmemcmp(st->expect, h->text, n) == 0) return;
+    s->result.failed++;
+    printf("  %s:%d: expected \"%ls\"\n  %s:%d: got      \"%ls\"\n", s->name, st->line, st->expect, s->name, st->line,
+           h->text ? h->text : L"");
+}
+
+static void Run(const DsScript* script, bool typeahead, bool verbose, const char* name, Sim* s)
+{
+    memset(s, 0, sizeof(*s));
+    s->name = name;
+    s->verbose = verbose;
+    const DsHookSimObserver observer = { s, CorrectionSent, CorrectionArrived, NULL };
+    DsHookSim* h = &s->hook;
+    DsHookSimInit(h, (uint64_t)DS_TYPEAHEAD_DEFAULT_CAP_MS * 1000000u, typeahead, &observer);
+
+    // Script time is shifted by however long each `expect` waited for input to settle. At equal
+    // times injected input goes first, then the timer, then the script.
+    uint64_t offset = 0;
+    for (size_t i = 0; i < script->count; i++) {
+        const DsScriptStep* st = &script->steps[i];
+        const uint64_t at = st->at_ns + offset;
+        while (DsHookSimAdvance(h, at)) {}
+        if (at > h->now) h->now = at;
+
+        switch (st->type) {
+        case DS_STEP_KEY:
+            if (st->down) s->result.keys++;
+            DsHookSimInput(h, st->vk, DsKeymapScanCode(st->vk), st->down);
+            break;
+        case DS_STEP_LAYOUT:
+        case DS_STEP_FOCUS:
+            DsHookSimInput(h, st->type == DS_STEP_FOCUS ? DS_HOOKSIM_VK_FOCUS : DS_HOOKSIM_VK_LAYOUT, st->value, true);
+            break;
+        case DS_STEP_INJECT:
+            h->inject_ns = st->inject_ns;
+            h->event_ns = st->event_ns;
+            break;
+        case DS_STEP_EXPECT:
+            while (DsHookSimAdvance(h, UINT64_MAX)) {}
+            offset += h->now - at;
+            Check(s, st);
+            break;
+        }
+    }
+}
+
+static void FreeSim(Sim* s)
+{
+    DsHookSimFree(&s->hook);
+    free(s->batches);
+    free(s->result.latency_ns);
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: diswitcher-fieldsim [--inject-ms X] [--event-us X] [--repeat DELAY_MS,RATE] [--no-typeahead] [--morph ru.dsmf] [--verbose] scenario.txt...\n");
+}
+
+int main(int argc, char** argv)
+{
+    setlocale(LC_ALL, "C.UTF-8");
+
+    double injectMs = 10.0, eventUs = 20.0;
+    double repeatDelayMs = DS_SCRIPT_DEFAULT_REPEAT_DELAY_MS, repeatRate = DS_SCRIPT_DEFAULT_REPEAT_RATE;
+    bool typeahead = true, verbose = false;
+    const char* morphPath = NULL;
+    int first = argc;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--inject-ms") == 0 && i + 1 < argc) injectMs = atof(argv[++i]);
+        else if (strcmp(argv[i], "--event-us") == 0 && i + 1 < argc) eventUs = atof(argv[++i]);
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%lf,%lf", &repeatDelayMs, &repeatRate) != 2) { Usage(); return 2; }
+        } else if (strcmp(argv[i], "--no-typeahead") == 0) typeahead = false;
+        else if (strcmp(argv[i], "--morph") == 0 && i + 1 < argc) morphPath = argv[++i];
+        else if (strcmp(argv[i], "--verbose") == 0) verbose = true;
+        else if (argv[i][0] == '-') { Usage(); return 2; }
+        else {
+            first = i;
+            break;
+        }
+    }
+    if (first == argc || injectMs < 0 || eventUs < 0 || repeatDelayMs < 0 || repeatRate < 0) {
+        Usage();
+        return 2;
+    }
+
+    DsMappedFile morphFile = {0};
+    DsMorph morph;
+    if (!DsToolLoadModel(morphPath, NULL, &morphFile, &morph)) return 1;
+
+    // Every script starts at the command-line settings; its own lines override them.
+    DsScript defaults;
+    DsScriptDefaults(&defaults);
+    defaults.repeat_delay_ns = (uint64_t)(repeatDelayMs * 1e6);
+    defaults.repeat_every_ns = repeatRate > 0 ? (uint64_t)(1e9 / repeatRate) : 0;
+    defaults.inject_ns = (uint64_t)(injectMs * 1e6);
+    defaults.event_ns = (uint64_t)(eventUs * 1e3);
+
+    printf("injection %.1f ms + %.0f us/event, key repeat after %.0f ms at %.0f/s, type-ahead %s\n", injectMs, eventUs,
+           repeatDelayMs, repeatRate, typeahead ? "on" : "off");
+    printf("%-24s %6s %5s %8s %6s %5s %6s %9s %9s  %s\n", "scenario", "keys", "corr", "injected", "backsp", "intl",
+           "pairs", "lat p50", "lat max", "result");
+
+    int status = 0;
+    const uint64_t t0 = DsMonotonicNs();
+    for (int i = first; i < argc; i++) {
+        const char* base = strrchr(argv[i], '/');
+        base = base ? base + 1 : argv[i];
+        DsScript script;
+        if (!DsScriptLoad(argv[i], &defaults, &script)) {
+            status = 1;
+            continue;
+        }
+        Sim sim;
+        if (verbose) printf("%s:\n", base);
+        Run(&script, typeahead, verbose, base, &sim);
+        const Result* r = &sim.result;
+        const DsHookSimStats* hs = &sim.hook.stats;
+        const uint64_t p50 = DsPercentile(r->latency_ns, r->latency_count, 50);
+        const uint64_t max = DsPercentile(r->latency_ns, r->latency_count, 100);
+        const bool paired = !hs->stray_up && !r->stuck;
+        const bool ok = !r->failed && paired;
+        char pairs[16];
+        if (paired) snprintf(pairs, sizeof(pairs), "ok");
+        else snprintf(pairs, sizeof(pairs), "%llu/%llu", (unsigned long long)hs->stray_up, (unsigned long long)r->stuck);
+        printf("%-24s %6llu %5llu %8llu %6llu %5llu %6s %6.1f ms %6.1f ms  %s (%zu/%zu expects)\n", base,
+               (unsigned long long)r->keys, (unsigned long long)hs->corrections, (unsigned long long)hs->injected,
+               (unsigned long long)hs->backspaces, (unsigned long long)hs->interleaved, pairs, (double)p50 / 1e6,
+               (double)max / 1e6, ok ? "OK" : "FAIL", r->expects - r->failed, r->expects);
+        if (!ok) status = 1;
+        FreeSim(&sim);
+        DsScriptFree(&script);
+    }
+    printf("%s in %.2f s (pairs: key-ups without a press / presses without a key-up)\n",
+           status ? "FAILED" : "all scenarios passed", (double)(DsMonotonicNs() - t0) / 1e9);
+
+    DsEngineShutdown();
+    if (morphPath) DsUnmapFile(&morphFile);
+    return status;
+}
@@ -0,0 +1,894 @@
+// Fixes wrong-layout words in UTF-8 text: files or a pipe in, the same text with "ghbdtn vbh"
+// turned into "привет мир" out.
+//
+//   diswitcher-filter [--threads N] [--morph ru.dsmf] [--config diswitcher.conf] [--stats] [file...]
+//   diswitcher-filter --bench [--threads N] [--morph ru.dsmf] [--config diswitcher.conf] file
+//
+// Every token (a run of letters and digits, as the engine reads a word while typing) goes through
+// the engine's single-token decision, DsSessionFixToken, and is replaced by its other-layout form if
+// typing it would have been corrected. Phrase corrections and one- and two-letter words need the
+// typing context and are left to DsSessionCorrectText (diswitcherd); bytes that are not valid UTF-8
+// pass through untouched.
+//
+// Files are memory-mapped, stdin is read in batches. A batch is cut into one slice per thread at
+// ASCII bytes that cannot be part of a token (spaces, punctuation, line breaks), so no token spans
+// two slices. Workers classify their slice 64 bytes at a time with SSE2 (a scalar table elsewhere)
+// into bit masks: bytes that may belong to a token (ASCII letters and digits, every byte >= 0x80),
+// digits, Cyrillic lead bytes 0xD0/0xD1 and continuation bytes. A run made of ASCII letters and
+// digits and whole lead + continuation pairs is one token whose length comes from the masks; it is
+// hashed as bytes and decoded, eight pairs per step, only if the worker has not decided it before.
+// Runs with any other byte >= 0x80 are decoded and split one character at a time. A worker records
+// its output as spans of the input it leaves alone and replacement bytes in a side buffer; the main
+// thread writes the spans of each batch in order straight from the input with writev, so unchanged
+// text is never copied, while the workers filter the next batch.
+//
+// Repeated words are cheap: each worker remembers its decisions (kept, or the replacement bytes) by
+// a hash of the token's bytes, so a common word costs a hash, one probe and a compare with the
+// remembered bytes, and the engine's own decision cache still serves what that table has lost.
+//
+// --bench runs the file through a naive single-threaded loop (decode each line to UTF-32, split,
+// DsSessionCheckToken per token, encode) and through the filter with one thread and with --threads,
+// checks that the outputs are identical and prints MB/s for each.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <locale.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FILTER_SSE2 1
+#endif
+
+#include "engine.h"
+#include "snapshot.h"
+#include "toolutil.h"
+#include "utf8.h"
+
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define SLICE_BYTES (4u << 20) // input per worker and batch
+#define MEMO_BITS 15           // remembered decisions per worker: 32K cache lines (2 MB)
+#define MEMO_BYTES 54          // token and replacement bytes (UTF-8) a decision remembers
+#define WRITE_IOV 1024
+
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t cap;
+} Buf;
+
+// A piece of output: `len` bytes of the input at `at`, or of the replacement buffer at `off`.
+typedef struct {
+    const uint8_t* at; // NULL: replacement bytes
+    size_t off;
+    size_t len;
+} Span;
+
+typedef struct {
+    Span* items;
+    size_t count;
+    size_t cap;
+} SpanList;
+
+typedef struct {
+    uint64_t tokens;  // runs of word characters
+    uint64_t checked; // sent to the engine
+    uint64_t fixed;
+    uint64_t memo_hits;
+} Stats;
+
+// A remembered decision, one cache line: the token's hash with the low bit set if it is fixed (0 if
+// the slot is empty), its bytes, then its replacement if it is fixed. The bytes tell the token from
+// another with the same hash.
+typedef struct {
+    uint64_t tag;
+    uint8_t token_len;
+    uint8_t repl_len;
+    uint8_t bytes[MEMO_BYTES];
+} MemoEntry;
+
+typedef struct {
+    pthread_t thread;
+    DsSession* session;
+    SpanList spans[2]; // by batch parity: one is filled while the other is written
+    Buf repl[2];
+    SpanList* cur_spans;
+    Buf* cur_repl;
+    MemoEntry* memo; // decisions by token hash, 1 << MEMO_BITS
+    Stats stats;
+    // Current slice.
+    const uint8_t* in;
+    size_t in_len;
+} Worker;
+
+static pthread_barrier_t g_start, g_done;
+static volatile bool g_stop;
+static Worker* g_workers;
+static unsigned g_threads;
+
+// Bytes that may belong to a token: ASCII letters and digits, and anything >= 0x80.
+static uint8_t g_maybe_word[256];
+#ifdef FILTER_SSE2
+// U+0400..U+047F (0xD0/0xD1 and a continuation byte) are all word characters, so runs of them and
+// ASCII letters and digits are single tokens. True in any UTF-8 locale; checked anyway.
+static bool g_cyrillic_words;
+#endif
+
+static void InitByteClasses(void)
+{
+    for (unsigned b = 0; b < 256; b++) {
+        g_maybe_word[b] = (b >= '0' && b <= '9') || (b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || b >= 0x80;
+    }
+#ifdef FILTER_SSE2
+    g_cyrillic_words = true;
+    for (wchar_t ch = 0x0400; ch < 0x0480; ch++) g_cyrillic_words &= DsIsWordChar(ch);
+#endif
+}
+
+static void AddSpan(SpanList* l, const uint8_t* at, size_t off, size_t len)
+{
+    if (!len) return;
+    l->items = (Span*)DsGrow(l->items, &l->cap, l->count + 1, sizeof(Span));
+    l->items[l->count].at = at;
+    l->items[l->count].off = off;
+    l->items[l->count].len = len;
+    l->count++;
+}
+
+// ---------- Scanning ----------
+
+#ifdef FILTER_SSE2
+// 16 0xFF then 16 zeros: loaded at kKeepFirst + 16 - n, the mask of the first n bytes.
+static const uint8_t kKeepFirst[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+#endif
+
+// Eight bytes at a time; most tokens fit in 16, which SSE2 reads in one masked load when `avail`
+// >= 16 bytes may be read. Never 0 or 1.
+static inline uint64_t HashBytes(const uint8_t* p, size_t n, size_t avail)
+{
+    uint64_t h = (uint64_t)n * 0x9E3779B97F4A7C15ull;
+#ifdef FILTER_SSE2
+    if (n <= 16 && avail >= 16) {
+        uint64_t v[2];
+        _mm_storeu_si128((__m128i*)v, _mm_and_si128(_mm_loadu_si128((const __m128i*)p),
+                                                    _mm_loadu_si128((const __m128i*)(kKeepFirst + 16 - n))));
+        h = (h ^ v[0]) * 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 29;
+        h = (h ^ v[1]) * 0xBF58476D1CE4E5B9ull;
+        n = 0;
+    }
+#else
+    (void)avail;
+#endif
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        h = (h ^ v) * 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 29;
+    }
+    if (n) {
+        uint64_t v = 0;
+        memcpy(&v, p, n);
+        h = (h ^ v) * 0xBF58476D1CE4E5B9ull;
+    }
+    h ^= h >> 32;
+    h *= 0x94D049BB133111EBull;
+    h ^= h >> 29;
+    return h | 2;
+}
+
+// Whether the `n` bytes at `p` are the first `n` of `q`, which has at least 16 readable bytes; read
+// the same way as HashBytes.
+static inline bool SameBytes(const uint8_t* p, size_t n, size_t avail, const uint8_t* q)
+{
+#ifdef FILTER_SSE2
+    if (n <= 16 && avail >= 16) {
+        const __m128i keep = _mm_loadu_si128((const __m128i*)(kKeepFirst + 16 - n));
+        const __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)p), keep);
+        const __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i*)q), keep);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) == 0xFFFF;
+    }
+#else
+    (void)avail;
+#endif
+    return memcmp(p, q, n) == 0;
+}
+
+typedef struct {
+    wchar_t chars[DS_TOKEN_MAX_CHARS + 1];
+    size_t n;
+    size_t start; // byte offset in the slice
+    bool too_long;
+    bool digits;
+} Token;
+
+static void Replace(Worker* w, const uint8_t* base, size_t* spanStart, size_t start, size_t end, const uint8_t* repl,
+                    size_t len)
+{
+    Buf* r = w->cur_repl;
+    r->data = (uint8_t*)DsGrow(r->data, &r->cap, r->len + len, 1);
+    memcpy(r->data + r->len, repl, len);
+    AddSpan(w->cur_spans, base + *spanStart, 0, start - *spanStart);
+    AddSpan(w->cur_spans, NULL, r->len, len);
+    r->len += len;
+    *spanStart = end;
+    w->stats.fixed++;
+}
+
+// Characters of a token of ASCII letters and digits and whole pairs 0xD0/0xD1 + continuation, of
+// `len` bytes at p; `avail` bytes may be read. With SSE2 eight pairs are decoded per step while
+// they last, and up to seven characters past the token are stored.
+static void DecodeWord(const uint8_t* p, size_t len, size_t avail, wchar_t* out)
+{
+#ifndef FILTER_SSE2
+    (void)avail;
+#endif
+    size_t i = 0, n = 0;
+    while (i < len) {
+#ifdef FILTER_SSE2
+        if (avail - i >= 16) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+            // Lead in the low byte of each 16-bit lane, continuation in the high byte.
+            const __m128i pair = _mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16((short)0xC0FE)),
+                                                 _mm_set1_epi16((short)0x80D0));
+            const size_t pairs = (len - i) / 2 < 8 ? (len - i) / 2 : 8;
+            const uint32_t want = (1u << (2 * pairs)) - 1;
+            if (pairs && ((uint32_t)_mm_movemask_epi8(pair) & want) == want) {
+                const __m128i cp = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x1F)), 6),
+                                                _mm_and_si128(_mm_srli_epi16(v, 8), _mm_set1_epi16(0x3F)));
+#if WCHAR_MAX > 0xFFFF
+                _mm_storeu_si128((__m128i*)(out + n), _mm_unpacklo_epi16(cp, _mm_setzero_si128()));
+                _mm_storeu_si128((__m128i*)(out + n + 4), _mm_unpackhi_epi16(cp, _mm_setzero_si128()));
+#else
+                _mm_storeu_si128((__m128i*)(out + n), cp);
+#endif
+                i += 2 * pairs;
+                n += pairs;
+                continue;
+            }
+        }
+#endif
+        if (p[i] < 0x80) {
+            out[n++] = p[i++];
+        } else {
+            out[n++] = (wchar_t)(((p[i] & 0x1F) << 6) | (p[i + 1] & 0x3F));
+            i += 2;
+        }
+    }
+}
+
+// Decision for a token of 3..DS_TOKEN_MAX_CHARS characters without digits at [start, end). `chars`
+// is NULL for a token of ASCII letters and whole Cyrillic pairs: it is decoded only if the memo
+// does not know it.
+static void DecideToken(Worker* w, const uint8_t* base, size_t* spanStart, size_t start, size_t end,
+                        const wchar_t* chars, size_t n)
+{
+    const size_t len = end - start;
+    const uint64_t h = HashBytes(base + start, len, w->in_len - start);
+    const size_t slot = h >> (64 - MEMO_BITS);
+    MemoEntry* e = &w->memo[slot];
+    if ((e->tag | 1) == (h | 1) && e->token_len == len && SameBytes(base + start, len, w->in_len - start, e->bytes)) {
+        w->stats.memo_hits++;
+        if (e->tag & 1) Replace(w, base, spanStart, start, end, e->bytes + len, e->repl_len);
+        return;
+    }
+
+    wchar_t decoded[DS_TOKEN_MAX_CHARS + 8]; // DecodeWord stores eight at a time
+    if (!chars) {
+        decoded[0] = 0; // DecodeWord always stores (3+ characters); GCC cannot tell
+        DecodeWord(base + start, len, w->in_len - start, decoded);
+        chars = decoded;
+    }
+    wchar_t fixed[DS_TOKEN_MAX_CHARS + 1];
+    uint8_t repl[DS_TOKEN_MAX_CHARS * 3];
+    w->stats.checked++;
+    const bool fix = DsSessionFixToken(w->session, chars, n, fixed);
+    const size_t replLen = fix ? DsWideToUtf8(fixed, n, (char*)repl, sizeof(repl)) : 0;
+    // Longer tokens are left to the engine's decision cache.
+    if (len + replLen <= MEMO_BYTES) {
+        e->tag = fix ? h | 1 : h & ~(uint64_t)1;
+        e->token_len = (uint8_t)len;
+        e->repl_len = (uint8_t)replLen;
+        memcpy(e->bytes, base + start, len);
+        memcpy(e->bytes + len, repl, replLen);
+    }
+    if (fix) Replace(w, base, spanStart, start, end, repl, replLen);
+}
+
+static void FinishToken(Worker* w, const uint8_t* base, size_t* spanStart, Token* t, size_t end)
+{
+    const size_t n = t->n;
+    const bool candidate = n >= 3 && !t->too_long && !t->digits;
+    t->n = 0;
+    t->too_long = t->digits = false;
+    w->stats.tokens++;
+    if (candidate) DecideToken(w, base, spanStart, t->start, end, t->chars, n);
+}
+
+// Splits a run of maybe-word bytes into tokens: ASCII bytes in it are letters or digits, the rest
+// is decoded and tested with DsIsWordChar.
+static void ScanRun(Worker* w, const uint8_t* base, size_t* spanStart, size_t i, size_t end)
+{
+    Token t;
+    t.n = 0;
+    t.too_long = t.digits = false;
+    while (i < end) {
+        const size_t at = i;
+        uint32_t cp = base[i];
+        if (cp < 0x80) {
+            i++;
+            t.digits |= cp <= '9';
+        } else if ((cp & 0xE0) == 0xC0 && i + 1 < end && (base[i + 1] & 0xC0) == 0x80 && cp >= 0xC2) {
+            cp = ((cp & 0x1F) << 6) | (base[i + 1] & 0x3F); // two bytes: all of Cyrillic
+            i += 2;
+        } else {
+            i += DsUtf8Decode(base + i, end - i, &cp);
+        }
+        // А..я and Ё/ё without the locale's classification; everything else asks the engine.
+        const bool cyrillic = (cp >= 0x0410 && cp <= 0x044F) || cp == 0x0401 || cp == 0x0451;
+        if (cp >= 0x80 && !cyrillic && (cp > WCHAR_MAX || !DsIsWordChar((wchar_t)cp))) {
+            if (t.n || t.too_long) FinishToken(w, base, spanStart, &t, at);
+            continue;
+        }
+        if (!t.n && !t.too_long) t.start = at;
+        if (t.n < DS_TOKEN_MAX_CHARS) t.chars[t.n++] = (wchar_t)cp;
+        else t.too_long = true;
+    }
+    if (t.n || t.too_long) FinishToken(w, base, spanStart, &t, end);
+}
+
+#ifdef FILTER_SSE2
+// 64 input bytes as bit masks, bit i for byte i.
+typedef struct {
+    uint64_t word;  // may belong to a token: ASCII letters and digits, anything >= 0x80
+    uint64_t digit;
+    uint64_t lead;  // 0xD0, 0xD1
+    uint64_t cont;  // 0x80..0xBF
+    uint64_t high;  // >= 0x80
+} BlockMasks;
+
+static inline void ClassifyBlock(const uint8_t* p, BlockMasks* m)
+{
+    memset(m, 0, sizeof(*m));
+    for (unsigned k = 0; k < 4; k++) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(p + 16 * k));
+        // Shift the ranges to the bottom of the signed range so one signed compare tests each.
+        const __m128i letter = _mm_cmplt_epi8(_mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8((char)('a' + 128))),
+                                              _mm_set1_epi8((char)(-128 + 26)));
+        const __m128i digit = _mm_cmplt_epi8(_mm_sub_epi8(v, _mm_set1_epi8((char)('0' + 128))), _mm_set1_epi8((char)(-128 + 10)));
+        const __m128i lead = _mm_cmpeq_epi8(_mm_and_si128(v, _mm_set1_epi8((char)0xFE)), _mm_set1_epi8((char)0xD0));
+        const __m128i cont = _mm_cmplt_epi8(v, _mm_set1_epi8((char)0xC0));
+        const unsigned shift = 16 * k;
+        m->word |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), v)) << shift;
+        m->digit |= (uint64_t)(uint32_t)_mm_movemask_epi8(digit) << shift;
+        m->lead |= (uint64_t)(uint32_t)_mm_movemask_epi8(lead) << shift;
+        m->cont |= (uint64_t)(uint32_t)_mm_movemask_epi8(cont) << shift;
+        m->high |= (uint64_t)(uint32_t)_mm_movemask_epi8(v) << shift;
+    }
+}
+
+// A run of maybe-word bytes followed across blocks.
+typedef struct {
+    size_t start;
+    size_t conts; // continuation bytes: the run has (length - conts) characters if it is simple
+    bool digits;
+    bool mixed;   // bytes >= 0x80 other than whole Cyrillic pairs: split and decoded by ScanRun
+} Run;
+
+static void FinishRun(Worker* w, const uint8_t* base, size_t* spanStart, const Run* r, size_t end)
+{
+    if (r->mixed) {
+        ScanRun(w, base, spanStart, r->start, end);
+        return;
+    }
+    // ASCII letters and digits and U+0400..U+047F, all word characters: one token.
+    const size_t n = end - r->start - r->conts;
+    w->stats.tokens++;
+    if (n >= 3 && n <= DS_TOKEN_MAX_CHARS && !r->digits) DecideToken(w, base, spanStart, r->start, end, NULL, n);
+}
+
+static void FilterSlice(Worker* w)
+{
+    w->cur_spans->count = 0;
+    w->cur_repl->len = 0;
+    const uint8_t* p = w->in;
+    const size_t n = w->in_len;
+    size_t spanStart = 0;
+    Run run;
+    bool inRun = false;
+    uint64_t carryLead = 0; // a lead byte ended the previous block
+    uint8_t tail[64];
+    for (size_t at = 0; at < n; at += 64) {
+        const uint8_t* block = p + at;
+        if (n - at < 64) {
+            memset(tail, 0, sizeof(tail)); // not word bytes
+            memcpy(tail, block, n - at);
+            block = tail;
+        }
+        BlockMasks m;
+        ClassifyBlock(block, &m);
+        // Not a whole pair: a continuation without its lead, a lead without its continuation (the
+        // bit after it), or another byte >= 0x80.
+        const uint64_t lead = g_cyrillic_words ? m.lead : 0;
+        const uint64_t cont = g_cyrillic_words ? m.cont : 0;
+        const uint64_t broken = (cont ^ ((lead << 1) | carryLead)) | (m.high & ~lead & ~cont);
+        carryLead = lead >> 63;
+
+        unsigned from = 0;
+        for (;;) {
+            if (!inRun) {
+                const uint64_t next = from < 64 ? m.word >> from << from : 0;
+                if (!next) break;
+                from = (unsigned)__builtin_ctzll(next);
+                run.start = at + from;
+                run.conts = 0;
+                run.digits = run.mixed = false;
+                inRun = true;
+            }
+            const uint64_t stop = ~m.word >> from << from;
+            const unsigned to = stop ? (unsigned)__builtin_ctzll(stop) : 64;
+            const uint64_t span = (to == 64 ? ~0ull : (1ull << to) - 1) >> from << from;
+            run.conts += (size_t)__builtin_popcountll(cont & span);
+            run.digits |= (m.digit & span) != 0;
+            run.mixed |= (broken & (to == 64 ? span : span | 1ull << to)) != 0;
+            if (to == 64) break;
+            FinishRun(w, p, &spanStart, &run, at + to);
+            inRun = false;
+            from = to + 1;
+        }
+    }
+    if (inRun) {
+        run.mixed |= carryLead != 0;
+        FinishRun(w, p, &spanStart, &run, n);
+    }
+    AddSpan(w->cur_spans, p + spanStart, 0, n - spanStart);
+}
+#else
+static size_t SkipNonWord(const uint8_t* p, size_t i, size_t n)
+{
+    while (i < n && !g_maybe_word[p[i]]) i++;
+    return i;
+}
+
+static size_t SkipMaybeWord(const uint8_t* p, size_t i, size_t n)
+{
+    while (i < n && g_maybe_word[p[i]]) i++;
+    return i;
+}
+
+static void FilterSlice(Worker* w)
+{
+    w->cur_spans->count = 0;
+    w->cur_repl->len = 0;
+    const uint8_t* p = w->in;
+    const size_t n = w->in_len;
+    size_t spanStart = 0;
+    size_t i = 0;
+    for (;;) {
+        i = SkipNonWord(p, i, n);
+        if (i >= n) break;
+        const size_t end = SkipMaybeWord(p, i, n);
+        ScanRun(w, p, &spanStart, i, end);
+        i = end;
+    }
+    AddSpan(w->cur_spans, p + spanStart, 0, n - spanStart);
+}
+#endif
+
+static void* WorkerMain(void* arg)
+{
+    Worker* w = (Worker*)arg;
+    for (;;) {
+        pthread_barrier_wait(&g_start);
+        if (g_stop) return NULL;
+        FilterSlice(w);
+        pthread_barrier_wait(&g_done);
+    }
+}
+
+// ---------- Batches ----------
+
+// First offset at or after `from` just past a byte no token can contain; `n` if there is none.
+static size_t CutAfter(const uint8_t* p, size_t from, size_t n)
+{
+    while (from < n && g_maybe_word[p[from]]) from++;
+    return from < n ? from + 1 : n;
+}
+
+// Last such offset at or before `n`, 0 if there is none.
+static size_t CutBefore(const uint8_t* p, size_t n)
+{
+    while (n && g_maybe_word[p[n - 1]]) n--;
+    return n;
+}
+
+typedef struct {
+    // A mapped file...
+    const uint8_t* map;
+    size_t size;
+    size_t pos;
+    // ...or a stream, read into two buffers in turn.
+    FILE* f;
+    bool eof;
+    Buf bufs[2];
+    Buf carry;
+} Source;
+
+// Next batch of about g_threads slices; `slot` picks the stream buffer. Length 0 at the end.
+static void NextBatch(Source* src, int slot, const uint8_t** data, size_t* len)
+{
+    const size_t want = (size_t)SLICE_BYTES * g_threads;
+    if (!src->f) {
+        const size_t cut = src->pos + want >= src->size ? src->size : CutAfter(src->map, src->pos + want, src->size);
+        *data = src->map + src->pos;
+        *len = cut - src->pos;
+        src->pos = cut;
+        return;
+    }
+
+    Buf* b = &src->bufs[slot];
+    b->data = (uint8_t*)DsGrow(b->data, &b->cap, want > src->carry.len ? want : src->carry.len + want, 1);
+    memcpy(b->data, src->carry.data, src->carry.len);
+    b->len = src->carry.len;
+    src->carry.len = 0;
+    for (;;) {
+        if (!src->eof) {
+            b->len += fread(b->data + b->len, 1, b->cap - b->len, src->f);
+            if (b->len < b->cap) src->eof = true;
+        }
+        const size_t cut = src->eof ? b->len : CutBefore(b->data, b->len);
+        if (cut || src->eof) {
+            src->carry.data = (uint8_t*)DsGrow(src->carry.data, &src->carry.cap, b->len - cut, 1);
+            memcpy(src->carry.data, b->data + cut, b->len - cut);
+            src->carry.len = b->len - cut;
+            *data = b->data;
+            *len = cut;
+            return;
+        }
+        b->data = (uint8_t*)DsGrow(b->data, &b->cap, b->cap * 2, 1); // one token longer than the batch
+    }
+}
+
+static void AssignSlices(const uint8_t* data, size_t len, int slot)
+{
+    size_t start = 0;
+    for (unsigned i = 0; i < g_threads; i++) {
+        size_t end = i + 1 == g_threads ? len : len * (i + 1) / g_threads;
+        if (end < start) end = start;
+        else if (end > start && end < len) end = CutAfter(data, end, len);
+        Worker* w = &g_workers[i];
+        w->in = data + start;
+        w->in_len = end - start;
+        w->cur_spans = &w->spans[slot];
+        w->cur_repl = &w->repl[slot];
+        start = end;
+    }
+}
+
+// ---------- Output ----------
+
+typedef struct {
+    int fd;     // writev here...
+    Buf* copy;  // ...or append here (--bench)
+    uint64_t bytes;
+    bool failed;
+} Sink;
+
+static void WriteIov(Sink* out, struct iovec* iov, int count)
+{
+    while (count && !out->failed) {
+        const ssize_t n = writev(out->fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            out->failed = true;
+            return;
+        }
+        size_t done = (size_t)n;
+        while (count && done >= iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count) {
+            iov->iov_base = (uint8_t*)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+}
+
+static void WriteBatch(Sink* out, int slot)
+{
+    struct iovec iov[WRITE_IOV];
+    int count = 0;
+    for (unsigned i = 0; i < g_threads; i++) {
+        const Worker* w = &g_workers[i];
+        const SpanList* l = &w->spans[slot];
+        for (size_t k = 0; k < l->count; k++) {
+            const Span* s = &l->items[k];
+            const uint8_t* bytes = s->at ? s->at : w->repl[slot].data + s->off;
+            out->bytes += s->len;
+            if (out->copy) {
+                Buf* c = out->copy;
+                c->data = (uint8_t*)DsGrow(c->data, &c->cap, c->len + s->len, 1);
+                memcpy(c->data + c->len, bytes, s->len);
+                c->len += s->len;
+                continue;
+            }
+            iov[count].iov_base = (void*)bytes;
+            iov[count].iov_len = s->len;
+            if (++count == WRITE_IOV) {
+                WriteIov(out, iov, count);
+                count = 0;
+            }
+        }
+    }
+    if (count) WriteIov(out, iov, count);
+}
+
+// Filters one source through the worker pool, writing batch k while batch k + 1 is filtered. A
+// stream reads batch k + 2 into batch k's buffer, so that happens only after batch k is written.
+static void FilterSource(Source* src, Sink* out)
+{
+    const uint8_t* data;
+    size_t len;
+    int slot = 0;
+    bool pending = false;
+    NextBatch(src, slot, &data, &len);
+    while (len) {
+        AssignSlices(data, len, slot);
+        pthread_barrier_wait(&g_start);
+        if (pending) WriteBatch(out, !slot);
+        NextBatch(src, !slot, &data, &len);
+        pthread_barrier_wait(&g_done);
+        pending = true;
+        slot = !slot;
+    }
+    if (pending) WriteBatch(out, !slot);
+}
+
+static void StartPool(unsigned threads, const DsHost* host)
+{
+    g_threads = threads;
+    g_stop = false;
+    g_workers = (Worker*)calloc(threads, sizeof(Worker));
+    if (!g_workers) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    pthread_barrier_init(&g_start, NULL, threads + 1);
+    pthread_barrier_init(&g_done, NULL, threads + 1);
+    for (unsigned i = 0; i < threads; i++) {
+        Worker* w = &g_workers[i];
+        w->session = DsSessionCreate(host);
+        w->memo = (MemoEntry*)aligned_alloc(DS_CACHE_LINE, ((size_t)1 << MEMO_BITS) * sizeof(MemoEntry));
+        if (w->memo) memset(w->memo, 0, ((size_t)1 << MEMO_BITS) * sizeof(MemoEntry));
+        if (!w->session || !w->memo) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        pthread_create(&w->thread, NULL, WorkerMain, w);
+    }
+}
+
+static void StopPool(Stats* total)
+{
+    g_stop = true;
+    pthread_barrier_wait(&g_start);
+    memset(total, 0, sizeof(*total));
+    for (unsigned i = 0; i < g_threads; i++) {
+        Worker* w = &g_workers[i];
+        pthread_join(w->thread, NULL);
+        total->tokens += w->stats.tokens;
+        total->checked += w->stats.checked;
+        total->fixed += w->stats.fixed;
+        total->memo_hits += w->stats.memo_hits;
+        DsSessionDestroy(w->session);
+        free(w->memo);
+        for (int s = 0; s < 2; s++) {
+            free(w->spans[s].items);
+            free(w->repl[s].data);
+        }
+    }
+    free(g_workers);
+    g_workers = NULL;
+    pthread_barrier_destroy(&g_start);
+    pthread_barrier_destroy(&g_done);
+}
+
+// ---------- Benchmark ----------
+
+// The obvious way: one line at a time through UTF-32, every token through the uncached decision.
+static void NaiveFilter(const uint8_t* data, size_t size, const DsHost* host, Buf* out)
+{
+    DsSession* s = DsSessionCreate(host);
+    size_t lineCap = 1024;
+    wchar_t* line = (wchar_t*)malloc(lineCap * sizeof(wchar_t));
+    char* utf8 = (char*)malloc(lineCap * 4);
+    size_t pos = 0;
+    while (pos < size && line && utf8) {
+        const uint8_t* nl = (const uint8_t*)memchr(data + pos, '\n', size - pos);
+        const size_t end = nl ? (size_t)(nl - data) + 1 : size;
+        if (end - pos + 1 > lineCap) {
+            while (end - pos + 1 > lineCap) lineCap *= 2;
+            line = (wchar_t*)realloc(line, lineCap * sizeof(wchar_t));
+            utf8 = (char*)realloc(utf8, lineCap * 4);
+            if (!line || !utf8) break;
+        }
+        const size_t n = DsUtf8ToWide((const char*)data + pos, end - pos, line, lineCap);
+        size_t start = 0;
+        for (size_t i = 0; i <= n; i++) {
+            if (i < n && DsIsWordChar(line[i])) continue;
+            DsTokenVerdict v;
+            if (i - start <= DS_TOKEN_MAX_CHARS && DsSessionCheckToken(s, line + start, i - start, &v) && v.fix) {
+                wmemcpy(line + start, v.corrected, i - start);
+            }
+            start = i + 1;
+        }
+        const size_t bytes = DsWideToUtf8(line, n, utf8, lineCap * 4);
+        out->data = (uint8_t*)DsGrow(out->data, &out->cap, out->len + bytes, 1);
+        memcpy(out->data + out->len, utf8, bytes);
+        out->len += bytes;
+        pos = end;
+    }
+    free(line);
+    free(utf8);
+    DsSessionDestroy(s);
+}
+
+static double FilterRun(const uint8_t* data, size_t size, unsigned threads, const DsHost* host, Buf* out, Stats* stats)
+{
+    Source src = {0};
+    src.map = data;
+    src.size = size;
+    Sink sink = {0};
+    sink.copy = out;
+    StartPool(threads, host);
+    const uint64_t t0 = DsMonotonicNs();
+    FilterSource(&src, &sink);
+    const double seconds = (double)(DsMonotonicNs() - t0) / 1e9;
+    StopPool(stats);
+    return seconds;
+}
+
+static int Bench(const char* path, unsigned threads, const DsHost* host)
+{
+    DsMappedFile file;
+    if (DsMapFile(path, &file) != 0) {
+        perror(path);
+        return 1;
+    }
+    const double mb = (double)file.size / 1e6;
+    Buf naive = {0}, one = {0}, many = {0};
+    Stats stats;
+
+    uint64_t t0 = DsMonotonicNs();
+    NaiveFilter(file.data, file.size, host, &naive);
+    const double naiveS = (double)(DsMonotonicNs() - t0) / 1e9;
+    printf("naive loop:           %8.1f MB/s (%.2f s)\n", mb / naiveS, naiveS);
+
+    const double oneS = FilterRun(file.data, file.size, 1, host, &one, &stats);
+    printf("filter, 1 thread:     %8.1f MB/s (%.2f s)  %.1fx\n", mb / oneS, oneS, naiveS / oneS);
+    const double manyS = FilterRun(file.data, file.size, threads, host, &many, &stats);
+    printf("filter, %2u threads:   %8.1f MB/s (%.2f s)  %.1fx\n", threads, mb / manyS, manyS, naiveS / manyS);
+    printf("tokens %llu, fixed %llu, decided before %.1f%%, to the engine %.1f%%\n",
+           (unsigned long long)stats.tokens, (unsigned long long)stats.fixed,
+           stats.tokens ? 100.0 * (double)stats.memo_hits / (double)stats.tokens : 0.0,
+           stats.tokens ? 100.0 * (double)stats.checked / (double)stats.tokens : 0.0);
+
+    const bool same = naive.len == one.len && one.len == many.len && memcmp(naive.data, one.data, one.len) == 0 &&
+                      memcmp(one.data, many.data, many.len) == 0;
+    printf("outputs %s\n", same ? "identical" : "DIFFER");
+    free(naive.data);
+    free(one.data);
+    free(many.data);
+    DsUnmapFile(&file);
+    return same ? 0 : 1;
+}
+
+// ---------- Main ----------
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: diswitcher-filter [--threads N] [--morph ru.dsmf] [--config diswitcher.conf] [--stats] [file...]\n"
+                    "       diswitcher-filter --bench [--threads N] [--morph ru.dsmf] [--config diswitcher.conf] file\n");
+}
+
+int main(int argc, char** argv)
+{
+    setlocale(LC_ALL, "C.UTF-8");
+
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned threads = cores > 0 ? (unsigned)cores : 1;
+    const char* morphPath = NULL;
+    const char* configPath = NULL;
+    bool bench = false, stats = false;
+    int firstFile = argc;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--morph") == 0 && i + 1 < argc) morphPath = argv[++i];
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) configPath = argv[++i];
+        else if (strcmp(argv[i], "--bench") == 0) bench = true;
+        else if (strcmp(argv[i], "--stats") == 0) stats = true;
+        else if (argv[i][0] == '-' && argv[i][1]) { Usage(); return 2; }
+        else { firstFile = i; break; }
+    }
+    if (threads == 0 || threads >= DS_SNAPSHOT_MAX_READERS || (bench && argc - firstFile != 1)) {
+        Usage();
+        return 2;
+    }
+
+    DsMappedFile morphFile = {0};
+    DsMorph morph;
+    if (!DsToolLoadModel(morphPath, configPath, &morphFile, &morph)) return 1;
+    InitByteClasses();
+    const DsHost host = {0}; // no clock: the decision cache statistics are not needed
+
+    int rc = 0;
+    if (bench) {
+        rc = Bench(argv[firstFile], threads, &host);
+    } else {
+        Sink sink = {0};
+        sink.fd = STDOUT_FILENO;
+        StartPool(threads, &host);
+        const uint64_t t0 = DsMonotonicNs();
+        for (int i = firstFile; i <= argc && rc == 0 && !sink.failed; i++) {
+            Source src = {0};
+            DsMappedFile file = {0};
+            struct stat st;
+            if (i == argc) {
+                if (firstFile != argc) break;
+                src.f = stdin;
+            } else if (strcmp(argv[i], "-") == 0) {
+                src.f = stdin;
+            } else if (stat(argv[i], &st) == 0 && !S_ISREG(st.st_mode)) {
+                // Pipes and devices are read like stdin.
+                if (!(src.f = fopen(argv[i], "rb"))) {
+                    perror(argv[i]);
+                    rc = 1;
+                    break;
+                }
+            } else if (DsMapFile(argv[i], &file) != 0) {
+                perror(argv[i]);
+                rc = 1;
+                break;
+            } else {
+                src.map = file.data;
+                src.size = file.size;
+            }
+            FilterSource(&src, &sink);
+            free(src.bufs[0].data);
+            free(src.bufs[1].data);
+            free(src.carry.data);
+            if (src.f && src.f != stdin) fclose(src.f);
+            if (!src.f) DsUnmapFile(&file);
+        }
+        const double seconds = (double)(DsMonotonicNs() - t0) / 1e9;
+        Stats total;
+        StopPool(&total);
+        if (sink.failed) {
+            perror("write");
+            rc = 1;
+        }
+        if (stats) {
+            fprintf(stderr, "%llu tokens, %llu fixed, %.1f%% decided before, %.1f%% to the engine; %.1f MB out in %.2f s (%.1f MB/s) with %u threads\n",
+                    (unsigned long long)total.tokens, (unsigned long long)total.fixed,
+                    total.tokens ? 100.0 * (double)total.memo_hits / (double)total.tokens : 0.0,
+                    total.tokens ? 100.0 * (double)total.checked / (double)total.tokens : 0.0, (double)sink.bytes / 1e6,
+                    seconds, (double)sink.bytes / 1e6 / seconds, threads);
+        }
+    }
+
+    DsEngineShutdown();
+    if (morphPath) DsUnmapFile(&morphFile);
+    return rc;
+}
@@ -0,0 +1,465 @@
+// Load generator for diswitcherd (tools/diswitcherd.c).
+//
+//   diswitcher-loadgen [--socket PATH] [--connections N] [--pipeline P] [--batch B] [--seconds S]
+//                      [--file queries.txt | --long] [--verify [--morph ru.dsmf] [--config diswitcher.conf]]
+//
+// Each connection runs on its own thread and keeps --pipeline CORRECT requests of --batch strings
+// in flight for --seconds. Strings are synthetic EN/RU queries (half typed in the wrong layout,
+// tools/querygen.h) or the lines of --file. Reported: requests/s, strings/s and round-trip latency
+// p50/p99/max as seen by the client, followed by the daemon's own STATS line.
+// --long sends strings of about 3 KB of Latin letters, Russian queries typed in the EN layout:
+// their corrections take twice the bytes, so every reply string comes back cut at
+// DS_BATCH_MAX_STRING_BYTES (DS_BATCH_TRUNCATED), and from --batch 256 on the reply would outgrow
+// DS_BATCH_MAX_FRAME and comes back as ERROR instead.
+// --verify corrects every string locally as well and counts replies that differ; the daemon must
+// then run with the same --morph/--config.
+//
+// Exit status is 0 only if no request failed, every reply string was whole UTF-8 and, with
+// --verify, every reply matched.
+
+#define _POSIX_C_SOURCE 200809L
+#include <locale.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "batchproto.h"
+#include "engine.h"
+#include "querygen.h"
+#include "toolutil.h"
+#include "utf8.h"
+
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define GENERATED_QUERIES 4096
+#define LONG_STRINGS 64
+#define LONG_STRING_BYTES (3 * DS_BATCH_MAX_STRING_BYTES / 4)
+#define MAX_PIPELINE 256
+#define MAX_SAMPLES_PER_CONNECTION (1u << 20)
+
+typedef struct {
+    char** items; // UTF-8, NUL-terminated
+    size_t count;
+} Strings;
+
+typedef struct {
+    uint64_t sent_ns;
+    size_t first; // index of the batch's first string
+} Slot;
+
+typedef struct {
+    pthread_t thread;
+    const char* socket_path;
+    const Strings* strings;
+    unsigned id;
+    unsigned pipeline;
+    unsigned batch;
+    uint64_t deadline_ns;
+    bool verify;
+
+    uint64_t requests;
+    uint64_t strings_done;
+    uint64_t corrected;
+    uint64_t truncated;
+    uint64_t errors;
+    uint64_t mismatches;
+    uint64_t* samples;
+    size_t sample_count;
+    int failed;
+    char error[128]; // the first ERROR reply
+} Client;
+
+static int Connect(const char* path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Reads one frame; `payload` is grown as needed. Returns the payload length, 0 on failure.
+static size_t ReadFrame(int fd, uint8_t** payload, size_t* cap)
+{
+    uint8_t header[4];
+    if (!DsReadAll(fd, header, 4)) return 0;
+    const uint32_t n = DsBatchLoad32(header);
+    if (n < 8 || n > DS_BATCH_MAX_FRAME) return 0;
+    if (n > *cap) {
+        uint8_t* p = (uint8_t*)realloc(*payload, n);
+        if (!p) return 0;
+        *payload = p;
+        *cap = n;
+    }
+    return DsReadAll(fd, *payload, n) ? n : 0;
+}
+
+static bool SendBatch(Client* c, int fd, DsBatchBuffer* b, uint32_t slot, size_t first)
+{
+    b->len = 0;
+    const size_t frame = DsBatchBeginFrame(b, DS_BATCH_KIND_CORRECT, slot);
+    DsBatchPut32(b, c->batch);
+    for (unsigned i = 0; i < c->batch; i++) {
+        const char* s = c->strings->items[(first + i) % c->strings->count];
+        DsBatchPutString(b, s, strlen(s));
+    }
+    DsBatchEndFrame(b, frame);
+    if (b->len - 4 > DS_BATCH_MAX_FRAME) {
+        fprintf(stderr, "a request of %u strings is longer than DS_BATCH_MAX_FRAME\n", c->batch);
+        return false;
+    }
+    return !b->failed && DsWriteAll(fd, b->data, b->len);
+}
+
+static uint64_t Clock(void* ctx)
+{
+    (void)ctx;
+    return DsMonotonicNs();
+}
+
+// True if `s` does not end inside a character.
+static bool WholeUtf8(const char* s, size_t n)
+{
+    size_t lead = n;
+    while (lead && ((uint8_t)s[lead - 1] & 0xC0) == 0x80) lead--;
+    if (!lead) return n == 0;
+    const uint8_t c = (uint8_t)s[lead - 1];
+    const size_t need = c < 0x80 ? 1 : c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 0;
+    return n - (lead - 1) == need;
+}
+
+// Checks a CORRECT reply against a local session.
+static void VerifyReply(Client* c, DsSession* session, DsBatchReader* r, size_t first)
+{
+    const uint32_t count = DsBatchGet32(r);
+    for (uint32_t i = 0; i < count && r->ok; i++) {
+        const uint8_t flags = DsBatchGet8(r);
+        DsBatchGet8(r);
+        DsBatchGet16(r);
+        size_t n;
+        const char* got = DsBatchGetString(r, &n);
+        if (!r->ok) break;
+        if (flags & DS_BATCH_CORRECTED) c->corrected++;
+        if (flags & DS_BATCH_TRUNCATED) c->truncated++;
+        if (n > DS_BATCH_MAX_STRING_BYTES || !WholeUtf8(got, n)) c->errors++;
+        if (!session) continue;
+
+        const char* sent = c->strings->items[(first + i) % c->strings->count];
+        wchar_t text[DS_BATCH_MAX_STRING_BYTES + 1];
+        wchar_t expected[DS_BATCH_MAX_STRING_BYTES + 2];
+        char expectedUtf8[4 * DS_BATCH_MAX_STRING_BYTES + 1];
+        const size_t len = DsUtf8ToWide(sent, strlen(sent), text, ARRAYSIZE(text));
+        DsSessionCorrectText(session, text, len, expected, ARRAYSIZE(expected));
+        const size_t expectedLen =
+            DsBatchFitString(expectedUtf8, DsWideToUtf8(expected, wcslen(expected), expectedUtf8, sizeof(expectedUtf8)));
+        if (expectedLen != n || memcmp(expectedUtf8, got, n) != 0) c->mismatches++;
+    }
+    if (!r->ok || count != c->batch) c->errors++;
+}
+
+static void* ClientMain(void* arg)
+{
+    Client* c = (Client*)arg;
+    const int fd = Connect(c->socket_path);
+    if (fd < 0) {
+        perror(c->socket_path);
+        c->failed = 1;
+        return NULL;
+    }
+    DsSession* session = NULL;
+    if (c->verify) {
+        DsHost host = {0};
+        host.clock_ns = Clock;
+        session = DsSessionCreate(&host);
+        if (!session) {
+            c->failed = 1;
+            close(fd);
+            return NULL;
+        }
+    }
+
+    Slot slots[MAX_PIPELINE];
+    DsBatchBuffer out = {0};
+    uint8_t* payload = NULL;
+    size_t payloadCap = 0;
+    size_t next = (size_t)c->id * 7919; // connections walk the strings from different points
+    unsigned inFlight = 0;
+    for (unsigned s = 0; s < c->pipeline; s++) {
+        slots[s].first = next;
+        slots[s].sent_ns = DsMonotonicNs();
+        if (!SendBatch(c, fd, &out, s, next)) {
+            c->failed = 1;
+            break;
+        }
+        next += c->batch;
+        inFlight++;
+    }
+
+    while (inFlight && !c->failed) {
+        const size_t n = ReadFrame(fd, &payload, &payloadCap);
+        if (!n) {
+            c->failed = 1;
+            break;
+        }
+        const uint64_t now = DsMonotonicNs();
+        DsBatchReader r;
+        DsBatchReaderInit(&r, payload, n);
+        const uint32_t kind = DsBatchGet32(&r);
+        const uint32_t slot = DsBatchGet32(&r);
+        if (slot >= c->pipeline) {
+            c->failed = 1;
+            break;
+        }
+        if (kind == DS_BATCH_KIND_CORRECT) VerifyReply(c, session, &r, slots[slot].first);
+        else {
+            size_t len;
+            const char* message = DsBatchGetString(&r, &len);
+            if (!c->error[0] && r.ok) snprintf(c->error, sizeof(c->error), "%.*s", (int)len, message);
+            c->errors++;
+        }
+        c->requests++;
+        c->strings_done += c->batch;
+        if (c->sample_count < MAX_SAMPLES_PER_CONNECTION) c->samples[c->sample_count++] = now - slots[slot].sent_ns;
+
+        inFlight--;
+        if (now < c->deadline_ns) {
+            slots[slot].first = next;
+            slots[slot].sent_ns = DsMonotonicNs();
+            if (!SendBatch(c, fd, &out, slot, next)) {
+                c->failed = 1;
+                break;
+            }
+            next += c->batch;
+            inFlight++;
+        }
+    }
+    free(payload);
+    DsBatchBufferFree(&out);
+    DsSessionDestroy(session);
+    close(fd);
+    return NULL;
+}
+
+static bool ServerStats(const char* path, char* out, size_t cap)
+{
+    const int fd = Connect(path);
+    if (fd < 0) return false;
+    DsBatchBuffer b = {0};
+    DsBatchEndFrame(&b, DsBatchBeginFrame(&b, DS_BATCH_KIND_STATS, 0));
+    uint8_t* payload = NULL;
+    size_t payloadCap = 0;
+    size_t n = (!b.failed && DsWriteAll(fd, b.data, b.len)) ? ReadFrame(fd, &payload, &payloadCap) : 0;
+    bool ok = false;
+    if (n) {
+        DsBatchReader r;
+        DsBatchReaderInit(&r, payload, n);
+        const uint32_t kind = DsBatchGet32(&r);
+        DsBatchGet32(&r);
+        size_t len;
+        const char* text = DsBatchGetString(&r, &len);
+        if (r.ok && kind == DS_BATCH_KIND_STATS) {
+            snprintf(out, cap, "%.*s", (int)len, text);
+            ok = true;
+        }
+    }
+    free(payload);
+    DsBatchBufferFree(&b);
+    close(fd);
+    return ok;
+}
+
+static bool AddString(Strings* s, const char* text, size_t n, size_t* cap)
+{
+    if (s->count == *cap) {
+        *cap = *cap ? 2 * *cap : 1024;
+        char** items = (char**)realloc(s->items, *cap * sizeof(char*));
+        if (!items) return false;
+        s->items = items;
+    }
+    n = DsBatchFitString(text, n);
+    char* copy = (char*)malloc(n + 1);
+    if (!copy) return false;
+    memcpy(copy, text, n);
+    copy[n] = 0;
+    s->items[s->count++] = copy;
+    return true;
+}
+
+// Russian queries typed in the EN layout, joined up to LONG_STRING_BYTES.
+static bool LongStrings(Strings* s, size_t* cap)
+{
+    uint64_t rng = 0x2545F4914F6CDD1Dull;
+    for (size_t i = 0; i < LONG_STRINGS; i++) {
+        char text[LONG_STRING_BYTES + 1];
+        size_t len = 0;
+        for (;;) {
+            wchar_t query[DS_QUERY_MAX_CHARS];
+            wchar_t typed[DS_QUERY_MAX_CHARS];
+            char utf8[4 * DS_QUERY_MAX_CHARS];
+            if (!DsGenerateQuery(&rng, query, ARRAYSIZE(query)) || query[0] < 0x400) continue;
+            DsMapRuToEn(query, typed, ARRAYSIZE(typed));
+            const size_t n = DsWideToUtf8(typed, wcslen(typed), utf8, sizeof(utf8));
+            if (len + 1 + n > LONG_STRING_BYTES) break;
+            if (len) text[len++] = ' ';
+            memcpy(text + len, utf8, n);
+            len += n;
+        }
+        if (!AddString(s, text, len, cap)) return false;
+    }
+    return true;
+}
+
+static bool LoadStrings(Strings* s, const char* path, bool longStrings)
+{
+    size_t cap = 0;
+    if (longStrings) return LongStrings(s, &cap);
+    if (!path) {
+        uint64_t rng = 0x2545F4914F6CDD1Dull;
+        for (size_t i = 0; i < GENERATED_QUERIES; i++) {
+            wchar_t query[DS_QUERY_MAX_CHARS];
+            char utf8[4 * DS_QUERY_MAX_CHARS];
+            const size_t len = DsGenerateQuery(&rng, query, ARRAYSIZE(query));
+            if (!AddString(s, utf8, DsWideToUtf8(query, len, utf8, sizeof(utf8)), &cap)) return false;
+        }
+        return true;
+    }
+    DsMappedFile f;
+    if (DsMapFile(path, &f) != 0) {
+        perror(path);
+        return false;
+    }
+    size_t start = 0;
+    for (size_t i = 0; i <= f.size; i++) {
+        if (i < f.size && f.data[i] != '\n') continue;
+        size_t end = i;
+        if (end > start && f.data[end - 1] == '\r') end--;
+        if (end > start && !AddString(s, (const char*)f.data + start, end - start, &cap)) return false;
+        start = i + 1;
+    }
+    DsUnmapFile(&f);
+    return s->count > 0;
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: diswitcher-loadgen [--socket PATH] [--connections N] [--pipeline P] [--batch B] [--seconds S] [--file queries.txt | --long] [--verify [--morph ru.dsmf] [--config diswitcher.conf]]\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* socketPath = "/tmp/diswitcherd.sock";
+    const char* file = NULL;
+    const char* morphPath = NULL;
+    const char* configPath = NULL;
+    unsigned connections = 4, pipeline = 4, batch = 32;
+    double seconds = 5.0;
+    bool verify = false, longStrings = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) socketPath = argv[++i];
+        else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc) connections = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) pipeline = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) batch = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) file = argv[++i];
+        else if (strcmp(argv[i], "--long") == 0) longStrings = true;
+        else if (strcmp(argv[i], "--verify") == 0) verify = true;
+        else if (strcmp(argv[i], "--morph") == 0 && i + 1 < argc) morphPath = argv[++i];
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) configPath = argv[++i];
+        else { Usage(); return 2; }
+    }
+    if (connections == 0 || pipeline == 0 || pipeline > MAX_PIPELINE || batch == 0 || batch > DS_BATCH_MAX_STRINGS || seconds <= 0 ||
+        (file && longStrings)) {
+        Usage();
+        return 2;
+    }
+    setlocale(LC_ALL, "C.UTF-8");
+
+    DsMappedFile morphFile = {0};
+    DsMorph morph;
+    if (verify && !DsToolLoadModel(morphPath, configPath, &morphFile, &morph)) return 1;
+    Strings strings = {0};
+    if (!LoadStrings(&strings, file, longStrings)) {
+        fprintf(stderr, "no strings to send\n");
+        return 1;
+    }
+
+    Client* clients = (Client*)calloc(connections, sizeof(Client));
+    if (!clients) return 1;
+    const uint64_t t0 = DsMonotonicNs();
+    for (unsigned i = 0; i < connections; i++) {
+        Client* c = &clients[i];
+        c->socket_path = socketPath;
+        c->strings = &strings;
+        c->id = i;
+        c->pipeline = pipeline;
+        c->batch = batch;
+        c->deadline_ns = t0 + (uint64_t)(seconds * 1e9);
+        c->verify = verify;
+        c->samples = (uint64_t*)malloc(MAX_SAMPLES_PER_CONNECTION * sizeof(uint64_t));
+        if (!c->samples) return 1;
+        pthread_create(&c->thread, NULL, ClientMain, c);
+    }
+
+    uint64_t requests = 0, sent = 0, corrected = 0, truncated = 0, errors = 0, mismatches = 0;
+    const char* firstError = NULL;
+    size_t sampleCount = 0;
+    int failed = 0;
+    for (unsigned i = 0; i < connections; i++) {
+        pthread_join(clients[i].thread, NULL);
+        requests += clients[i].requests;
+        sent += clients[i].strings_done;
+        corrected += clients[i].corrected;
+        truncated += clients[i].truncated;
+        if (!firstError && clients[i].error[0]) firstError = clients[i].error;
+        errors += clients[i].errors;
+        mismatches += clients[i].mismatches;
+        sampleCount += clients[i].sample_count;
+        failed |= clients[i].failed;
+    }
+    const double elapsed = (double)(DsMonotonicNs() - t0) / 1e9;
+
+    uint64_t* samples = (uint64_t*)malloc((sampleCount ? sampleCount : 1) * sizeof(uint64_t));
+    if (!samples) return 1;
+    size_t k = 0;
+    for (unsigned i = 0; i < connections; i++) {
+        memcpy(samples + k, clients[i].samples, clients[i].sample_count * sizeof(uint64_t));
+        k += clients[i].sample_count;
+    }
+    const uint64_t p50 = DsPercentile(samples, sampleCount, 50.0);
+    const uint64_t p99 = DsPercentile(samples, sampleCount, 99.0);
+    const uint64_t maxNs = sampleCount ? samples[sampleCount - 1] : 0; // sorted by DsPercentile
+
+    printf("load: %u connections x %u in flight x %u strings, %.1f s, %zu distinct strings\n", connections, pipeline,
+           batch, elapsed, strings.count);
+    printf("requests: %llu (%.0f/s), strings: %llu (%.0f/s), corrected %llu, truncated %llu, errors %llu\n",
+           (unsigned long long)requests, (double)requests / elapsed, (unsigned long long)sent, (double)sent / elapsed,
+           (unsigned long long)corrected, (unsigned long long)truncated, (unsigned long long)errors);
+    if (firstError) printf("error reply: %s\n", firstError);
+    printf("round trip: p50 %.1f us, p99 %.1f us, max %.1f us\n", (double)p50 / 1e3, (double)p99 / 1e3, (double)maxNs / 1e3);
+    if (verify) printf("verify: %llu replies differ from the local engine\n", (unsigned long long)mismatches);
+    char stats[512];
+    if (ServerStats(socketPath, stats, sizeof(stats))) printf("daemon: %s\n", stats);
+
+    for (unsigned i = 0; i < connections; i++) free(clients[i].samples);
+    for (size_t i = 0; i < strings.count; i++) free(strings.items[i]);
+    free(strings.items);
+    free(samples);
+    free(clients);
+    DsEngineShutdown();
+    if (morphPath) DsUnmapFile(&morphFile);
+
+    const int status = (!failed && !errors && !mismatches) ? 0 : 1;
+    printf("result: %s\n", status ? "FAIL" : "OK");
+    return status;
+}
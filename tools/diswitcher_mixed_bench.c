@@ -0,0 +1,190 @@
+// Mixed-script tokens: how often they come back right and how much gets retyped doing it.
+//
+//   diswitcher-mixed-bench [--words N] [--morph ru.dsmf] [--config diswitcher.conf] corpus.txt
+//
+// A word typed partly on the wrong layout, because the user switched mid-word ("ghbвет") or hit
+// the switch by accident ("приdtn"), reaches the engine as one token in two scripts. Every word
+// of 4+ letters in one script from the corpus (up to --words of them, default 20000) is split at
+// each inner position, and both the wrong-start and the wrong-end tokens are typed key by key
+// into a session followed by a space. The host applies what the engine sends to a model of the
+// text field, which must read the word and the space afterwards.
+//
+// The report gives the share of tokens restored, left as typed or changed into something else;
+// the backspaces sent against the whole-token retyping that restores the same words (a backspace
+// and a character for every letter); and the latency of the deciding key (the space) next to the
+// same word typed entirely on the wrong layout.
+
+#define _POSIX_C_SOURCE 200809L
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "keymap.h"
+#include "toolutil.h"
+
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+typedef struct {
+    uint64_t tokens;
+    uint64_t restored;
+    uint64_t kept;    // left as typed
+    uint64_t garbled; // changed into something else
+    uint64_t backspaces;
+    uint64_t chars;
+    uint64_t whole_backspaces; // what retyping the whole token would have sent for the restored ones
+    uint64_t* latency_ns;
+    size_t latency_count;
+} Stats;
+
+static uint64_t Clock(void* ctx)
+{
+    (void)ctx;
+    return DsMonotonicNs();
+}
+
+static void Record(Stats* st, uint64_t ns)
+{
+    st->latency_ns[st->latency_count++] = ns;
+}
+
+static void Judge(Stats* st, const DsTextField* f, const DsBenchWord* w, const wchar_t* token, uint64_t backspaces, uint64_t chars)
+{
+    st->tokens++;
+    const size_t n = w->len;
+    if (f->len == n + 1 && f->text[n] == L' ' && wmemcmp(f->text, w->text, n) == 0) {
+        st->restored++;
+        st->backspaces += backspaces;
+        st->chars += chars;
+        st->whole_backspaces += n;
+    } else if (f->len == n + 1 && wmemcmp(f->text, token, n) == 0) {
+        st->kept++;
+    } else {
+        st->garbled++;
+    }
+}
+
+static double Percent(uint64_t a, uint64_t b)
+{
+    return b ? 100.0 * (double)a / (double)b : 0.0;
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: diswitcher-mixed-bench [--words N] [--morph ru.dsmf] [--config diswitcher.conf] corpus.txt\n");
+}
+
+int main(int argc, char** argv)
+{
+    setlocale(LC_ALL, "C.UTF-8");
+
+    size_t maxWords = 20000;
+    const char* morphPath = NULL;
+    const char* configPath = NULL;
+    const char* path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--words") == 0 && i + 1 < argc) maxWords = (size_t)atol(argv[++i]);
+        else if (strcmp(argv[i], "--morph") == 0 && i + 1 < argc) morphPath = argv[++i];
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) configPath = argv[++i];
+        else if (argv[i][0] == '-' || path) { Usage(); return 2; }
+        else path = argv[i];
+    }
+    if (!path || maxWords == 0) {
+        Usage();
+        return 2;
+    }
+
+    DsMappedFile morphFile = {0};
+    DsMorph morph;
+    if (!DsToolLoadModel(morphPath, configPath, &morphFile, &morph)) return 1;
+
+    DsMappedFile corpus;
+    if (DsMapFile(path, &corpus) != 0) {
+        perror(path);
+        return 1;
+    }
+    DsBenchWord* words = (DsBenchWord*)malloc(maxWords * sizeof(DsBenchWord));
+    if (!words) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    const size_t wordCount = DsLoadBenchWords(&corpus, maxWords, 4, true, words);
+    DsUnmapFile(&corpus);
+    size_t splits = 0;
+    for (size_t i = 0; i < wordCount; i++) splits += words[i].len - 1;
+
+    Stats mixed[2] = {0}; // wrong start, wrong end
+    Stats whole = {0};
+    for (int m = 0; m < 2; m++) mixed[m].latency_ns = (uint64_t*)malloc((splits + 1) * sizeof(uint64_t));
+    whole.latency_ns = (uint64_t*)malloc((wordCount + 1) * sizeof(uint64_t));
+    if (!mixed[0].latency_ns || !mixed[1].latency_ns || !whole.latency_ns) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    DsTextField field;
+    memset(&field, 0, sizeof(field));
+    DsHost host = {0};
+    host.ctx = &field;
+    host.clock_ns = Clock;
+    host.send_text = DsTextFieldSend;
+    DsSession* s = DsSessionCreate(&host);
+    if (!s) {
+        fprintf(stderr, "cannot create a session\n");
+        return 1;
+    }
+    // One token at a time: no neighbours to build a phrase or settle a short word from.
+    DsSessionSetPhraseCorrection(s, false);
+    DsSessionSetShortWords(s, false);
+
+    for (size_t i = 0; i < wordCount; i++) {
+        const DsBenchWord* w = &words[i];
+        const size_t n = w->len;
+        const wchar_t* other = w->other;
+
+        for (size_t k = 1; k < n; k++) {
+            for (int m = 0; m < 2; m++) {
+                // m == 0: the first k letters on the wrong layout; m == 1: the letters from k on.
+                wchar_t token[DS_TOKEN_MAX_CHARS + 1];
+                for (size_t j = 0; j < n; j++) token[j] = (j < k) == (m == 0) ? other[j] : w->text[j];
+                token[n] = 0;
+                const uint64_t bs = field.backspaces, ch = field.chars;
+                Record(&mixed[m], DsTextFieldTypeToken(s, &field, token, n));
+                Judge(&mixed[m], &field, w, token, field.backspaces - bs, field.chars - ch);
+            }
+        }
+        const uint64_t bs = field.backspaces, ch = field.chars;
+        Record(&whole, DsTextFieldTypeToken(s, &field, other, n));
+        Judge(&whole, &field, w, other, field.backspaces - bs, field.chars - ch);
+    }
+
+    printf("corpus: %zu words of 4+ letters, %zu split points\n\n", wordCount, splits);
+    printf("tokens            count   restored       kept    garbled  backspaces/fix  whole-token  saved\n");
+    const char* labels[3] = { "wrong start", "wrong end", "whole word" };
+    Stats* all[3] = { &mixed[0], &mixed[1], &whole };
+    for (int r = 0; r < 3; r++) {
+        const Stats* st = all[r];
+        const double perFix = st->restored ? (double)st->backspaces / (double)st->restored : 0.0;
+        const double wholePerFix = st->restored ? (double)st->whole_backspaces / (double)st->restored : 0.0;
+        printf("%-12s %10llu %9.2f%% %9.2f%% %9.2f%% %15.2f %12.2f %5.1f%%\n", labels[r], (unsigned long long)st->tokens,
+               Percent(st->restored, st->tokens), Percent(st->kept, st->tokens), Percent(st->garbled, st->tokens),
+               perFix, wholePerFix, 100.0 - Percent(st->backspaces, st->whole_backspaces));
+    }
+    printf("\ndecision latency (the space after the token):\n");
+    for (int r = 0; r < 3; r++) {
+        char name[32], latency[96];
+        snprintf(name, sizeof(name), "%s%s", r < 2 ? "mixed, " : "", labels[r]);
+        DsFormatLatency(all[r]->latency_ns, all[r]->latency_count, latency, sizeof(latency));
+        printf("%-22s %s  (%zu keys)\n", name, latency, all[r]->latency_count);
+    }
+    if (field.overflow) printf("field overflowed %llu times\n", (unsigned long long)field.overflow);
+
+    DsSessionDestroy(s);
+    for (int m = 0; m < 2; m++) free(mixed[m].latency_ns);
+    free(whole.latency_ns);
+    free(words);
+    DsEngineShutdown();
+    if (morphPath) DsUnmapFile(&morphFile);
+    return 0;
+}
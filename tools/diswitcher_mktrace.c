@@ -0,0 +1,66 @@
+// Builds a keystroke capture (src/keytrace.h) from a small text script, so scenarios such as
+// focus changes or phrase typing can be replayed on Linux without a Windows capture.
+//
+//   diswitcher-mktrace script.txt out.dskt
+//
+// The script language is that of tools/script.h, shared with diswitcher-fieldsim. Only key
+// presses, layout switches and focus changes are recorded; `inject` and `expect` are settings and
+// checks of the simulated field and leave nothing in a trace.
+
+#define _POSIX_C_SOURCE 200809L
+#include <locale.h>
+#include <stdio.h>
+
+#include "keymap.h"
+#include "keytrace.h"
+#include "script.h"
+#include "toolutil.h"
+
+// Key and focus steps become trace events, in milliseconds.
+static void WriteStep(DsTraceWriter* w, const DsScriptStep* st)
+{
+    const uint64_t ms = st->at_ns / 1000000u;
+    switch (st->type) {
+    case DS_STEP_KEY:
+        DsTraceWriteKey(w, ms, st->down, st->vk, DsKeymapScanCode(st->vk), 0);
+        break;
+    case DS_STEP_LAYOUT:
+        DsTraceWriteLayout(w, ms, DsLayoutToId((DsLayout)st->value), false);
+        break;
+    case DS_STEP_FOCUS:
+        DsTraceWriteFocus(w, ms, st->value);
+        break;
+    case DS_STEP_INJECT:
+    case DS_STEP_EXPECT:
+        break;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    setlocale(LC_ALL, "C.UTF-8");
+    if (argc != 3) {
+        fprintf(stderr, "usage: diswitcher-mktrace script.txt out.dskt\n");
+        return 2;
+    }
+
+    DsScript defaults, script;
+    DsScriptDefaults(&defaults);
+    if (!DsScriptLoad(argv[1], &defaults, &script)) return 1;
+    FILE* out = fopen(argv[2], "wb");
+    if (!out) {
+        perror(argv[2]);
+        DsScriptFree(&script);
+        return 1;
+    }
+    static uint8_t buf[64 * 1024];
+    DsTraceWriter writer;
+    DsTraceWriterInit(&writer, buf, sizeof(buf), DsFlushToFile, out);
+    DsTraceWriteHeader(&writer, 0);
+    for (size_t i = 0; i < script.count; i++) WriteStep(&writer, &script.steps[i]);
+
+    bool ok = DsTraceWriterFlush(&writer);
+    if (fclose(out) != 0) ok = false;
+    DsScriptFree(&script);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,466 @@
+// Compiles and benchmarks the Russian word-form model read by src/morph.c.
+//
+//   diswitcher-morph build <dict.txt> <out.dsmf>
+//   diswitcher-morph lookup <model.dsmf> <word>...
+//   diswitcher-morph bench <model.dsmf> <words.txt> [rounds]
+//
+// Input is UTF-8 text, one form per line; only the first tab/space separated field is used, so
+// OpenCorpora's dict.opcorpora.txt (lexeme id line, then "FORM<TAB>grammemes" lines), pymorphy
+// word dumps and frequency lists ("word count") all work unchanged. Forms with characters outside
+// the model alphabet (see morph.h) are skipped.
+//
+// The builder is the incremental algorithm for sorted input (Daciuk et al., 2000): the automaton
+// is kept minimal as words are added, so memory stays proportional to the result, not the input.
+// Because equivalent suffix states are merged, every lexeme ends up as its stem followed by a
+// shared subgraph for its ending paradigm.
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "morph.h"
+#include "toolutil.h"
+#include "utf8.h"
+
+#define MAX_FORM_SYMBOLS 48
+
+// ---------- Input ----------
+
+typedef struct {
+    uint8_t* arena; // per form: length byte, then symbols
+    size_t arena_len;
+    size_t arena_cap;
+    uint32_t* forms; // offsets into arena
+    size_t count;
+    size_t cap;
+    size_t skipped;
+} FormList;
+
+static void* XRealloc(void* p, size_t size)
+{
+    void* q = realloc(p, size);
+    if (!q) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return q;
+}
+
+static void FormListAdd(FormList* l, const uint8_t* sym, size_t n)
+{
+    if (l->arena_len + n + 1 > l->arena_cap) {
+        l->arena_cap = l->arena_cap ? l->arena_cap * 2 : (1u << 20);
+        l->arena = (uint8_t*)XRealloc(l->arena, l->arena_cap);
+    }
+    if (l->count == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : (1u << 16);
+        l->forms = (uint32_t*)XRealloc(l->forms, l->cap * sizeof(uint32_t));
+    }
+    l->forms[l->count++] = (uint32_t)l->arena_len;
+    l->arena[l->arena_len++] = (uint8_t)n;
+    memcpy(l->arena + l->arena_len, sym, n);
+    l->arena_len += n;
+}
+
+// Calls `fn` for the first field of every non-empty line that is not a bare lexeme id.
+typedef void (*FieldFn)(void* ctx, const char* field, size_t len);
+
+static void ForEachField(const DsMappedFile* f, FieldFn fn, void* ctx)
+{
+    const char* p = (const char*)f->data;
+    const char* end = p + f->size;
+    while (p < end) {
+        const char* eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) eol = end;
+        const char* q = p;
+        while (q < eol && *q != '\t' && *q != ' ' && *q != '\r') q++;
+        size_t len = (size_t)(q - p);
+        if (len >= 3 && (uint8_t)p[0] == 0xEF && (uint8_t)p[1] == 0xBB && (uint8_t)p[2] == 0xBF) {
+            p += 3; // BOM
+            len -= 3;
+        }
+        bool digitsOnly = len > 0;
+        for (size_t i = 0; i < len && digitsOnly; i++) digitsOnly = p[i] >= '0' && p[i] <= '9';
+        if (len && !digitsOnly) fn(ctx, p, len);
+        p = eol + 1;
+    }
+}
+
+// UTF-8 field -> model symbols; false if the form does not fit the alphabet.
+static bool FieldToSymbols(const char* field, size_t len, uint8_t* sym, size_t* n)
+{
+    size_t count = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        uint32_t cp;
+        pos += DsUtf8Decode((const uint8_t*)field + pos, len - pos, &cp);
+        const int s = cp <= 0xFFFF ? DsMorphSymbol((wchar_t)cp) : 0;
+        if (!s || count == MAX_FORM_SYMBOLS) return false;
+        sym[count++] = (uint8_t)s;
+    }
+    *n = count;
+    return count > 0;
+}
+
+static void CollectForm(void* ctx, const char* field, size_t len)
+{
+    FormList* l = (FormList*)ctx;
+    uint8_t sym[MAX_FORM_SYMBOLS];
+    size_t n;
+    if (FieldToSymbols(field, len, sym, &n)) FormListAdd(l, sym, n);
+    else l->skipped++;
+}
+
+static const uint8_t* g_sort_arena;
+
+static int CompareForms(const void* a, const void* b)
+{
+    const uint8_t* x = g_sort_arena + *(const uint32_t*)a;
+    const uint8_t* y = g_sort_arena + *(const uint32_t*)b;
+    const size_t n = x[0] < y[0] ? x[0] : y[0];
+    const int c = memcmp(x + 1, y + 1, n);
+    if (c) return c;
+    return (int)x[0] - (int)y[0];
+}
+
+// ---------- Minimal automaton builder ----------
+
+// A transition is packed as (target state id << 6) | label.
+typedef struct {
+    uint32_t first; // index into the transition pool
+    uint8_t count;
+    bool final;
+} FrozenState;
+
+typedef struct {
+    uint32_t trans[DS_MORPH_SYMBOLS];
+    uint8_t count;
+    bool final;
+} OpenState;
+
+typedef struct {
+    FrozenState* states;
+    size_t state_count;
+    size_t state_cap;
+    uint32_t* pool;
+    size_t pool_len;
+    size_t pool_cap;
+    uint32_t* table; // register: open addressing over state id + 1 (0 = empty)
+    size_t table_cap;
+} Builder;
+
+static uint64_t HashState(const uint32_t* trans, size_t count, bool final)
+{
+    uint64_t h = final ? 0x9E3779B97F4A7C15ULL : 0x7F4A7C159E3779B9ULL;
+    for (size_t i = 0; i < count; i++) h = (h ^ trans[i]) * 0x100000001B3ULL;
+    return h ^ (h >> 29);
+}
+
+static bool SameState(const Builder* b, uint32_t id, const uint32_t* trans, size_t count, bool final)
+{
+    const FrozenState* s = &b->states[id];
+    return s->final == final && s->count == count && memcmp(b->pool + s->first, trans, count * sizeof(uint32_t)) == 0;
+}
+
+static void RegisterGrow(Builder* b)
+{
+    const size_t cap = b->table_cap ? b->table_cap * 2 : (1u << 16);
+    uint32_t* table = (uint32_t*)calloc(cap, sizeof(uint32_t));
+    if (!table) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (size_t id = 0; id < b->state_count; id++) {
+        const FrozenState* s = &b->states[id];
+        size_t slot = (size_t)HashState(b->pool + s->first, s->count, s->final) & (cap - 1);
+        while (table[slot]) slot = (slot + 1) & (cap - 1);
+        table[slot] = (uint32_t)id + 1;
+    }
+    free(b->table);
+    b->table = table;
+    b->table_cap = cap;
+}
+
+// Replaces an open state by its registered equivalent, registering it if it is new.
+static uint32_t Freeze(Builder* b, const OpenState* o)
+{
+    if ((b->state_count + 1) * 2 > b->table_cap) RegisterGrow(b);
+
+    size_t slot = (size_t)HashState(o->trans, o->count, o->final) & (b->table_cap - 1);
+    while (b->table[slot]) {
+        const uint32_t id = b->table[slot] - 1;
+        if (SameState(b, id, o->trans, o->count, o->final)) return id;
+        slot = (slot + 1) & (b->table_cap - 1);
+    }
+
+    if (b->pool_len + o->count > b->pool_cap) {
+        b->pool_cap = b->pool_cap ? b->pool_cap * 2 : (1u << 20);
+        b->pool = (uint32_t*)XRealloc(b->pool, b->pool_cap * sizeof(uint32_t));
+    }
+    if (b->state_count == b->state_cap) {
+        b->state_cap = b->state_cap ? b->state_cap * 2 : (1u << 16);
+        b->states = (FrozenState*)XRealloc(b->states, b->state_cap * sizeof(FrozenState));
+    }
+    const uint32_t id = (uint32_t)b->state_count++;
+    b->states[id].first = (uint32_t)b->pool_len;
+    b->states[id].count = o->count;
+    b->states[id].final = o->final;
+    memcpy(b->pool + b->pool_len, o->trans, o->count * sizeof(uint32_t));
+    b->pool_len += o->count;
+    b->table[slot] = id + 1;
+    return id;
+}
+
+// Freezes path[depth..from+1] bottom-up, linking each into its parent's last transition.
+static void FreezePath(Builder* b, OpenState* path, size_t depth, size_t from)
+{
+    for (size_t i = depth; i > from; i--) {
+        const uint32_t id = Freeze(b, &path[i]);
+        OpenState* parent = &path[i - 1];
+        parent->trans[parent->count - 1] = (id << 6) | (parent->trans[parent->count - 1] & 0x3F);
+    }
+}
+
+static uint32_t BuildAutomaton(Builder* b, const FormList* l)
+{
+    static OpenState path[MAX_FORM_SYMBOLS + 1];
+    memset(&path[0], 0, sizeof(path[0]));
+    const uint8_t* prev = NULL;
+
+    for (size_t i = 0; i < l->count; i++) {
+        const uint8_t* w = l->arena + l->forms[i];
+        const size_t n = w[0];
+        size_t common = 0;
+        const size_t prevLen = prev ? prev[0] : 0;
+        while (common < n && common < prevLen && prev[1 + common] == w[1 + common]) common++;
+
+        FreezePath(b, path, prevLen, common);
+        for (size_t d = common; d < n; d++) {
+            path[d].trans[path[d].count++] = w[1 + d];
+            memset(&path[d + 1], 0, sizeof(path[d + 1]));
+        }
+        path[n].final = true;
+        prev = w;
+    }
+    FreezePath(b, path, prev ? prev[0] : 0, 0);
+    return Freeze(b, &path[0]);
+}
+
+static bool WriteU32(FILE* out, uint32_t v)
+{
+    const uint8_t b[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24)};
+    return fwrite(b, 1, 4, out) == 4;
+}
+
+// Lays states out as runs of edges (postorder, so targets precede their parents) and writes the model.
+static bool WriteModel(const Builder* b, uint32_t root, uint32_t formCount, const char* path, size_t* bytesOut)
+{
+    uint32_t* offset = (uint32_t*)XRealloc(NULL, b->state_count * sizeof(uint32_t));
+    uint32_t edgeCount = 1; // edge 0 is a sentinel so that target 0 can mean "no outgoing edges"
+    for (size_t id = 0; id < b->state_count; id++) {
+        offset[id] = b->states[id].count ? edgeCount : 0;
+        edgeCount += b->states[id].count;
+        if (edgeCount > DS_MORPH_MAX_EDGES) {
+            fprintf(stderr, "model too large: more than %u edges\n", DS_MORPH_MAX_EDGES);
+            free(offset);
+            return false;
+        }
+    }
+
+    FILE* out = fopen(path, "wb");
+    if (!out) {
+        perror(path);
+        free(offset);
+        return false;
+    }
+    bool ok = fwrite(DS_MORPH_MAGIC, 1, 4, out) == 4;
+    ok = ok && WriteU32(out, DS_MORPH_VERSION) && WriteU32(out, edgeCount) && WriteU32(out, offset[root]);
+    ok = ok && WriteU32(out, formCount) && WriteU32(out, (uint32_t)b->state_count);
+    ok = ok && WriteU32(out, 0) && WriteU32(out, 0);
+    ok = ok && WriteU32(out, DS_MORPH_EDGE_LAST);
+
+    for (size_t id = 0; id < b->state_count && ok; id++) {
+        const FrozenState* s = &b->states[id];
+        for (uint32_t t = 0; t < s->count && ok; t++) {
+            const uint32_t packed = b->pool[s->first + t];
+            const uint32_t target = packed >> 6;
+            uint32_t e = (packed & 0x3F) | (offset[target] << 8);
+            if (b->states[target].final) e |= DS_MORPH_EDGE_FINAL;
+            if (t + 1 == s->count) e |= DS_MORPH_EDGE_LAST;
+            ok = WriteU32(out, e);
+        }
+    }
+    free(offset);
+    if (fclose(out) != 0) ok = false;
+    *bytesOut = DS_MORPH_HEADER_SIZE + (size_t)edgeCount * 4;
+    return ok;
+}
+
+static int CmdBuild(const char* dictPath, const char* outPath)
+{
+    const uint64_t t0 = DsMonotonicNs();
+    DsMappedFile f;
+    if (DsMapFile(dictPath, &f) != 0) {
+        perror(dictPath);
+        return 1;
+    }
+    FormList l = {0};
+    ForEachField(&f, CollectForm, &l);
+    DsUnmapFile(&f);
+
+    g_sort_arena = l.arena;
+    qsort(l.forms, l.count, sizeof(uint32_t), CompareForms);
+    size_t unique = 0;
+    for (size_t i = 0; i < l.count; i++) {
+        if (unique && CompareForms(&l.forms[unique - 1], &l.forms[i]) == 0) continue;
+        l.forms[unique++] = l.forms[i];
+    }
+    l.count = unique;
+    if (!l.count) {
+        fprintf(stderr, "%s: no usable word forms\n", dictPath);
+        return 1;
+    }
+
+    Builder b = {0};
+    const uint32_t root = BuildAutomaton(&b, &l);
+    size_t bytes = 0;
+    const bool ok = WriteModel(&b, root, (uint32_t)l.count, outPath, &bytes);
+    const double ms = (double)(DsMonotonicNs() - t0) / 1e6;
+
+    if (ok) {
+        printf("forms:   %zu (%zu lines skipped)\n", l.count, l.skipped);
+        printf("states:  %zu, edges: %zu\n", b.state_count, b.pool_len);
+        printf("model:   %zu bytes (%.2f bytes/form, text %zu bytes)\n", bytes, (double)bytes / (double)l.count, l.arena_len - l.count);
+        printf("built in %.0f ms\n", ms);
+    }
+    free(l.arena);
+    free(l.forms);
+    free(b.states);
+    free(b.pool);
+    free(b.table);
+    return ok ? 0 : 1;
+}
+
+// ---------- Lookup / benchmark ----------
+
+static bool OpenModel(const char* path, DsMappedFile* f, DsMorph* m)
+{
+    if (DsMapFile(path, f) != 0) {
+        perror(path);
+        return false;
+    }
+    if (!DsMorphOpen(m, f->data, f->size)) {
+        fprintf(stderr, "%s: not a valid model\n", path);
+        DsUnmapFile(f);
+        return false;
+    }
+    return true;
+}
+
+static int CmdLookup(const char* modelPath, char** words, int count)
+{
+    DsMappedFile f;
+    DsMorph m;
+    if (!OpenModel(modelPath, &f, &m)) return 1;
+    for (int i = 0; i < count; i++) {
+        wchar_t w[MAX_FORM_SYMBOLS * 2];
+        const size_t n = DsUtf8ToWide(words[i], strlen(words[i]), w, sizeof(w) / sizeof(w[0]));
+        printf("%s\t%s\n", words[i], DsMorphContains(&m, w, n) ? "yes" : "no");
+    }
+    DsUnmapFile(&f);
+    return 0;
+}
+
+typedef struct {
+    wchar_t* text; // all words, NUL separated
+    size_t len;
+    size_t cap;
+    size_t count;
+} WordList;
+
+static void CollectWord(void* ctx, const char* field, size_t len)
+{
+    WordList* l = (WordList*)ctx;
+    if (l->len + len + 1 > l->cap) {
+        l->cap = (l->cap + len + 1) * 2;
+        l->text = (wchar_t*)XRealloc(l->text, l->cap * sizeof(wchar_t));
+    }
+    const size_t n = DsUtf8ToWide(field, len, l->text + l->len, len + 1);
+    l->len += n + 1;
+    l->count++;
+}
+
+// Looks up every word `rounds` times; returns hits per round and the average ns per lookup.
+static size_t BenchPass(const DsMorph* m, const WordList* l, int rounds, bool reversed, double* nsPerLookup)
+{
+    wchar_t tmp[MAX_FORM_SYMBOLS * 4];
+    size_t hits = 0;
+    const uint64_t t0 = DsMonotonicNs();
+    for (int r = 0; r < rounds; r++) {
+        hits = 0;
+        for (const wchar_t* w = l->text; w < l->text + l->len;) {
+            const size_t n = wcslen(w);
+            const wchar_t* q = w;
+            if (reversed && n < sizeof(tmp) / sizeof(tmp[0])) {
+                for (size_t i = 0; i < n; i++) tmp[i] = w[n - 1 - i];
+                q = tmp;
+            }
+            hits += DsMorphContains(m, q, n);
+            w += n + 1;
+        }
+    }
+    *nsPerLookup = (double)(DsMonotonicNs() - t0) / ((double)l->count * rounds);
+    return hits;
+}
+
+static int CmdBench(const char* modelPath, const char* wordsPath, int rounds)
+{
+    const uint64_t tOpen = DsMonotonicNs();
+    DsMappedFile f;
+    DsMorph m;
+    if (!OpenModel(modelPath, &f, &m)) return 1;
+    const double openUs = (double)(DsMonotonicNs() - tOpen) / 1e3;
+
+    DsMappedFile wf;
+    if (DsMapFile(wordsPath, &wf) != 0) {
+        perror(wordsPath);
+        DsUnmapFile(&f);
+        return 1;
+    }
+    WordList l = {0};
+    ForEachField(&wf, CollectWord, &l);
+    DsUnmapFile(&wf);
+    if (!l.count) {
+        fprintf(stderr, "%s: no words\n", wordsPath);
+        DsUnmapFile(&f);
+        return 1;
+    }
+
+    printf("model:    %zu bytes, %u forms, %u states, opened in %.1f us\n", f.size, m.form_count, m.state_count, openUs);
+    double ns = 0;
+    size_t hits = BenchPass(&m, &l, rounds, false, &ns);
+    printf("words:    %zu, %zu known (%.1f%%), %.0f ns/lookup\n", l.count, hits, 100.0 * (double)hits / (double)l.count, ns);
+    // Reversed words approximate the negative lookups the engine does for mapped English text.
+    hits = BenchPass(&m, &l, rounds, true, &ns);
+    printf("reversed: %zu known (%.1f%%), %.0f ns/lookup\n", hits, 100.0 * (double)hits / (double)l.count, ns);
+
+    free(l.text);
+    DsUnmapFile(&f);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 4 && strcmp(argv[1], "build") == 0) return CmdBuild(argv[2], argv[3]);
+    if (argc >= 4 && strcmp(argv[1], "lookup") == 0) return CmdLookup(argv[2], argv + 3, argc - 3);
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "bench") == 0) {
+        const int rounds = argc == 5 ? atoi(argv[4]) : 5;
+        return CmdBench(argv[2], argv[3], rounds > 0 ? rounds : 1);
+    }
+    fprintf(stderr,
+            "usage: diswitcher-morph build <dict.txt> <out.dsmf>\n"
+            "       diswitcher-morph lookup <model.dsmf> <word>...\n"
+            "       diswitcher-morph bench <model.dsmf> <words.txt> [rounds]\n");
+    return 2;
+}
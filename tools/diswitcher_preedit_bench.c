@@ -0,0 +1,300 @@
+// Commit latency per word: correcting in preedit (tools/preedit.h) against injecting backspaces.
+//
+//   diswitcher-preedit-bench [--words N] [--event-us X] [--morph ru.dsmf] [--config diswitcher.conf]
+//                            corpus.txt
+//
+// First a few scripted cases check the preedit host on its own: a wrong-layout word is committed
+// corrected, Backspace edits the preedit, Pause retypes it in the other layout, Enter commits, and a
+// word longer than DS_TOKEN_MAX_CHARS is committed as typed.
+//
+// Then every word of the corpus (up to --words, default 20000) is typed key by key with a space
+// after it, once in its own layout and once with the other layout active, down two paths:
+//   preedit    DsPreedit; the word is final when the commit callback has it.
+//   injection  DsSession as the Windows hook drives it; a correction is final once its backspaces and
+//              characters have been delivered, each as a press and a release costing --event-us
+//              (default 20, what SendInput and the hook chain take per event in diswitcher-fieldsim).
+// Latency runs from the space being pressed. Both paths must leave the same text; the report gives
+// corrections, synthetic events and p50/p99/max commit latency of each path, over all words and
+// over corrected ones. Exit status is 1 if a scripted case fails or the paths disagree on a word.
+
+#define _POSIX_C_SOURCE 200809L
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "keymap.h"
+#include "preedit.h"
+#include "toolutil.h"
+
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define OUT_MAX_CHARS 256
+
+typedef struct {
+    wchar_t text[OUT_MAX_CHARS];
+    size_t len;
+    uint64_t committed_ns; // of the last commit
+} Document;
+
+typedef struct {
+    Document doc;
+    wchar_t preedit[DS_PREEDIT_MAX_CHARS + 1];
+} Client;
+
+typedef struct {
+    DsTextField text; // first: the session's send_text gets the Field
+    DsLayout layout;  // switched by the engine, as the hook's host does
+} Field;
+
+typedef struct {
+    uint64_t* all_ns;
+    uint64_t* fixed_ns;
+    size_t all;
+    size_t fixed;
+    uint64_t events;
+} Latency;
+
+// A scripted case: keys typed in `layout` (the characters they give there), then what the document
+// must hold. L'\b' is Backspace, L'\x13' Pause, L'\r' Enter.
+typedef struct {
+    const char* name;
+    DsLayout layout;
+    const wchar_t* keys;
+    const wchar_t* expect;
+} Case;
+
+static const Case kCases[] = {
+    { "wrong layout", DS_LAYOUT_EN, L"ghbdtn ", L"привет " },
+    { "as written", DS_LAYOUT_EN, L"hello world ", L"hello world " },
+    { "backspace", DS_LAYOUT_EN, L"ghbd\b\bbdtn ", L"привет " },
+    { "pause", DS_LAYOUT_EN, L"yt\x13 ", L"не " },
+    { "enter", DS_LAYOUT_RU, L"руддщ\r", L"hello" },
+    { "punctuation", DS_LAYOUT_RU, L"руддщ.", L"hello." },
+    // 65 letters, one past DS_TOKEN_MAX_CHARS: the first 64 are committed as typed.
+    { "long word", DS_LAYOUT_EN,
+      L"ghbdtnghbdtnghbdtnghbdtnghbdtnghbdtnghbdtnghbdtnghbdtnghbdtnghbdt ",
+      L"ghbdtnghbdtnghbdtnghbdtnghbdtnghbdtnghbdtnghbdtnghbdtnghbdtnghbdt " },
+};
+
+static void ClientUpdate(void* ctx, const wchar_t* text, size_t n)
+{
+    Client* c = (Client*)ctx;
+    wmemcpy(c->preedit, text, n);
+    c->preedit[n] = 0;
+}
+
+static void ClientCommit(void* ctx, const wchar_t* text, size_t n)
+{
+    Document* d = &((Client*)ctx)->doc;
+    for (size_t i = 0; i < n && d->len < ARRAYSIZE(d->text) - 1; i++) d->text[d->len++] = text[i];
+    d->text[d->len] = 0;
+    d->committed_ns = DsMonotonicNs();
+}
+
+static uint64_t Clock(void* ctx)
+{
+    (void)ctx;
+    return DsMonotonicNs();
+}
+
+static void FieldSwitchLayout(void* ctx, bool toEnglish)
+{
+    ((Field*)ctx)->layout = toEnglish ? DS_LAYOUT_EN : DS_LAYOUT_RU;
+}
+
+static uint32_t KeyFor(wchar_t ch, DsLayout layout, unsigned* mods)
+{
+    uint32_t vk;
+    bool shift;
+    *mods = 0;
+    if (ch == L'\b') return DS_VK_BACK;
+    if (ch == L'\x13') return DS_VK_PAUSE;
+    if (!DsKeymapFindKey(layout, ch, &vk, &shift)) return 0;
+    if (shift) *mods = DS_PREEDIT_SHIFT;
+    return vk;
+}
+
+static bool RunCase(DsPreedit* p, const Case* c)
+{
+    Client client;
+    memset(&client, 0, sizeof(client));
+    const DsPreeditClient pc = { &client, ClientUpdate, ClientCommit };
+    DsPreeditFocusIn(p, &pc, 0);
+    DsPreeditSetLayout(p, c->layout);
+    for (const wchar_t* k = c->keys; *k; k++) {
+        unsigned mods;
+        const uint32_t vk = KeyFor(*k, c->layout, &mods);
+        // Enter goes to the application after the commit; the document does not take a newline.
+        DsPreeditKeyDown(p, vk, mods);
+        DsPreeditKeyUp(p, vk);
+    }
+    DsPreeditFocusOut(p);
+    const bool ok = wcscmp(client.doc.text, c->expect) == 0;
+    printf("  %-12s %s", c->name, ok ? "ok\n" : "FAIL: ");
+    if (!ok) printf("expected \"%ls\", got \"%ls\"\n", c->expect, client.doc.text);
+    return ok;
+}
+
+static void Record(Latency* l, uint64_t ns, bool fixed)
+{
+    l->all_ns[l->all++] = ns;
+    if (fixed) l->fixed_ns[l->fixed++] = ns;
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: diswitcher-preedit-bench [--words N] [--event-us X] [--morph ru.dsmf] [--config diswitcher.conf] corpus.txt\n");
+}
+
+int main(int argc, char** argv)
+{
+    setlocale(LC_ALL, "C.UTF-8");
+
+    size_t maxWords = 20000;
+    double eventUs = 20.0;
+    const char* morphPath = NULL;
+    const char* configPath = NULL;
+    const char* path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--words") == 0 && i + 1 < argc) maxWords = (size_t)atol(argv[++i]);
+        else if (strcmp(argv[i], "--event-us") == 0 && i + 1 < argc) eventUs = atof(argv[++i]);
+        else if (strcmp(argv[i], "--morph") == 0 && i + 1 < argc) morphPath = argv[++i];
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) configPath = argv[++i];
+        else if (argv[i][0] == '-' || path) { Usage(); return 2; }
+        else path = argv[i];
+    }
+    if (!path || maxWords == 0 || eventUs < 0) {
+        Usage();
+        return 2;
+    }
+
+    DsMappedFile morphFile = {0};
+    DsMorph morph;
+    if (!DsToolLoadModel(morphPath, configPath, &morphFile, &morph)) return 1;
+
+    DsPreedit preedit;
+    if (!DsPreeditInit(&preedit, DS_LAYOUT_EN)) {
+        fprintf(stderr, "cannot create a session\n");
+        return 1;
+    }
+    int failed = 0;
+    printf("preedit cases:\n");
+    for (size_t i = 0; i < ARRAYSIZE(kCases); i++) failed |= !RunCase(&preedit, &kCases[i]);
+    DsPreeditDestroy(&preedit);
+
+    DsMappedFile corpus;
+    if (DsMapFile(path, &corpus) != 0) {
+        perror(path);
+        return 1;
+    }
+    DsBenchWord* words = (DsBenchWord*)malloc(maxWords * sizeof(DsBenchWord));
+    if (!words) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    const size_t count = DsLoadBenchWords(&corpus, maxWords, 1, false, words);
+    DsUnmapFile(&corpus);
+
+    Latency lat[2]; // preedit, injection
+    for (int k = 0; k < 2; k++) {
+        memset(&lat[k], 0, sizeof(lat[k]));
+        lat[k].all_ns = (uint64_t*)malloc((2 * count + 1) * sizeof(uint64_t));
+        lat[k].fixed_ns = (uint64_t*)malloc((2 * count + 1) * sizeof(uint64_t));
+        if (!lat[k].all_ns || !lat[k].fixed_ns) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+    }
+
+    // Both paths see the same key sequence, so short words get the same neighbours.
+    Client client;
+    memset(&client, 0, sizeof(client));
+    const DsPreeditClient pc = { &client, ClientUpdate, ClientCommit };
+    Field field;
+    memset(&field, 0, sizeof(field));
+    DsHost host = {0};
+    host.ctx = &field;
+    host.clock_ns = Clock;
+    host.send_text = DsTextFieldSend;
+    host.switch_layout = FieldSwitchLayout;
+    DsSession* session = DsSessionCreate(&host);
+    if (!session || !DsPreeditInit(&preedit, DS_LAYOUT_EN)) {
+        fprintf(stderr, "cannot create a session\n");
+        return 1;
+    }
+    DsSessionSetPhraseCorrection(session, false);
+    DsPreeditFocusIn(&preedit, &pc, 0);
+
+    uint64_t mismatches = 0;
+    for (size_t i = 0; i < 2 * count; i++) {
+        const DsBenchWord* w = &words[i / 2];
+        const DsLayout own = w->layout;
+        const DsLayout layout = (i & 1) ? (own == DS_LAYOUT_EN ? DS_LAYOUT_RU : DS_LAYOUT_EN) : own;
+        DsPreeditSetLayout(&preedit, layout);
+        field.layout = layout;
+        client.doc.len = 0;
+        DsTextField* f = &field.text;
+        f->len = f->backspaces = f->chars = 0;
+
+        uint64_t injectNs = 0, preeditNs = 0;
+        for (size_t k = 0; k <= w->len; k++) {
+            uint32_t vk = DS_VK_SPACE;
+            bool shift = false;
+            if (k < w->len) DsKeymapFindKey(own, w->text[k], &vk, &shift);
+            const wchar_t ch = DsKeymapChar(field.layout, vk, shift, false);
+
+            const uint64_t t0 = DsMonotonicNs();
+            if (DsSessionKeyDown(session, DS_KEY_TEXT, ch, vk) == DS_PASS && f->len < DS_TEXT_FIELD_MAX_CHARS) {
+                f->text[f->len++] = ch;
+            }
+            const uint64_t t1 = DsMonotonicNs();
+            DsSessionKeyUp(session, vk);
+            // A key down and up per backspace and per character sent.
+            if (k == w->len) injectNs = t1 - t0 + (uint64_t)((double)(2 * (f->backspaces + f->chars)) * eventUs * 1000.0);
+
+            const uint64_t t2 = DsMonotonicNs();
+            DsPreeditKeyDown(&preedit, vk, shift ? DS_PREEDIT_SHIFT : 0);
+            if (k == w->len) preeditNs = client.doc.committed_ns - t2;
+            DsPreeditKeyUp(&preedit, vk);
+        }
+        f->text[f->len] = 0;
+        const uint64_t events = 2 * (f->backspaces + f->chars);
+        const bool fixed = events > 0;
+        Record(&lat[0], preeditNs, fixed);
+        Record(&lat[1], injectNs, fixed);
+        lat[1].events += events;
+        if (client.doc.len != f->len || wmemcmp(client.doc.text, f->text, f->len) != 0) {
+            if (mismatches++ < 5) printf("mismatch: preedit \"%ls\", injection \"%ls\"\n", client.doc.text, f->text);
+        }
+    }
+
+    DsPreeditStats ps = preedit.stats;
+    printf("\ncorpus: %zu words, each typed in its own layout and in the other one\n", count);
+    printf("preedit: %llu commits, %llu corrected, 0 synthetic events; injection: %llu synthetic events\n",
+           (unsigned long long)ps.commits, (unsigned long long)ps.corrections, (unsigned long long)lat[1].events);
+    printf("paths disagree on %llu words\n\n", (unsigned long long)mismatches);
+    printf("commit latency from the space (injection: %.1f us per synthetic event):\n", eventUs);
+    for (int k = 0; k < 2; k++) {
+        char latency[96];
+        Latency* l = &lat[k];
+        DsFormatLatency(l->all_ns, l->all, latency, sizeof(latency));
+        printf("%-10s all   %s\n", k ? "injection" : "preedit", latency);
+        if (!l->fixed) continue;
+        DsFormatLatency(l->fixed_ns, l->fixed, latency, sizeof(latency));
+        printf("%-10s fixed %s  (%zu words, %.1f synthetic events each)\n", "", latency, l->fixed,
+               (double)l->events / (double)l->fixed);
+    }
+
+    DsPreeditDestroy(&preedit);
+    DsSessionDestroy(session);
+    for (int k = 0; k < 2; k++) {
+        free(lat[k].all_ns);
+        free(lat[k].fixed_ns);
+    }
+    free(words);
+    DsEngineShutdown();
+    if (morphPath) DsUnmapFile(&morphFile);
+    return failed || mismatches ? 1 : 0;
+}
@@ -0,0 +1,477 @@
+// Replays a keystroke capture (see src/keytrace.h) through the engine on Linux.
+//
+//   diswitcher-replay [--timed] [--speed X] [--no-predict] [--no-phrase] [--print-text] [--log] [--morph ru.dsmf] [--config diswitcher.conf]
+//                     [--adapt diswitcher.adapt] [--event-us X] trace.dskt
+//
+// The default run feeds every event as fast as possible and reports throughput and per-key engine
+// latency. --timed additionally re-feeds the trace with its original inter-event timing (scaled by
+// --speed) and checks that the resulting text is identical, i.e. that ordering does not depend on
+// timing. Injected output is applied to a simulated text buffer so the final text can be inspected.
+// When the trace has focus changes, a second pass with predictive layout switching disabled
+// reports how many corrections and injected events the per-window layout memory avoided.
+// Likewise, when phrase corrections happened, a pass with them disabled compares word-by-word
+// correction against batched phrase retyping. The two fix different sets of words, so besides the
+// totals (injection rounds, fixed words, final text) the comparison is per fixed word: injected
+// events, engine time of the keys that triggered a correction, and injection time at --event-us
+// per event (default 20, what SendInput and the hook chain take per event in diswitcher-fieldsim).
+// --morph loads a word-form model (src/morph.h) and --config applies a configuration file
+// (src/config.h) to the engine model, as the Windows host does. --adapt keeps adaptive letter
+// statistics (src/adapt.h) in the given file, created if missing: the main pass learns from the
+// trace into it, so replaying a trace repeatedly shows what the engine learns over time, and a pass
+// without the statistics reports what they changed. The other passes learn into a scratch copy of
+// the statistics as they were before the main pass, so they stay comparable with it.
+
+#define _POSIX_C_SOURCE 200809L
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "keymap.h"
+#include "keytrace.h"
+#include "toolutil.h"
+
+typedef struct {
+    DsLayout layout;
+    bool down[256];
+    bool caps;
+
+    wchar_t* text;
+    size_t len;
+    size_t cap;
+
+    // Engine clock: trace time of the current event plus real time spent since it was fed, so
+    // time windows (Pause-to-revert) follow the trace while cache timings stay real.
+    uint64_t trace_ns;
+    uint64_t real_at_event;
+
+    uint64_t keydowns;
+    uint64_t keyups;
+    uint64_t swallowed;
+    uint64_t focus_changes;
+    uint64_t user_switches;
+    uint64_t engine_switches;
+    uint64_t corrections;
+    uint64_t injected_events;
+    uint64_t backspaces;
+    uint64_t fixed_words;   // words in the injected text
+    uint64_t correction_ns; // engine time of the key events that injected something
+} Replay;
+
+static bool g_log = false;
+static bool g_predict = true;
+static bool g_phrase = true;
+static double g_event_us = 20.0;
+static DsAdaptSketch* g_adapt = NULL;         // in the --adapt file
+static DsAdaptSketch* g_adapt_scratch = NULL; // copy of the file's sketch before the main pass
+static DsAdaptSketch* g_adapt_start = NULL;
+
+static void TextReserve(Replay* r, size_t extra)
+{
+    if (r->len + extra + 1 <= r->cap) return;
+    size_t cap = r->cap ? r->cap * 2 : 4096;
+    while (cap < r->len + extra + 1) cap *= 2;
+    wchar_t* p = (wchar_t*)realloc(r->text, cap * sizeof(wchar_t));
+    if (!p) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    r->text = p;
+    r->cap = cap;
+}
+
+static void TextAppend(Replay* r, wchar_t ch)
+{
+    TextReserve(r, 1);
+    r->text[r->len++] = ch;
+}
+
+static void TextErase(Replay* r, size_t n)
+{
+    r->len = n > r->len ? 0 : r->len - n;
+}
+
+static uint64_t ReplayClockNs(void* ctx)
+{
+    const Replay* r = (const Replay*)ctx;
+    return r->trace_ns + (DsMonotonicNs() - r->real_at_event);
+}
+
+static void ReplaySwitchLayout(void* ctx, bool toEnglish)
+{
+    Replay* r = (Replay*)ctx;
+    r->layout = toEnglish ? DS_LAYOUT_EN : DS_LAYOUT_RU;
+    r->engine_switches++;
+}
+
+static void ReplaySendText(void* ctx, size_t backspaces, const wchar_t* text)
+{
+    Replay* r = (Replay*)ctx;
+    const size_t n = wcslen(text);
+    TextErase(r, backspaces);
+    for (size_t i = 0; i < n; i++) TextAppend(r, text[i]);
+    r->corrections++;
+    r->backspaces += backspaces;
+    r->injected_events += 2 * (backspaces + n); // key down + key up per unit, as SendInput does
+    for (size_t i = 0; i < n; i++) {
+        if (DsIsWordChar(text[i]) && (i == 0 || !DsIsWordChar(text[i - 1]))) r->fixed_words++;
+    }
+}
+
+static void ReplayLog(void* ctx, const wchar_t* msg)
+{
+    (void)ctx;
+    fprintf(stderr, "%ls", msg);
+}
+
+static bool AnyDown(const Replay* r, uint32_t a, uint32_t b, uint32_t c)
+{
+    return r->down[a] || r->down[b] || r->down[c];
+}
+
+// Mirrors the classification in LowLevelKeyboardProc (main.c).
+static DsKeyKind ClassifyKey(const Replay* r, uint32_t vk, wchar_t* ch)
+{
+    *ch = 0;
+    if (vk == DS_VK_PAUSE) return DS_KEY_PAUSE;
+    if (AnyDown(r, DS_VK_CONTROL, DS_VK_LCONTROL, DS_VK_RCONTROL) || AnyDown(r, DS_VK_MENU, DS_VK_LMENU, DS_VK_RMENU)) {
+        return DS_KEY_SHORTCUT;
+    }
+    if (vk == DS_VK_BACK) return DS_KEY_BACK;
+    if (vk == DS_VK_ESCAPE) return DS_KEY_ESCAPE;
+    const bool shift = AnyDown(r, DS_VK_SHIFT, DS_VK_LSHIFT, DS_VK_RSHIFT);
+    *ch = DsKeymapChar(r->layout, vk, shift, r->caps);
+    return *ch ? DS_KEY_TEXT : DS_KEY_OTHER;
+}
+
+// Feeds one trace event; returns engine time spent in ns for key events, 0 otherwise.
+static uint64_t FeedEvent(Replay* r, const DsTraceEvent* ev)
+{
+    r->trace_ns = ev->time_ms * 1000000ull;
+    r->real_at_event = DsMonotonicNs();
+
+    switch (ev->type) {
+    case DS_TRACE_FOCUS:
+        r->focus_changes++;
+        DsEngineFocusChanged(ev->value, r->layout == DS_LAYOUT_EN ? DS_LANG_EN : DS_LANG_RU);
+        return 0;
+    case DS_TRACE_LAYOUT:
+        // Engine-initiated switches are re-created by the engine under test.
+        if (!(ev->flags & DS_TRACE_F_ENGINE)) {
+            r->layout = DsLayoutFromId(ev->value);
+            r->user_switches++;
+        }
+        return 0;
+    case DS_TRACE_KEYUP: {
+        r->keyups++;
+        const uint64_t corrections = r->corrections;
+        const uint64_t t0 = DsMonotonicNs();
+        if (DsEngineKeyUp(ev->vk) == DS_SWALLOW) r->swallowed++;
+        const uint64_t dt = DsMonotonicNs() - t0;
+        if (r->corrections != corrections) r->correction_ns += dt;
+        r->down[ev->vk & 0xFF] = false;
+        return dt;
+    }
+    case DS_TRACE_KEYDOWN: {
+        r->keydowns++;
+        wchar_t ch = 0;
+        const DsKeyKind kind = ClassifyKey(r, ev->vk, &ch);
+        const uint64_t corrections = r->corrections;
+        const uint64_t t0 = DsMonotonicNs();
+        const DsKeyResult res = DsEngineKeyDown(kind, ch, ev->vk);
+        const uint64_t dt = DsMonotonicNs() - t0;
+        if (r->corrections != corrections) r->correction_ns += dt;
+
+        if (ev->vk == DS_VK_CAPITAL && !r->down[DS_VK_CAPITAL]) r->caps = !r->caps;
+        r->down[ev->vk & 0xFF] = true;
+
+        if (res == DS_SWALLOW) {
+            r->swallowed++;
+        } else if (kind == DS_KEY_TEXT) {
+            TextAppend(r, ch);
+        } else if (kind == DS_KEY_BACK) {
+            TextErase(r, 1);
+        }
+        return dt;
+    }
+    default:
+        return 0;
+    }
+}
+
+typedef struct {
+    uint64_t events;
+    uint64_t wall_ns;
+    uint64_t max_lag_ns; // timed mode: how late events were fed relative to schedule
+    uint64_t* key_ns;    // per-key engine latency samples
+    size_t key_count;
+} PassResult;
+
+static bool RunPass(const uint8_t* data, size_t size, Replay* r, bool timed, double speed, bool predict, bool phrase,
+                    PassResult* out)
+{
+    DsTraceReader reader;
+    if (!DsTraceReaderInit(&reader, data, size)) {
+        fprintf(stderr, "not a diswitcher trace (bad magic or version)\n");
+        return false;
+    }
+
+    memset(r, 0, sizeof(*r));
+    r->layout = DS_LAYOUT_EN;
+
+    DsHost host;
+    memset(&host, 0, sizeof(host));
+    host.ctx = r;
+    host.clock_ns = ReplayClockNs;
+    host.switch_layout = ReplaySwitchLayout;
+    host.send_text = ReplaySendText;
+    host.log = g_log ? ReplayLog : NULL;
+    DsEngineInit(&host);
+    DsEngineSetPredictiveSwitching(predict);
+    DsEngineSetPhraseCorrection(phrase);
+
+    size_t sampleCap = 1024;
+    out->key_ns = (uint64_t*)malloc(sampleCap * sizeof(uint64_t));
+    out->key_count = 0;
+    out->events = 0;
+    out->max_lag_ns = 0;
+
+    const uint64_t start = DsMonotonicNs();
+    DsTraceEvent ev;
+    int rc;
+    while ((rc = DsTraceReadNext(&reader, &ev)) == 1) {
+        if (timed) {
+            const uint64_t due = start + (uint64_t)((double)ev.time_ms * 1e6 / speed);
+            DsSleepUntilNs(due);
+            const uint64_t now = DsMonotonicNs();
+            if (now > due && now - due > out->max_lag_ns) out->max_lag_ns = now - due;
+        }
+        const uint64_t dt = FeedEvent(r, &ev);
+        if (ev.type == DS_TRACE_KEYDOWN || ev.type == DS_TRACE_KEYUP) {
+            if (out->key_count == sampleCap) {
+                sampleCap *= 2;
+                out->key_ns = (uint64_t*)realloc(out->key_ns, sampleCap * sizeof(uint64_t));
+                if (!out->key_ns) {
+                    fprintf(stderr, "out of memory\n");
+                    exit(1);
+                }
+            }
+            out->key_ns[out->key_count++] = dt;
+        }
+        out->events++;
+    }
+    out->wall_ns = DsMonotonicNs() - start;
+    if (rc < 0) {
+        fprintf(stderr, "warning: trace truncated or corrupt after %llu events\n", (unsigned long long)out->events);
+    }
+    return true;
+}
+
+static void PrintPass(const char* label, PassResult* p)
+{
+    char latency[96];
+    DsFormatLatency(p->key_ns, p->key_count, latency, sizeof(latency));
+    printf("%s: %llu events in %.3f ms (%.2f M events/s); engine per key %s\n", label, (unsigned long long)p->events,
+           (double)p->wall_ns / 1e6, p->wall_ns ? (double)p->events * 1e3 / (double)p->wall_ns : 0.0, latency);
+}
+
+static double PerWord(double total, uint64_t words)
+{
+    return words ? total / (double)words : 0.0;
+}
+
+static void PrintText(const Replay* r)
+{
+    printf("--- text ---\n");
+    for (size_t i = 0; i < r->len; i++) {
+        const wchar_t ch = r->text[i] == L'\r' ? L'\n' : r->text[i];
+        printf("%lc", (wint_t)ch);
+    }
+    printf("\n------------\n");
+}
+
+// The sketch a secondary pass learns into: the statistics as they were before the main pass.
+static DsAdaptSketch* ScratchAdapt(void)
+{
+    if (!g_adapt) return NULL;
+    memcpy(g_adapt_scratch, g_adapt_start, sizeof(DsAdaptSketch));
+    return g_adapt_scratch;
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: diswitcher-replay [--timed] [--speed X] [--no-predict] [--no-phrase] [--print-text] [--log] [--morph ru.dsmf] [--config diswitcher.conf] [--adapt diswitcher.adapt] [--event-us X] trace.dskt\n");
+}
+
+int main(int argc, char** argv)
+{
+    setlocale(LC_ALL, "C.UTF-8");
+
+    bool timed = false, printText = false;
+    double speed = 1.0;
+    const char* path = NULL;
+    const char* morphPath = NULL;
+    const char* configPath = NULL;
+    const char* adaptPath = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--timed") == 0) timed = true;
+        else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) speed = atof(argv[++i]);
+        else if (strcmp(argv[i], "--print-text") == 0) printText = true;
+        else if (strcmp(argv[i], "--log") == 0) g_log = true;
+        else if (strcmp(argv[i], "--no-predict") == 0) g_predict = false;
+        else if (strcmp(argv[i], "--no-phrase") == 0) g_phrase = false;
+        else if (strcmp(argv[i], "--morph") == 0 && i + 1 < argc) morphPath = argv[++i];
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) configPath = argv[++i];
+        else if (strcmp(argv[i], "--adapt") == 0 && i + 1 < argc) adaptPath = argv[++i];
+        else if (strcmp(argv[i], "--event-us") == 0 && i + 1 < argc) g_event_us = atof(argv[++i]);
+        else if (argv[i][0] == '-') { Usage(); return 2; }
+        else path = argv[i];
+    }
+    if (!path || speed <= 0 || g_event_us < 0) {
+        Usage();
+        return 2;
+    }
+
+    DsMappedFile morphFile = {0};
+    DsMorph morph;
+    if (!DsToolLoadModel(morphPath, configPath, &morphFile, &morph)) return 1;
+
+    DsWritableFile adaptFile = {0};
+    if (adaptPath) {
+        if (DsMapFileWritable(adaptPath, sizeof(DsAdaptSketch), &adaptFile) != 0) {
+            perror(adaptPath);
+            return 1;
+        }
+        g_adapt = DsAdaptAttach(adaptFile.data, adaptFile.size);
+        g_adapt_start = (DsAdaptSketch*)malloc(sizeof(DsAdaptSketch));
+        g_adapt_scratch = (DsAdaptSketch*)malloc(sizeof(DsAdaptSketch));
+        if (!g_adapt || !g_adapt_start || !g_adapt_scratch) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        memcpy(g_adapt_start, g_adapt, sizeof(DsAdaptSketch));
+    }
+
+    DsMappedFile file;
+    if (DsMapFile(path, &file) != 0) {
+        perror(path);
+        return 1;
+    }
+
+    Replay fast;
+    PassResult fastRes;
+    DsEngineSetAdaptive(g_adapt);
+    if (!RunPass(file.data, file.size, &fast, false, 1.0, g_predict, g_phrase, &fastRes)) return 1;
+
+    DsCacheStats cache;
+    DsEngineGetCacheStats(&cache);
+    DsLayoutStats layoutStats;
+    DsEngineGetLayoutStats(&layoutStats);
+    DsPhraseStats phraseStats;
+    DsEngineGetPhraseStats(&phraseStats);
+    const uint64_t decisions = cache.hits + cache.misses;
+
+    printf("trace: %llu events, %zu bytes (%.2f bytes/event)\n", (unsigned long long)fastRes.events, file.size,
+           fastRes.events ? (double)(file.size - DS_TRACE_HEADER_SIZE) / (double)fastRes.events : 0.0);
+    printf("keys: %llu down, %llu up, %llu swallowed; focus changes: %llu; user layout switches: %llu\n",
+           (unsigned long long)fast.keydowns, (unsigned long long)fast.keyups, (unsigned long long)fast.swallowed,
+           (unsigned long long)fast.focus_changes, (unsigned long long)fast.user_switches);
+    printf("engine: %llu corrections, %llu layout switches, %llu injected events, %llu backspaces\n",
+           (unsigned long long)fast.corrections, (unsigned long long)fast.engine_switches,
+           (unsigned long long)fast.injected_events, (unsigned long long)fast.backspaces);
+    if (decisions) {
+        printf("decision cache: %llu/%llu hits (%.1f%%), %.3f us/hit, %.3f us/miss\n",
+               (unsigned long long)cache.hits, (unsigned long long)decisions,
+               100.0 * (double)cache.hits / (double)decisions,
+               cache.hits ? (double)cache.hit_ns / 1e3 / (double)cache.hits : 0.0,
+               cache.misses ? (double)cache.miss_ns / 1e3 / (double)cache.misses : 0.0);
+    }
+    PrintPass("fast", &fastRes);
+
+    if (g_adapt) {
+        Replay plain;
+        PassResult plainRes;
+        DsEngineSetAdaptive(NULL);
+        if (!RunPass(file.data, file.size, &plain, false, 1.0, g_predict, g_phrase, &plainRes)) return 1;
+        const bool same = plain.len == fast.len && memcmp(plain.text, fast.text, fast.len * sizeof(wchar_t)) == 0;
+        printf("adaptive: %llu EN + %llu RU tokens learned in all, %llu + %llu in this pass, generation %u\n",
+               (unsigned long long)g_adapt->learned[DS_LANG_EN], (unsigned long long)g_adapt->learned[DS_LANG_RU],
+               (unsigned long long)(g_adapt->learned[DS_LANG_EN] - g_adapt_start->learned[DS_LANG_EN]),
+               (unsigned long long)(g_adapt->learned[DS_LANG_RU] - g_adapt_start->learned[DS_LANG_RU]),
+               g_adapt->generation);
+        printf("adaptive: corrections %llu -> %llu, text %s (without -> with)\n",
+               (unsigned long long)plain.corrections, (unsigned long long)fast.corrections,
+               same ? "identical" : "differs");
+        free(plainRes.key_ns);
+        free(plain.text);
+    }
+
+    if (g_predict && fast.focus_changes) {
+        Replay base;
+        PassResult baseRes;
+        DsEngineSetAdaptive(ScratchAdapt());
+        if (!RunPass(file.data, file.size, &base, false, 1.0, false, g_phrase, &baseRes)) return 1;
+        printf("predictive layout: %llu focus changes, %llu remembered, %llu predictive switches\n",
+               (unsigned long long)layoutStats.focus_changes, (unsigned long long)layoutStats.remembered,
+               (unsigned long long)layoutStats.predictive_switches);
+        printf("predictive layout: corrections %llu -> %llu, injected events %llu -> %llu (without -> with)\n",
+               (unsigned long long)base.corrections, (unsigned long long)fast.corrections,
+               (unsigned long long)base.injected_events, (unsigned long long)fast.injected_events);
+        free(baseRes.key_ns);
+        free(base.text);
+    }
+
+    if (phraseStats.phrases) {
+        Replay words;
+        PassResult wordsRes;
+        DsEngineSetAdaptive(ScratchAdapt());
+        if (!RunPass(file.data, file.size, &words, false, 1.0, g_predict, false, &wordsRes)) return 1;
+        const bool same = words.len == fast.len && memcmp(words.text, fast.text, fast.len * sizeof(wchar_t)) == 0;
+        printf("phrases: %llu corrected (%llu tokens, %llu short)\n", (unsigned long long)phraseStats.phrases,
+               (unsigned long long)phraseStats.phrase_tokens, (unsigned long long)phraseStats.short_tokens);
+        printf("phrase pass: injection rounds %llu -> %llu, fixed words %llu -> %llu, injected events %llu -> %llu, "
+               "text %s (without -> with)\n",
+               (unsigned long long)words.corrections, (unsigned long long)fast.corrections,
+               (unsigned long long)words.fixed_words, (unsigned long long)fast.fixed_words,
+               (unsigned long long)words.injected_events, (unsigned long long)fast.injected_events,
+               same ? "identical" : "differs");
+        printf("phrase pass: per fixed word %.1f -> %.1f injected events, engine %.2f -> %.2f us, "
+               "injection %.1f -> %.1f us at %.1f us/event (without -> with)\n",
+               PerWord((double)words.injected_events, words.fixed_words),
+               PerWord((double)fast.injected_events, fast.fixed_words),
+               PerWord((double)words.correction_ns / 1e3, words.fixed_words),
+               PerWord((double)fast.correction_ns / 1e3, fast.fixed_words),
+               PerWord((double)words.injected_events * g_event_us, words.fixed_words),
+               PerWord((double)fast.injected_events * g_event_us, fast.fixed_words), g_event_us);
+        free(wordsRes.key_ns);
+        free(words.text);
+    }
+
+    int status = 0;
+    if (timed) {
+        Replay slow;
+        PassResult slowRes;
+        DsEngineSetAdaptive(ScratchAdapt());
+        if (!RunPass(file.data, file.size, &slow, true, speed, g_predict, g_phrase, &slowRes)) return 1;
+        PrintPass("timed", &slowRes);
+        printf("timed: max scheduling lag %.3f ms at speed x%.2f\n", (double)slowRes.max_lag_ns / 1e6, speed);
+        const bool same = slow.len == fast.len && memcmp(slow.text, fast.text, fast.len * sizeof(wchar_t)) == 0;
+        printf("ordering: %s\n", same ? "OK (timed and fast replays produce identical text)" : "MISMATCH");
+        if (!same) status = 1;
+        free(slowRes.key_ns);
+        free(slow.text);
+    }
+
+    if (printText) PrintText(&fast);
+
+    free(fastRes.key_ns);
+    free(fast.text);
+    DsUnmapFile(&file);
+    DsEngineShutdown();
+    if (morphPath) DsUnmapFile(&morphFile);
+    if (adaptPath) DsUnmapWritableFile(&adaptFile);
+    free(g_adapt_start);
+    free(g_adapt_scratch);
+    return status;
+}
@@ -0,0 +1,278 @@
+// Multi-session scaling benchmark for the reentrant engine API (DsSession in src/engine.h).
+//
+//   diswitcher-session-bench [--threads N] [--queries N] [--seconds S] [--file queries.txt]
+//                            [--morph ru.dsmf] [--publish]
+//
+// Every thread owns one session and corrects search-style queries with DsSessionCorrectText; all
+// sessions share the published model. Thread counts double from 1 up to --threads (default: all
+// online cores) and each step reports queries/s, speedup over one thread and parallel efficiency.
+// Every output is compared with the one a single session produced beforehand, so a session that
+// leaks state into another (or a torn model) shows up as a mismatch.
+//
+// Queries are generated from a small EN/RU vocabulary, half of them typed in the wrong layout,
+// unless --file gives one UTF-8 query per line. --publish keeps republishing the current model from
+// another thread meanwhile, which makes every session drop its decision cache over and over.
+//
+// Exit status is 0 only if every output matched.
+
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "querygen.h"
+#include "snapshot.h"
+#include "toolutil.h"
+#include "utf8.h"
+
+#define QUERY_MAX_CHARS DS_QUERY_MAX_CHARS
+
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+typedef struct {
+    wchar_t text[QUERY_MAX_CHARS];
+    size_t len;
+    uint64_t expected; // hash of the single-session output
+} Query;
+
+typedef struct {
+    Query* items;
+    size_t count;
+} QuerySet;
+
+typedef struct {
+    pthread_t thread;
+    const QuerySet* queries;
+    volatile uint32_t* go;
+    volatile uint32_t* stop;
+    volatile uint32_t* ready;
+    unsigned id;
+    unsigned threads;
+    uint64_t done;
+    uint64_t corrections;
+    uint64_t mismatches;
+    int failed;
+} Worker;
+
+static uint64_t OutputHash(const wchar_t* s)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (; *s; s++) h = (h ^ (uint64_t)(uint32_t)*s) * 0x100000001b3ull;
+    return h;
+}
+
+static uint64_t Clock(void* ctx)
+{
+    (void)ctx;
+    return DsMonotonicNs();
+}
+
+static bool GenerateQueries(QuerySet* set, size_t count)
+{
+    set->items = (Query*)calloc(count, sizeof(Query));
+    if (!set->items) return false;
+    set->count = count;
+    uint64_t rng = 0x2545F4914F6CDD1Dull;
+    for (size_t q = 0; q < count; q++) {
+        Query* out = &set->items[q];
+        out->len = DsGenerateQuery(&rng, out->text, QUERY_MAX_CHARS);
+    }
+    return true;
+}
+
+static bool LoadQueries(QuerySet* set, const char* path)
+{
+    DsMappedFile f;
+    if (DsMapFile(path, &f) != 0) {
+        perror(path);
+        return false;
+    }
+    size_t lines = 0;
+    for (size_t i = 0; i < f.size; i++) lines += f.data[i] == '\n';
+    set->items = (Query*)calloc(lines + 1, sizeof(Query));
+    if (!set->items) return false;
+    set->count = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= f.size; i++) {
+        if (i < f.size && f.data[i] != '\n') continue;
+        size_t end = i;
+        if (end > start && f.data[end - 1] == '\r') end--;
+        if (end > start) {
+            Query* q = &set->items[set->count++];
+            q->len = DsUtf8ToWide((const char*)f.data + start, end - start, q->text, QUERY_MAX_CHARS);
+        }
+        start = i + 1;
+    }
+    DsUnmapFile(&f);
+    return set->count > 0;
+}
+
+// Single session, single thread: the outputs every thread count must reproduce.
+static bool ComputeExpected(QuerySet* set, uint64_t* corrections)
+{
+    DsHost host = {0};
+    host.clock_ns = Clock;
+    DsSession* s = DsSessionCreate(&host);
+    if (!s) return false;
+    *corrections = 0;
+    for (size_t i = 0; i < set->count; i++) {
+        wchar_t out[QUERY_MAX_CHARS + 2];
+        *corrections += DsSessionCorrectText(s, set->items[i].text, set->items[i].len, out, ARRAYSIZE(out));
+        set->items[i].expected = OutputHash(out);
+    }
+    DsSessionDestroy(s);
+    return true;
+}
+
+static void* WorkerMain(void* arg)
+{
+    Worker* w = (Worker*)arg;
+    DsHost host = {0};
+    host.clock_ns = Clock;
+    DsSession* s = DsSessionCreate(&host);
+    if (!s) w->failed = 1;
+    __atomic_fetch_add(w->ready, 1, __ATOMIC_SEQ_CST);
+    while (!__atomic_load_n(w->go, __ATOMIC_ACQUIRE)) sched_yield();
+    if (!s) return NULL;
+
+    // Threads start at different points of the list so they do not all miss the cache in step.
+    const size_t n = w->queries->count;
+    size_t i = (size_t)w->id * n / w->threads;
+    while (!__atomic_load_n(w->stop, __ATOMIC_RELAXED)) {
+        for (int batch = 0; batch < 64; batch++) {
+            const Query* q = &w->queries->items[i];
+            wchar_t out[QUERY_MAX_CHARS + 2];
+            w->corrections += DsSessionCorrectText(s, q->text, q->len, out, ARRAYSIZE(out));
+            if (OutputHash(out) != q->expected) w->mismatches++;
+            w->done++;
+            if (++i == n) i = 0;
+        }
+    }
+    DsSessionDestroy(s);
+    return NULL;
+}
+
+typedef struct {
+    double qps;
+    uint64_t mismatches;
+    int failed;
+} StepResult;
+
+static StepResult RunStep(const QuerySet* set, unsigned threads, double seconds)
+{
+    StepResult r = {0};
+    Worker* workers = (Worker*)calloc(threads, sizeof(Worker));
+    if (!workers) {
+        r.failed = 1;
+        return r;
+    }
+    volatile uint32_t go = 0, stop = 0, ready = 0;
+    for (unsigned i = 0; i < threads; i++) {
+        workers[i].queries = set;
+        workers[i].go = &go;
+        workers[i].stop = &stop;
+        workers[i].ready = &ready;
+        workers[i].id = i;
+        workers[i].threads = threads;
+        pthread_create(&workers[i].thread, NULL, WorkerMain, &workers[i]);
+    }
+    while (__atomic_load_n(&ready, __ATOMIC_ACQUIRE) != threads) sched_yield();
+    const uint64_t t0 = DsMonotonicNs();
+    __atomic_store_n(&go, 1, __ATOMIC_RELEASE);
+    DsSleepUntilNs(t0 + (uint64_t)(seconds * 1e9));
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    uint64_t done = 0;
+    for (unsigned i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        done += workers[i].done;
+        r.mismatches += workers[i].mismatches;
+        r.failed |= workers[i].failed;
+    }
+    const uint64_t ns = DsMonotonicNs() - t0;
+    r.qps = (double)done / ((double)ns / 1e9);
+    free(workers);
+    return r;
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: diswitcher-session-bench [--threads N] [--queries N] [--seconds S] [--file queries.txt] [--morph ru.dsmf] [--publish]\n");
+}
+
+int main(int argc, char** argv)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned maxThreads = cores > 0 ? (unsigned)cores : 1;
+    size_t queryCount = 20000;
+    double seconds = 1.0;
+    const char* file = NULL;
+    const char* morphPath = NULL;
+    bool publish = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) maxThreads = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--queries") == 0 && i + 1 < argc) queryCount = (size_t)atol(argv[++i]);
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) file = argv[++i];
+        else if (strcmp(argv[i], "--morph") == 0 && i + 1 < argc) morphPath = argv[++i];
+        else if (strcmp(argv[i], "--publish") == 0) publish = true;
+        else { Usage(); return 2; }
+    }
+    // One reader slot goes to the reference session and one to the publisher's clones.
+    if (maxThreads == 0 || maxThreads + 2 > DS_SNAPSHOT_MAX_READERS || queryCount == 0 || seconds <= 0) {
+        Usage();
+        return 2;
+    }
+
+    DsMappedFile morphFile = {0};
+    DsMorph morph;
+    if (!DsToolLoadModel(morphPath, NULL, &morphFile, &morph)) return 1;
+
+    QuerySet set = {0};
+    if (file ? !LoadQueries(&set, file) : !GenerateQueries(&set, queryCount)) {
+        fprintf(stderr, "no queries\n");
+        return 1;
+    }
+    uint64_t corrections = 0;
+    if (!ComputeExpected(&set, &corrections)) {
+        fprintf(stderr, "cannot create a session\n");
+        return 1;
+    }
+    printf("queries: %zu, %llu corrections in one pass; %ld online cores, sessions up to %u%s\n", set.count,
+           (unsigned long long)corrections, cores, maxThreads, publish ? ", models republished meanwhile" : "");
+
+    // Same content under a new generation every millisecond: outputs must not change, caches are
+    // dropped.
+    DsPublisher pub;
+    if (publish && !DsPublisherStart(&pub, 1000000, NULL, NULL)) publish = false;
+
+    printf("threads   queries/s   speedup   efficiency   mismatches\n");
+    double baseline = 0.0;
+    uint64_t mismatches = 0;
+    int failed = 0;
+    for (unsigned t = 1;; t = t * 2 > maxThreads && t < maxThreads ? maxThreads : t * 2) {
+        const StepResult r = RunStep(&set, t, seconds);
+        if (t == 1) baseline = r.qps;
+        const double speedup = baseline > 0 ? r.qps / baseline : 0.0;
+        printf("%7u %11.0f %8.2fx %11.0f%% %12llu\n", t, r.qps, speedup, 100.0 * speedup / t,
+               (unsigned long long)r.mismatches);
+        mismatches += r.mismatches;
+        failed |= r.failed;
+        if (t >= maxThreads) break;
+    }
+
+    if (publish) {
+        DsPublisherStop(&pub);
+        printf("models published meanwhile: %llu\n", (unsigned long long)pub.publishes);
+    }
+    free(set.items);
+    DsEngineShutdown();
+    if (morphPath) DsUnmapFile(&morphFile);
+
+    const int status = (mismatches == 0 && !failed) ? 0 : 1;
+    printf("result: %s\n", status ? "FAIL" : "OK");
+    return status;
+}
@@ -0,0 +1,527 @@
+// Generates, checks and benchmarks the short-word perfect hash behind DsShortWordClass (src/model.h).
+//
+//   diswitcher-shortwords gen > src/shortwords.h
+//   diswitcher-shortwords check
+//   diswitcher-shortwords bench [--file corpus.txt] [--lines N]
+//
+// The word lists below are the source of truth: every valid one- and two-letter EN and RU word
+// (lowercase), plus, derived through the built-in layout map, every token that becomes one of them
+// when mapped to the other layout. Twins that would need a non-letter key (",", ";", "[", ...) are
+// left out: such a key ends the token before it could be looked up.
+//
+// gen searches a hash-and-displace perfect hash over those keys: a first multiplicative hash picks
+// a bucket, whose displacement is XORed into a second one to give the slot. Buckets are placed
+// largest first and the multipliers are re-drawn until every bucket fits, so a lookup costs two
+// multiplications, two loads and one compare, and every key gets a slot of its own.
+//
+// check compares the compiled-in table with the lists for every one- and two-letter string over
+// both alphabets. bench corrects a corpus twice through DsSessionCorrectText, with short-word
+// correction off and on: once as typed (every change is a false positive) and once with every word
+// typed in the wrong layout (every word restored is a hit), and times DsShortWordClass against a
+// linear scan of the same lists. Without --file the corpus is generated from a small vocabulary of
+// sentences that mix content words with prepositions and particles.
+
+#define _POSIX_C_SOURCE 200809L
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "toolutil.h"
+#include "utf8.h"
+
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static const wchar_t* const kWordsEn[] = {
+    L"a", L"i", L"ah", L"am", L"an", L"as", L"at", L"ax", L"be", L"by", L"do", L"eh", L"go", L"ha",
+    L"he", L"hi", L"hm", L"id", L"if", L"in", L"is", L"it", L"ma", L"me", L"my", L"no", L"of", L"oh",
+    L"ok", L"on", L"or", L"ow", L"ox", L"pa", L"pi", L"so", L"to", L"uh", L"um", L"up", L"us", L"we",
+};
+
+static const wchar_t* const kWordsRu[] = {
+    // а в и к о с у я
+    L"\u0430", L"\u0432", L"\u0438", L"\u043a", L"\u043e", L"\u0441", L"\u0443", L"\u044f",
+    // ад ай ал ах бы во вы да до ее её ей ел ем же за из ил им их
+    L"\u0430\u0434", L"\u0430\u0439", L"\u0430\u043b", L"\u0430\u0445", L"\u0431\u044b", L"\u0432\u043e",
+    L"\u0432\u044b", L"\u0434\u0430", L"\u0434\u043e", L"\u0435\u0435", L"\u0435\u0451", L"\u0435\u0439",
+    L"\u0435\u043b", L"\u0435\u043c", L"\u0436\u0435", L"\u0437\u0430", L"\u0438\u0437", L"\u0438\u043b",
+    L"\u0438\u043c", L"\u0438\u0445",
+    // ко ли мы на не ни но ну об ой он ох от по со та те то ты уж ум ус эх эй юг яд
+    L"\u043a\u043e", L"\u043b\u0438", L"\u043c\u044b", L"\u043d\u0430", L"\u043d\u0435", L"\u043d\u0438",
+    L"\u043d\u043e", L"\u043d\u0443", L"\u043e\u0431", L"\u043e\u0439", L"\u043e\u043d", L"\u043e\u0445",
+    L"\u043e\u0442", L"\u043f\u043e", L"\u0441\u043e", L"\u0442\u0430", L"\u0442\u0435", L"\u0442\u043e",
+    L"\u0442\u044b", L"\u0443\u0436", L"\u0443\u043c", L"\u0443\u0441", L"\u044d\u0445", L"\u044d\u0439",
+    L"\u044e\u0433", L"\u044f\u0434",
+};
+
+#define MAX_KEYS 256
+#define TABLE_BITS 9 // slots; at most half of them used
+#define BUCKET_BITS 7
+#define MAX_ATTEMPTS 100000
+
+typedef struct {
+    uint32_t key;
+    uint32_t flags;
+} Key;
+
+typedef struct {
+    Key keys[MAX_KEYS];
+    size_t count;
+} KeySet;
+
+static uint32_t PackKey(const wchar_t* lower, size_t n)
+{
+    if (n == 0 || n > 2 || lower[0] >= 0x800 || (n == 2 && lower[1] >= 0x800)) return 0;
+    return ((uint32_t)lower[0] << 11) | (n == 2 ? (uint32_t)lower[1] : 0);
+}
+
+static void AddKey(KeySet* set, uint32_t key, uint32_t flags)
+{
+    for (size_t i = 0; i < set->count; i++) {
+        if (set->keys[i].key == key) {
+            set->keys[i].flags |= flags;
+            return;
+        }
+    }
+    if (set->count == MAX_KEYS) {
+        fprintf(stderr, "too many keys\n");
+        exit(1);
+    }
+    set->keys[set->count].key = key;
+    set->keys[set->count].flags = flags;
+    set->count++;
+}
+
+static bool IsLetterToken(const wchar_t* s)
+{
+    for (; *s; s++) {
+        if (!DsIsLatinLetter(*s) && !DsIsCyrillicLetter(*s)) return false;
+    }
+    return true;
+}
+
+static void AddWords(KeySet* set, const wchar_t* const* words, size_t count, bool english)
+{
+    for (size_t i = 0; i < count; i++) {
+        const size_t n = wcslen(words[i]);
+        AddKey(set, PackKey(words[i], n), DS_SHORT_WORD);
+        wchar_t twin[4];
+        if (english) DsMapEnToRu(words[i], twin, ARRAYSIZE(twin));
+        else DsMapRuToEn(words[i], twin, ARRAYSIZE(twin));
+        if (wcslen(twin) == n && IsLetterToken(twin)) AddKey(set, PackKey(twin, n), DS_SHORT_TWIN);
+    }
+}
+
+static void BuildKeys(KeySet* set)
+{
+    set->count = 0;
+    AddWords(set, kWordsEn, ARRAYSIZE(kWordsEn), true);
+    AddWords(set, kWordsRu, ARRAYSIZE(kWordsRu), false);
+}
+
+// ---------- gen ----------
+
+typedef struct {
+    uint32_t mul1;
+    uint32_t mul2;
+    uint16_t displace[1u << BUCKET_BITS];
+    uint32_t table[1u << TABLE_BITS]; // key | flags << 24; 0 = empty
+} PerfectHash;
+
+static uint32_t NextRandom(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (uint32_t)(*state >> 16);
+}
+
+static uint32_t Bucket(const PerfectHash* ph, uint32_t key)
+{
+    return (key * ph->mul1) >> (32 - BUCKET_BITS);
+}
+
+static uint32_t BaseSlot(const PerfectHash* ph, uint32_t key)
+{
+    return (key * ph->mul2) >> (32 - TABLE_BITS);
+}
+
+static bool TryPlace(PerfectHash* ph, const KeySet* set)
+{
+    static size_t members[1u << BUCKET_BITS][MAX_KEYS];
+    size_t sizes[1u << BUCKET_BITS] = {0};
+    for (size_t i = 0; i < set->count; i++) {
+        const uint32_t b = Bucket(ph, set->keys[i].key);
+        members[b][sizes[b]++] = i;
+    }
+    uint32_t order[1u << BUCKET_BITS];
+    for (uint32_t b = 0; b < (1u << BUCKET_BITS); b++) order[b] = b;
+    for (uint32_t i = 1; i < (1u << BUCKET_BITS); i++) { // largest first
+        const uint32_t b = order[i];
+        uint32_t j = i;
+        while (j && sizes[order[j - 1]] < sizes[b]) { order[j] = order[j - 1]; j--; }
+        order[j] = b;
+    }
+
+    memset(ph->table, 0, sizeof(ph->table));
+    memset(ph->displace, 0, sizeof(ph->displace));
+    for (uint32_t i = 0; i < (1u << BUCKET_BITS) && sizes[order[i]]; i++) {
+        const uint32_t b = order[i];
+        uint32_t d = 0;
+        for (; d < (1u << TABLE_BITS); d++) {
+            bool fits = true;
+            for (size_t m = 0; m < sizes[b] && fits; m++) {
+                const uint32_t slot = BaseSlot(ph, set->keys[members[b][m]].key) ^ d;
+                if (ph->table[slot]) fits = false;
+                for (size_t o = 0; o < m && fits; o++) {
+                    if ((BaseSlot(ph, set->keys[members[b][o]].key) ^ d) == slot) fits = false;
+                }
+            }
+            if (fits) break;
+        }
+        if (d == (1u << TABLE_BITS)) return false;
+        ph->displace[b] = (uint16_t)d;
+        for (size_t m = 0; m < sizes[b]; m++) {
+            const Key* k = &set->keys[members[b][m]];
+            ph->table[BaseSlot(ph, k->key) ^ d] = k->key | (k->flags << 24);
+        }
+    }
+    return true;
+}
+
+static int Generate(void)
+{
+    KeySet set;
+    BuildKeys(&set);
+    static PerfectHash ph;
+    uint64_t rng = 0x9E3779B97F4A7C15ull;
+    int attempt = 0;
+    for (; attempt < MAX_ATTEMPTS; attempt++) {
+        ph.mul1 = NextRandom(&rng) | 1u;
+        ph.mul2 = NextRandom(&rng) | 1u;
+        if (TryPlace(&ph, &set)) break;
+    }
+    if (attempt == MAX_ATTEMPTS) {
+        fprintf(stderr, "no perfect hash found\n");
+        return 1;
+    }
+
+    printf("#ifndef DISWITCHER_SHORTWORDS_H\n#define DISWITCHER_SHORTWORDS_H\n\n");
+    printf("// Generated by tools/diswitcher_shortwords.c (diswitcher-shortwords gen > src/shortwords.h);\n");
+    printf("// do not edit. %zu keys; multipliers found on attempt %d. Only src/model.c includes this.\n\n", set.count,
+           attempt + 1);
+    printf("#include <stdint.h>\n\n");
+    printf("#define DS_SHORT_TABLE_BITS %d\n", TABLE_BITS);
+    printf("#define DS_SHORT_BUCKET_BITS %d\n", BUCKET_BITS);
+    printf("#define DS_SHORT_MUL1 0x%08Xu\n", ph.mul1);
+    printf("#define DS_SHORT_MUL2 0x%08Xu\n\n", ph.mul2);
+    printf("static const uint16_t kShortDisplace[1u << DS_SHORT_BUCKET_BITS] = {");
+    for (uint32_t i = 0; i < (1u << BUCKET_BITS); i++) printf("%s%u,", i % 16 ? " " : "\n    ", ph.displace[i]);
+    printf("\n};\n\n");
+    printf("// (first letter << 11 | second letter or 0) | DS_SHORT_* flags << 24; 0 = empty.\n");
+    printf("static const uint32_t kShortTable[1u << DS_SHORT_TABLE_BITS] = {");
+    for (uint32_t i = 0; i < (1u << TABLE_BITS); i++) printf("%s0x%08X,", i % 8 ? " " : "\n    ", ph.table[i]);
+    printf("\n};\n\n#endif\n");
+    return 0;
+}
+
+// ---------- check ----------
+
+static int Check(void)
+{
+    KeySet set;
+    BuildKeys(&set);
+    static wchar_t letters[26 + 33];
+    size_t count = 0;
+    for (wchar_t c = L'a'; c <= L'z'; c++) letters[count++] = c;
+    for (wchar_t c = 0x0430; c <= 0x044F; c++) letters[count++] = c;
+    letters[count++] = 0x0451;
+
+    size_t checked = 0, wrong = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j <= count; j++) {
+            const wchar_t s[3] = { letters[i], j < count ? letters[j] : 0, 0 };
+            const size_t n = j < count ? 2 : 1;
+            const uint32_t key = PackKey(s, n);
+            uint32_t expected = 0;
+            for (size_t k = 0; k < set.count; k++) {
+                if (set.keys[k].key == key) expected = set.keys[k].flags;
+            }
+            const uint32_t got = DsShortWordClass(s, n);
+            if (got != expected) {
+                char utf8[16];
+                DsWideToUtf8(s, n, utf8, sizeof(utf8));
+                fprintf(stderr, "%s: table says %u, lists say %u\n", utf8, got, expected);
+                wrong++;
+            }
+            checked++;
+        }
+    }
+    printf("%zu strings checked against %zu keys: %s\n", checked, set.count, wrong ? "MISMATCH (regenerate src/shortwords.h)" : "OK");
+    return wrong ? 1 : 0;
+}
+
+// ---------- bench ----------
+
+// Sentences for the generated corpus, one word class per slot: short words come between content
+// words, as they do in running text.
+static const wchar_t* const kContentEn[] = {
+    L"weather", L"train", L"ticket", L"school", L"people", L"city", L"music", L"phone", L"work", L"house",
+    L"friend", L"morning", L"letter", L"money", L"water", L"street",
+};
+static const wchar_t* const kContentRu[] = {
+    L"\u043f\u043e\u0433\u043e\u0434\u0430", L"\u043f\u043e\u0435\u0437\u0434", L"\u0431\u0438\u043b\u0435\u0442",
+    L"\u0448\u043a\u043e\u043b\u0430", L"\u043b\u044e\u0434\u0438", L"\u0433\u043e\u0440\u043e\u0434",
+    L"\u043c\u0443\u0437\u044b\u043a\u0430", L"\u0442\u0435\u043b\u0435\u0444\u043e\u043d",
+    L"\u0440\u0430\u0431\u043e\u0442\u0430", L"\u0434\u043e\u043c\u0430", L"\u0434\u0440\u0443\u0433",
+    L"\u0443\u0442\u0440\u043e\u043c", L"\u043f\u0438\u0441\u044c\u043c\u043e", L"\u0434\u0435\u043d\u044c\u0433\u0438",
+    L"\u0432\u043e\u0434\u0430", L"\u0443\u043b\u0438\u0446\u0430",
+};
+static const wchar_t* const kFunctionEn[] = {
+    L"a", L"i", L"in", L"on", L"to", L"of", L"is", L"it", L"at", L"by", L"we", L"my", L"no", L"so", L"up", L"or",
+};
+static const wchar_t* const kFunctionRu[] = {
+    L"\u0432", L"\u0438", L"\u044f", L"\u0441", L"\u043a", L"\u0430", L"\u043d\u0430", L"\u043d\u0435",
+    L"\u043f\u043e", L"\u0434\u0430", L"\u043d\u043e", L"\u043e\u043d", L"\u043c\u044b", L"\u0432\u044b",
+    L"\u0442\u043e", L"\u0437\u0430",
+};
+
+#define LINE_MAX_CHARS 256
+#define LINE_MAX_WORDS 32
+
+typedef struct {
+    wchar_t text[LINE_MAX_CHARS];
+    size_t len;
+} Line;
+
+typedef struct {
+    Line* items;
+    size_t count;
+} Corpus;
+
+static void GenerateCorpus(Corpus* c, size_t lines)
+{
+    c->items = (Line*)calloc(lines, sizeof(Line));
+    c->count = lines;
+    uint64_t rng = 0x2545F4914F6CDD1Dull;
+    for (size_t l = 0; l < lines; l++) {
+        const bool russian = NextRandom(&rng) & 1;
+        const unsigned words = 3 + NextRandom(&rng) % 6;
+        Line* out = &c->items[l];
+        for (unsigned w = 0; w < words; w++) {
+            const wchar_t* word;
+            if (w % 2) {
+                word = russian ? kFunctionRu[NextRandom(&rng) % ARRAYSIZE(kFunctionRu)]
+                               : kFunctionEn[NextRandom(&rng) % ARRAYSIZE(kFunctionEn)];
+            } else {
+                word = russian ? kContentRu[NextRandom(&rng) % ARRAYSIZE(kContentRu)]
+                               : kContentEn[NextRandom(&rng) % ARRAYSIZE(kContentEn)];
+            }
+            const size_t n = wcslen(word);
+            if (out->len + n + 2 >= LINE_MAX_CHARS) break;
+            if (w) out->text[out->len++] = L' ';
+            wmemcpy(out->text + out->len, word, n);
+            out->len += n;
+        }
+    }
+}
+
+static bool LoadCorpus(Corpus* c, const char* path, size_t maxLines)
+{
+    DsMappedFile f;
+    if (DsMapFile(path, &f) != 0) {
+        perror(path);
+        return false;
+    }
+    size_t lines = 0;
+    for (size_t i = 0; i < f.size; i++) lines += f.data[i] == '\n';
+    if (lines + 1 < maxLines) maxLines = lines + 1;
+    c->items = (Line*)calloc(maxLines, sizeof(Line));
+    c->count = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= f.size && c->count < maxLines; i++) {
+        if (i < f.size && f.data[i] != '\n') continue;
+        size_t end = i;
+        if (end > start && f.data[end - 1] == '\r') end--;
+        if (end > start) {
+            Line* l = &c->items[c->count++];
+            l->len = DsUtf8ToWide((const char*)f.data + start, end - start, l->text, LINE_MAX_CHARS);
+        }
+        start = i + 1;
+    }
+    DsUnmapFile(&f);
+    return c->count > 0;
+}
+
+// Every word typed in the other layout: what a user gets after forgetting to switch.
+static void WrongLayout(const Line* in, Line* out)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < in->len; i++) {
+        const wchar_t ch = in->text[i];
+        const wchar_t one[2] = { ch, 0 };
+        wchar_t mapped[2] = { ch, 0 };
+        if (DsIsCyrillicLetter(ch)) DsMapRuToEn(one, mapped, ARRAYSIZE(mapped));
+        else if (DsIsLatinLetter(ch)) DsMapEnToRu(one, mapped, ARRAYSIZE(mapped));
+        out->text[n++] = mapped[0];
+    }
+    out->text[n] = 0;
+    out->len = n;
+}
+
+typedef struct {
+    size_t words;
+    size_t short_words;
+    size_t changed;       // words that differ from the reference
+    size_t short_changed; // ... of them one- or two-letter words
+} Diff;
+
+// Word-by-word comparison of `got` with `want` (same word boundaries, the mapping is 1:1).
+static void CompareWords(const wchar_t* got, const wchar_t* want, size_t len, Diff* d)
+{
+    size_t start = 0;
+    for (size_t i = 0; i <= len; i++) {
+        if (i < len && want[i] != L' ') continue;
+        const size_t n = i - start;
+        if (n) {
+            const bool same = wmemcmp(got + start, want + start, n) == 0;
+            d->words++;
+            d->short_words += n <= 2;
+            if (!same) {
+                d->changed++;
+                d->short_changed += n <= 2;
+            }
+        }
+        start = i + 1;
+    }
+}
+
+static uint64_t Clock(void* ctx)
+{
+    (void)ctx;
+    return DsMonotonicNs();
+}
+
+// Corrects every line as typed and in the wrong layout; false positives are words changed in the
+// former, misses are words the latter still has in the wrong layout.
+static void RunCorpus(const Corpus* c, bool shortWords, Diff* asTyped, Diff* wrong)
+{
+    DsHost host = {0};
+    host.clock_ns = Clock;
+    DsSession* s = DsSessionCreate(&host);
+    if (!s) {
+        fprintf(stderr, "cannot create a session\n");
+        exit(1);
+    }
+    DsSessionSetShortWords(s, shortWords);
+    memset(asTyped, 0, sizeof(*asTyped));
+    memset(wrong, 0, sizeof(*wrong));
+    for (size_t i = 0; i < c->count; i++) {
+        const Line* line = &c->items[i];
+        wchar_t out[LINE_MAX_CHARS + 2];
+        DsSessionCorrectText(s, line->text, line->len, out, ARRAYSIZE(out));
+        CompareWords(out, line->text, line->len, asTyped);
+        Line typed;
+        WrongLayout(line, &typed);
+        DsSessionCorrectText(s, typed.text, typed.len, out, ARRAYSIZE(out));
+        CompareWords(out, line->text, line->len, wrong);
+    }
+    DsSessionDestroy(s);
+}
+
+static bool LinearClass(const wchar_t* lower, size_t n)
+{
+    const wchar_t* const* lists[2] = { kWordsEn, kWordsRu };
+    const size_t counts[2] = { ARRAYSIZE(kWordsEn), ARRAYSIZE(kWordsRu) };
+    for (int l = 0; l < 2; l++) {
+        for (size_t i = 0; i < counts[l]; i++) {
+            const wchar_t* w = lists[l][i];
+            if (w[0] == lower[0] && (n == 1 ? w[1] == 0 : (w[1] == lower[1] && w[2] == 0))) return true;
+        }
+    }
+    return false;
+}
+
+static void TimeLookups(void)
+{
+    enum { PROBES = 4096, ROUNDS = 2000 };
+    static wchar_t probes[PROBES][2];
+    static size_t lens[PROBES];
+    uint64_t rng = 0x853C49E6748FEA9Bull;
+    for (size_t i = 0; i < PROBES; i++) {
+        const bool cyr = NextRandom(&rng) & 1;
+        for (int k = 0; k < 2; k++) {
+            probes[i][k] = cyr ? (wchar_t)(0x0430 + NextRandom(&rng) % 32) : (wchar_t)(L'a' + NextRandom(&rng) % 26);
+        }
+        lens[i] = 1 + (NextRandom(&rng) & 1);
+    }
+    volatile uint32_t sink = 0;
+    uint64_t t0 = DsMonotonicNs();
+    for (int r = 0; r < ROUNDS; r++) {
+        for (size_t i = 0; i < PROBES; i++) sink += DsShortWordClass(probes[i], lens[i]);
+    }
+    const double hashNs = (double)(DsMonotonicNs() - t0) / ((double)PROBES * ROUNDS);
+    t0 = DsMonotonicNs();
+    for (int r = 0; r < ROUNDS / 10; r++) {
+        for (size_t i = 0; i < PROBES; i++) sink += LinearClass(probes[i], lens[i]);
+    }
+    const double linearNs = (double)(DsMonotonicNs() - t0) / ((double)PROBES * (ROUNDS / 10));
+    (void)sink;
+    printf("lookup: perfect hash %.2f ns, linear scan of %zu words %.2f ns\n", hashNs,
+           ARRAYSIZE(kWordsEn) + ARRAYSIZE(kWordsRu), linearNs);
+}
+
+static void PrintRow(const char* label, const Diff* asTyped, const Diff* wrong)
+{
+    printf("%-10s %9zu %9zu %13zu/%zu %12zu/%zu\n", label, asTyped->changed, asTyped->short_changed,
+           wrong->words - wrong->changed, wrong->words, wrong->short_words - wrong->short_changed, wrong->short_words);
+}
+
+static int Bench(int argc, char** argv)
+{
+    const char* file = NULL;
+    size_t lines = 20000;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) file = argv[++i];
+        else if (strcmp(argv[i], "--lines") == 0 && i + 1 < argc) lines = (size_t)atol(argv[++i]);
+        else return 2;
+    }
+    Corpus c = {0};
+    if (file) {
+        if (!LoadCorpus(&c, file, lines)) return 1;
+    } else {
+        GenerateCorpus(&c, lines);
+    }
+
+    Diff offTyped, offWrong, onTyped, onWrong;
+    RunCorpus(&c, false, &offTyped, &offWrong);
+    RunCorpus(&c, true, &onTyped, &onWrong);
+    printf("corpus: %zu lines, %zu words, %zu of them short\n", c.count, offTyped.words, offTyped.short_words);
+    printf("short words  false pos  (short)  wrong layout: restored  (short)\n");
+    PrintRow("off", &offTyped, &offWrong);
+    PrintRow("on", &onTyped, &onWrong);
+    TimeLookups();
+    free(c.items);
+    DsEngineShutdown();
+
+    const bool ok = onTyped.changed <= offTyped.changed;
+    printf("false positives: %s\n", ok ? "OK (no growth)" : "GREW");
+    return ok ? 0 : 1;
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: diswitcher-shortwords gen | check | bench [--file corpus.txt] [--lines N]\n");
+}
+
+int main(int argc, char** argv)
+{
+    setlocale(LC_ALL, "C.UTF-8");
+    int status = 2;
+    if (argc >= 2 && strcmp(argv[1], "gen") == 0) status = Generate();
+    else if (argc >= 2 && strcmp(argv[1], "check") == 0) status = Check();
+    else if (argc >= 2 && strcmp(argv[1], "bench") == 0) status = Bench(argc - 2, argv + 2);
+    if (status == 2) Usage();
+    return status;
+}
@@ -0,0 +1,326 @@
+// Stress test for the snapshot domain behind DsEnginePublishModel (src/snapshot.h).
+//
+//   diswitcher-snapshot-stress [--readers N] [--writers M] [--seconds S] [--stall-every K]
+//
+// Readers spin on Enter/verify/Leave over a payload carrying a canary, a serial number and a
+// checksum; writers keep publishing fresh payloads. Reclaimed payloads are poisoned before they
+// are freed, so a reader that can still see a reclaimed snapshot fails verification (and ASan/TSan
+// builds report the access itself). Every --stall-every reads a reader sleeps inside its section to
+// keep retired snapshots pinned and drive writers into the full-retire-list path.
+// A second phase replays synthetic typing through the engine on one thread while the writers
+// publish models with random thresholds, i.e. the hook/reloader setup of the Windows host.
+//
+// Exit status is 0 only if no violation was observed.
+
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "engine.h"
+#include "snapshot.h"
+#include "toolutil.h"
+
+#define PAYLOAD_VALUES 256
+#define PAYLOAD_CANARY 0x5AFE5AFE5AFE5AFEull
+#define PAYLOAD_POISON 0xDEADDEADDEADDEADull
+
+typedef struct {
+    uint64_t canary;
+    uint64_t serial;
+    uint32_t values[PAYLOAD_VALUES];
+    uint64_t checksum;
+} Payload;
+
+typedef struct {
+    DsSnapshotDomain domain;
+    volatile uint32_t stop;
+    volatile uint64_t serial;
+    volatile uint64_t freed;
+    volatile uint64_t violations;
+    unsigned stall_every;
+} Shared;
+
+typedef struct {
+    Shared* shared;
+    pthread_t thread;
+    unsigned id;
+    uint64_t ops;
+    uint64_t ns;
+    uint64_t stalls;
+    uint64_t max_pending;
+} Worker;
+
+static uint64_t Checksum(const Payload* p)
+{
+    uint64_t h = 0xcbf29ce484222325ull ^ p->serial;
+    for (size_t i = 0; i < PAYLOAD_VALUES; i++) h = (h ^ p->values[i]) * 0x100000001b3ull;
+    return h;
+}
+
+static uint32_t NextRandom(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (uint32_t)(*state >> 16);
+}
+
+static Payload* NewPayload(Shared* s, uint64_t* rng)
+{
+    Payload* p = (Payload*)malloc(sizeof(Payload));
+    if (!p) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    p->canary = PAYLOAD_CANARY;
+    p->serial = DsAtomicFetchAdd64(&s->serial, 1) + 1;
+    for (size_t i = 0; i < PAYLOAD_VALUES; i++) p->values[i] = NextRandom(rng);
+    p->checksum = Checksum(p);
+    return p;
+}
+
+static void FreePayload(void* ctx, void* snapshot)
+{
+    Shared* s = (Shared*)ctx;
+    Payload* p = (Payload*)snapshot;
+    p->canary = PAYLOAD_POISON;
+    memset(p->values, 0xA5, sizeof(p->values));
+    DsAtomicFetchAdd64(&s->freed, 1);
+    free(p);
+}
+
+static void SleepNs(long ns)
+{
+    struct timespec ts = { 0, ns };
+    nanosleep(&ts, NULL);
+}
+
+static void* ReaderMain(void* arg)
+{
+    Worker* w = (Worker*)arg;
+    Shared* s = w->shared;
+    const int slot = DsSnapshotRegisterReader(&s->domain);
+    if (slot < 0) {
+        fprintf(stderr, "reader %u: no free slot\n", w->id);
+        DsAtomicFetchAdd64(&s->violations, 1);
+        return NULL;
+    }
+
+    const uint64_t t0 = DsMonotonicNs();
+    while (!DsAtomicLoad32(&s->stop)) {
+        for (int i = 0; i < 256; i++) {
+            const Payload* p = (const Payload*)DsSnapshotEnter(&s->domain, slot);
+            bool ok = p->canary == PAYLOAD_CANARY && p->checksum == Checksum(p);
+            w->ops++;
+            if (s->stall_every && w->ops % s->stall_every == 0) {
+                SleepNs(50000);
+                ok = ok && p->canary == PAYLOAD_CANARY && p->checksum == Checksum(p);
+                w->stalls++;
+            }
+            DsSnapshotLeave(&s->domain, slot);
+            if (!ok) DsAtomicFetchAdd64(&s->violations, 1);
+        }
+    }
+    w->ns = DsMonotonicNs() - t0;
+    DsSnapshotUnregisterReader(&s->domain, slot);
+    return NULL;
+}
+
+static void* WriterMain(void* arg)
+{
+    Worker* w = (Worker*)arg;
+    Shared* s = w->shared;
+    uint64_t rng = 0x9E3779B97F4A7C15ull * (w->id + 1);
+    const uint64_t t0 = DsMonotonicNs();
+    while (!DsAtomicLoad32(&s->stop)) {
+        DsSnapshotPublish(&s->domain, NewPayload(s, &rng));
+        w->ops++;
+        DsSnapshotStats st;
+        DsSnapshotGetStats(&s->domain, &st);
+        if (st.pending > w->max_pending) w->max_pending = st.pending;
+        if ((w->ops & 15) == 0) DsSnapshotReclaim(&s->domain);
+    }
+    w->ns = DsMonotonicNs() - t0;
+    return NULL;
+}
+
+// Cost of an uncontended Enter + Leave pair.
+static double MeasureEnterLeaveNs(Shared* s)
+{
+    const int slot = DsSnapshotRegisterReader(&s->domain);
+    if (slot < 0) return 0.0;
+    const int rounds = 10000000;
+    uintptr_t sink = 0;
+    const uint64_t t0 = DsMonotonicNs();
+    for (int i = 0; i < rounds; i++) {
+        sink ^= (uintptr_t)DsSnapshotEnter(&s->domain, slot);
+        DsSnapshotLeave(&s->domain, slot);
+    }
+    const uint64_t ns = DsMonotonicNs() - t0;
+    DsSnapshotUnregisterReader(&s->domain, slot);
+    if (sink == 1) puts("");
+    return (double)ns / rounds;
+}
+
+static int RunDomainPhase(unsigned readers, unsigned writers, double seconds, unsigned stallEvery)
+{
+    Shared* s = (Shared*)calloc(1, sizeof(Shared));
+    if (!s) return 1;
+    s->stall_every = stallEvery;
+    uint64_t rng = 42;
+    DsSnapshotInit(&s->domain, NewPayload(s, &rng), FreePayload, s);
+
+    const double enterLeaveNs = MeasureEnterLeaveNs(s);
+
+    Worker* workers = (Worker*)calloc(readers + writers, sizeof(Worker));
+    if (!workers) return 1;
+    for (unsigned i = 0; i < readers + writers; i++) {
+        workers[i].shared = s;
+        workers[i].id = i;
+        pthread_create(&workers[i].thread, NULL, i < readers ? ReaderMain : WriterMain, &workers[i]);
+    }
+    DsSleepUntilNs(DsMonotonicNs() + (uint64_t)(seconds * 1e9));
+    DsAtomicStore32(&s->stop, 1);
+    for (unsigned i = 0; i < readers + writers; i++) pthread_join(workers[i].thread, NULL);
+
+    uint64_t reads = 0, readNs = 0, stalls = 0, publishes = 0, maxPending = 0;
+    for (unsigned i = 0; i < readers; i++) {
+        reads += workers[i].ops;
+        readNs += workers[i].ns;
+        stalls += workers[i].stalls;
+    }
+    for (unsigned i = readers; i < readers + writers; i++) {
+        publishes += workers[i].ops;
+        if (workers[i].max_pending > maxPending) maxPending = workers[i].max_pending;
+    }
+    const size_t pendingAfter = DsSnapshotReclaim(&s->domain);
+    DsSnapshotStats st;
+    DsSnapshotGetStats(&s->domain, &st);
+
+    printf("domain: %u readers, %u writers, %.1f s\n", readers, writers, seconds);
+    printf("reads: %llu (%.1f M/s total), %llu stalled; uncontended enter+leave %.1f ns\n",
+           (unsigned long long)reads, readNs ? (double)reads / ((double)readNs / readers / 1e9) / 1e6 : 0.0,
+           (unsigned long long)stalls, enterLeaveNs);
+    printf("publishes: %llu (%.0f/s), reclaimed %llu, max pending %llu (limit %d), pending after stop %zu\n",
+           (unsigned long long)publishes, (double)publishes / seconds, (unsigned long long)st.reclaimed,
+           (unsigned long long)maxPending, DS_SNAPSHOT_MAX_RETIRED, pendingAfter);
+
+    DsSnapshotDestroy(&s->domain);
+    const uint64_t allocated = DsAtomicLoad64(&s->serial);
+    const uint64_t freed = DsAtomicLoad64(&s->freed);
+    const uint64_t violations = DsAtomicLoad64(&s->violations);
+    printf("payloads: %llu allocated, %llu freed; violations: %llu\n", (unsigned long long)allocated,
+           (unsigned long long)freed, (unsigned long long)violations);
+
+    const int status = (violations == 0 && allocated == freed && pendingAfter == 0) ? 0 : 1;
+    free(workers);
+    free(s);
+    return status;
+}
+
+// ---------- Engine phase ----------
+
+// Each publisher republishes the model with random thresholds from its own generator.
+static void RandomThresholds(void* ctx, DsModel* m)
+{
+    uint64_t* rng = (uint64_t*)ctx;
+    m->thresholds.min_diff = 4 + (int)(NextRandom(rng) % 5);
+    m->thresholds.min_mapped = 6 + (int)(NextRandom(rng) % 5);
+}
+
+static uint64_t g_sent = 0;
+
+static void SendText(void* ctx, size_t backspaces, const wchar_t* text)
+{
+    (void)ctx;
+    (void)backspaces;
+    (void)text;
+    g_sent++;
+}
+
+static int RunEnginePhase(unsigned writers, double seconds)
+{
+    DsHost host = {0};
+    host.send_text = SendText;
+    DsEngineInit(&host);
+
+    // Words typed on the wrong layout ("ghbdtn" = "привет") mixed with correct ones.
+    static const wchar_t* const kWords[] = {
+        L"ghbdtn", L"hello", L"\u0440\u0443\u0434\u0434\u0449", L"\u043f\u0440\u0438\u0432\u0435\u0442",
+        L"vbh", L"world", L"ctqxfc", L"test",
+    };
+
+    DsPublisher* pubs = (DsPublisher*)calloc(writers, sizeof(DsPublisher));
+    uint64_t* rngs = (uint64_t*)calloc(writers, sizeof(uint64_t));
+    if (!pubs || !rngs) return 1;
+    for (unsigned i = 0; i < writers; i++) {
+        rngs[i] = 0xA24BAED4963EE407ull * (i + 1);
+        if (!DsPublisherStart(&pubs[i], 20000, RandomThresholds, &rngs[i])) return 1;
+    }
+
+    uint64_t keys = 0;
+    const uint64_t t0 = DsMonotonicNs();
+    const uint64_t deadline = t0 + (uint64_t)(seconds * 1e9);
+    while (DsMonotonicNs() < deadline) {
+        for (size_t w = 0; w < sizeof(kWords) / sizeof(kWords[0]); w++) {
+            for (const wchar_t* c = kWords[w]; *c; c++) {
+                DsEngineKeyDown(DS_KEY_TEXT, *c, 0x41);
+                DsEngineKeyUp(0x41);
+                keys++;
+            }
+            DsEngineKeyDown(DS_KEY_TEXT, L' ', 0x20);
+            DsEngineKeyUp(0x20);
+            keys++;
+        }
+    }
+    const uint64_t ns = DsMonotonicNs() - t0;
+    uint64_t publishes = 0;
+    for (unsigned i = 0; i < writers; i++) {
+        DsPublisherStop(&pubs[i]);
+        publishes += pubs[i].publishes;
+    }
+    free(pubs);
+    free(rngs);
+
+    const size_t pending = DsEngineReclaimModels();
+    DsModelStats st;
+    DsEngineGetModelStats(&st);
+    printf("engine: %llu keys (%.0f ns/key) with %llu models published meanwhile, %llu corrections\n",
+           (unsigned long long)keys, (double)ns / (double)keys, (unsigned long long)publishes,
+           (unsigned long long)g_sent);
+    printf("engine models: generation %u, reclaimed %llu, pending after stop %zu\n", st.generation,
+           (unsigned long long)st.reclaimed, pending);
+    DsEngineShutdown();
+    return (pending == 0 && st.reclaimed == publishes) ? 0 : 1;
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: diswitcher-snapshot-stress [--readers N] [--writers M] [--seconds S] [--stall-every K]\n");
+}
+
+int main(int argc, char** argv)
+{
+    unsigned readers = 4, writers = 2, stallEvery = 4096;
+    double seconds = 2.0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--readers") == 0 && i + 1 < argc) readers = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--writers") == 0 && i + 1 < argc) writers = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) seconds = atof(argv[++i]);
+        else if (strcmp(argv[i], "--stall-every") == 0 && i + 1 < argc) stallEvery = (unsigned)atoi(argv[++i]);
+        else { Usage(); return 2; }
+    }
+    // Leave room for the slot MeasureEnterLeaveNs takes.
+    if (readers == 0 || readers >= DS_SNAPSHOT_MAX_READERS || writers == 0 || seconds <= 0) {
+        Usage();
+        return 2;
+    }
+
+    int status = RunDomainPhase(readers, writers, seconds, stallEvery);
+    status |= RunEnginePhase(writers, seconds / 2);
+    printf("result: %s\n", status ? "FAIL" : "OK");
+    return status;
+}
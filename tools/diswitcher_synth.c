@@ -0,0 +1,710 @@
+// Turns clean EN/RU text into labeled wrong-layout data: what a user would have typed, keystroke by
+// keystroke, with the layout mistakes people make injected at chosen rates.
+//
+//   diswitcher-synth [--threads N] [--seed S] [--word P] [--phrase P] [--case P] [--typo P]
+//                    [--cps N] [--text out.txt] [--labels out.tsv] [--trace out.dskt] [input.txt|-]
+//
+// Every letter is typed on the key that produces it in its own layout (tools/keymap.h, the same
+// physical mapping as kRuToEn in src/model.c); what lands on screen is what that key gives in the
+// layout that is actually active. Errors, each drawn per word:
+//   --word P    the layout is the other one for this word only (default 0.03)
+//   --phrase P  at a change of language the user does not switch and types the next 2-6 words of
+//               the new language in the old layout (default 0.2). A line starts with either layout
+//               left over, so half of the lines begin with such a change.
+//   --case P    Caps Lock left on over the word, or Shift held into its second letter (default 0.01)
+//   --typo P    one slipped keystroke: neighbouring key, swapped pair, dropped or doubled key
+//               (default 0.01)
+// Punctuation typed while the layout is wrong comes out as the other layout's character on that key
+// ("бы," typed on EN is ",s?"), as it does for real. Characters on neither layout are copied to the
+// text and left out of the trace.
+//
+// Outputs (any combination; the text goes to stdout when nothing is chosen):
+//   --text    the text as typed, line for line
+//   --labels  one row per word: line (1-based), column in the typed line, typed, expected, kinds;
+//             expected is the word in the right layout and case, keeping typos (layout correction
+//             cannot undo them); kinds is "ok" or a '+'-joined subset of word, phrase, case, typo
+//   --trace   the keystrokes and layout switches as a capture (src/keytrace.h) at --cps characters
+//             per second (default 8) with some jitter, each line starting with a layout record;
+//             replaying it reproduces --text
+//
+// The input is read in batches of --threads slices cut at line breaks. Workers synthesize the slices
+// of one batch into one of two output sets while the main thread writes the other (the previous
+// batch) and reads the next batch, so output stays in input order. Random draws are seeded per line
+// from --seed and the line number, so the output does not depend on the thread count.
+
+#define _GNU_SOURCE
+#include <locale.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "keymap.h"
+#include "keytrace.h"
+#include "toolutil.h"
+#include "utf8.h"
+
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define SLICE_BYTES (4u << 20) // input per worker and batch
+#define PIECE_CHARS 4096       // longer lines are synthesized in pieces cut at a space
+#define WORD_MAX 64            // longer letter runs are typed as several words
+#define LINE_PAUSE_MS 900
+
+enum {
+    KIND_WORD = 1,
+    KIND_PHRASE = 2,
+    KIND_CASE = 4,
+    KIND_TYPO = 8,
+};
+
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t cap;
+} Buf;
+
+typedef struct {
+    uint8_t vk;
+    bool shift;
+} Key;
+
+typedef struct {
+    uint64_t lines;
+    uint64_t words;
+    uint64_t kinds[4]; // words with KIND_WORD, _PHRASE, _CASE, _TYPO
+    uint64_t keystrokes;
+    uint64_t untypeable;
+} Stats;
+
+// What one worker made of one slice.
+typedef struct {
+    Buf text;
+    Buf labels;
+    Buf trace;
+} Output;
+
+typedef struct {
+    pthread_t thread;
+    Output out[2]; // by batch parity: one is filled while the other is written
+    Output* cur;
+    DsTraceWriter writer;
+    uint8_t trace_buf[64 * 1024];
+    uint64_t now_ms;
+    int trace_layout; // layout the trace last switched to, -1 at the start of a line
+    Stats stats;
+    // Current slice.
+    const uint8_t* in;
+    size_t in_len;
+    uint64_t first_line;
+} Worker;
+
+// Per line, in typing order.
+typedef struct {
+    uint64_t rng;
+    uint64_t jitter;   // timing only, so the trace does not change the text
+    DsLayout active;   // what the keyboard is actually set to
+    DsLayout believed; // what the user thinks it is set to
+    DsLayout prev;     // language of the previous word
+    unsigned run_left; // words left in a --phrase error
+    size_t col;        // characters typed on this line so far
+} Typist;
+
+static uint32_t g_rate_word, g_rate_phrase, g_rate_case, g_rate_typo; // probability * 2^32
+static uint64_t g_seed = 1;
+static uint32_t g_interval_ms = 125;
+static bool g_want_text, g_want_labels, g_want_trace;
+
+// Key tables built from tools/keymap.c once.
+static uint16_t g_key_of[2][0x10000]; // char -> vk | shift << 8 | 0x8000, 0 if not on the layout
+static wchar_t g_char_of[2][256][2][2]; // layout, vk, shift, caps
+static uint8_t g_letter[0x10000];      // 1 + layout of a letter typeable on its layout, else 0
+static uint8_t g_scan[256];
+static uint8_t g_left[256], g_right[256]; // letter-row neighbours, 0 at the edge
+
+static void InitKeyTables(void)
+{
+    for (int l = 0; l < 2; l++) {
+        for (unsigned vk = 1; vk < 256; vk++) {
+            for (int shift = 0; shift < 2; shift++) {
+                for (int caps = 0; caps < 2; caps++) g_char_of[l][vk][shift][caps] = DsKeymapChar((DsLayout)l, vk, shift, caps);
+                const wchar_t ch = g_char_of[l][vk][shift][0];
+                if (ch && (uint32_t)ch < 0x10000 && !g_key_of[l][ch]) g_key_of[l][ch] = (uint16_t)(0x8000 | vk | shift << 8);
+            }
+        }
+    }
+    for (wchar_t ch = 1; ch < 0x10000; ch++) {
+        if (DsIsLatinLetter(ch) && g_key_of[DS_LAYOUT_EN][ch]) g_letter[ch] = 1 + DS_LAYOUT_EN;
+        else if (DsIsCyrillicLetter(ch) && g_key_of[DS_LAYOUT_RU][ch]) g_letter[ch] = 1 + DS_LAYOUT_RU;
+    }
+    for (unsigned vk = 0; vk < 256; vk++) g_scan[vk] = (uint8_t)DsKeymapScanCode(vk);
+    static const char* const kRows[] = { "QWERTYUIOP\xDB\xDD", "ASDFGHJKL\xBA\xDE", "ZXCVBNM\xBC\xBE" };
+    for (size_t r = 0; r < ARRAYSIZE(kRows); r++) {
+        const uint8_t* row = (const uint8_t*)kRows[r];
+        for (size_t i = 0; row[i]; i++) {
+            g_left[row[i]] = i ? row[i - 1] : 0;
+            g_right[row[i]] = row[i + 1];
+        }
+    }
+}
+
+static uint32_t NextRandom(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (uint32_t)(*state >> 16);
+}
+
+static bool Chance(uint64_t* rng, uint32_t rate)
+{
+    return rate && NextRandom(rng) < rate;
+}
+
+static uint32_t ParseRate(const char* s)
+{
+    const double p = atof(s);
+    return p <= 0 ? 0 : p >= 1 ? UINT32_MAX : (uint32_t)(p * 4294967296.0);
+}
+
+// ---------- Output buffers ----------
+
+static void Reserve(Buf* b, size_t extra)
+{
+    if (b->len + extra > b->cap) b->data = (uint8_t*)DsGrow(b->data, &b->cap, b->len + extra, 1);
+}
+
+static void PutByte(Buf* b, uint8_t c)
+{
+    Reserve(b, 1);
+    b->data[b->len++] = c;
+}
+
+static void PutWide(Buf* b, const wchar_t* s, size_t n)
+{
+    Reserve(b, n * 4);
+    uint8_t* out = b->data + b->len;
+    for (size_t i = 0; i < n; i++) {
+        const uint32_t cp = (uint32_t)s[i];
+        if (cp < 0x80) {
+            *out++ = (uint8_t)cp;
+        } else if (cp < 0x800) { // all of Cyrillic
+            *out++ = (uint8_t)(0xC0 | cp >> 6);
+            *out++ = (uint8_t)(0x80 | (cp & 0x3F));
+        } else {
+            out += DsUtf8Encode(cp, out);
+        }
+    }
+    b->len = (size_t)(out - b->data);
+}
+
+static void PutNumber(Buf* b, uint64_t v)
+{
+    char digits[24];
+    size_t n = 0;
+    do digits[n++] = (char)('0' + v % 10); while (v /= 10);
+    Reserve(b, n);
+    while (n) b->data[b->len++] = (uint8_t)digits[--n];
+}
+
+static bool FlushTrace(void* ctx, const uint8_t* data, size_t len)
+{
+    Buf* b = (Buf*)ctx;
+    Reserve(b, len);
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return true;
+}
+
+// ---------- Typing ----------
+
+static void Press(Worker* w, Typist* t, uint8_t vk, bool shift)
+{
+    w->stats.keystrokes++;
+    if (!g_want_trace) return;
+    // 60-140% of the nominal interval between keys.
+    const uint32_t interval = g_interval_ms * (60 + NextRandom(&t->jitter) % 81) / 100;
+    const uint32_t hold = interval / 3 ? interval / 3 : 1;
+    if (shift) DsTraceWriteKey(&w->writer, w->now_ms, true, DS_VK_LSHIFT, g_scan[DS_VK_LSHIFT], 0);
+    DsTraceWriteKey(&w->writer, w->now_ms, true, vk, g_scan[vk], 0);
+    DsTraceWriteKey(&w->writer, w->now_ms + hold, false, vk, g_scan[vk], 0);
+    if (shift) DsTraceWriteKey(&w->writer, w->now_ms + hold, false, DS_VK_LSHIFT, g_scan[DS_VK_LSHIFT], 0);
+    w->now_ms += interval;
+}
+
+static void SyncLayout(Worker* w, const Typist* t)
+{
+    if (!g_want_trace || w->trace_layout == (int)t->active) return;
+    DsTraceWriteLayout(&w->writer, w->now_ms, DsLayoutToId(t->active), false);
+    w->trace_layout = (int)t->active;
+}
+
+static int LetterLayout(wchar_t ch)
+{
+    return (uint32_t)ch < 0x10000 ? g_letter[ch] - 1 : -1;
+}
+
+static void TypeOther(Worker* w, Typist* t, wchar_t ch)
+{
+    const uint16_t believed = (uint32_t)ch < 0x10000 ? g_key_of[t->believed][ch] : 0;
+    const uint16_t active = (uint32_t)ch < 0x10000 ? g_key_of[t->active][ch] : 0;
+    const uint16_t key = believed ? believed : active;
+    wchar_t typed = ch;
+    if (key) {
+        typed = g_char_of[t->active][key & 0xFF][(key >> 8) & 1][0];
+        SyncLayout(w, t);
+        Press(w, t, (uint8_t)key, (key >> 8) & 1);
+    } else {
+        w->stats.untypeable++;
+    }
+    if (g_want_text) PutWide(&w->cur->text, &typed, 1);
+    t->col++;
+}
+
+// One slipped keystroke somewhere in the word; false if the draw left it as it was (no neighbouring
+// letter, nothing to swap with). Keys stay letters of `layout`.
+static bool Typo(uint64_t* rng, DsLayout layout, Key* keys, size_t* n)
+{
+    const size_t at = NextRandom(rng) % *n;
+    switch (NextRandom(rng) % 4) {
+    case 0: {
+        const uint8_t next = (NextRandom(rng) & 1) ? g_left[keys[at].vk] : g_right[keys[at].vk];
+        if (!next || LetterLayout(g_char_of[layout][next][0][0]) != (int)layout) return false;
+        keys[at].vk = next;
+        return true;
+    }
+    case 1: {
+        if (at + 1 >= *n || keys[at].vk == keys[at + 1].vk) return false;
+        const Key k = keys[at];
+        keys[at] = keys[at + 1];
+        keys[at + 1] = k;
+        return true;
+    }
+    case 2:
+        if (*n <= 2) return false;
+        memmove(keys + at, keys + at + 1, (*n - at - 1) * sizeof(Key));
+        (*n)--;
+        return true;
+    default:
+        if (*n >= WORD_MAX) return false;
+        memmove(keys + at + 1, keys + at, (*n - at) * sizeof(Key));
+        (*n)++;
+        return true;
+    }
+}
+
+static void TypeWord(Worker* w, Typist* t, uint64_t lineNo, const wchar_t* word, size_t n, DsLayout lang)
+{
+    unsigned kinds = 0;
+    if (lang != t->prev) t->run_left = Chance(&t->rng, g_rate_phrase) ? 2 + NextRandom(&t->rng) % 5 : 0;
+    t->prev = lang;
+    t->believed = lang;
+    if (t->run_left) {
+        t->run_left--;
+        kinds |= KIND_PHRASE;
+    } else if (Chance(&t->rng, g_rate_word)) {
+        kinds |= KIND_WORD;
+    }
+    t->active = kinds ? (DsLayout)!lang : lang;
+    const bool typo = Chance(&t->rng, g_rate_typo);
+    const bool slip = Chance(&t->rng, g_rate_case);
+
+    if (!kinds && !typo && !slip && !g_want_trace && !g_want_labels) {
+        // Typed as meant: most words, and nothing to record but the text.
+        w->stats.words++;
+        w->stats.keystrokes += n;
+        if (g_want_text) PutWide(&w->cur->text, word, n);
+        t->col += n;
+        return;
+    }
+
+    Key keys[WORD_MAX + 1];
+    for (size_t i = 0; i < n; i++) {
+        const uint16_t k = g_key_of[lang][word[i]];
+        keys[i].vk = (uint8_t)k;
+        keys[i].shift = (k >> 8) & 1;
+    }
+    if (typo && Typo(&t->rng, lang, keys, &n)) kinds |= KIND_TYPO;
+
+    // Expected: the keys as pressed, read in the right layout, with the case the user meant.
+    wchar_t expected[WORD_MAX + 1];
+    for (size_t i = 0; i < n; i++) expected[i] = g_char_of[lang][keys[i].vk][keys[i].shift][0];
+
+    bool caps = false;
+    if (slip) {
+        kinds |= KIND_CASE;
+        if (n >= 3 && keys[0].shift && !keys[1].shift && (NextRandom(&t->rng) & 1)) keys[1].shift = true;
+        else caps = true;
+    }
+
+    wchar_t typed[WORD_MAX + 1];
+    SyncLayout(w, t);
+    if (caps) Press(w, t, DS_VK_CAPITAL, false);
+    for (size_t i = 0; i < n; i++) {
+        typed[i] = g_char_of[t->active][keys[i].vk][keys[i].shift][caps];
+        Press(w, t, keys[i].vk, keys[i].shift);
+    }
+    if (caps) Press(w, t, DS_VK_CAPITAL, false);
+
+    Stats* st = &w->stats;
+    st->words++;
+    for (int k = 0; k < 4; k++) st->kinds[k] += (kinds >> k) & 1;
+    if (g_want_text) PutWide(&w->cur->text, typed, n);
+    if (g_want_labels) {
+        static const char* const kNames[] = { "word", "phrase", "case", "typo" };
+        Buf* b = &w->cur->labels;
+        PutNumber(b, lineNo);
+        PutByte(b, '\t');
+        PutNumber(b, t->col);
+        PutByte(b, '\t');
+        PutWide(b, typed, n);
+        PutByte(b, '\t');
+        PutWide(b, expected, n);
+        PutByte(b, '\t');
+        if (!kinds) {
+            Reserve(b, 2);
+            memcpy(b->data + b->len, "ok", 2);
+            b->len += 2;
+        }
+        for (int k = 0, first = 1; k < 4; k++) {
+            if (!((kinds >> k) & 1)) continue;
+            const size_t len = strlen(kNames[k]);
+            Reserve(b, len + 1);
+            if (!first) b->data[b->len++] = '+';
+            memcpy(b->data + b->len, kNames[k], len);
+            b->len += len;
+            first = 0;
+        }
+        PutByte(b, '\n');
+    }
+    t->col += n;
+}
+
+static void TypePiece(Worker* w, Typist* t, uint64_t lineNo, const wchar_t* s, size_t n)
+{
+    size_t i = 0;
+    while (i < n) {
+        const int lang = LetterLayout(s[i]);
+        if (lang < 0) {
+            TypeOther(w, t, s[i++]);
+            continue;
+        }
+        size_t end = i + 1;
+        while (end < n && end - i < WORD_MAX && LetterLayout(s[end]) == lang) end++;
+        TypeWord(w, t, lineNo, s + i, end - i, (DsLayout)lang);
+        i = end;
+    }
+}
+
+static void TypeLine(Worker* w, uint64_t lineNo, const uint8_t* p, size_t len)
+{
+    Typist t = {0};
+    t.rng = (g_seed ^ (lineNo * 0x9E3779B97F4A7C15ull)) | 1;
+    t.jitter = t.rng ^ 0xD1B54A32D192ED03ull;
+    for (int i = 0; i < 4; i++) NextRandom(&t.rng), NextRandom(&t.jitter);
+    // Whatever layout the previous line ended in.
+    t.active = t.believed = t.prev = (DsLayout)(NextRandom(&t.rng) & 1);
+    w->trace_layout = -1; // every line states its layout, so slices need no state from each other
+
+    if (len && p[len - 1] == '\r') len--;
+    wchar_t piece[PIECE_CHARS + 1];
+    while (len) {
+        // Cut at a space so words stay whole; PIECE_CHARS bytes never hold more characters.
+        size_t take = len;
+        if (take > PIECE_CHARS) {
+            take = PIECE_CHARS;
+            while (take && p[take - 1] != ' ') take--;
+            if (!take) {
+                take = PIECE_CHARS;
+                while (take && (p[take] & 0xC0) == 0x80) take--;
+            }
+        }
+        const size_t n = DsUtf8ToWide((const char*)p, take, piece, ARRAYSIZE(piece));
+        TypePiece(w, &t, lineNo, piece, n);
+        p += take;
+        len -= take;
+    }
+    if (g_want_text) PutByte(&w->cur->text, '\n');
+    if (g_want_trace) {
+        Press(w, &t, DS_VK_RETURN, false);
+        // Counted from Enter's release, which is the last record: a slice starts the same way.
+        w->now_ms = w->writer.last_ms + LINE_PAUSE_MS;
+    }
+    w->stats.lines++;
+}
+
+static void SynthSlice(Worker* w)
+{
+    w->cur->text.len = w->cur->labels.len = w->cur->trace.len = 0;
+    if (g_want_trace) {
+        DsTraceWriterInit(&w->writer, w->trace_buf, sizeof(w->trace_buf), FlushTrace, &w->cur->trace);
+        // Continue the previous slice's clock: the first record's delta is the pause since then.
+        w->writer.have_last = true;
+        w->writer.last_ms = 0;
+        w->now_ms = LINE_PAUSE_MS;
+    }
+    const uint8_t* p = w->in;
+    const uint8_t* end = p + w->in_len;
+    uint64_t lineNo = w->first_line;
+    while (p < end) {
+        const uint8_t* eol = (const uint8_t*)memchr(p, '\n', (size_t)(end - p));
+        if (!eol) eol = end;
+        TypeLine(w, lineNo++, p, (size_t)(eol - p));
+        p = eol + 1;
+    }
+    if (g_want_trace) DsTraceWriterFlush(&w->writer);
+}
+
+// ---------- Pipeline ----------
+
+static pthread_barrier_t g_start, g_done;
+static volatile bool g_stop;
+static bool g_eof;
+static Worker* g_workers;
+static unsigned g_threads;
+
+static void* WorkerMain(void* arg)
+{
+    Worker* w = (Worker*)arg;
+    for (;;) {
+        pthread_barrier_wait(&g_start);
+        if (g_stop) return NULL;
+        SynthSlice(w);
+        pthread_barrier_wait(&g_done);
+    }
+}
+
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t cap;
+} Input;
+
+// Refills `in` from `f` with everything after the last complete line (carried over in `carry`).
+static void ReadBatch(FILE* f, Input* in, Buf* carry)
+{
+    in->len = 0;
+    in->data = (uint8_t*)DsGrow(in->data, &in->cap, carry->len + 1, 1);
+    if (carry->len) {
+        memcpy(in->data, carry->data, carry->len);
+        in->len = carry->len;
+        carry->len = 0;
+    }
+    for (;;) {
+        if (!g_eof) {
+            in->len += fread(in->data + in->len, 1, in->cap - in->len, f);
+            if (in->len < in->cap) g_eof = true;
+        }
+        if (g_eof) return;
+        const uint8_t* nl = (const uint8_t*)memrchr(in->data, '\n', in->len);
+        if (nl) {
+            const size_t keep = (size_t)(nl - in->data) + 1;
+            Reserve(carry, in->len - keep);
+            memcpy(carry->data, in->data + keep, in->len - keep);
+            carry->len = in->len - keep;
+            in->len = keep;
+            return;
+        }
+        in->data = (uint8_t*)DsGrow(in->data, &in->cap, in->cap + 1, 1); // one line longer than the batch
+    }
+}
+
+// Hands each worker a run of whole lines and numbers them.
+static void AssignSlices(const Input* in, uint64_t* nextLine)
+{
+    size_t start = 0;
+    for (unsigned i = 0; i < g_threads; i++) {
+        size_t end = in->len * (i + 1) / g_threads;
+        if (i + 1 == g_threads) {
+            end = in->len;
+        } else if (end > start) {
+            const uint8_t* nl = (const uint8_t*)memchr(in->data + end - 1, '\n', in->len - end + 1);
+            end = nl ? (size_t)(nl - in->data) + 1 : in->len;
+        } else {
+            end = start;
+        }
+        Worker* w = &g_workers[i];
+        w->in = in->data + start;
+        w->in_len = end - start;
+        w->first_line = *nextLine;
+        for (const uint8_t* p = w->in; (p = memchr(p, '\n', (size_t)(w->in + w->in_len - p))) != NULL; p++) (*nextLine)++;
+        if (w->in_len && w->in[w->in_len - 1] != '\n') (*nextLine)++;
+        start = end;
+    }
+}
+
+static bool WriteBuf(FILE* f, const Buf* b)
+{
+    return !f || !b->len || DsFlushToFile(f, b->data, b->len);
+}
+
+static bool WriteBatch(int slot, FILE* text, FILE* labels, FILE* trace, uint64_t* bytes)
+{
+    bool ok = true;
+    for (unsigned i = 0; i < g_threads; i++) {
+        const Output* o = &g_workers[i].out[slot];
+        ok &= WriteBuf(text, &o->text);
+        ok &= WriteBuf(labels, &o->labels);
+        ok &= WriteBuf(trace, &o->trace);
+        *bytes += o->text.len + o->labels.len + o->trace.len;
+    }
+    return ok;
+}
+
+static FILE* OpenOutput(const char* path)
+{
+    if (!path) return NULL;
+    if (strcmp(path, "-") == 0) return stdout;
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    return f;
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: diswitcher-synth [--threads N] [--seed S] [--word P] [--phrase P] [--case P] [--typo P] [--cps N] [--text out.txt] [--labels out.tsv] [--trace out.dskt] [input.txt|-]\n");
+}
+
+int main(int argc, char** argv)
+{
+    setlocale(LC_ALL, "C.UTF-8");
+
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    g_threads = cores > 0 ? (unsigned)cores : 1;
+    g_rate_word = ParseRate("0.03");
+    g_rate_phrase = ParseRate("0.2");
+    g_rate_case = ParseRate("0.01");
+    g_rate_typo = ParseRate("0.01");
+    const char* inPath = "-";
+    const char* textPath = NULL;
+    const char* labelsPath = NULL;
+    const char* tracePath = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) g_threads = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) g_seed = strtoull(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--word") == 0 && i + 1 < argc) g_rate_word = ParseRate(argv[++i]);
+        else if (strcmp(argv[i], "--phrase") == 0 && i + 1 < argc) g_rate_phrase = ParseRate(argv[++i]);
+        else if (strcmp(argv[i], "--case") == 0 && i + 1 < argc) g_rate_case = ParseRate(argv[++i]);
+        else if (strcmp(argv[i], "--typo") == 0 && i + 1 < argc) g_rate_typo = ParseRate(argv[++i]);
+        else if (strcmp(argv[i], "--cps") == 0 && i + 1 < argc) {
+            const double cps = atof(argv[++i]);
+            if (cps <= 0) { Usage(); return 2; }
+            g_interval_ms = (uint32_t)(1000.0 / cps);
+            if (!g_interval_ms) g_interval_ms = 1;
+        }
+        else if (strcmp(argv[i], "--text") == 0 && i + 1 < argc) textPath = argv[++i];
+        else if (strcmp(argv[i], "--labels") == 0 && i + 1 < argc) labelsPath = argv[++i];
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) tracePath = argv[++i];
+        else if (argv[i][0] == '-' && argv[i][1]) { Usage(); return 2; }
+        else inPath = argv[i];
+    }
+    if (g_threads == 0) {
+        Usage();
+        return 2;
+    }
+    if (!textPath && !labelsPath && !tracePath) textPath = "-";
+    g_want_text = textPath != NULL;
+    g_want_labels = labelsPath != NULL;
+    g_want_trace = tracePath != NULL;
+
+    FILE* in = strcmp(inPath, "-") == 0 ? stdin : fopen(inPath, "rb");
+    if (!in) {
+        perror(inPath);
+        return 1;
+    }
+    FILE* text = OpenOutput(textPath);
+    FILE* labels = OpenOutput(labelsPath);
+    FILE* trace = OpenOutput(tracePath);
+    if (trace) {
+        uint8_t header[DS_TRACE_HEADER_SIZE];
+        DsTraceWriter hw;
+        DsTraceWriterInit(&hw, header, sizeof(header), DsFlushToFile, trace);
+        DsTraceWriteHeader(&hw, 0);
+        if (!DsTraceWriterFlush(&hw)) {
+            perror(tracePath);
+            return 1;
+        }
+    }
+
+    InitKeyTables();
+    g_workers = (Worker*)calloc(g_threads, sizeof(Worker));
+    Input batches[2] = {0};
+    for (int i = 0; i < 2; i++) {
+        batches[i].cap = (size_t)SLICE_BYTES * g_threads;
+        batches[i].data = (uint8_t*)malloc(batches[i].cap);
+        if (!batches[i].data) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+    }
+    if (!g_workers) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    pthread_barrier_init(&g_start, NULL, g_threads + 1);
+    pthread_barrier_init(&g_done, NULL, g_threads + 1);
+    for (unsigned i = 0; i < g_threads; i++) {
+        pthread_create(&g_workers[i].thread, NULL, WorkerMain, &g_workers[i]);
+    }
+
+    const uint64_t t0 = DsMonotonicNs();
+    Buf carry = {0};
+    uint64_t nextLine = 1, bytesIn = 0, bytesOut = 0;
+    bool ok = true, written = true;
+    int cur = 0;
+    ReadBatch(in, &batches[cur], &carry);
+    while (batches[cur].len) {
+        AssignSlices(&batches[cur], &nextLine);
+        for (unsigned i = 0; i < g_threads; i++) g_workers[i].cur = &g_workers[i].out[cur];
+        bytesIn += batches[cur].len;
+        pthread_barrier_wait(&g_start);
+        // While the workers synthesize this batch: write the previous one, read the next.
+        if (!written) ok &= WriteBatch(!cur, text, labels, trace, &bytesOut);
+        ReadBatch(in, &batches[!cur], &carry);
+        pthread_barrier_wait(&g_done);
+        written = false;
+        cur = !cur;
+    }
+    if (!written) ok &= WriteBatch(!cur, text, labels, trace, &bytesOut);
+    g_stop = true;
+    pthread_barrier_wait(&g_start);
+    for (unsigned i = 0; i < g_threads; i++) pthread_join(g_workers[i].thread, NULL);
+    const double seconds = (double)(DsMonotonicNs() - t0) / 1e9;
+
+    Stats total = {0};
+    for (unsigned i = 0; i < g_threads; i++) {
+        const Stats* s = &g_workers[i].stats;
+        total.lines += s->lines;
+        total.words += s->words;
+        for (int k = 0; k < 4; k++) total.kinds[k] += s->kinds[k];
+        total.keystrokes += s->keystrokes;
+        total.untypeable += s->untypeable;
+        for (int o = 0; o < 2; o++) {
+            free(g_workers[i].out[o].text.data);
+            free(g_workers[i].out[o].labels.data);
+            free(g_workers[i].out[o].trace.data);
+        }
+    }
+    fprintf(stderr, "%llu lines, %llu words: %llu word, %llu phrase, %llu case, %llu typo; %llu keystrokes, %llu characters on neither layout\n",
+            (unsigned long long)total.lines, (unsigned long long)total.words, (unsigned long long)total.kinds[0],
+            (unsigned long long)total.kinds[1], (unsigned long long)total.kinds[2], (unsigned long long)total.kinds[3],
+            (unsigned long long)total.keystrokes, (unsigned long long)total.untypeable);
+    fprintf(stderr, "%.1f MB in, %.1f MB out in %.2f s: %.1f MB/s in with %u threads\n", (double)bytesIn / 1e6,
+            (double)bytesOut / 1e6, seconds, (double)bytesIn / 1e6 / seconds, g_threads);
+
+    if (in != stdin) fclose(in);
+    if (text && text != stdout && fclose(text) != 0) ok = false;
+    if (labels && labels != stdout && fclose(labels) != 0) ok = false;
+    if (trace && trace != stdout && fclose(trace) != 0) ok = false;
+    if (text == stdout || labels == stdout || trace == stdout) ok &= fflush(stdout) == 0;
+    free(batches[0].data);
+    free(batches[1].data);
+    free(carry.data);
+    if (!ok) fprintf(stderr, "write error\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,638 @@
+// Derives the bigram lists of the scorers from text instead of picking them by hand.
+//
+//   diswitcher-train [--threads N] [--top N] [--bad N] [--min-expected N] [--config diswitcher.conf]
+//                    [--out trained.conf] [--source bigrams.inc] [--matrix] [corpus.txt...]
+//
+// Reads UTF-8 text (files, or standard input when none are given or one is "-", so a dump can be
+// piped in from a decompressor) and counts, per language, each letter's successor inside words of
+// one script: another letter, or the end of the word. Letters are folded to lowercase; anything that
+// is not a Latin or basic Cyrillic letter ends a word.
+//
+// The result is a diswitcher.conf fragment, loadable with --config by the engine and the tools:
+//   bigrams.en / bigrams.ru  the --top (default 32) most frequent letter pairs of each language;
+//   bigrams.ru_bad           up to --bad (default 16) pairs that Russian avoids. These are pairs at
+//                            the lowest level below, seen at least --min-expected times less often
+//                            than chance predicts. Ranked by how often the same two keys make an
+//                            English pair, since English typed on the Russian layout is what they
+//                            are meant to catch.
+// --source writes the same lists as C arrays in the form of the built-in tables in src/model.c.
+//
+// Smoothing and quantization: a successor's probability is interpolated with its overall
+// frequency (Witten-Bell: a letter followed by many different letters in the corpus leaves more
+// room for unseen ones). Its ratio to the overall frequency is quantized to one of 16 levels in
+// half-bit steps, with level 8 as chance; --matrix prints the levels.
+//
+// Scaling: files are memory-mapped, and standard input is read into a small pool of buffers. The
+// input is cut into blocks of BLOCK_BYTES at a byte that cannot be inside a word, and queued to
+// the workers. Each worker counts into its own table. The alphabets are fixed, so the table is a
+// dense array of pair counters rather than a hash table: one increment per letter, and nothing
+// is shared until the tables are summed at the end. Counting is addition, so the result does not
+// depend on the number of threads or on where the blocks were cut.
+
+#define _GNU_SOURCE
+#include <locale.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "layoutmem.h"
+#include "model.h"
+#include "snapshot.h"
+#include "toolutil.h"
+
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define SYMBOLS 34                // 0 = end of word, then a..z (EN) or а..я and ё (RU)
+#define BLOCK_BYTES (4u << 20)    // unit of work; standard input is read in buffers of this size
+#define MAX_FILES 64
+#define LEVELS 16
+#define CHANCE_LEVEL 8
+
+static const int kLetters[2] = { 33, 26 }; // DsLang: RU, EN
+
+typedef struct {
+    uint64_t pairs[2][SYMBOLS][SYMBOLS]; // [lang][letter][successor or 0]
+    uint64_t words[2];
+} Counts;
+
+typedef struct {
+    const uint8_t* data;
+    size_t len;
+    uint8_t* buffer; // returned to the pool when counted; NULL for mapped files
+} Block;
+
+// Bounded queue of blocks from the reader (the main thread) to the workers, and the pool of read
+// buffers going back.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready; // a block was queued, or the input ended
+    pthread_cond_t room;  // a block was taken, or a buffer came back
+    Block* ring;
+    size_t cap;
+    size_t head;
+    size_t count;
+    uint8_t** free_buffers;
+    size_t free_count;
+    bool done;
+} Queue;
+
+typedef struct {
+    DS_ALIGN(DS_CACHE_LINE) pthread_t thread;
+    Queue* queue;
+    Counts counts;
+    uint64_t blocks;
+} Worker;
+
+// ASCII byte -> EN symbol 1..26, 0 for anything else.
+static uint8_t g_ascii[128];
+
+static void InitSymbols(void)
+{
+    for (int c = 'a'; c <= 'z'; c++) {
+        g_ascii[c] = (uint8_t)(c - 'a' + 1);
+        g_ascii[c - 'a' + 'A'] = (uint8_t)(c - 'a' + 1);
+    }
+}
+
+// Code point of a two-byte sequence -> RU symbol 1..32 (а..я) or 33 (ё), 0 for anything else.
+static int CyrillicSymbol(unsigned cp)
+{
+    if (cp >= 0x0430 && cp <= 0x044F) return (int)(cp - 0x0430 + 1);
+    if (cp >= 0x0410 && cp <= 0x042F) return (int)(cp - 0x0410 + 1);
+    if (cp == 0x0451 || cp == 0x0401) return 33;
+    return 0;
+}
+
+static wchar_t SymbolChar(int lang, int sym)
+{
+    if (lang == DS_LANG_EN) return (wchar_t)(L'a' + sym - 1);
+    return sym == 33 ? (wchar_t)0x0451 : (wchar_t)(0x0430 + sym - 1);
+}
+
+static int CharSymbol(wchar_t ch, int* lang)
+{
+    if (ch >= L'a' && ch <= L'z') { *lang = DS_LANG_EN; return ch - L'a' + 1; }
+    *lang = DS_LANG_RU;
+    return CyrillicSymbol((unsigned)ch);
+}
+
+// True for bytes a block may be cut after: ASCII that is not a letter.
+static bool IsCutByte(uint8_t b)
+{
+    return b < 0x80 && !g_ascii[b];
+}
+
+static void CountBlock(Counts* c, const uint8_t* p, size_t n)
+{
+    const uint8_t* end = p + n;
+    int lang = -1, prev = 0;
+    while (p < end) {
+        const uint8_t b = *p;
+        int sym = 0, l = DS_LANG_EN;
+        if (b < 0x80) {
+            sym = g_ascii[b];
+            p++;
+        } else if ((b == 0xD0 || b == 0xD1) && p + 1 < end && (p[1] & 0xC0) == 0x80) {
+            sym = CyrillicSymbol(((unsigned)(b & 0x1F) << 6) | (p[1] & 0x3Fu));
+            l = DS_LANG_RU;
+            p += 2;
+        } else {
+            for (p++; p < end && (*p & 0xC0) == 0x80; p++) {}
+        }
+        if (!sym || l != lang) {
+            if (lang >= 0) c->pairs[lang][prev][0]++;
+            lang = -1;
+            if (!sym) continue;
+        }
+        if (lang < 0) {
+            lang = l;
+            prev = 0;
+            c->words[l]++;
+        }
+        c->pairs[lang][prev][sym]++;
+        prev = sym;
+    }
+    if (lang >= 0) c->pairs[lang][prev][0]++;
+}
+
+static void ReturnBuffer(Queue* q, uint8_t* buffer)
+{
+    pthread_mutex_lock(&q->lock);
+    q->free_buffers[q->free_count++] = buffer;
+    pthread_cond_signal(&q->room);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void* WorkerMain(void* arg)
+{
+    Worker* w = (Worker*)arg;
+    Queue* q = w->queue;
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        while (!q->count && !q->done) pthread_cond_wait(&q->ready, &q->lock);
+        if (!q->count) {
+            pthread_mutex_unlock(&q->lock);
+            return NULL;
+        }
+        const Block block = q->ring[q->head];
+        q->head = (q->head + 1) % q->cap;
+        q->count--;
+        pthread_cond_signal(&q->room);
+        pthread_mutex_unlock(&q->lock);
+
+        CountBlock(&w->counts, block.data, block.len);
+        w->blocks++;
+
+        if (block.buffer) ReturnBuffer(q, block.buffer);
+    }
+}
+
+static void Push(Queue* q, const uint8_t* data, size_t len, uint8_t* buffer)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->cap) pthread_cond_wait(&q->room, &q->lock);
+    q->ring[(q->head + q->count) % q->cap] = (Block){ data, len, buffer };
+    q->count++;
+    pthread_cond_signal(&q->ready);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static uint8_t* TakeBuffer(Queue* q)
+{
+    pthread_mutex_lock(&q->lock);
+    while (!q->free_count) pthread_cond_wait(&q->room, &q->lock);
+    uint8_t* b = q->free_buffers[--q->free_count];
+    pthread_mutex_unlock(&q->lock);
+    return b;
+}
+
+// Length of the longest prefix of `data` that ends after a cut byte; all of it if there is none (a
+// word split there is counted as two, once in a few megabytes of letters).
+static size_t CutLength(const uint8_t* data, size_t len)
+{
+    for (size_t i = len; i > 0; i--) {
+        if (IsCutByte(data[i - 1])) return i;
+    }
+    return len;
+}
+
+static void QueueMapped(Queue* q, const uint8_t* data, size_t size)
+{
+    while (size) {
+        const size_t len = size <= BLOCK_BYTES ? size : CutLength(data, BLOCK_BYTES);
+        Push(q, data, len, NULL);
+        data += len;
+        size -= len;
+    }
+}
+
+// Reads a stream block by block; the partial word at the end of each block opens the next one.
+static uint64_t QueueStream(Queue* q, FILE* f, const char* name, uint8_t* carry)
+{
+    size_t carryLen = 0;
+    uint64_t bytes = 0;
+    for (;;) {
+        uint8_t* buffer = TakeBuffer(q);
+        memcpy(buffer, carry, carryLen);
+        const size_t got = fread(buffer + carryLen, 1, BLOCK_BYTES - carryLen, f);
+        bytes += got;
+        const size_t len = carryLen + got;
+        const bool eof = got < BLOCK_BYTES - carryLen;
+        const size_t cut = eof ? len : CutLength(buffer, len);
+        carryLen = len - cut;
+        memcpy(carry, buffer + cut, carryLen);
+        if (cut) Push(q, buffer, cut, buffer);
+        else ReturnBuffer(q, buffer);
+        if (eof) break;
+    }
+    if (ferror(f)) perror(name);
+    return bytes;
+}
+
+// ---------- Smoothing, quantization and selection ----------
+
+typedef struct {
+    double successor[SYMBOLS]; // P(b): how often b (or the end of a word) follows any letter
+    double letter[SYMBOLS];    // P(a) among letters
+    double cond[SYMBOLS][SYMBOLS]; // P(b | a), smoothed
+    uint64_t context[SYMBOLS]; // occurrences of a
+    uint8_t level[SYMBOLS][SYMBOLS];
+    uint64_t letters;
+} LangModel;
+
+// Level of a probability ratio in half-bit steps around chance, rounded to the nearest step.
+static uint8_t Quantize(double ratio)
+{
+    const double step = 1.4142135623730951, half = 1.189207115002721; // 2^(1/2), 2^(1/4)
+    int level = CHANCE_LEVEL;
+    for (double up = half; level < LEVELS - 1 && ratio >= up; up *= step) level++;
+    for (double down = 1.0 / half; level > 0 && ratio < down; down /= step) level--;
+    return (uint8_t)level;
+}
+
+static void Smooth(const Counts* c, int lang, LangModel* m)
+{
+    memset(m, 0, sizeof(*m));
+    const int n = kLetters[lang];
+    uint64_t successors[SYMBOLS] = {0};
+    uint64_t total = 0;
+    for (int a = 1; a <= n; a++) {
+        for (int b = 0; b <= n; b++) {
+            m->context[a] += c->pairs[lang][a][b];
+            successors[b] += c->pairs[lang][a][b];
+        }
+        total += m->context[a];
+    }
+    m->letters = total;
+    // Add-one on the overall frequency, so no successor is impossible.
+    for (int b = 0; b <= n; b++) m->successor[b] = (double)(successors[b] + 1) / (double)(total + (uint64_t)n + 1);
+    for (int a = 1; a <= n; a++) {
+        m->letter[a] = total ? (double)m->context[a] / (double)total : 0.0;
+        int types = 0;
+        for (int b = 0; b <= n; b++) types += c->pairs[lang][a][b] != 0;
+        for (int b = 0; b <= n; b++) {
+            const double seen = (double)c->pairs[lang][a][b];
+            m->cond[a][b] = m->context[a] ? (seen + types * m->successor[b]) / (double)(m->context[a] + (uint64_t)types)
+                                          : m->successor[b];
+            m->level[a][b] = Quantize(m->cond[a][b] / m->successor[b]);
+        }
+    }
+}
+
+typedef struct {
+    wchar_t first;
+    wchar_t second;
+    double rank;
+} Candidate;
+
+static int ByRank(const void* x, const void* y)
+{
+    const Candidate* a = (const Candidate*)x;
+    const Candidate* b = (const Candidate*)y;
+    if (a->rank != b->rank) return a->rank > b->rank ? -1 : 1;
+    if (a->first != b->first) return a->first < b->first ? -1 : 1;
+    return a->second < b->second ? -1 : a->second > b->second;
+}
+
+static size_t FrequentPairs(const LangModel* m, int lang, Candidate* out, size_t top)
+{
+    const int n = kLetters[lang];
+    size_t count = 0;
+    for (int a = 1; a <= n; a++) {
+        for (int b = 1; b <= n; b++) {
+            out[count++] = (Candidate){ SymbolChar(lang, a), SymbolChar(lang, b), m->letter[a] * m->cond[a][b] };
+        }
+    }
+    qsort(out, count, sizeof(*out), ByRank);
+    while (count && out[count - 1].rank == 0.0) count--;
+    return count < top ? count : top;
+}
+
+// Russian pairs at level 0 with enough evidence, ranked by the English pair on the same keys.
+static size_t AvoidedPairs(const LangModel* ru, const LangModel* en, const DsModel* model, double minExpected,
+                           Candidate* out, size_t top)
+{
+    const int n = kLetters[DS_LANG_RU];
+    size_t count = 0;
+    for (int a = 1; a <= n; a++) {
+        for (int b = 1; b <= n; b++) {
+            if (ru->level[a][b] != 0 || (double)ru->context[a] * ru->successor[b] < minExpected) continue;
+            const wchar_t ru2[3] = { SymbolChar(DS_LANG_RU, a), SymbolChar(DS_LANG_RU, b) };
+            wchar_t en2[3];
+            DsModelMap(model, true, ru2, en2, ARRAYSIZE(en2));
+            int la, lb;
+            const int sa = CharSymbol(en2[0], &la), sb = CharSymbol(en2[1], &lb);
+            const bool english = sa && sb && la == DS_LANG_EN && lb == DS_LANG_EN;
+            // Pairs whose keys make no English pair still count, behind all that do.
+            const double rank = english ? 1.0 + en->letter[sa] * en->cond[sa][sb] : ru->context[a] * ru->successor[b] / (double)ru->letters;
+            out[count++] = (Candidate){ ru2[0], ru2[1], rank };
+        }
+    }
+    qsort(out, count, sizeof(*out), ByRank);
+    return count < top ? count : top;
+}
+
+// ---------- Output ----------
+
+static void PutChar(FILE* f, wchar_t ch)
+{
+    char buf[4];
+    if (ch < 0x80) {
+        fputc((int)ch, f);
+        return;
+    }
+    buf[0] = (char)(0xC0 | (ch >> 6));
+    buf[1] = (char)(0x80 | (ch & 0x3F));
+    fwrite(buf, 1, 2, f);
+}
+
+// An empty list would replace the built-in one with nothing, so it is left out.
+static void WriteConfigList(FILE* f, const char* key, const Candidate* pairs, size_t count)
+{
+    if (!count) {
+        fprintf(f, "# %s: not enough text\n", key);
+        return;
+    }
+    fprintf(f, "%s =", key);
+    for (size_t i = 0; i < count; i++) {
+        fputc(' ', f);
+        PutChar(f, pairs[i].first);
+        PutChar(f, pairs[i].second);
+    }
+    fputc('\n', f);
+}
+
+static void WriteSourceList(FILE* f, const char* name, const Candidate* pairs, size_t count)
+{
+    fprintf(f, "static const wchar_t* const %s[] = {", name);
+    for (size_t i = 0; i < count; i++) {
+        fputs(i % 10 ? " " : "\n    ", f);
+        if (pairs[i].first < 0x80) fprintf(f, "L\"%c%c\",", (char)pairs[i].first, (char)pairs[i].second);
+        else fprintf(f, "L\"\\u%04x\\u%04x\",", (unsigned)pairs[i].first, (unsigned)pairs[i].second);
+    }
+    fputs("\n};\n\n", f);
+}
+
+static void PrintMatrix(const LangModel* m, int lang)
+{
+    const int n = kLetters[lang];
+    fprintf(stderr, "\n%s levels (row: letter, column: next letter, $: end of word; %d = chance):\n   ",
+            lang == DS_LANG_EN ? "EN" : "RU", CHANCE_LEVEL);
+    for (int b = 1; b <= n; b++) {
+        fputc(' ', stderr);
+        PutChar(stderr, SymbolChar(lang, b));
+    }
+    fputs(" $\n", stderr);
+    for (int a = 1; a <= n; a++) {
+        PutChar(stderr, SymbolChar(lang, a));
+        fputs("  ", stderr);
+        for (int b = 1; b <= n; b++) fprintf(stderr, " %x", m->level[a][b]);
+        fprintf(stderr, " %x\n", m->level[a][0]);
+    }
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: diswitcher-train [--threads N] [--top N] [--bad N] [--min-expected N] [--config diswitcher.conf]\n"
+                    "                        [--out trained.conf] [--source bigrams.inc] [--matrix] [corpus.txt...]\n");
+}
+
+int main(int argc, char** argv)
+{
+    setlocale(LC_ALL, "C.UTF-8");
+
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned threads = cores > 0 ? (unsigned)cores : 1;
+    size_t top = 32, bad = 16;
+    double minExpected = 100.0;
+    const char* configPath = NULL;
+    const char* outPath = NULL;
+    const char* sourcePath = NULL;
+    bool matrix = false;
+    const char* paths[MAX_FILES];
+    size_t fileCount = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) top = (size_t)atol(argv[++i]);
+        else if (strcmp(argv[i], "--bad") == 0 && i + 1 < argc) bad = (size_t)atol(argv[++i]);
+        else if (strcmp(argv[i], "--min-expected") == 0 && i + 1 < argc) minExpected = atof(argv[++i]);
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) configPath = argv[++i];
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) outPath = argv[++i];
+        else if (strcmp(argv[i], "--source") == 0 && i + 1 < argc) sourcePath = argv[++i];
+        else if (strcmp(argv[i], "--matrix") == 0) matrix = true;
+        else if ((argv[i][0] == '-' && argv[i][1]) || fileCount == MAX_FILES) { Usage(); return 2; }
+        else paths[fileCount++] = argv[i];
+    }
+    if (threads == 0 || top > DS_MODEL_MAX_BIGRAMS || bad > DS_MODEL_MAX_BIGRAMS) {
+        Usage();
+        return 2;
+    }
+    if (!fileCount) paths[fileCount++] = "-";
+
+    // The key map (for ranking avoided pairs) comes from the built-in model or --config.
+    DsModel* model = DsModelCreate();
+    if (!model) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    if (configPath) {
+        DsMappedFile configFile;
+        if (DsMapFile(configPath, &configFile) != 0) {
+            perror(configPath);
+            return 1;
+        }
+        DsConfigError err;
+        const bool ok = DsConfigApply(model, (const char*)configFile.data, configFile.size, &err);
+        DsUnmapFile(&configFile);
+        if (!ok) {
+            fprintf(stderr, "%s:%zu: %s\n", configPath, err.line, err.message);
+            return 1;
+        }
+    }
+    InitSymbols();
+
+    // Enough blocks in flight to keep every worker busy while the reader fills the next one.
+    Queue queue = {0};
+    queue.cap = (size_t)threads * 2;
+    queue.ring = (Block*)calloc(queue.cap, sizeof(Block));
+    const size_t buffers = queue.cap + threads + 1;
+    uint8_t* carry = NULL;
+    queue.free_buffers = (uint8_t**)calloc(buffers, sizeof(uint8_t*));
+    Worker* workers = (Worker*)aligned_alloc(DS_CACHE_LINE, threads * sizeof(Worker));
+    if (!queue.ring || !queue.free_buffers || !workers) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.ready, NULL);
+    pthread_cond_init(&queue.room, NULL);
+    memset(workers, 0, threads * sizeof(Worker));
+
+    const uint64_t t0 = DsMonotonicNs();
+    for (unsigned i = 0; i < threads; i++) {
+        workers[i].queue = &queue;
+        pthread_create(&workers[i].thread, NULL, WorkerMain, &workers[i]);
+    }
+
+    DsMappedFile files[MAX_FILES];
+    size_t mapped = 0;
+    uint64_t bytes = 0;
+    bool failed = false;
+    for (size_t f = 0; f < fileCount; f++) {
+        struct stat st;
+        const bool isStdin = strcmp(paths[f], "-") == 0;
+        if (!isStdin && stat(paths[f], &st) == 0 && S_ISREG(st.st_mode)) {
+            if (DsMapFile(paths[f], &files[mapped]) != 0) {
+                perror(paths[f]);
+                failed = true;
+                break;
+            }
+            QueueMapped(&queue, files[mapped].data, files[mapped].size);
+            bytes += files[mapped].size;
+            mapped++;
+            continue;
+        }
+        FILE* in = isStdin ? stdin : fopen(paths[f], "rb");
+        if (!in) {
+            perror(paths[f]);
+            failed = true;
+            break;
+        }
+        // Buffers come with the first stream: one per queued block, per worker, and one being read.
+        if (!carry) {
+            carry = (uint8_t*)malloc(BLOCK_BYTES);
+            for (size_t b = 0; carry && b < buffers; b++) {
+                uint8_t* buffer = (uint8_t*)malloc(BLOCK_BYTES);
+                if (!buffer) break;
+                ReturnBuffer(&queue, buffer);
+            }
+            if (!carry || queue.free_count < buffers) {
+                fprintf(stderr, "out of memory\n");
+                failed = true;
+                break;
+            }
+        }
+        bytes += QueueStream(&queue, in, isStdin ? "stdin" : paths[f], carry);
+        if (!isStdin) fclose(in);
+    }
+
+    pthread_mutex_lock(&queue.lock);
+    queue.done = true;
+    pthread_cond_broadcast(&queue.ready);
+    pthread_mutex_unlock(&queue.lock);
+
+    Counts* total = (Counts*)calloc(1, sizeof(Counts));
+    uint64_t minBlocks = UINT64_MAX, maxBlocks = 0;
+    for (unsigned i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        const Counts* c = &workers[i].counts;
+        if (total) {
+            for (int l = 0; l < 2; l++) {
+                total->words[l] += c->words[l];
+                for (int a = 0; a < SYMBOLS; a++) {
+                    for (int b = 0; b < SYMBOLS; b++) total->pairs[l][a][b] += c->pairs[l][a][b];
+                }
+            }
+        }
+        if (workers[i].blocks < minBlocks) minBlocks = workers[i].blocks;
+        if (workers[i].blocks > maxBlocks) maxBlocks = workers[i].blocks;
+    }
+    const double seconds = (double)(DsMonotonicNs() - t0) / 1e9;
+    if (!total) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    if (failed) return 1;
+
+    LangModel* langs = (LangModel*)calloc(2, sizeof(LangModel));
+    Candidate* en = (Candidate*)calloc(SYMBOLS * SYMBOLS, sizeof(Candidate));
+    Candidate* ru = (Candidate*)calloc(SYMBOLS * SYMBOLS, sizeof(Candidate));
+    Candidate* avoided = (Candidate*)calloc(SYMBOLS * SYMBOLS, sizeof(Candidate));
+    if (!langs || !en || !ru || !avoided) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    Smooth(total, DS_LANG_EN, &langs[DS_LANG_EN]);
+    Smooth(total, DS_LANG_RU, &langs[DS_LANG_RU]);
+    const size_t enCount = FrequentPairs(&langs[DS_LANG_EN], DS_LANG_EN, en, top);
+    const size_t ruCount = FrequentPairs(&langs[DS_LANG_RU], DS_LANG_RU, ru, top);
+    const size_t badCount = AvoidedPairs(&langs[DS_LANG_RU], &langs[DS_LANG_EN], model, minExpected, avoided, bad);
+
+    FILE* out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out) {
+        perror(outPath);
+        return 1;
+    }
+    fprintf(out, "# diswitcher-train: %.1f MB, %llu EN and %llu RU words\n", (double)bytes / 1e6,
+            (unsigned long long)total->words[DS_LANG_EN], (unsigned long long)total->words[DS_LANG_RU]);
+    WriteConfigList(out, "bigrams.en", en, enCount);
+    WriteConfigList(out, "bigrams.ru", ru, ruCount);
+    WriteConfigList(out, "bigrams.ru_bad", avoided, badCount);
+    if (outPath && fclose(out) != 0) {
+        perror(outPath);
+        return 1;
+    }
+    if (sourcePath) {
+        FILE* src = fopen(sourcePath, "w");
+        if (!src) {
+            perror(sourcePath);
+            return 1;
+        }
+        fprintf(src, "// Generated by diswitcher-train from %.1f MB of text; replaces the tables of the same name in src/model.c.\n\n",
+                (double)bytes / 1e6);
+        WriteSourceList(src, "kBigramsEn", en, enCount);
+        WriteSourceList(src, "kBigramsRu", ru, ruCount);
+        WriteSourceList(src, "kBadBigramsRu", avoided, badCount);
+        if (fclose(src) != 0) {
+            perror(sourcePath);
+            return 1;
+        }
+    }
+
+    fprintf(stderr, "%.1f MB in %.2f s: %.1f MB/s with %u threads; %llu EN and %llu RU words; blocks per thread %llu..%llu\n",
+            (double)bytes / 1e6, seconds, (double)bytes / 1e6 / seconds, threads,
+            (unsigned long long)total->words[DS_LANG_EN], (unsigned long long)total->words[DS_LANG_RU],
+            (unsigned long long)minBlocks, (unsigned long long)maxBlocks);
+    if (matrix) {
+        PrintMatrix(&langs[DS_LANG_EN], DS_LANG_EN);
+        PrintMatrix(&langs[DS_LANG_RU], DS_LANG_RU);
+    }
+
+    for (size_t f = 0; f < mapped; f++) DsUnmapFile(&files[f]);
+    for (size_t i = 0; i < queue.free_count; i++) free(queue.free_buffers[i]);
+    free(queue.free_buffers);
+    free(carry);
+    free(queue.ring);
+    free(workers);
+    free(total);
+    free(langs);
+    free(en);
+    free(ru);
+    free(avoided);
+    DsModelFree(model);
+    return 0;
+}
@@ -0,0 +1,217 @@
+// Deterministic simulation of the type-ahead stage (src/typeahead.h) against injection delay.
+//
+//   diswitcher-typeahead-sim [--cps N] [--jitter F] [--inject-ms X] [--event-us X] [--cap-ms X] [--morph ru.dsmf] trace.dskt
+//
+// Runs a keystroke capture in virtual time through the engine and the model of the Windows input
+// path in tools/hooksim.h: the events of a SendInput call reach the hook only `--inject-ms` later,
+// plus `--event-us` per event, while real keys keep arriving on their own schedule, and every event
+// the hook lets through is applied to a text buffer standing in for the focused application, so a
+// key that slips in ahead of a correction's backspaces gets erased exactly as it would on the
+// desktop.
+//
+// The trace is rescaled to each typing speed (keys per second, default sweep 10 15 20 30 40), with
+// every gap between events stretched or squeezed by up to --jitter (default 0.6) from a fixed seed
+// so that bursts like "space, next letter" occur as they do in real typing, and then
+// run three times: an ideal pass where injection is instantaneous, then the delayed pass without
+// and with type-ahead. Reported per speed: real key presses that reached the application while a
+// correction was still in flight, whether the final text matches the ideal pass, queue depth, the
+// longest stay in the queue (bounded by --cap-ms) and the delay of held keys from the physical
+// press to the application. Exits with status 1 if type-ahead leaves any interleaving or text
+// difference, exceeds the cap, or lets a key-up reach the application without its press, at 15
+// keys/s or more.
+
+#define _POSIX_C_SOURCE 200809L
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "hooksim.h"
+#include "keymap.h"
+#include "keytrace.h"
+#include "toolutil.h"
+#include "typeahead.h"
+
+typedef struct {
+    uint64_t inject_ns; // SendInput to first event at the hook
+    uint64_t event_ns;  // per further event
+    bool typeahead;
+} SimParams;
+
+typedef struct {
+    DsHookSim hook;
+    uint64_t* delay_ns; // held keys: arrival to delivery
+    size_t delay_count;
+    size_t delay_cap;
+} Sim;
+
+static void ReplayPassed(void* ctx, const DsHookSim* hook, uint64_t delayNs)
+{
+    (void)hook;
+    Sim* s = (Sim*)ctx;
+    s->delay_ns = (uint64_t*)DsGrow(s->delay_ns, &s->delay_cap, s->delay_count + 1, sizeof(uint64_t));
+    s->delay_ns[s->delay_count++] = delayNs;
+}
+
+static void Run(const DsTraceEvent* events, size_t count, double scale, uint64_t capNs, const SimParams* params,
+                Sim* s)
+{
+    memset(s, 0, sizeof(*s));
+    const DsHookSimObserver observer = { s, NULL, NULL, ReplayPassed };
+    DsHookSim* h = &s->hook;
+    DsHookSimInit(h, capNs, params->typeahead, &observer);
+    h->inject_ns = params->inject_ns;
+    h->event_ns = params->event_ns;
+
+    // Merge the trace with injected input and the timer, in time order. At equal times injected
+    // input goes first, then the timer, then the trace: the ideal pass thus applies a correction
+    // before anything typed after it.
+    for (size_t next = 0; next < count; next++) {
+        const DsTraceEvent* ev = &events[next];
+        const uint64_t at = (uint64_t)((double)ev->time_ms * 1e6 * scale);
+        while (DsHookSimAdvance(h, at)) {}
+        if (at > h->now) h->now = at;
+        // Engine-initiated layout switches are re-created by the engine under test.
+        if (ev->type == DS_TRACE_FOCUS) DsHookSimInput(h, DS_HOOKSIM_VK_FOCUS, ev->value, true);
+        else if (ev->type == DS_TRACE_LAYOUT && !(ev->flags & DS_TRACE_F_ENGINE)) {
+            DsHookSimInput(h, DS_HOOKSIM_VK_LAYOUT, (uint32_t)DsLayoutFromId(ev->value), true);
+        } else if (ev->type == DS_TRACE_KEYDOWN || ev->type == DS_TRACE_KEYUP) {
+            DsHookSimInput(h, ev->vk, ev->scan, ev->type == DS_TRACE_KEYDOWN);
+        }
+    }
+    while (DsHookSimAdvance(h, UINT64_MAX)) {}
+}
+
+static void FreeSim(Sim* s)
+{
+    DsHookSimFree(&s->hook);
+    free(s->delay_ns);
+}
+
+static bool SameText(const Sim* a, const Sim* b)
+{
+    return a->hook.len == b->hook.len && memcmp(a->hook.text, b->hook.text, a->hook.len * sizeof(wchar_t)) == 0;
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: diswitcher-typeahead-sim [--cps N] [--jitter F] [--inject-ms X] [--event-us X] [--cap-ms X] [--morph ru.dsmf] trace.dskt\n");
+}
+
+int main(int argc, char** argv)
+{
+    setlocale(LC_ALL, "C.UTF-8");
+
+    double speeds[8] = { 10, 15, 20, 30, 40 };
+    size_t speedCount = 5;
+    double jitter = 0.6, injectMs = 40.0, eventUs = 40.0, capMs = DS_TYPEAHEAD_DEFAULT_CAP_MS;
+    const char* path = NULL;
+    const char* morphPath = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--cps") == 0 && i + 1 < argc) {
+            speeds[0] = atof(argv[++i]);
+            speedCount = 1;
+        } else if (strcmp(argv[i], "--jitter") == 0 && i + 1 < argc) jitter = atof(argv[++i]);
+        else if (strcmp(argv[i], "--inject-ms") == 0 && i + 1 < argc) injectMs = atof(argv[++i]);
+        else if (strcmp(argv[i], "--event-us") == 0 && i + 1 < argc) eventUs = atof(argv[++i]);
+        else if (strcmp(argv[i], "--cap-ms") == 0 && i + 1 < argc) capMs = atof(argv[++i]);
+        else if (strcmp(argv[i], "--morph") == 0 && i + 1 < argc) morphPath = argv[++i];
+        else if (argv[i][0] == '-') { Usage(); return 2; }
+        else path = argv[i];
+    }
+    if (!path || speeds[0] <= 0 || jitter < 0 || jitter >= 1 || injectMs < 0 || eventUs < 0 || capMs <= 0) {
+        Usage();
+        return 2;
+    }
+
+    DsMappedFile morphFile = {0};
+    DsMorph morph;
+    if (!DsToolLoadModel(morphPath, NULL, &morphFile, &morph)) return 1;
+
+    DsMappedFile file;
+    if (DsMapFile(path, &file) != 0) {
+        perror(path);
+        return 1;
+    }
+    DsTraceReader reader;
+    if (!DsTraceReaderInit(&reader, file.data, file.size)) {
+        fprintf(stderr, "not a diswitcher trace (bad magic or version)\n");
+        return 1;
+    }
+    DsTraceEvent* events = NULL;
+    size_t count = 0, cap = 0, keydowns = 0;
+    DsTraceEvent ev;
+    int rc;
+    while ((rc = DsTraceReadNext(&reader, &ev)) == 1) {
+        events = (DsTraceEvent*)DsGrow(events, &cap, count + 1, sizeof(DsTraceEvent));
+        events[count++] = ev;
+        if (ev.type == DS_TRACE_KEYDOWN) keydowns++;
+    }
+    if (rc < 0) fprintf(stderr, "warning: trace truncated or corrupt after %zu events\n", count);
+    if (!keydowns || events[count - 1].time_ms <= events[0].time_ms) {
+        fprintf(stderr, "trace has no timed key presses\n");
+        return 1;
+    }
+    const double traceCps = (double)keydowns * 1000.0 / (double)(events[count - 1].time_ms - events[0].time_ms);
+    const uint64_t capNs = (uint64_t)(capMs * 1e6);
+
+    // Jitter is applied once, in trace milliseconds, so every pass and speed sees the same rhythm.
+    uint64_t seed = 0x9E3779B97F4A7C15ull, prev = events[0].time_ms, at = events[0].time_ms;
+    for (size_t i = 1; i < count; i++) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        const double f = 1.0 + jitter * ((double)(seed >> 11) / (double)(1ull << 53) * 2.0 - 1.0);
+        const uint64_t gap = events[i].time_ms - prev;
+        prev = events[i].time_ms;
+        at += (uint64_t)((double)gap * f + 0.5);
+        events[i].time_ms = at;
+    }
+
+    printf("trace: %zu events, %zu key presses at %.1f keys/s; jitter %.0f%%, injection %.1f ms + %.0f us/event, cap %.0f ms\n",
+           count, keydowns, traceCps, jitter * 100.0, injectMs, eventUs, capMs);
+    printf("%6s  %5s  %8s  %9s  %7s  %7s  %5s  %5s  %8s  %9s  %9s  %6s  %4s\n", "keys/s", "corr", "off:intl",
+           "off:text", "on:intl", "on:text", "held", "depth", "max hold", "delay p50", "delay p99", "capped", "lost");
+
+    int status = 0;
+    const SimParams ideal = { 0, 0, false };
+    const SimParams off = { (uint64_t)(injectMs * 1e6), (uint64_t)(eventUs * 1e3), false };
+    const SimParams on = { off.inject_ns, off.event_ns, true };
+    for (size_t i = 0; i < speedCount; i++) {
+        const double scale = traceCps / speeds[i];
+        Sim ref, without, with;
+        Run(events, count, scale, capNs, &ideal, &ref);
+        Run(events, count, scale, capNs, &off, &without);
+        Run(events, count, scale, capNs, &on, &with);
+
+        const DsTypeaheadStats* ts = &with.hook.typeahead.stats;
+        const uint64_t p50 = DsPercentile(with.delay_ns, with.delay_count, 50);
+        const uint64_t p99 = DsPercentile(with.delay_ns, with.delay_count, 99);
+        const bool ok = SameText(&with, &ref) && with.hook.stats.interleaved == 0;
+        printf("%6.0f  %5llu  %8llu  %9s  %7llu  %7s  %5llu  %5llu  %5.1f ms  %6.1f ms  %6.1f ms  %6llu  %4llu\n",
+               speeds[i], (unsigned long long)ref.hook.stats.corrections, (unsigned long long)without.hook.stats.interleaved,
+               SameText(&without, &ref) ? "same" : "CORRUPTED", (unsigned long long)with.hook.stats.interleaved,
+               SameText(&with, &ref) ? "same" : "DIFF", (unsigned long long)ts->held,
+               (unsigned long long)ts->max_depth, (double)ts->max_hold_ns / 1e6, (double)p50 / 1e6,
+               (double)p99 / 1e6, (unsigned long long)ts->capped, (unsigned long long)ts->lost);
+        if (ts->max_hold_ns > capNs) {
+            printf("        latency cap exceeded: a key was held %.1f ms\n", (double)ts->max_hold_ns / 1e6);
+            if (speeds[i] >= 15) status = 1;
+        }
+        if (with.hook.stats.stray_up) {
+            printf("        %llu key-ups reached the application without their press\n",
+                   (unsigned long long)with.hook.stats.stray_up);
+            if (speeds[i] >= 15) status = 1;
+        }
+        if (!ok && speeds[i] >= 15) status = 1;
+        FreeSim(&ref);
+        FreeSim(&without);
+        FreeSim(&with);
+    }
+    printf("ordering: %s\n", status ? "FAILED" : "OK (no key reached the application ahead of a correction)");
+
+    free(events);
+    DsUnmapFile(&file);
+    DsEngineShutdown();
+    if (morphPath) DsUnmapFile(&morphFile);
+    return status;
+}
@@ -0,0 +1,666 @@
+// Local batch correction daemon: backends on the same host send batches of strings over a Unix
+// socket and get back wrong-layout corrections with confidence margins (wire format in
+// tools/batchproto.h).
+//
+//   diswitcherd [--socket PATH] [--workers N] [--window S] [--quiet] [--morph ru.dsmf]
+//               [--config diswitcher.conf]
+//
+// One thread runs an epoll loop over the listening socket and all connections: it reads frames,
+// hands CORRECT requests to a pool of workers and writes their replies back. Each worker owns an
+// engine session (DsSession), so the pool shares only the published model. A string is corrected
+// with DsSessionCorrectText, i.e. exactly as if it had been typed (phrases included) but without
+// injecting anything; its margin comes from the single-token decision (DsSessionCheckToken) of the
+// word closest to the threshold.
+//
+// A connection with CONN_MAX_PENDING requests in the pool, or with more than CONN_MAX_OUTPUT bytes
+// of replies it has not read, is not read from until that drains.
+//
+// Latency is measured from a request's last byte arriving to its reply being queued for writing.
+// Every --window seconds (default 1) the loop closes a statistics window: requests/s, strings/s and
+// p50/p99/max latency over it are printed (unless --quiet or idle) and served to STATS requests:
+//
+//   uptime_s= requests= strings= errors= connections= workers= window_s= rps= strings_per_s=
+//   p50_us= p99_us= max_us=
+//
+// SIGINT/SIGTERM stop the daemon and remove the socket.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <locale.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "batchproto.h"
+#include "engine.h"
+#include "snapshot.h"
+#include "toolutil.h"
+#include "utf8.h"
+
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define MAX_CONNECTIONS 1024
+#define CONN_MAX_PENDING 64
+#define CONN_MAX_OUTPUT (4u << 20)
+#define CONN_READ_CHUNK (64u << 10)
+#define LATENCY_SAMPLES 65536
+
+#define TAG_LISTEN ((uint64_t)MAX_CONNECTIONS + 0)
+#define TAG_DONE ((uint64_t)MAX_CONNECTIONS + 1)
+#define TAG_SIGNAL ((uint64_t)MAX_CONNECTIONS + 2)
+#define TAG_TIMER ((uint64_t)MAX_CONNECTIONS + 3)
+
+// ---------- Worker pool ----------
+
+typedef struct Job {
+    struct Job* next;
+    uint32_t conn; // connection slot
+    uint32_t gen;  // the slot's generation when the request arrived
+    uint64_t received_ns;
+    uint8_t* payload; // kind, id, body
+    size_t len;
+    DsBatchBuffer reply; // whole frame, filled in by the worker
+    uint32_t strings;
+    bool error;
+} Job;
+
+typedef struct {
+    Job* head;
+    Job* tail;
+} JobList;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    JobList queue; // to the workers
+    JobList done;  // back to the event loop
+    bool stop;
+    int done_fd;   // eventfd, signalled when `done` gets a job
+} Pool;
+
+typedef struct {
+    pthread_t thread;
+    Pool* pool;
+    DsSession* session;
+} Worker;
+
+static void JobListPush(JobList* l, Job* j)
+{
+    j->next = NULL;
+    if (l->tail) l->tail->next = j;
+    else l->head = j;
+    l->tail = j;
+}
+
+static Job* JobListPop(JobList* l)
+{
+    Job* j = l->head;
+    if (j) {
+        l->head = j->next;
+        if (!l->head) l->tail = NULL;
+    }
+    return j;
+}
+
+static void JobFree(Job* j)
+{
+    free(j->payload);
+    DsBatchBufferFree(&j->reply);
+    free(j);
+}
+
+static uint64_t Clock(void* ctx)
+{
+    (void)ctx;
+    return DsMonotonicNs();
+}
+
+static void PutError(DsBatchBuffer* b, uint32_t id, const char* message)
+{
+    const size_t frame = DsBatchBeginFrame(b, DS_BATCH_KIND_ERROR, id);
+    DsBatchPutString(b, message, strlen(message));
+    DsBatchEndFrame(b, frame);
+}
+
+static int Abs(int v)
+{
+    return v < 0 ? -v : v;
+}
+
+// Margin of the word whose single-token decision came closest to the threshold.
+static bool WeakestMargin(DsSession* s, const wchar_t* text, size_t n, int* margin)
+{
+    bool scored = false;
+    *margin = 0;
+    for (size_t i = 0; i < n;) {
+        if (!DsIsWordChar(text[i])) {
+            i++;
+            continue;
+        }
+        size_t end = i;
+        while (end < n && DsIsWordChar(text[end])) end++;
+        DsTokenVerdict v;
+        if (DsSessionCheckToken(s, text + i, end - i, &v) && (!scored || Abs(v.margin) < Abs(*margin))) {
+            *margin = v.margin;
+            scored = true;
+        }
+        i = end;
+    }
+    return scored;
+}
+
+static void ProcessCorrect(DsSession* s, Job* job, uint32_t id, DsBatchReader* r)
+{
+    const uint32_t count = DsBatchGet32(r);
+    if (!r->ok || count > DS_BATCH_MAX_STRINGS) {
+        PutError(&job->reply, id, "malformed CORRECT request");
+        job->error = true;
+        return;
+    }
+    const size_t frame = DsBatchBeginFrame(&job->reply, DS_BATCH_KIND_CORRECT, id);
+    DsBatchPut32(&job->reply, count);
+    for (uint32_t i = 0; i < count; i++) {
+        size_t n;
+        const char* utf8 = DsBatchGetString(r, &n);
+        if (!r->ok) break;
+        wchar_t text[DS_BATCH_MAX_STRING_BYTES + 1];
+        wchar_t corrected[DS_BATCH_MAX_STRING_BYTES + 2];
+        char out[4 * DS_BATCH_MAX_STRING_BYTES + 1];
+        const size_t len = DsUtf8ToWide(utf8, n, text, ARRAYSIZE(text));
+        const size_t fixes = DsSessionCorrectText(s, text, len, corrected, ARRAYSIZE(corrected));
+        int margin;
+        const bool scored = WeakestMargin(s, text, len, &margin);
+        if (margin > INT16_MAX) margin = INT16_MAX;
+        if (margin < INT16_MIN) margin = INT16_MIN;
+        // Latin to Cyrillic doubles the bytes, so a string near the limit can come back cut.
+        const size_t outLen = DsWideToUtf8(corrected, wcslen(corrected), out, sizeof(out));
+        const bool truncated = DsBatchFitString(out, outLen) < outLen;
+
+        DsBatchPut8(&job->reply, (uint8_t)((fixes ? DS_BATCH_CORRECTED : 0) | (scored ? DS_BATCH_SCORED : 0) |
+                                           (truncated ? DS_BATCH_TRUNCATED : 0)));
+        DsBatchPut8(&job->reply, 0);
+        DsBatchPut16(&job->reply, (uint16_t)(int16_t)margin);
+        DsBatchPutString(&job->reply, out, outLen);
+        if (job->reply.len - frame - 4 > DS_BATCH_MAX_FRAME) break;
+    }
+    if (!r->ok || job->reply.len - frame - 4 > DS_BATCH_MAX_FRAME) {
+        job->reply.len = frame;
+        PutError(&job->reply, id, r->ok ? "reply too large" : "malformed CORRECT request");
+        job->error = true;
+        return;
+    }
+    DsBatchEndFrame(&job->reply, frame);
+    job->strings = count;
+}
+
+static void* WorkerMain(void* arg)
+{
+    Worker* w = (Worker*)arg;
+    Pool* pool = w->pool;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->queue.head && !pool->stop) pthread_cond_wait(&pool->wake, &pool->lock);
+        Job* job = JobListPop(&pool->queue);
+        pthread_mutex_unlock(&pool->lock);
+        if (!job) return NULL;
+
+        DsBatchReader r;
+        DsBatchReaderInit(&r, job->payload, job->len);
+        DsBatchGet32(&r); // kind, always CORRECT here
+        const uint32_t id = DsBatchGet32(&r);
+        ProcessCorrect(w->session, job, id, &r);
+
+        pthread_mutex_lock(&pool->lock);
+        JobListPush(&pool->done, job);
+        pthread_mutex_unlock(&pool->lock);
+        const uint64_t one = 1;
+        if (write(pool->done_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) perror("eventfd");
+    }
+}
+
+// ---------- Connections ----------
+
+typedef struct {
+    int fd;         // -1: closed; the slot is free once `pending` is 0 as well
+    uint32_t gen;
+    bool eof;       // peer finished sending; closed once every reply is written
+    uint32_t pending;
+    uint32_t events; // currently registered with epoll
+    uint8_t* in;
+    size_t in_len;
+    size_t in_cap;
+    DsBatchBuffer out;
+    size_t out_off;
+} Conn;
+
+typedef struct {
+    uint64_t requests;
+    uint64_t strings;
+    uint64_t errors;
+    uint64_t samples[LATENCY_SAMPLES];
+    size_t sample_count;
+    uint64_t max_ns;
+    uint64_t start_ns;
+} Window;
+
+typedef struct {
+    int epoll_fd;
+    Pool pool;
+    Conn conns[MAX_CONNECTIONS];
+    unsigned open_conns;
+    unsigned workers;
+    uint64_t start_ns;
+    uint64_t total_requests;
+    uint64_t total_strings;
+    uint64_t total_errors;
+    Window window;
+    char last_stats[512]; // the last closed window, as served to STATS
+    bool quiet;
+} Daemon;
+
+static void ConnUpdateEvents(Daemon* d, Conn* c)
+{
+    uint32_t events = 0;
+    if (!c->eof && c->pending < CONN_MAX_PENDING && c->out.len - c->out_off < CONN_MAX_OUTPUT) events |= EPOLLIN;
+    if (c->out_off < c->out.len) events |= EPOLLOUT;
+    if (events == c->events) return;
+    struct epoll_event ev = { .events = events, .data.u64 = (uint64_t)(c - d->conns) };
+    epoll_ctl(d->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = events;
+}
+
+static void ConnClose(Daemon* d, Conn* c)
+{
+    if (c->fd < 0) return;
+    epoll_ctl(d->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    c->gen++; // replies still in the pool are dropped
+    free(c->in);
+    c->in = NULL;
+    c->in_len = c->in_cap = 0;
+    DsBatchBufferFree(&c->out);
+    c->out_off = 0;
+    d->open_conns--;
+}
+
+static void ConnFlush(Daemon* d, Conn* c)
+{
+    while (c->out_off < c->out.len) {
+        const ssize_t n = send(c->fd, c->out.data + c->out_off, c->out.len - c->out_off, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            ConnClose(d, c);
+            return;
+        }
+        c->out_off += (size_t)n;
+    }
+    if (c->out_off == c->out.len) c->out.len = c->out_off = 0;
+    if (c->eof && !c->pending && !c->out.len) {
+        ConnClose(d, c);
+        return;
+    }
+    ConnUpdateEvents(d, c);
+}
+
+static void FormatStats(const Daemon* d, char* out, size_t cap, double windowS, uint64_t requests, uint64_t strings,
+                        uint64_t p50, uint64_t p99, uint64_t maxNs)
+{
+    snprintf(out, cap,
+             "uptime_s=%.1f requests=%llu strings=%llu errors=%llu connections=%u workers=%u window_s=%.2f "
+             "rps=%.0f strings_per_s=%.0f p50_us=%.1f p99_us=%.1f max_us=%.1f",
+             (double)(DsMonotonicNs() - d->start_ns) / 1e9, (unsigned long long)d->total_requests,
+             (unsigned long long)d->total_strings, (unsigned long long)d->total_errors, d->open_conns, d->workers,
+             windowS, windowS > 0 ? (double)requests / windowS : 0.0, windowS > 0 ? (double)strings / windowS : 0.0,
+             (double)p50 / 1e3, (double)p99 / 1e3, (double)maxNs / 1e3);
+}
+
+static void CloseWindow(Daemon* d)
+{
+    Window* w = &d->window;
+    const uint64_t now = DsMonotonicNs();
+    const double seconds = (double)(now - w->start_ns) / 1e9;
+    const uint64_t p50 = DsPercentile(w->samples, w->sample_count, 50.0);
+    const uint64_t p99 = DsPercentile(w->samples, w->sample_count, 99.0);
+    FormatStats(d, d->last_stats, sizeof(d->last_stats), seconds, w->requests, w->strings, p50, p99, w->max_ns);
+    if (!d->quiet && w->requests) fprintf(stderr, "diswitcherd: %s\n", d->last_stats);
+    memset(w, 0, offsetof(Window, samples));
+    w->sample_count = 0;
+    w->max_ns = 0;
+    w->start_ns = now;
+}
+
+static void RecordRequest(Daemon* d, uint64_t receivedNs, uint32_t strings, bool error)
+{
+    Window* w = &d->window;
+    const uint64_t ns = DsMonotonicNs() - receivedNs;
+    w->requests++;
+    w->strings += strings;
+    w->errors += error;
+    if (w->sample_count < LATENCY_SAMPLES) w->samples[w->sample_count++] = ns;
+    if (ns > w->max_ns) w->max_ns = ns;
+    d->total_requests++;
+    d->total_strings += strings;
+    d->total_errors += error;
+}
+
+// Parses every complete frame in the input buffer, as far as the pending limit allows.
+static void ConnParse(Daemon* d, Conn* c)
+{
+    size_t off = 0;
+    while (c->fd >= 0 && c->pending < CONN_MAX_PENDING && c->in_len - off >= 4) {
+        const uint32_t n = DsBatchLoad32(c->in + off);
+        if (n < 8 || n > DS_BATCH_MAX_FRAME) {
+            ConnClose(d, c);
+            return;
+        }
+        if (c->in_len - off - 4 < n) break;
+        const uint8_t* payload = c->in + off + 4;
+        const uint32_t kind = DsBatchLoad32(payload);
+        const uint32_t id = DsBatchLoad32(payload + 4);
+        off += 4 + (size_t)n;
+
+        if (kind == DS_BATCH_KIND_CORRECT) {
+            Job* job = (Job*)calloc(1, sizeof(Job));
+            uint8_t* copy = job ? (uint8_t*)malloc(n) : NULL;
+            if (!copy) {
+                free(job);
+                PutError(&c->out, id, "out of memory");
+                continue;
+            }
+            memcpy(copy, payload, n);
+            job->conn = (uint32_t)(c - d->conns);
+            job->gen = c->gen;
+            job->received_ns = DsMonotonicNs();
+            job->payload = copy;
+            job->len = n;
+            c->pending++;
+            pthread_mutex_lock(&d->pool.lock);
+            JobListPush(&d->pool.queue, job);
+            pthread_cond_signal(&d->pool.wake);
+            pthread_mutex_unlock(&d->pool.lock);
+        } else if (kind == DS_BATCH_KIND_STATS) {
+            const size_t frame = DsBatchBeginFrame(&c->out, DS_BATCH_KIND_STATS, id);
+            DsBatchPutString(&c->out, d->last_stats, strlen(d->last_stats));
+            DsBatchEndFrame(&c->out, frame);
+        } else {
+            PutError(&c->out, id, "unknown request kind");
+            d->total_errors++;
+        }
+    }
+    if (c->fd < 0) return;
+    memmove(c->in, c->in + off, c->in_len - off);
+    c->in_len -= off;
+    ConnFlush(d, c);
+}
+
+static void ConnRead(Daemon* d, Conn* c)
+{
+    // Room for the frame being received, or at least one read chunk.
+    size_t need = c->in_len + CONN_READ_CHUNK;
+    if (c->in_len >= 4) {
+        const size_t frame = 4 + (size_t)DsBatchLoad32(c->in);
+        if (frame <= 4 + DS_BATCH_MAX_FRAME && frame > need) need = frame;
+    }
+    if (need > c->in_cap) {
+        uint8_t* in = (uint8_t*)realloc(c->in, need);
+        if (!in) {
+            ConnClose(d, c);
+            return;
+        }
+        c->in = in;
+        c->in_cap = need;
+    }
+    const ssize_t n = recv(c->fd, c->in + c->in_len, c->in_cap - c->in_len, MSG_DONTWAIT);
+    if (n < 0) {
+        if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) ConnClose(d, c);
+        return;
+    }
+    if (n == 0) {
+        c->eof = true;
+        ConnFlush(d, c);
+        return;
+    }
+    c->in_len += (size_t)n;
+    ConnParse(d, c);
+}
+
+static void AcceptAll(Daemon* d, int listenFd)
+{
+    for (;;) {
+        const int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("accept");
+            return;
+        }
+        Conn* c = NULL;
+        for (size_t i = 0; i < MAX_CONNECTIONS && !c; i++) {
+            if (d->conns[i].fd < 0 && !d->conns[i].pending) c = &d->conns[i];
+        }
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->eof = false;
+        c->events = EPOLLIN;
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = (uint64_t)(c - d->conns) };
+        if (epoll_ctl(d->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            c->fd = -1;
+            continue;
+        }
+        d->open_conns++;
+    }
+}
+
+static void CollectReplies(Daemon* d)
+{
+    uint64_t signalled;
+    if (read(d->pool.done_fd, &signalled, sizeof(signalled)) < 0) return;
+    pthread_mutex_lock(&d->pool.lock);
+    JobList done = d->pool.done;
+    d->pool.done.head = d->pool.done.tail = NULL;
+    pthread_mutex_unlock(&d->pool.lock);
+
+    Job* job;
+    while ((job = JobListPop(&done))) {
+        Conn* c = &d->conns[job->conn];
+        c->pending--;
+        RecordRequest(d, job->received_ns, job->strings, job->error);
+        if (c->fd >= 0 && c->gen == job->gen) {
+            DsBatchPutBytes(&c->out, job->reply.data, job->reply.len);
+            // Reading may have stopped at the pending limit with whole frames still buffered.
+            if (c->in_len) ConnParse(d, c);
+            else ConnFlush(d, c);
+        }
+        JobFree(job);
+    }
+}
+
+// ---------- Setup ----------
+
+static int Listen(const char* path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // A socket file nobody answers on is left over from a daemon that did not exit cleanly.
+    const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0 && connect(probe, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "%s: another daemon is listening\n", path);
+        close(probe);
+        return -1;
+    }
+    if (probe >= 0) close(probe);
+    unlink(path);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool AddFd(int epollFd, int fd, uint64_t tag)
+{
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = tag };
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+static void Usage(void)
+{
+    fprintf(stderr, "usage: diswitcherd [--socket PATH] [--workers N] [--window S] [--quiet] [--morph ru.dsmf] [--config diswitcher.conf]\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* socketPath = "/tmp/diswitcherd.sock";
+    const char* morphPath = NULL;
+    const char* configPath = NULL;
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned workers = cores > 0 ? (unsigned)cores : 1;
+    double window = 1.0;
+    bool quiet = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) socketPath = argv[++i];
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) workers = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) window = atof(argv[++i]);
+        else if (strcmp(argv[i], "--quiet") == 0) quiet = true;
+        else if (strcmp(argv[i], "--morph") == 0 && i + 1 < argc) morphPath = argv[++i];
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) configPath = argv[++i];
+        else { Usage(); return 2; }
+    }
+    if (workers == 0 || workers >= DS_SNAPSHOT_MAX_READERS || window <= 0) {
+        Usage();
+        return 2;
+    }
+    setlocale(LC_ALL, "C.UTF-8");
+
+    DsMappedFile morphFile = {0};
+    DsMorph morph;
+    if (!DsToolLoadModel(morphPath, configPath, &morphFile, &morph)) return 1;
+
+    Daemon* d = (Daemon*)calloc(1, sizeof(Daemon));
+    if (!d) return 1;
+    d->workers = workers;
+    d->quiet = quiet;
+    d->start_ns = d->window.start_ns = DsMonotonicNs();
+    FormatStats(d, d->last_stats, sizeof(d->last_stats), 0.0, 0, 0, 0, 0, 0);
+    for (size_t i = 0; i < MAX_CONNECTIONS; i++) d->conns[i].fd = -1;
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL); // inherited by the workers
+    signal(SIGPIPE, SIG_IGN);
+
+    const int listenFd = Listen(socketPath);
+    if (listenFd < 0) return 1;
+    d->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    const int signalFd = signalfd(-1, &signals, SFD_CLOEXEC);
+    const int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    d->pool.done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    const struct itimerspec period = {
+        .it_interval = { (time_t)window, (long)((window - (double)(time_t)window) * 1e9) },
+        .it_value = { (time_t)window, (long)((window - (double)(time_t)window) * 1e9) },
+    };
+    if (d->epoll_fd < 0 || signalFd < 0 || timerFd < 0 || d->pool.done_fd < 0 || timerfd_settime(timerFd, 0, &period, NULL) != 0 ||
+        !AddFd(d->epoll_fd, listenFd, TAG_LISTEN) || !AddFd(d->epoll_fd, signalFd, TAG_SIGNAL) ||
+        !AddFd(d->epoll_fd, timerFd, TAG_TIMER) || !AddFd(d->epoll_fd, d->pool.done_fd, TAG_DONE)) {
+        perror("diswitcherd");
+        return 1;
+    }
+
+    pthread_mutex_init(&d->pool.lock, NULL);
+    pthread_cond_init(&d->pool.wake, NULL);
+    Worker* pool = (Worker*)calloc(workers, sizeof(Worker));
+    if (!pool) return 1;
+    DsHost host = {0};
+    host.clock_ns = Clock;
+    for (unsigned i = 0; i < workers; i++) {
+        pool[i].pool = &d->pool;
+        pool[i].session = DsSessionCreate(&host);
+        if (!pool[i].session) {
+            fprintf(stderr, "cannot create engine session %u\n", i);
+            return 1;
+        }
+        pthread_create(&pool[i].thread, NULL, WorkerMain, &pool[i]);
+    }
+    fprintf(stderr, "diswitcherd: listening on %s with %u workers\n", socketPath, workers);
+
+    bool running = true;
+    while (running) {
+        struct epoll_event events[64];
+        const int n = epoll_wait(d->epoll_fd, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            const uint64_t tag = events[i].data.u64;
+            if (tag == TAG_LISTEN) {
+                AcceptAll(d, listenFd);
+            } else if (tag == TAG_DONE) {
+                CollectReplies(d);
+            } else if (tag == TAG_TIMER) {
+                uint64_t expirations;
+                if (read(timerFd, &expirations, sizeof(expirations)) > 0) CloseWindow(d);
+            } else if (tag == TAG_SIGNAL) {
+                running = false;
+            } else {
+                Conn* c = &d->conns[tag];
+                if (c->fd < 0) continue;
+                if (events[i].events & (EPOLLERR | EPOLLHUP) && !(events[i].events & EPOLLIN)) {
+                    ConnClose(d, c);
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT) ConnFlush(d, c);
+                if (c->fd >= 0 && events[i].events & EPOLLIN) ConnRead(d, c);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&d->pool.lock);
+    d->pool.stop = true;
+    pthread_cond_broadcast(&d->pool.wake);
+    pthread_mutex_unlock(&d->pool.lock);
+    for (unsigned i = 0; i < workers; i++) pthread_join(pool[i].thread, NULL);
+    for (unsigned i = 0; i < workers; i++) DsSessionDestroy(pool[i].session);
+    Job* job;
+    while ((job = JobListPop(&d->pool.queue))) JobFree(job);
+    while ((job = JobListPop(&d->pool.done))) JobFree(job);
+    for (size_t i = 0; i < MAX_CONNECTIONS; i++) ConnClose(d, &d->conns[i]);
+
+    close(listenFd);
+    unlink(socketPath);
+    fprintf(stderr, "diswitcherd: %llu requests, %llu strings, %llu errors in %.1f s\n",
+            (unsigned long long)d->total_requests, (unsigned long long)d->total_strings,
+            (unsigned long long)d->total_errors, (double)(DsMonotonicNs() - d->start_ns) / 1e9);
+    free(pool);
+    free(d);
+    DsEngineShutdown();
+    if (morphPath) DsUnmapFile(&morphFile);
+    return 0;
+}
@@ -0,0 +1,261 @@
+#include "hooksim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "toolutil.h"
+
+static void TextAppend(DsHookSim* s, wchar_t ch)
+{
+    s->text = (wchar_t*)DsGrow(s->text, &s->cap, s->len + 2, sizeof(wchar_t));
+    s->text[s->len++] = ch;
+    s->text[s->len] = 0;
+}
+
+static void TextErase(DsHookSim* s, size_t n)
+{
+    s->len = n > s->len ? 0 : s->len - n;
+    if (s->text) s->text[s->len] = 0;
+}
+
+static void Enqueue(DsHookSim* s, const DsHookSimEvent* in)
+{
+    if (s->queue_head && s->queue_head == s->queue_len) s->queue_head = s->queue_len = 0;
+    s->queue = (DsHookSimEvent*)DsGrow(s->queue, &s->queue_cap, s->queue_len + 1, sizeof(DsHookSimEvent));
+    s->queue[s->queue_len++] = *in;
+    if (DS_INJECT_IS_CORRECTION(in->tag)) s->corrections_pending++;
+}
+
+// SendInput: the batch reaches the hook after the injection delay, one event after another.
+static void SendInputSim(DsHookSim* s, const DsHookSimEvent* batch, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        DsHookSimEvent in = batch[i];
+        in.time_ns = s->now + s->inject_ns + i * s->event_ns;
+        Enqueue(s, &in);
+    }
+    s->stats.injected += n;
+}
+
+static void ArmTimer(DsHookSim* s)
+{
+    s->timer_ns = DsTypeaheadDeadline(&s->typeahead);
+}
+
+static void ReplayHeldKeys(DsHookSim* s)
+{
+    DsTypeaheadKey keys[DS_TYPEAHEAD_MAX_KEYS];
+    DsHookSimEvent batch[DS_TYPEAHEAD_MAX_KEYS];
+    const size_t n = DsTypeaheadFlush(&s->typeahead, keys, s->now);
+    for (size_t i = 0; i < n; i++) {
+        memset(&batch[i], 0, sizeof(batch[i]));
+        batch[i].vk = keys[i].vk;
+        batch[i].scan = keys[i].scan;
+        batch[i].flags = keys[i].flags;
+        batch[i].down = keys[i].down;
+        batch[i].tag = DsTypeaheadReplayTag(&keys[i]);
+    }
+    SendInputSim(s, batch, n);
+    ArmTimer(s);
+}
+
+static uint64_t SimClockNs(void* ctx)
+{
+    return ((const DsHookSim*)ctx)->now;
+}
+
+static void SimSwitchLayout(void* ctx, bool toEnglish)
+{
+    ((DsHookSim*)ctx)->layout = toEnglish ? DS_LAYOUT_EN : DS_LAYOUT_RU;
+}
+
+// Mirrors SendBackspacesAndText: key down + key up per backspace and per character, one SendInput.
+static void SimSendText(void* ctx, size_t backspaces, const wchar_t* text)
+{
+    DsHookSim* s = (DsHookSim*)ctx;
+    const size_t n = wcslen(text);
+    const size_t events = 2 * (backspaces + n);
+    if (!events) return;
+    DsHookSimEvent* batch = (DsHookSimEvent*)calloc(events, sizeof(DsHookSimEvent));
+    if (!batch) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < backspaces + n; i++) {
+        for (int up = 0; up < 2; up++) {
+            DsHookSimEvent* in = &batch[count++];
+            in->vk = i < backspaces ? DS_VK_BACK : DS_HOOKSIM_VK_PACKET;
+            in->ch = i < backspaces ? 0 : text[i - backspaces];
+            in->down = !up;
+            in->tag = DsTypeaheadCorrectionTag();
+        }
+    }
+    SendInputSim(s, batch, count);
+    free(batch);
+    DsTypeaheadCorrectionSent(&s->typeahead, (uint32_t)count, s->now);
+    ArmTimer(s);
+
+    s->stats.corrections++;
+    s->stats.backspaces += backspaces;
+    if (s->observer.correction_sent) s->observer.correction_sent(s->observer.ctx, s, backspaces, text, count);
+}
+
+static bool AnyDown(const DsHookSim* s, uint32_t a, uint32_t b, uint32_t c)
+{
+    return s->down[a] || s->down[b] || s->down[c];
+}
+
+// Same classification as diswitcher-replay (and LowLevelKeyboardProc).
+static DsKeyKind ClassifyKey(const DsHookSim* s, uint32_t vk, wchar_t* ch)
+{
+    *ch = 0;
+    if (vk == DS_VK_PAUSE) return DS_KEY_PAUSE;
+    if (AnyDown(s, DS_VK_CONTROL, DS_VK_LCONTROL, DS_VK_RCONTROL) || AnyDown(s, DS_VK_MENU, DS_VK_LMENU, DS_VK_RMENU)) {
+        return DS_KEY_SHORTCUT;
+    }
+    if (vk == DS_VK_BACK) return DS_KEY_BACK;
+    if (vk == DS_VK_ESCAPE) return DS_KEY_ESCAPE;
+    const bool shift = AnyDown(s, DS_VK_SHIFT, DS_VK_LSHIFT, DS_VK_RSHIFT);
+    *ch = DsKeymapChar(s->layout, vk, shift, s->caps);
+    return *ch ? DS_KEY_TEXT : DS_KEY_OTHER;
+}
+
+// The focused application receives a key event the hook let through. The user's own keys, replayed
+// or not, are paired press with release; injected characters come as VK_PACKET and are not.
+static void Deliver(DsHookSim* s, const DsHookSimEvent* in, bool userKey, DsKeyKind kind, wchar_t ch)
+{
+    const uint32_t vk = in->vk & 0xFF;
+    if (userKey) {
+        if (!in->down && !s->app_down[vk]) s->stats.stray_up++;
+        s->app_down[vk] = in->down;
+    }
+    if (!in->down) return;
+    if (in->vk == DS_HOOKSIM_VK_PACKET) TextAppend(s, in->ch);
+    else if (kind == DS_KEY_TEXT) TextAppend(s, ch);
+    else if (kind == DS_KEY_BACK || in->vk == DS_VK_BACK) TextErase(s, 1);
+}
+
+// One event at the hook; mirrors LowLevelKeyboardProc.
+static void Hook(DsHookSim* s, const DsHookSimEvent* in)
+{
+    uint32_t replayTag = 0;
+    if (in->tag) {
+        if (DS_INJECT_IS_CORRECTION(in->tag)) {
+            s->corrections_pending--;
+            if (DsTypeaheadCorrectionSeen(&s->typeahead)) ReplayHeldKeys(s);
+            else if (!s->typeahead.correction_in_flight) ArmTimer(s);
+            Deliver(s, in, false, DS_KEY_OTHER, 0);
+            if (s->observer.correction_arrived) s->observer.correction_arrived(s->observer.ctx, s);
+            return;
+        }
+        replayTag = in->tag;
+    }
+
+    if (DsTypeaheadExpire(&s->typeahead, s->now)) ReplayHeldKeys(s);
+    DsTypeaheadKey key = { in->vk, in->scan, in->flags, in->down, 0, 0, 0 };
+    const DsTypeaheadAction action = DsTypeaheadOffer(&s->typeahead, &key, replayTag, s->now);
+    if (action != DS_TYPEAHEAD_PASS) {
+        if (action == DS_TYPEAHEAD_HOLD_FLUSH) ReplayHeldKeys(s);
+        else ArmTimer(s);
+        return;
+    }
+    if (replayTag && s->observer.replay_passed) s->observer.replay_passed(s->observer.ctx, s, s->now - key.arrived_ns);
+
+    if (in->vk == DS_HOOKSIM_VK_LAYOUT) {
+        s->layout = (DsLayout)in->scan;
+        return;
+    }
+    if (in->vk == DS_HOOKSIM_VK_FOCUS) {
+        DsEngineFocusChanged(in->scan, s->layout == DS_LAYOUT_EN ? DS_LANG_EN : DS_LANG_RU);
+        return;
+    }
+
+    const uint32_t vk = in->vk & 0xFF;
+    if (in->down) {
+        s->stats.keys++;
+        if (s->corrections_pending) s->stats.interleaved++;
+    }
+    if (!in->down) {
+        const DsKeyResult res = DsEngineKeyUp(in->vk);
+        s->down[vk] = false;
+        if (res != DS_SWALLOW) Deliver(s, in, true, DS_KEY_OTHER, 0);
+        return;
+    }
+    wchar_t ch = 0;
+    const DsKeyKind kind = ClassifyKey(s, in->vk, &ch);
+    const DsKeyResult res = DsEngineKeyDown(kind, ch, in->vk);
+    if (in->vk == DS_VK_CAPITAL && !s->down[DS_VK_CAPITAL]) s->caps = !s->caps;
+    s->down[vk] = true;
+    if (res != DS_SWALLOW) Deliver(s, in, true, kind, ch);
+}
+
+static void TimerFired(DsHookSim* s)
+{
+    s->timer_ns = 0;
+    if (DsTypeaheadExpire(&s->typeahead, s->now)) ReplayHeldKeys(s);
+    else ArmTimer(s);
+}
+
+void DsHookSimInit(DsHookSim* s, uint64_t capNs, bool typeahead, const DsHookSimObserver* observer)
+{
+    memset(s, 0, sizeof(*s));
+    s->layout = DS_LAYOUT_EN;
+    if (observer) s->observer = *observer;
+    DsTypeaheadInit(&s->typeahead, capNs);
+    DsTypeaheadSetEnabled(&s->typeahead, typeahead);
+
+    DsHost host;
+    memset(&host, 0, sizeof(host));
+    host.ctx = s;
+    host.clock_ns = SimClockNs;
+    host.switch_layout = SimSwitchLayout;
+    host.send_text = SimSendText;
+    DsEngineInit(&host);
+}
+
+void DsHookSimFree(DsHookSim* s)
+{
+    free(s->queue);
+    free(s->text);
+    s->queue = NULL;
+    s->text = NULL;
+}
+
+bool DsHookSimAdvance(DsHookSim* s, uint64_t until)
+{
+    const uint64_t queueAt = s->queue_head < s->queue_len ? s->queue[s->queue_head].time_ns : UINT64_MAX;
+    const uint64_t timerAt = s->timer_ns ? s->timer_ns : UINT64_MAX;
+    if ((queueAt > until && timerAt > until) || (queueAt == UINT64_MAX && timerAt == UINT64_MAX)) return false;
+    if (queueAt <= timerAt) {
+        const DsHookSimEvent in = s->queue[s->queue_head++];
+        if (in.time_ns > s->now) s->now = in.time_ns;
+        Hook(s, &in);
+    } else {
+        if (timerAt > s->now) s->now = timerAt;
+        TimerFired(s);
+    }
+    return true;
+}
+
+void DsHookSimInput(DsHookSim* s, uint32_t vk, uint32_t scan, bool down)
+{
+    DsHookSimEvent in;
+    memset(&in, 0, sizeof(in));
+    in.time_ns = s->now;
+    in.vk = vk;
+    in.scan = scan;
+    in.down = down;
+    Hook(s, &in);
+}
+
+size_t DsHookSimStuckKeys(const DsHookSim* s)
+{
+    size_t n = 0;
+    for (int vk = 0; vk < 256; vk++) {
+        if (s->app_down[vk]) n++;
+    }
+    return n;
+}
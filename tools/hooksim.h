@@ -0,0 +1,110 @@
+#ifndef DISWITCHER_HOOKSIM_H
+#define DISWITCHER_HOOKSIM_H
+
+// Model of the Windows input path for the simulators (diswitcher-typeahead-sim, diswitcher-fieldsim),
+// in virtual time.
+//
+// SendInput events reach the hook only after an injection delay, plus a little per event, while
+// real keys arrive on their own schedule. The hook mirrors LowLevelKeyboardProc (main.c): the
+// type-ahead stage (src/typeahead.h) and its timer, key classification, the engine (driven through
+// the default session), and whatever it lets through is applied to a text buffer standing in for
+// the focused application, so a key that slips in ahead of a correction's backspaces gets erased
+// exactly as it would on the desktop. The host callbacks mirror SendBackspacesAndText: a key down
+// and up per backspace and per character, in one batch tagged as a correction. The application
+// also pairs key presses and releases, so a boundary key whose press was swallowed but whose
+// release leaked shows up as a stray key-up.
+//
+// Changes to the hook path in main.c are mirrored here once for both tools. What a tool counts
+// beyond DsHookSimStats it gets through a DsHookSimObserver.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#include "keymap.h"
+#include "typeahead.h"
+
+#define DS_HOOKSIM_VK_PACKET 0xE7 // Unicode character injected with KEYEVENTF_UNICODE
+// User layout switches and focus changes. On the desktop they are hotkeys (Alt+Shift, Alt+Tab), i.e.
+// key events that queue up behind held keys like any other, so they are fed through the hook as
+// pseudo keys (scan = layout or window id).
+#define DS_HOOKSIM_VK_LAYOUT 0xFF
+#define DS_HOOKSIM_VK_FOCUS 0xFE
+
+typedef struct {
+    uint64_t time_ns; // when it reaches the hook
+    uint32_t vk;
+    uint32_t scan;
+    uint32_t flags;
+    wchar_t ch;       // DS_HOOKSIM_VK_PACKET events
+    bool down;
+    uint32_t tag;     // dwExtraInfo
+} DsHookSimEvent;
+
+typedef struct {
+    uint64_t keys;        // real key presses past the type-ahead stage
+    uint64_t interleaved; // ... while events of a correction were still on their way to the hook
+    uint64_t corrections;
+    uint64_t injected;    // events sent with SendInput: corrections and replayed keys
+    uint64_t backspaces;
+    uint64_t stray_up;    // key-ups the application got without the press
+} DsHookSimStats;
+
+typedef struct DsHookSim DsHookSim;
+
+// Per-tool accounting; any callback may be NULL. `sim->now` is the current virtual time.
+typedef struct {
+    void* ctx;
+    // A correction of `events` events was sent.
+    void (*correction_sent)(void* ctx, const DsHookSim* sim, size_t backspaces, const wchar_t* text, size_t events);
+    // One event of the oldest correction on its way reached the application.
+    void (*correction_arrived)(void* ctx, const DsHookSim* sim);
+    // A replayed key press or release got through, `delayNs` after it first reached the hook.
+    void (*replay_passed)(void* ctx, const DsHookSim* sim, uint64_t delayNs);
+} DsHookSimObserver;
+
+struct DsHookSim {
+    uint64_t now;
+    uint64_t inject_ns; // SendInput to first event at the hook
+    uint64_t event_ns;  // per further event
+
+    DsLayout layout;
+    bool down[256];     // at the hook
+    bool app_down[256]; // as the application saw it
+    bool caps;
+
+    // Input not yet seen by the hook; arrival times are non-decreasing.
+    DsHookSimEvent* queue;
+    size_t queue_head;
+    size_t queue_len;
+    size_t queue_cap;
+    size_t corrections_pending; // correction events in the queue
+
+    DsTypeahead typeahead;
+    uint64_t timer_ns; // armed WM_TIMER, 0 if none
+
+    wchar_t* text; // the field, NUL-terminated; NULL while nothing was typed
+    size_t len;
+    size_t cap;
+
+    DsHookSimStats stats;
+    DsHookSimObserver observer;
+};
+
+// Starts an empty field at time 0 on the EN layout and points the engine's default session at it.
+// `observer` may be NULL.
+void DsHookSimInit(DsHookSim* s, uint64_t capNs, bool typeahead, const DsHookSimObserver* observer);
+void DsHookSimFree(DsHookSim* s);
+
+// Delivers the next injected event or timer due no later than `until`; false if there is none. At
+// equal times injected input goes before the timer; callers feed real input after both.
+bool DsHookSimAdvance(DsHookSim* s, uint64_t until);
+
+// A real key event (or pseudo key) reaching the hook at `s->now`.
+void DsHookSimInput(DsHookSim* s, uint32_t vk, uint32_t scan, bool down);
+
+// Keys the application saw pressed and not released.
+size_t DsHookSimStuckKeys(const DsHookSim* s);
+
+#endif
@@ -0,0 +1,128 @@
+#include "keymap.h"
+
+#include <stddef.h>
+
+typedef struct {
+    uint8_t vk;
+    uint8_t scan;
+    wchar_t en;
+    wchar_t en_shift;
+    wchar_t ru;
+    wchar_t ru_shift;
+    bool letter_en; // Caps Lock applies
+    bool letter_ru;
+} KeyRow;
+
+static const KeyRow kKeys[] = {
+    {'Q', 0x10, L'q', L'Q', L'й', L'Й', true, true},
+    {'W', 0x11, L'w', L'W', L'ц', L'Ц', true, true},
+    {'E', 0x12, L'e', L'E', L'у', L'У', true, true},
+    {'R', 0x13, L'r', L'R', L'к', L'К', true, true},
+    {'T', 0x14, L't', L'T', L'е', L'Е', true, true},
+    {'Y', 0x15, L'y', L'Y', L'н', L'Н', true, true},
+    {'U', 0x16, L'u', L'U', L'г', L'Г', true, true},
+    {'I', 0x17, L'i', L'I', L'ш', L'Ш', true, true},
+    {'O', 0x18, L'o', L'O', L'щ', L'Щ', true, true},
+    {'P', 0x19, L'p', L'P', L'з', L'З', true, true},
+    {0xDB, 0x1A, L'[', L'{', L'х', L'Х', false, true},
+    {0xDD, 0x1B, L']', L'}', L'ъ', L'Ъ', false, true},
+    {'A', 0x1E, L'a', L'A', L'ф', L'Ф', true, true},
+    {'S', 0x1F, L's', L'S', L'ы', L'Ы', true, true},
+    {'D', 0x20, L'd', L'D', L'в', L'В', true, true},
+    {'F', 0x21, L'f', L'F', L'а', L'А', true, true},
+    {'G', 0x22, L'g', L'G', L'п', L'П', true, true},
+    {'H', 0x23, L'h', L'H', L'р', L'Р', true, true},
+    {'J', 0x24, L'j', L'J', L'о', L'О', true, true},
+    {'K', 0x25, L'k', L'K', L'л', L'Л', true, true},
+    {'L', 0x26, L'l', L'L', L'д', L'Д', true, true},
+    {0xBA, 0x27, L';', L':', L'ж', L'Ж', false, true},
+    {0xDE, 0x28, L'\'', L'"', L'э', L'Э', false, true},
+    {0xC0, 0x29, L'`', L'~', L'ё', L'Ё', false, true},
+    {0xDC, 0x2B, L'\\', L'|', L'\\', L'/', false, false},
+    {'Z', 0x2C, L'z', L'Z', L'я', L'Я', true, true},
+    {'X', 0x2D, L'x', L'X', L'ч', L'Ч', true, true},
+    {'C', 0x2E, L'c', L'C', L'с', L'С', true, true},
+    {'V', 0x2F, L'v', L'V', L'м', L'М', true, true},
+    {'B', 0x30, L'b', L'B', L'и', L'И', true, true},
+    {'N', 0x31, L'n', L'N', L'т', L'Т', true, true},
+    {'M', 0x32, L'm', L'M', L'ь', L'Ь', true, true},
+    {0xBC, 0x33, L',', L'<', L'б', L'Б', false, true},
+    {0xBE, 0x34, L'.', L'>', L'ю', L'Ю', false, true},
+    {0xBF, 0x35, L'/', L'?', L'.', L',', false, false},
+    {'1', 0x02, L'1', L'!', L'1', L'!', false, false},
+    {'2', 0x03, L'2', L'@', L'2', L'"', false, false},
+    {'3', 0x04, L'3', L'#', L'3', L'№', false, false},
+    {'4', 0x05, L'4', L'$', L'4', L';', false, false},
+    {'5', 0x06, L'5', L'%', L'5', L'%', false, false},
+    {'6', 0x07, L'6', L'^', L'6', L':', false, false},
+    {'7', 0x08, L'7', L'&', L'7', L'?', false, false},
+    {'8', 0x09, L'8', L'*', L'8', L'*', false, false},
+    {'9', 0x0A, L'9', L'(', L'9', L'(', false, false},
+    {'0', 0x0B, L'0', L')', L'0', L')', false, false},
+    {0xBD, 0x0C, L'-', L'_', L'-', L'_', false, false},
+    {0xBB, 0x0D, L'=', L'+', L'=', L'+', false, false},
+    {DS_VK_SPACE, 0x39, L' ', L' ', L' ', L' ', false, false},
+    {DS_VK_RETURN, 0x1C, L'\r', L'\r', L'\r', L'\r', false, false},
+    {DS_VK_TAB, 0x0F, L'\t', L'\t', L'\t', L'\t', false, false},
+};
+
+static const struct {
+    uint8_t vk;
+    uint8_t scan;
+} kNonTextScans[] = {
+    {DS_VK_BACK, 0x0E}, {DS_VK_LSHIFT, 0x2A}, {DS_VK_RSHIFT, 0x36}, {DS_VK_SHIFT, 0x2A},
+    {DS_VK_LCONTROL, 0x1D}, {DS_VK_CONTROL, 0x1D}, {DS_VK_LMENU, 0x38}, {DS_VK_MENU, 0x38},
+    {DS_VK_CAPITAL, 0x3A}, {DS_VK_ESCAPE, 0x01}, {DS_VK_PAUSE, 0x45}, {DS_VK_LEFT, 0x4B}, {DS_VK_RIGHT, 0x4D},
+};
+
+#define KEYMAP_ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+DsLayout DsLayoutFromId(uint32_t layoutId)
+{
+    return ((layoutId & 0x3FF) == 0x19) ? DS_LAYOUT_RU : DS_LAYOUT_EN;
+}
+
+uint32_t DsLayoutToId(DsLayout layout)
+{
+    return layout == DS_LAYOUT_RU ? DS_LAYOUT_ID_RU : DS_LAYOUT_ID_EN;
+}
+
+wchar_t DsKeymapChar(DsLayout layout, uint32_t vk, bool shift, bool capsLock)
+{
+    for (size_t i = 0; i < KEYMAP_ARRAYSIZE(kKeys); i++) {
+        const KeyRow* k = &kKeys[i];
+        if (k->vk != vk) continue;
+        const bool ru = (layout == DS_LAYOUT_RU);
+        const bool letter = ru ? k->letter_ru : k->letter_en;
+        const bool upper = (letter && capsLock) ? !shift : shift;
+        if (ru) return upper ? k->ru_shift : k->ru;
+        return upper ? k->en_shift : k->en;
+    }
+    return 0;
+}
+
+bool DsKeymapFindKey(DsLayout layout, wchar_t ch, uint32_t* vk, bool* shift)
+{
+    for (size_t i = 0; i < KEYMAP_ARRAYSIZE(kKeys); i++) {
+        const KeyRow* k = &kKeys[i];
+        const wchar_t base = layout == DS_LAYOUT_RU ? k->ru : k->en;
+        const wchar_t shifted = layout == DS_LAYOUT_RU ? k->ru_shift : k->en_shift;
+        if (ch == base || ch == shifted) {
+            *vk = k->vk;
+            *shift = (ch != base);
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t DsKeymapScanCode(uint32_t vk)
+{
+    for (size_t i = 0; i < KEYMAP_ARRAYSIZE(kKeys); i++) {
+        if (kKeys[i].vk == vk) return kKeys[i].scan;
+    }
+    for (size_t i = 0; i < KEYMAP_ARRAYSIZE(kNonTextScans); i++) {
+        if (kNonTextScans[i].vk == vk) return kNonTextScans[i].scan;
+    }
+    return 0;
+}
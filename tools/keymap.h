@@ -0,0 +1,54 @@
+#ifndef DISWITCHER_KEYMAP_H
+#define DISWITCHER_KEYMAP_H
+
+// Offline stand-in for ToUnicodeEx: US QWERTY and Russian ЙЦУКЕН character tables keyed by
+// Windows virtual-key codes, so captured traces can be turned back into text off-desktop.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wchar.h>
+
+enum {
+    DS_VK_BACK = 0x08,
+    DS_VK_TAB = 0x09,
+    DS_VK_RETURN = 0x0D,
+    DS_VK_SHIFT = 0x10,
+    DS_VK_CONTROL = 0x11,
+    DS_VK_MENU = 0x12,
+    DS_VK_PAUSE = 0x13,
+    DS_VK_CAPITAL = 0x14,
+    DS_VK_ESCAPE = 0x1B,
+    DS_VK_SPACE = 0x20,
+    DS_VK_LEFT = 0x25,
+    DS_VK_RIGHT = 0x27,
+    DS_VK_LSHIFT = 0xA0,
+    DS_VK_RSHIFT = 0xA1,
+    DS_VK_LCONTROL = 0xA2,
+    DS_VK_RCONTROL = 0xA3,
+    DS_VK_LMENU = 0xA4,
+    DS_VK_RMENU = 0xA5,
+};
+
+typedef enum {
+    DS_LAYOUT_EN = 0,
+    DS_LAYOUT_RU = 1,
+} DsLayout;
+
+// Layout ids as stored in traces (low 32 bits of the Windows HKL).
+#define DS_LAYOUT_ID_EN 0x04090409u
+#define DS_LAYOUT_ID_RU 0x04190419u
+
+// Anything that is not Russian is treated as the EN table.
+DsLayout DsLayoutFromId(uint32_t layoutId);
+uint32_t DsLayoutToId(DsLayout layout);
+
+// Character produced by `vk` or 0 if the key is not a text key in this layout.
+wchar_t DsKeymapChar(DsLayout layout, uint32_t vk, bool shift, bool capsLock);
+
+// Reverse lookup: which key (and shift state) types `ch` in this layout.
+bool DsKeymapFindKey(DsLayout layout, wchar_t ch, uint32_t* vk, bool* shift);
+
+// Set-1 scan code for a virtual key (0 if unknown); only used to make synthetic traces look real.
+uint32_t DsKeymapScanCode(uint32_t vk);
+
+#endif
@@ -0,0 +1,188 @@
+#include "preedit.h"
+
+#include <string.h>
+
+#include "toolutil.h"
+
+#define PREEDIT_ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static uint64_t PreeditClock(void* ctx)
+{
+    (void)ctx;
+    return DsMonotonicNs();
+}
+
+static void Show(DsPreedit* p)
+{
+    if (p->client.update) p->client.update(p->client.ctx, p->text, p->len);
+}
+
+static void Append(DsPreedit* p, wchar_t ch)
+{
+    if (p->len < PREEDIT_ARRAYSIZE(p->text) - 1) p->text[p->len++] = ch;
+    p->text[p->len] = 0;
+}
+
+static void Commit(DsPreedit* p)
+{
+    if (p->len) {
+        if (p->client.commit) p->client.commit(p->client.ctx, p->text, p->len);
+        p->stats.commits++;
+        if (p->rewritten) p->stats.corrections++;
+    }
+    p->len = 0;
+    p->text[0] = 0;
+    p->rewritten = false;
+}
+
+// The session's text field is the preedit: with phrase correction off and Pause kept from it, it
+// never erases more than the word it is correcting.
+static void SessionSendText(void* ctx, size_t backspaces, const wchar_t* text)
+{
+    DsPreedit* p = (DsPreedit*)ctx;
+    p->len = backspaces < p->len ? p->len - backspaces : 0;
+    p->text[p->len] = 0;
+    for (; *text; text++) Append(p, *text);
+    p->rewritten = true;
+}
+
+static void SessionSwitchLayout(void* ctx, bool toEnglish)
+{
+    DsPreedit* p = (DsPreedit*)ctx;
+    const DsLayout layout = toEnglish ? DS_LAYOUT_EN : DS_LAYOUT_RU;
+    if (layout == p->layout) return;
+    p->layout = layout;
+    p->stats.layout_switches++;
+}
+
+// Ends the session's token without a decision, as Escape does.
+static void CommitAsTyped(DsPreedit* p)
+{
+    DsSessionKeyDown(p->session, DS_KEY_ESCAPE, 0, 0);
+    Commit(p);
+}
+
+// Pause on a word in preedit: the same keys in the other layout, which the following keys are read
+// in too. The session sees the new word typed afresh. False if some key is not a letter there.
+static bool Flip(DsPreedit* p)
+{
+    wchar_t flipped[DS_PREEDIT_MAX_CHARS + 1];
+    if (p->layout == DS_LAYOUT_EN) DsMapEnToRu(p->text, flipped, PREEDIT_ARRAYSIZE(flipped));
+    else DsMapRuToEn(p->text, flipped, PREEDIT_ARRAYSIZE(flipped));
+    for (const wchar_t* c = flipped; *c; c++) {
+        if (!DsIsWordChar(*c)) return false;
+    }
+    DsSessionKeyDown(p->session, DS_KEY_ESCAPE, 0, 0);
+    p->len = 0;
+    for (const wchar_t* c = flipped; *c; c++) {
+        DsSessionKeyDown(p->session, DS_KEY_TEXT, *c, 0);
+        Append(p, *c);
+    }
+    SessionSwitchLayout(p, p->layout != DS_LAYOUT_EN);
+    p->stats.flips++;
+    Show(p);
+    return true;
+}
+
+bool DsPreeditInit(DsPreedit* p, DsLayout layout)
+{
+    memset(p, 0, sizeof(*p));
+    p->layout = layout;
+    DsHost host = {0};
+    host.ctx = p;
+    host.clock_ns = PreeditClock;
+    host.switch_layout = SessionSwitchLayout;
+    host.send_text = SessionSendText;
+    p->session = DsSessionCreate(&host);
+    if (!p->session) return false;
+    DsSessionSetPhraseCorrection(p->session, false);
+    return true;
+}
+
+void DsPreeditDestroy(DsPreedit* p)
+{
+    DsSessionDestroy(p->session);
+    p->session = NULL;
+}
+
+void DsPreeditFocusIn(DsPreedit* p, const DsPreeditClient* client, uint64_t window)
+{
+    p->client = *client;
+    p->len = 0;
+    p->text[0] = 0;
+    p->rewritten = false;
+    DsSessionFocusChanged(p->session, window, p->layout == DS_LAYOUT_EN ? DS_LANG_EN : DS_LANG_RU);
+}
+
+void DsPreeditFocusOut(DsPreedit* p)
+{
+    DsSessionKeyDown(p->session, DS_KEY_OTHER, 0, 0);
+    Commit(p);
+    Show(p);
+    memset(&p->client, 0, sizeof(p->client));
+}
+
+void DsPreeditReset(DsPreedit* p)
+{
+    CommitAsTyped(p);
+    Show(p);
+}
+
+bool DsPreeditKeyDown(DsPreedit* p, uint32_t vk, unsigned mods)
+{
+    p->stats.keys++;
+    if (mods & DS_PREEDIT_CHORD) {
+        // A shortcut acts on the document (select all, paste), which must hold the word by then.
+        CommitAsTyped(p);
+        Show(p);
+        return false;
+    }
+    switch (vk) {
+    case DS_VK_PAUSE:
+        return p->len && Flip(p);
+    case DS_VK_BACK:
+        DsSessionKeyDown(p->session, DS_KEY_BACK, 0, vk);
+        if (!p->len) return false;
+        p->text[--p->len] = 0;
+        Show(p);
+        return true;
+    case DS_VK_ESCAPE:
+        CommitAsTyped(p);
+        Show(p);
+        return false;
+    default:
+        break;
+    }
+
+    const wchar_t ch = DsKeymapChar(p->layout, vk, (mods & DS_PREEDIT_SHIFT) != 0, (mods & DS_PREEDIT_CAPS) != 0);
+    if (!ch || ch == L'\r' || ch == L'\t') {
+        // Enter, Tab, arrows, ...: the word is corrected and committed, then the application acts.
+        DsSessionKeyDown(p->session, DS_KEY_OTHER, 0, vk);
+        Commit(p);
+        Show(p);
+        return false;
+    }
+    if (DsIsWordChar(ch)) {
+        // The session keeps no more of a token than this, so it could not correct the rest.
+        if (p->len >= DS_TOKEN_MAX_CHARS) CommitAsTyped(p);
+        DsSessionKeyDown(p->session, DS_KEY_TEXT, ch, vk);
+        Append(p, ch);
+        Show(p);
+        return true;
+    }
+    // A boundary: a swallowed one came back with the correction.
+    if (DsSessionKeyDown(p->session, DS_KEY_TEXT, ch, vk) == DS_PASS) Append(p, ch);
+    Commit(p);
+    Show(p);
+    return true;
+}
+
+void DsPreeditKeyUp(DsPreedit* p, uint32_t vk)
+{
+    DsSessionKeyUp(p->session, vk);
+}
+
+void DsPreeditSetLayout(DsPreedit* p, DsLayout layout)
+{
+    p->layout = layout;
+}
@@ -0,0 +1,83 @@
+#ifndef DISWITCHER_PREEDIT_H
+#define DISWITCHER_PREEDIT_H
+
+// Preedit host for the engine, for input-method frameworks such as IBus.
+//
+// The Windows hook sees a key only after the application has it, so a correction has to erase the
+// word with backspaces and type it again, and keys typed meanwhile race the injected ones. An input
+// method sees keys before the application: the word being typed stays in preedit (shown, but not
+// yet part of the document) and is committed at the boundary that ends it, already corrected.
+// Nothing is erased, no key is synthesized, and switching the layout means reading the next keys in
+// the other table.
+//
+// Keys go through an engine session exactly as they were typed, and the preedit is the session's
+// text field: its send_text rewrites the preedit before the commit, its switch_layout changes the
+// table. Phrase correction is off, since it would have to edit committed text; for the same reason
+// Pause acts on the word still in preedit, retyping it in the other layout, and is passed on to
+// the application otherwise.
+//
+// A process keeps one DsPreedit and points it at whichever input context has focus, as the Windows
+// hook does with the default session; the session's per-window layout memory applies as usual.
+// Single-threaded.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#include "engine.h"
+#include "keymap.h"
+
+#define DS_PREEDIT_MAX_CHARS (DS_TOKEN_MAX_CHARS + 2) // a word and its boundary; longer words are committed as typed
+
+// Modifier state of a key press.
+#define DS_PREEDIT_SHIFT 0x1u
+#define DS_PREEDIT_CAPS 0x2u
+#define DS_PREEDIT_CHORD 0x4u // Ctrl or Alt held: a shortcut, not text
+
+typedef struct {
+    void* ctx;
+    // The preedit is now `text` (`n` characters, possibly none) with the caret at its end.
+    void (*update)(void* ctx, const wchar_t* text, size_t n);
+    // `text` becomes part of the document before the caret; the preedit is empty afterwards.
+    void (*commit)(void* ctx, const wchar_t* text, size_t n);
+} DsPreeditClient;
+
+typedef struct {
+    uint64_t keys;
+    uint64_t commits;
+    uint64_t corrections;     // commits the engine rewrote before they were made
+    uint64_t flips;           // words retyped in the other layout with Pause
+    uint64_t layout_switches;
+} DsPreeditStats;
+
+typedef struct {
+    DsSession* session;
+    DsPreeditClient client;
+    DsLayout layout; // the table keys are read in
+    wchar_t text[DS_PREEDIT_MAX_CHARS + 1];
+    size_t len;
+    bool rewritten;  // the session replaced preedit text since the last commit
+    DsPreeditStats stats;
+} DsPreedit;
+
+// Creates the session (with the published model, see DsEnginePublishModel). False if that fails.
+bool DsPreeditInit(DsPreedit* p, DsLayout layout);
+void DsPreeditDestroy(DsPreedit* p);
+
+// Input now goes to `client`, an input context identified by `window`.
+void DsPreeditFocusIn(DsPreedit* p, const DsPreeditClient* client, uint64_t window);
+// Ends the word as a non-text key would, corrected if need be, and commits it.
+void DsPreeditFocusOut(DsPreedit* p);
+// The application moved the caret or dropped the composition: commits the word as typed.
+void DsPreeditReset(DsPreedit* p);
+
+// A key press. True if it was consumed; otherwise the application gets it, after anything it
+// ended has been committed.
+bool DsPreeditKeyDown(DsPreedit* p, uint32_t vk, unsigned mods);
+void DsPreeditKeyUp(DsPreedit* p, uint32_t vk);
+
+// The user picked a layout; keys are read in it from now on.
+void DsPreeditSetLayout(DsPreedit* p, DsLayout layout);
+
+#endif
@@ -0,0 +1,68 @@
+#include "querygen.h"
+
+#include <stdbool.h>
+
+#include "engine.h"
+
+static const wchar_t* const kWordsEn[] = {
+    L"hello", L"weather", L"today", L"tomorrow", L"news", L"price", L"delivery", L"review",
+    L"recipe", L"tickets", L"train", L"download", L"free", L"movie", L"music", L"schedule",
+    L"store", L"book", L"school", L"university", L"translate", L"dictionary", L"map", L"repair",
+    L"apartment", L"car", L"phone", L"city", L"road", L"work", L"time", L"people",
+};
+
+static const wchar_t* const kWordsRu[] = {
+    L"\u043f\u0440\u0438\u0432\u0435\u0442", L"\u043a\u0430\u043a", L"\u0434\u0435\u043b\u0430",
+    L"\u0441\u0435\u0433\u043e\u0434\u043d\u044f", L"\u043f\u043e\u0433\u043e\u0434\u0430",
+    L"\u0445\u043e\u0440\u043e\u0448\u0430\u044f", L"\u0440\u0430\u0431\u043e\u0442\u0430",
+    L"\u0432\u0440\u0435\u043c\u044f", L"\u0447\u0435\u043b\u043e\u0432\u0435\u043a",
+    L"\u0433\u043e\u0440\u043e\u0434", L"\u0434\u043e\u0440\u043e\u0433\u0430",
+    L"\u043d\u043e\u0432\u043e\u0441\u0442\u0438", L"\u043a\u0443\u043f\u0438\u0442\u044c",
+    L"\u0442\u0435\u043b\u0435\u0444\u043e\u043d", L"\u0446\u0435\u043d\u0430",
+    L"\u0434\u043e\u0441\u0442\u0430\u0432\u043a\u0430", L"\u043e\u0442\u0437\u044b\u0432\u044b",
+    L"\u0440\u0435\u0446\u0435\u043f\u0442", L"\u0431\u0438\u043b\u0435\u0442\u044b",
+    L"\u043f\u043e\u0435\u0437\u0434", L"\u043c\u043e\u0441\u043a\u0432\u0430",
+    L"\u0441\u043a\u0430\u0447\u0430\u0442\u044c",
+    L"\u0431\u0435\u0441\u043f\u043b\u0430\u0442\u043d\u043e", L"\u0444\u0438\u043b\u044c\u043c",
+    L"\u043c\u0443\u0437\u044b\u043a\u0430", L"\u0437\u0430\u0432\u0442\u0440\u0430",
+    L"\u0440\u0430\u0441\u043f\u0438\u0441\u0430\u043d\u0438\u0435",
+    L"\u043c\u0430\u0433\u0430\u0437\u0438\u043d", L"\u043a\u043d\u0438\u0433\u0430",
+    L"\u0448\u043a\u043e\u043b\u0430",
+    L"\u0443\u043d\u0438\u0432\u0435\u0440\u0441\u0438\u0442\u0435\u0442",
+    L"\u043f\u0435\u0440\u0435\u0432\u043e\u0434", L"\u0441\u043b\u043e\u0432\u0430\u0440\u044c",
+    L"\u043a\u0430\u0440\u0442\u0430", L"\u0440\u0435\u043c\u043e\u043d\u0442",
+    L"\u043a\u0432\u0430\u0440\u0442\u0438\u0440\u0430", L"\u043c\u0430\u0448\u0438\u043d\u0430",
+};
+
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static uint32_t NextRandom(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (uint32_t)(*state >> 16);
+}
+
+size_t DsGenerateQuery(uint64_t* rng, wchar_t* out, size_t outCap)
+{
+    size_t len = 0;
+    const bool russian = NextRandom(rng) & 1;
+    const bool wrongLayout = NextRandom(rng) & 1;
+    const unsigned words = 1 + NextRandom(rng) % 5;
+    for (unsigned w = 0; w < words; w++) {
+        const wchar_t* word = russian ? kWordsRu[NextRandom(rng) % ARRAYSIZE(kWordsRu)]
+                                      : kWordsEn[NextRandom(rng) % ARRAYSIZE(kWordsEn)];
+        wchar_t typed[64];
+        if (!wrongLayout) wcscpy(typed, word);
+        else if (russian) DsMapRuToEn(word, typed, ARRAYSIZE(typed));
+        else DsMapEnToRu(word, typed, ARRAYSIZE(typed));
+        const size_t n = wcslen(typed);
+        if (len + n + 1 >= outCap) break;
+        if (w) out[len++] = L' ';
+        wmemcpy(out + len, typed, n);
+        len += n;
+    }
+    if (outCap) out[len] = 0;
+    return len;
+}
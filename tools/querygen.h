@@ -0,0 +1,17 @@
+#ifndef DISWITCHER_QUERYGEN_H
+#define DISWITCHER_QUERYGEN_H
+
+// Synthetic search-style queries for the Linux benchmarks: one to five words from a small EN/RU
+// vocabulary, all in one language, and half of the queries typed in the wrong layout.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#define DS_QUERY_MAX_CHARS 256
+
+// Writes the next query of the sequence `rng` (nonzero xorshift state) to `out`, NUL-terminated
+// and at most `outCap` - 1 characters. Returns its length.
+size_t DsGenerateQuery(uint64_t* rng, wchar_t* out, size_t outCap);
+
+#endif
@@ -0,0 +1,217 @@
+#include "script.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "keymap.h"
+#include "toolutil.h"
+
+#define MAX_TEXT_CHARS 1024
+
+static DsScriptStep* AddStep(DsScript* s, DsStepType type, uint64_t at, int line)
+{
+    s->steps = (DsScriptStep*)DsGrow(s->steps, &s->cap, s->count + 1, sizeof(DsScriptStep));
+    DsScriptStep* st = &s->steps[s->count++];
+    memset(st, 0, sizeof(*st));
+    st->type = type;
+    st->at_ns = at;
+    st->line = line;
+    return st;
+}
+
+static void AddKey(DsScript* s, uint64_t at, uint32_t vk, bool down, int line)
+{
+    DsScriptStep* st = AddStep(s, DS_STEP_KEY, at, line);
+    st->vk = vk;
+    st->down = down;
+}
+
+// Key down, repeats while held, key up. Steps stay in time order: the next key starts after this
+// one is released.
+static void Press(DsScript* s, uint32_t vk, bool shift, uint64_t holdNs, int line)
+{
+    const uint64_t t = s->now_ns;
+    if (shift) AddKey(s, t, DS_VK_LSHIFT, true, line);
+    AddKey(s, t, vk, true, line);
+    for (uint64_t r = t + s->repeat_delay_ns; s->repeat_every_ns && r < t + holdNs; r += s->repeat_every_ns) {
+        AddKey(s, r, vk, true, line);
+    }
+    AddKey(s, t + holdNs, vk, false, line);
+    if (shift) AddKey(s, t + holdNs, DS_VK_LSHIFT, false, line);
+    s->now_ns = t + (holdNs < s->interval_ns ? s->interval_ns : holdNs + s->interval_ns);
+}
+
+static bool ParseLayout(const char* name, DsLayout* out)
+{
+    if (strcmp(name, "en") == 0) *out = DS_LAYOUT_EN;
+    else if (strcmp(name, "ru") == 0) *out = DS_LAYOUT_RU;
+    else return false;
+    return true;
+}
+
+static bool NamedKey(const char* name, uint32_t* vk)
+{
+    static const struct {
+        const char* name;
+        uint32_t vk;
+    } kNames[] = {
+        {"pause", DS_VK_PAUSE}, {"back", DS_VK_BACK}, {"escape", DS_VK_ESCAPE}, {"enter", DS_VK_RETURN},
+        {"space", DS_VK_SPACE}, {"tab", DS_VK_TAB}, {"left", DS_VK_LEFT}, {"right", DS_VK_RIGHT},
+    };
+    for (size_t i = 0; i < sizeof(kNames) / sizeof(kNames[0]); i++) {
+        if (strcmp(kNames[i].name, name) == 0) {
+            *vk = kNames[i].vk;
+            return true;
+        }
+    }
+    return false;
+}
+
+// UTF-8 with the escapes of `type` (\s space, \n Enter, \t Tab, \\ backslash) to characters.
+static size_t Unescape(const char* utf8, wchar_t* out, size_t cap)
+{
+    wchar_t raw[MAX_TEXT_CHARS];
+    if (mbstowcs(raw, utf8, MAX_TEXT_CHARS) == (size_t)-1) return (size_t)-1;
+    raw[MAX_TEXT_CHARS - 1] = 0;
+    size_t n = 0;
+    for (const wchar_t* p = raw; *p && n + 1 < cap; p++) {
+        wchar_t ch = *p;
+        if (ch == L'\\' && p[1]) {
+            p++;
+            ch = *p == L's' ? L' ' : *p == L'n' ? L'\r' : *p == L't' ? L'\t' : *p;
+        }
+        out[n++] = ch;
+    }
+    out[n] = 0;
+    return n;
+}
+
+static bool FindKey(DsLayout layout, wchar_t ch, uint32_t* vk, bool* shift, int line)
+{
+    if (DsKeymapFindKey(layout, ch, vk, shift)) return true;
+    fprintf(stderr, "line %d: '%lc' is not on the %s layout\n", line, (wint_t)ch, layout == DS_LAYOUT_RU ? "ru" : "en");
+    return false;
+}
+
+static bool ParseLine(DsScript* s, char* line, int lineNo)
+{
+    char* nl = strpbrk(line, "\r\n");
+    if (nl) *nl = 0;
+    while (*line == ' ' || *line == '\t') line++;
+    if (!*line || *line == '#') return true;
+
+    char* arg = strchr(line, ' ');
+    if (arg) *arg++ = 0;
+    else arg = line + strlen(line);
+
+    wchar_t text[MAX_TEXT_CHARS];
+    DsLayout layout;
+    uint32_t vk;
+    bool shift = false;
+    if (strcmp(line, "cps") == 0) {
+        const double cps = atof(arg);
+        if (cps <= 0) goto bad;
+        s->interval_ns = (uint64_t)(1e9 / cps);
+    } else if (strcmp(line, "layout") == 0) {
+        if (!ParseLayout(arg, &layout)) goto bad;
+        AddStep(s, DS_STEP_LAYOUT, s->now_ns, lineNo)->value = layout;
+    } else if (strcmp(line, "focus") == 0) {
+        AddStep(s, DS_STEP_FOCUS, s->now_ns, lineNo)->value = (uint32_t)strtoul(arg, NULL, 10);
+    } else if (strcmp(line, "wait") == 0) {
+        s->now_ns += strtoull(arg, NULL, 10) * 1000000u;
+    } else if (strcmp(line, "key") == 0) {
+        if (!NamedKey(arg, &vk)) goto bad;
+        Press(s, vk, false, s->interval_ns / 3, lineNo);
+    } else if (strcmp(line, "type") == 0) {
+        char* rest = strchr(arg, ' ');
+        if (!rest) goto bad;
+        *rest++ = 0;
+        if (!ParseLayout(arg, &layout) || Unescape(rest, text, MAX_TEXT_CHARS) == (size_t)-1) goto bad;
+        for (const wchar_t* p = text; *p; p++) {
+            if (!FindKey(layout, *p, &vk, &shift, lineNo)) return false;
+            Press(s, vk, shift, s->interval_ns / 3, lineNo);
+        }
+    } else if (strcmp(line, "hold") == 0) {
+        char* ms = strrchr(arg, ' ');
+        if (!ms) goto bad;
+        *ms++ = 0;
+        char* ch = strchr(arg, ' ');
+        if (ch) {
+            *ch++ = 0;
+            if (!ParseLayout(arg, &layout) || Unescape(ch, text, MAX_TEXT_CHARS) != 1) goto bad;
+            if (!FindKey(layout, text[0], &vk, &shift, lineNo)) return false;
+        } else if (!NamedKey(arg, &vk)) {
+            goto bad;
+        }
+        Press(s, vk, shift, strtoull(ms, NULL, 10) * 1000000u, lineNo);
+    } else if (strcmp(line, "repeat") == 0) {
+        double delayMs = 0, rate = 0;
+        if (sscanf(arg, "%lf %lf", &delayMs, &rate) != 2 || delayMs < 0 || rate < 0) goto bad;
+        s->repeat_delay_ns = (uint64_t)(delayMs * 1e6);
+        s->repeat_every_ns = rate > 0 ? (uint64_t)(1e9 / rate) : 0;
+    } else if (strcmp(line, "inject") == 0) {
+        double ms = 0, us = 0;
+        if (sscanf(arg, "%lf %lf", &ms, &us) < 1 || ms < 0 || us < 0) goto bad;
+        DsScriptStep* st = AddStep(s, DS_STEP_INJECT, s->now_ns, lineNo);
+        st->inject_ns = (uint64_t)(ms * 1e6);
+        st->event_ns = (uint64_t)(us * 1e3);
+    } else if (strcmp(line, "expect") == 0) {
+        const size_t n = Unescape(arg, text, MAX_TEXT_CHARS);
+        if (n == (size_t)-1) goto bad;
+        DsScriptStep* st = AddStep(s, DS_STEP_EXPECT, s->now_ns, lineNo);
+        st->expect = (wchar_t*)malloc((n + 1) * sizeof(wchar_t));
+        if (!st->expect) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        wmemcpy(st->expect, text, n + 1);
+    } else {
+        goto bad;
+    }
+    return true;
+
+bad:
+    fprintf(stderr, "line %d: cannot parse '%s %s'\n", lineNo, line, arg);
+    return false;
+}
+
+void DsScriptDefaults(DsScript* s)
+{
+    memset(s, 0, sizeof(*s));
+    s->interval_ns = 1000000000u / DS_SCRIPT_DEFAULT_CPS;
+    s->repeat_delay_ns = (uint64_t)DS_SCRIPT_DEFAULT_REPEAT_DELAY_MS * 1000000u;
+    s->repeat_every_ns = 1000000000u / DS_SCRIPT_DEFAULT_REPEAT_RATE;
+}
+
+bool DsScriptLoad(const char* path, const DsScript* defaults, DsScript* s)
+{
+    FILE* in = fopen(path, "r");
+    if (!in) {
+        perror(path);
+        return false;
+    }
+    *s = *defaults;
+    s->steps = NULL;
+    s->count = s->cap = 0;
+    DsScriptStep* st = AddStep(s, DS_STEP_INJECT, 0, 0);
+    st->inject_ns = s->inject_ns;
+    st->event_ns = s->event_ns;
+    char line[4096];
+    int lineNo = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), in)) ok = ParseLine(s, line, ++lineNo);
+    fclose(in);
+    // Whatever the script leaves in flight is delivered before the end.
+    if (ok) AddStep(s, DS_STEP_EXPECT, s->now_ns, lineNo);
+    else DsScriptFree(s);
+    return ok;
+}
+
+void DsScriptFree(DsScript* s)
+{
+    for (size_t i = 0; i < s->count; i++) free(s->steps[i].expect);
+    free(s->steps);
+    s->steps = NULL;
+    s->count = s->cap = 0;
+}
@@ -0,0 +1,77 @@
+#ifndef DISWITCHER_SCRIPT_H
+#define DISWITCHER_SCRIPT_H
+
+// Scenario scripts of the Linux tools (diswitcher-mktrace, diswitcher-fieldsim): a typing session
+// written as text, read into key events in virtual time.
+//
+// Lines (blank lines and '#' comments are ignored):
+//   cps <n>                     typing speed in characters per second
+//   layout en|ru                user switches the keyboard layout
+//   focus <id>                  focus moves to window <id> (0 = no window)
+//   type en|ru <text>           press the keys that produce <text> on the EN or RU layout; the replay
+//                               produces whatever the *current* layout maps them to. Escapes: \s
+//                               space, \n Enter, \t Tab, \\ backslash
+//   key <name>                  pause, back, escape, enter, space, tab, left, right
+//   hold en|ru <char> <ms>      press the key for <char> and keep it down for <ms>, repeating
+//   hold <key name> <ms>        ... the same for a named key
+//   repeat <delay ms> <rate>    key-repeat: first repeat after <delay>, then <rate> per second
+//   wait <ms>                   idle time
+//   inject <ms> [<us>]          injection delay of SendInput, and per further event, from here on
+//   expect <text>               once all injected input has arrived, the field must read exactly
+//                               <text> (same escapes as `type`)
+//
+// A key is held for a third of the typing interval, and the next one is pressed an interval after
+// it (or after its release, if held longer); a shifted character is wrapped in Left Shift.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#define DS_SCRIPT_DEFAULT_CPS 8
+#define DS_SCRIPT_DEFAULT_REPEAT_DELAY_MS 500
+#define DS_SCRIPT_DEFAULT_REPEAT_RATE 30
+
+typedef enum {
+    DS_STEP_KEY,
+    DS_STEP_LAYOUT,
+    DS_STEP_FOCUS,
+    DS_STEP_INJECT, // new injection delay
+    DS_STEP_EXPECT, // `expect`; also ends every script, with `expect` NULL
+} DsStepType;
+
+// One scripted event, in script time.
+typedef struct {
+    uint64_t at_ns;
+    DsStepType type;
+    uint32_t vk;
+    uint32_t value; // DsLayout or window id
+    bool down;
+    uint64_t inject_ns;
+    uint64_t event_ns;
+    wchar_t* expect;
+    int line;
+} DsScriptStep;
+
+typedef struct {
+    DsScriptStep* steps; // in time order
+    size_t count;
+    size_t cap;
+    uint64_t now_ns;
+    uint64_t interval_ns;
+    uint64_t repeat_delay_ns;
+    uint64_t repeat_every_ns;
+    uint64_t inject_ns; // injection delay at the start, until an `inject` line
+    uint64_t event_ns;
+} DsScript;
+
+// The settings a script starts with unless the caller overrides them: DS_SCRIPT_DEFAULT_CPS, the
+// default key repeat and no injection delay.
+void DsScriptDefaults(DsScript* s);
+
+// Reads `path` starting from `defaults`. The first step is an injection step with the default
+// delay. Errors go to stderr with the line number.
+bool DsScriptLoad(const char* path, const DsScript* defaults, DsScript* s);
+void DsScriptFree(DsScript* s);
+
+#endif
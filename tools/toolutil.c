@@ -0,0 +1,351 @@
+#define _POSIX_C_SOURCE 200809L
+#include "toolutil.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "utf8.h"
+
+#define CORPUS_LINE_MAX_CHARS 1024
+
+int DsMapFile(const char* path, DsMappedFile* out)
+{
+    out->data = NULL;
+    out->size = 0;
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        const int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int err = errno;
+    close(fd);
+    if (p == MAP_FAILED) {
+        errno = err;
+        return -1;
+    }
+    posix_madvise(p, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+    out->data = (const uint8_t*)p;
+    out->size = (size_t)st.st_size;
+    return 0;
+}
+
+void DsUnmapFile(DsMappedFile* f)
+{
+    if (f->data) munmap((void*)f->data, f->size);
+    f->data = NULL;
+    f->size = 0;
+}
+
+int DsMapFileWritable(const char* path, size_t size, DsWritableFile* out)
+{
+    out->data = NULL;
+    out->size = 0;
+
+    const int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || ((size_t)st.st_size < size && ftruncate(fd, (off_t)size) != 0)) {
+        const int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const int err = errno;
+    close(fd);
+    if (p == MAP_FAILED) {
+        errno = err;
+        return -1;
+    }
+    out->data = (uint8_t*)p;
+    out->size = size;
+    return 0;
+}
+
+void DsUnmapWritableFile(DsWritableFile* f)
+{
+    if (f->data) {
+        msync(f->data, f->size, MS_SYNC);
+        munmap(f->data, f->size);
+    }
+    f->data = NULL;
+    f->size = 0;
+}
+
+bool DsWriteAll(int fd, const void* data, size_t n)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    while (n) {
+        const ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return false;
+        p += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+bool DsReadAll(int fd, void* data, size_t n)
+{
+    uint8_t* p = (uint8_t*)data;
+    while (n) {
+        const ssize_t r = read(fd, p, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        n -= (size_t)r;
+    }
+    return true;
+}
+
+bool DsFlushToFile(void* file, const uint8_t* data, size_t len)
+{
+    return fwrite(data, 1, len, (FILE*)file) == len;
+}
+
+void* DsGrow(void* p, size_t* cap, size_t need, size_t elem)
+{
+    if (need <= *cap) return p;
+    size_t n = *cap ? *cap : 64;
+    while (n < need) n *= 2;
+    p = realloc(p, n * elem);
+    if (!p) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    *cap = n;
+    return p;
+}
+
+uint64_t DsMonotonicNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void DsSleepUntilNs(uint64_t deadlineNs)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)(deadlineNs / 1000000000ull);
+    ts.tv_nsec = (long)(deadlineNs % 1000000000ull);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+static int CompareU64(const void* a, const void* b)
+{
+    const uint64_t x = *(const uint64_t*)a;
+    const uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+uint64_t DsPercentile(uint64_t* values, size_t count, double p)
+{
+    if (!count) return 0;
+    qsort(values, count, sizeof(values[0]), CompareU64);
+    size_t idx = (size_t)(p / 100.0 * (double)(count - 1) + 0.5);
+    if (idx >= count) idx = count - 1;
+    return values[idx];
+}
+
+bool DsToolLoadModel(const char* morphPath, const char* configPath, DsMappedFile* morphFile, DsMorph* morph)
+{
+    if (!morphPath && !configPath) return true;
+    DsModel* model = DsEngineCloneModel();
+    if (!model) {
+        fprintf(stderr, "out of memory\n");
+        return false;
+    }
+    if (morphPath) {
+        if (DsMapFile(morphPath, morphFile) != 0) {
+            perror(morphPath);
+            return false;
+        }
+        if (!DsMorphOpen(morph, morphFile->data, morphFile->size)) {
+            fprintf(stderr, "%s: not a valid morphology model\n", morphPath);
+            return false;
+        }
+        model->morph = morph;
+    }
+    if (configPath) {
+        DsMappedFile configFile;
+        if (DsMapFile(configPath, &configFile) != 0) {
+            perror(configPath);
+            return false;
+        }
+        DsConfigError err;
+        const bool ok = DsConfigApply(model, (const char*)configFile.data, configFile.size, &err);
+        DsUnmapFile(&configFile);
+        if (!ok) {
+            fprintf(stderr, "%s:%zu: %s\n", configPath, err.line, err.message);
+            return false;
+        }
+    }
+    DsEnginePublishModel(model);
+    return true;
+}
+
+static bool IsCorpusLetter(wchar_t c)
+{
+    return (c >= L'a' && c <= L'z') || (c >= L'A' && c <= L'Z') || (c >= 0x0400 && c <= 0x04FF);
+}
+
+size_t DsLoadCorpusWords(const DsMappedFile* f, size_t cap,
+                         bool (*take)(void* ctx, size_t index, const wchar_t* word, size_t len), void* ctx)
+{
+    size_t count = 0;
+    wchar_t line[CORPUS_LINE_MAX_CHARS];
+    size_t start = 0;
+    for (size_t i = 0; i <= f->size && count < cap; i++) {
+        // Lines that run on are cut; a word split there is lost, not corrupted.
+        if (i < f->size && f->data[i] != '\n' && i - start < CORPUS_LINE_MAX_CHARS) continue;
+        const size_t n = DsUtf8ToWide((const char*)f->data + start, i - start, line, CORPUS_LINE_MAX_CHARS);
+        start = i + 1;
+        for (size_t p = 0; p < n && count < cap;) {
+            while (p < n && !IsCorpusLetter(line[p])) p++;
+            const size_t b = p;
+            while (p < n && IsCorpusLetter(line[p])) p++;
+            const size_t len = p - b;
+            if (len == 0 || len > DS_TOKEN_MAX_CHARS) continue;
+            if (take(ctx, count, line + b, len)) count++;
+        }
+    }
+    return count;
+}
+
+static void* PublisherMain(void* arg)
+{
+    DsPublisher* p = (DsPublisher*)arg;
+    while (!__atomic_load_n(&p->stop, __ATOMIC_RELAXED)) {
+        DsModel* m = DsEngineCloneModel();
+        if (m) {
+            if (p->edit) p->edit(p->ctx, m);
+            DsEnginePublishModel(m);
+            if ((++p->publishes & 7) == 0) DsEngineReclaimModels();
+        }
+        DsSleepUntilNs(DsMonotonicNs() + p->interval_ns);
+    }
+    DsEngineReclaimModels();
+    return NULL;
+}
+
+bool DsPublisherStart(DsPublisher* p, uint64_t intervalNs, void (*edit)(void* ctx, DsModel* m), void* ctx)
+{
+    memset(p, 0, sizeof(*p));
+    p->interval_ns = intervalNs;
+    p->edit = edit;
+    p->ctx = ctx;
+    return pthread_create(&p->thread, NULL, PublisherMain, p) == 0;
+}
+
+void DsPublisherStop(DsPublisher* p)
+{
+    __atomic_store_n(&p->stop, 1, __ATOMIC_RELAXED);
+    pthread_join(p->thread, NULL);
+}
+
+void DsTextFieldSend(void* field, size_t backspaces, const wchar_t* text)
+{
+    DsTextField* f = (DsTextField*)field;
+    f->backspaces += backspaces;
+    f->len = backspaces < f->len ? f->len - backspaces : 0;
+    for (; *text; text++) {
+        f->chars++;
+        if (f->len < DS_TEXT_FIELD_MAX_CHARS) f->text[f->len++] = *text;
+        else f->overflow++;
+    }
+    f->text[f->len] = 0;
+}
+
+uint64_t DsTextFieldTypeToken(DsSession* s, DsTextField* f, const wchar_t* token, size_t n)
+{
+    f->len = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t vk = 0;
+        bool shift;
+        if (!DsKeymapFindKey(DS_LAYOUT_EN, token[i], &vk, &shift)) DsKeymapFindKey(DS_LAYOUT_RU, token[i], &vk, &shift);
+        if (DsSessionKeyDown(s, DS_KEY_TEXT, token[i], vk) == DS_PASS && f->len < DS_TEXT_FIELD_MAX_CHARS) {
+            f->text[f->len++] = token[i];
+        }
+        DsSessionKeyUp(s, vk);
+    }
+    const uint64_t t0 = DsMonotonicNs();
+    const DsKeyResult r = DsSessionKeyDown(s, DS_KEY_TEXT, L' ', DS_VK_SPACE);
+    const uint64_t dt = DsMonotonicNs() - t0;
+    if (r == DS_PASS && f->len < DS_TEXT_FIELD_MAX_CHARS) f->text[f->len++] = L' ';
+    f->text[f->len] = 0;
+    DsSessionKeyUp(s, DS_VK_SPACE);
+    return dt;
+}
+
+static bool IsKeyLetter(wchar_t c)
+{
+    return (c >= L'a' && c <= L'z') || (c >= L'A' && c <= L'Z') || (c >= 0x0410 && c <= 0x044F) || c == 0x0401 ||
+           c == 0x0451;
+}
+
+typedef struct {
+    DsBenchWord* words;
+    size_t min_len;
+    bool other_letters;
+} BenchWordFilter;
+
+static bool TakeBenchWord(void* ctx, size_t index, const wchar_t* word, size_t len)
+{
+    const BenchWordFilter* f = (const BenchWordFilter*)ctx;
+    if (len < f->min_len) return false;
+    DsBenchWord* w = &f->words[index];
+    const DsLayout own = DsIsLatinLetter(word[0]) ? DS_LAYOUT_EN : DS_LAYOUT_RU;
+    const DsLayout other = own == DS_LAYOUT_EN ? DS_LAYOUT_RU : DS_LAYOUT_EN;
+    bool letters = true;
+    for (size_t k = 0; k < len; k++) {
+        uint32_t vk;
+        bool shift;
+        if (!DsKeymapFindKey(own, word[k], &vk, &shift)) return false;
+        w->other[k] = DsKeymapChar(other, vk, shift, false);
+        letters = letters && IsKeyLetter(w->other[k]);
+    }
+    if (!letters && f->other_letters) return false;
+    w->other[letters ? len : 0] = 0;
+    wmemcpy(w->text, word, len);
+    w->text[len] = 0;
+    w->len = len;
+    w->layout = own;
+    return true;
+}
+
+size_t DsLoadBenchWords(const DsMappedFile* f, size_t cap, size_t minLen, bool otherLetters, DsBenchWord* words)
+{
+    BenchWordFilter filter = { words, minLen, otherLetters };
+    return DsLoadCorpusWords(f, cap, TakeBenchWord, &filter);
+}
+
+const char* DsFormatLatency(uint64_t* ns, size_t count, char* out, size_t cap)
+{
+    snprintf(out, cap, "p50 %7.2f us  p99 %7.2f us  max %8.2f us", (double)DsPercentile(ns, count, 50) / 1e3,
+             (double)DsPercentile(ns, count, 99) / 1e3, (double)DsPercentile(ns, count, 100) / 1e3);
+    return out;
+}
@@ -0,0 +1,110 @@
+#ifndef DISWITCHER_TOOLUTIL_H
+#define DISWITCHER_TOOLUTIL_H
+
+// Small POSIX helpers shared by the Linux tools.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#include "engine.h"
+#include "keymap.h"
+#include "morph.h"
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+} DsMappedFile;
+
+// Maps a file read-only. Returns 0 on success, -1 (with errno set) on failure.
+int DsMapFile(const char* path, DsMappedFile* out);
+void DsUnmapFile(DsMappedFile* f);
+
+typedef struct {
+    uint8_t* data;
+    size_t size;
+} DsWritableFile;
+
+// Maps the first `size` bytes of a file read-write and shared, creating the file or growing it with
+// zeros first if needed; changes reach the file. Returns 0 on success, -1 (with errno set) on failure.
+int DsMapFileWritable(const char* path, size_t size, DsWritableFile* out);
+void DsUnmapWritableFile(DsWritableFile* f);
+
+// Writes / reads all `n` bytes, retrying after signals. False on an error or end of file.
+bool DsWriteAll(int fd, const void* data, size_t n);
+bool DsReadAll(int fd, void* data, size_t n);
+// DsTraceWriter flush callback for a stdio stream passed as `file`.
+bool DsFlushToFile(void* file, const uint8_t* data, size_t len);
+
+// Grows the array `p` of `*cap` elements of `elem` bytes to hold at least `need`, doubling; exits
+// on allocation failure.
+void* DsGrow(void* p, size_t* cap, size_t need, size_t elem);
+
+uint64_t DsMonotonicNs(void);
+void DsSleepUntilNs(uint64_t deadlineNs);
+
+// Sorts `values` in place and returns the p-th percentile (0..100).
+uint64_t DsPercentile(uint64_t* values, size_t count, double p);
+
+// Sets up the engine model as the Windows host does: the word-form model `morphPath` is mapped into
+// *morphFile and opened into *morph (both must outlive the engine), the configuration file
+// `configPath` is applied, and the result is published. Either path may be NULL; with neither the
+// built-in model stays. Prints the reason and returns false on failure.
+bool DsToolLoadModel(const char* morphPath, const char* configPath, DsMappedFile* morphFile, DsMorph* morph);
+
+// A thread that publishes a copy of the current engine model every `interval_ns`, for the tools that
+// run readers against model swaps. `edit`, if set, changes each copy before it is published. Retired
+// models are reclaimed along the way and once more when the thread stops.
+typedef struct {
+    pthread_t thread;
+    volatile uint32_t stop;
+    uint64_t interval_ns;
+    void (*edit)(void* ctx, DsModel* m);
+    void* ctx;
+    uint64_t publishes;
+} DsPublisher;
+
+bool DsPublisherStart(DsPublisher* p, uint64_t intervalNs, void (*edit)(void* ctx, DsModel* m), void* ctx);
+void DsPublisherStop(DsPublisher* p);
+
+// A text field behind the engine's send_text (DsTextFieldSend, with the DsHost ctx pointing at the
+// field or at a struct that starts with one): backspaces erase, the text is appended.
+#define DS_TEXT_FIELD_MAX_CHARS 256
+
+typedef struct {
+    wchar_t text[DS_TEXT_FIELD_MAX_CHARS + 1]; // NUL-terminated
+    size_t len;
+    uint64_t backspaces; // sent by the engine so far
+    uint64_t chars;
+    uint64_t overflow;   // characters that did not fit
+} DsTextField;
+
+void DsTextFieldSend(void* field, size_t backspaces, const wchar_t* text);
+// Empties the field and types `token` and a space into it through `s`, each character with its key on
+// whichever layout has it. Returns the time the space took in the engine.
+uint64_t DsTextFieldTypeToken(DsSession* s, DsTextField* f, const wchar_t* token, size_t n);
+
+// Words of a UTF-8 corpus for the benchmarks: runs of Latin or Cyrillic letters no longer than an
+// engine token, in file order. Each is offered to `take` with the number accepted so far, which
+// returns whether it kept the word; stops once `cap` are kept. Returns the number kept.
+size_t DsLoadCorpusWords(const DsMappedFile* f, size_t cap,
+                         bool (*take)(void* ctx, size_t index, const wchar_t* word, size_t len), void* ctx);
+
+// A corpus word every key of which is on its own layout.
+typedef struct {
+    wchar_t text[DS_TOKEN_MAX_CHARS + 1];
+    wchar_t other[DS_TOKEN_MAX_CHARS + 1]; // the same keys on the other layout; empty unless all letters
+    size_t len;
+    DsLayout layout; // its own
+} DsBenchWord;
+
+// DsLoadCorpusWords for the typing benchmarks: words of at least `minLen` letters that can be typed
+// on their own layout and, with `otherLetters`, whose keys give letters on the other layout too.
+size_t DsLoadBenchWords(const DsMappedFile* f, size_t cap, size_t minLen, bool otherLetters, DsBenchWord* words);
+
+// Formats "p50 X us  p99 Y us  max Z us" of `ns` (sorted in place) into `out`; returns `out`.
+const char* DsFormatLatency(uint64_t* ns, size_t count, char* out, size_t cap);
+
+#endif